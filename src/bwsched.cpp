@@ -0,0 +1,433 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+// CommentsTranslationProject: TRANSLATED
+
+#include "precomp.h"
+
+#include "bwsched.h"
+
+CBandwidthScheduler BandwidthScheduler;
+
+//
+// ****************************************************************************
+// CBandwidthScheduler
+//
+
+CBandwidthScheduler::CBandwidthScheduler() : Members(10, 10), Devices(10, 10)
+{
+    HANDLES(InitializeCriticalSection(&CS));
+    GlobalLimit = 0;
+    LastID = 0;
+#ifdef _DEBUG
+    memset(&GlobalCheck, 0, sizeof(GlobalCheck));
+#endif // _DEBUG
+}
+
+CBandwidthScheduler::~CBandwidthScheduler()
+{
+    HANDLES(DeleteCriticalSection(&CS));
+}
+
+BOOL CBandwidthScheduler::GetDeviceName(const char* path, char* device)
+{
+    CALL_STACK_MESSAGE2("CBandwidthScheduler::GetDeviceName(%s)", path);
+    device[0] = 0;
+    if (path == NULL || path[0] == 0)
+        return FALSE;
+
+    char resPath[MAX_PATH];
+    lstrcpyn(resPath, path, MAX_PATH);
+    if (resPath[0] != '\\' && resPath[1] == ':')
+    {
+        ResolveSubsts(resPath);
+        if (resPath[0] != '\\' && resPath[1] == ':') // mapped network drive is the server it is connected to
+        {
+            char localRoot[3];
+            localRoot[0] = UpperCase[(BYTE)resPath[0]];
+            localRoot[1] = ':';
+            localRoot[2] = 0;
+            char uncPath[MAX_PATH];
+            DWORD uncPathSize = MAX_PATH;
+            if (WNetGetConnection(localRoot, uncPath, &uncPathSize) == NO_ERROR && IsUNCPath(uncPath))
+                lstrcpyn(resPath, uncPath, MAX_PATH);
+            else
+            {
+                lstrcpyn(device, localRoot, BWSCHED_MAX_DEVICE);
+                return TRUE;
+            }
+        }
+    }
+    if (resPath[0] == '\\' && resPath[1] == '\\') // UNC path: all shares of the server share its bandwidth
+    {
+        const char* s = resPath + 2;
+        while (*s != 0 && *s != '\\')
+            s++;
+        int len = (int)(s - resPath);
+        if (len > 2 && len < BWSCHED_MAX_DEVICE)
+        {
+            memcpy(device, resPath, len);
+            device[len] = 0;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+int CBandwidthScheduler::GetDeviceIndex(const char* device)
+{
+    int i;
+    for (i = 0; i < Devices.Count; i++)
+    {
+        if (StrICmp(Devices[i].Name, device) == 0)
+            return i;
+    }
+    CBandwidthDevice d;
+    memset(&d, 0, sizeof(d));
+    lstrcpyn(d.Name, device, BWSCHED_MAX_DEVICE);
+    Devices.Add(d);
+    if (!Devices.IsGood())
+    {
+        Devices.ResetState();
+        TRACE_E(LOW_MEMORY);
+        return -1;
+    }
+    return Devices.Count - 1;
+}
+
+int CBandwidthScheduler::FindMember(int id)
+{
+    int i;
+    for (i = 0; i < Members.Count; i++)
+    {
+        if (Members[i]->ID == id)
+            return i;
+    }
+    return -1;
+}
+
+int CBandwidthScheduler::AddMember(const char* sourcePath, const char* targetPath, DWORD weight)
+{
+    CALL_STACK_MESSAGE4("CBandwidthScheduler::AddMember(%s, %s, %u)", sourcePath, targetPath, weight);
+    char srcDevice[BWSCHED_MAX_DEVICE];
+    char tgtDevice[BWSCHED_MAX_DEVICE];
+    // obtaining the device names may take a while (network), do it outside the critical section
+    BOOL srcOK = GetDeviceName(sourcePath, srcDevice);
+    BOOL tgtOK = GetDeviceName(targetPath, tgtDevice);
+
+    CBandwidthMember* m = new CBandwidthMember;
+    if (m == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        return 0;
+    }
+    memset(m, 0, sizeof(CBandwidthMember));
+    m->Weight = weight > 0 ? weight : 1;
+
+    HANDLES(EnterCriticalSection(&CS));
+    m->Devices[0] = -1;
+    m->Devices[1] = srcOK ? GetDeviceIndex(srcDevice) : -1;
+    m->Devices[2] = tgtOK ? GetDeviceIndex(tgtDevice) : -1;
+    if (m->Devices[2] == m->Devices[1]) // copying within one device, one limit is enough
+        m->Devices[2] = -1;
+    m->ID = ++LastID;
+    int id = m->ID;
+    Members.Add(m);
+    if (!Members.IsGood())
+    {
+        Members.ResetState();
+        delete m;
+        id = 0;
+    }
+    HANDLES(LeaveCriticalSection(&CS));
+    return id;
+}
+
+void CBandwidthScheduler::RemoveMember(int id)
+{
+    HANDLES(EnterCriticalSection(&CS));
+    int i = FindMember(id);
+    if (i != -1)
+        Members.Delete(i);
+    else
+        TRACE_E("CBandwidthScheduler::RemoveMember(): unknown member " << id);
+    HANDLES(LeaveCriticalSection(&CS));
+}
+
+void CBandwidthScheduler::SetWeight(int id, DWORD weight)
+{
+    HANDLES(EnterCriticalSection(&CS));
+    int i = FindMember(id);
+    if (i != -1)
+        Members[i]->Weight = weight > 0 ? weight : 1;
+    HANDLES(LeaveCriticalSection(&CS));
+}
+
+DWORD
+CBandwidthScheduler::GetBucketLimit(CBandwidthMember* m, int bucket)
+{
+    if (bucket == 0)
+        return GlobalLimit;
+    return m->Devices[bucket] != -1 ? Devices[m->Devices[bucket]].Limit : 0;
+}
+
+unsigned __int64
+CBandwidthScheduler::GetActiveWeight(CBandwidthMember* m, int bucket, DWORD now)
+{
+    unsigned __int64 weight = 0;
+    int i;
+    for (i = 0; i < Members.Count; i++)
+    {
+        CBandwidthMember* other = Members[i];
+        if (other != m && (!other->Started || (int)(other->ActiveUntil - now) <= 0))
+            continue; // not transferring anything now, does not take its share
+        if (bucket == 0)
+            weight += other->Weight; // all members share the global limit
+        else
+        {
+            int dev = m->Devices[bucket];
+            if (other->Devices[1] == dev || other->Devices[2] == dev)
+                weight += other->Weight;
+        }
+    }
+    return weight;
+}
+
+#ifdef _DEBUG
+void CBandwidthScheduler::CheckLimit(CBandwidthCheck* check, DWORD limit, DWORD bytes, DWORD now, const char* name)
+{
+    if (limit != check->Limit) // the limit was changed, start checking the new one
+    {
+        check->Limit = limit;
+        check->Start = now;
+        check->Bytes = 0;
+    }
+    if (limit == 0)
+        return;
+    check->Bytes += bytes;
+    DWORD elapsed = now - check->Start;
+    if (elapsed >= BWSCHED_CHECK_TIME)
+    {
+        // the members may go over the limit only by the tokens they saved up, by the debt of
+        // their last block (COperations waits at most a second) and by the shares they took
+        // before the other members became active
+        unsigned __int64 allowed = (unsigned __int64)limit *
+                                   (elapsed + BWSCHED_BURST_TIME + 1000 + BWSCHED_ACTIVE_TIME) / 1000;
+        if (check->Bytes > allowed)
+        {
+            TRACE_E("CBandwidthScheduler: limit of " << name << " (" << limit << " B/s) was exceeded: " << check->Bytes << " bytes in " << elapsed << " ms");
+        }
+        check->Start = now;
+        check->Bytes = 0;
+    }
+}
+#endif // _DEBUG
+
+DWORD CBandwidthScheduler::Consume(int id, DWORD bytes, DWORD now, DWORD* rate)
+{
+    DWORD wait = 0;
+    DWORD minRate = 0;
+    HANDLES(EnterCriticalSection(&CS));
+    int index = FindMember(id);
+    if (index != -1)
+    {
+        CBandwidthMember* m = Members[index];
+        int b;
+        if (!m->Started)
+        {
+            for (b = 0; b < BWSCHED_BUCKETS; b++)
+            {
+                m->Buckets[b].Tokens = 0;
+                m->Buckets[b].LastRefill = now;
+            }
+            m->Started = TRUE;
+        }
+        for (b = 0; b < BWSCHED_BUCKETS; b++)
+        {
+            CBandwidthBucket* bucket = &m->Buckets[b];
+            DWORD limit = GetBucketLimit(m, b);
+#ifdef _DEBUG
+            if (b == 0)
+                CheckLimit(&GlobalCheck, limit, bytes, now, "all operations");
+            else if (m->Devices[b] != -1)
+                CheckLimit(&Devices[m->Devices[b]].Check, limit, bytes, now, Devices[m->Devices[b]].Name);
+#endif // _DEBUG
+            if (limit == 0) // no limit, keep the bucket ready for the time the limit is set
+            {
+                bucket->Tokens = 0;
+                bucket->LastRefill = now;
+                continue;
+            }
+
+            // share of the member: the limit divided among the active members by their weights
+            unsigned __int64 share = ((unsigned __int64)limit * m->Weight) / GetActiveWeight(m, b, now);
+            if (share == 0)
+                share = 1;
+
+            // tokens are counted in thousandths of byte, then rate (B/s) * time (ms) gives tokens
+            int elapsed = (int)(now - bucket->LastRefill);
+            if (elapsed > 0)
+            {
+                __int64 burst = (__int64)share * BWSCHED_BURST_TIME;
+                if (bucket->Tokens < burst)
+                {
+                    bucket->Tokens += (__int64)share * elapsed;
+                    if (bucket->Tokens > burst)
+                        bucket->Tokens = burst;
+                }
+                bucket->LastRefill = now;
+            }
+            bucket->Tokens -= (__int64)bytes * 1000;
+            if (bucket->Tokens < 0) // debt: the member must wait till it is paid off
+            {
+                unsigned __int64 w = ((unsigned __int64)(-bucket->Tokens) + share - 1) / share;
+                if (w > wait)
+                    wait = w < 0x7FFFFFFF ? (DWORD)w : 0x7FFFFFFF;
+            }
+            if (minRate == 0 || share < minRate)
+                minRate = (DWORD)share;
+        }
+        // waiting member still counts as active (otherwise the other members would take its share)
+        if ((int)(now + wait + BWSCHED_ACTIVE_TIME - m->ActiveUntil) > 0)
+            m->ActiveUntil = now + wait + BWSCHED_ACTIVE_TIME;
+    }
+    else
+        TRACE_E("CBandwidthScheduler::Consume(): unknown member " << id);
+    HANDLES(LeaveCriticalSection(&CS));
+    if (rate != NULL)
+        *rate = minRate;
+    return wait;
+}
+
+void CBandwidthScheduler::SetGlobalLimit(DWORD limit)
+{
+    HANDLES(EnterCriticalSection(&CS));
+    GlobalLimit = limit;
+    HANDLES(LeaveCriticalSection(&CS));
+}
+
+DWORD
+CBandwidthScheduler::GetGlobalLimit()
+{
+    HANDLES(EnterCriticalSection(&CS));
+    DWORD limit = GlobalLimit;
+    HANDLES(LeaveCriticalSection(&CS));
+    return limit;
+}
+
+BOOL CBandwidthScheduler::SetDeviceLimit(const char* device, DWORD limit)
+{
+    HANDLES(EnterCriticalSection(&CS));
+    int i = GetDeviceIndex(device);
+    if (i != -1)
+        Devices[i].Limit = limit;
+    HANDLES(LeaveCriticalSection(&CS));
+    return i != -1;
+}
+
+int CBandwidthScheduler::GetNextDeviceLimit(const char*& s, char* device, DWORD* limit)
+{
+    while (*s == ';' || *s == ' ')
+        s++;
+    if (*s == 0)
+        return 0;
+    const char* name = s;
+    while (*s != 0 && *s != '=' && *s != ';')
+        s++;
+    const char* nameEnd = s;
+    while (nameEnd > name && *(nameEnd - 1) == ' ')
+        nameEnd--;
+    int len = (int)(nameEnd - name);
+    // the device is a drive ("D:") or a server ("\\nas"), see GetDeviceName()
+    BOOL ok = *s == '=' &&
+              (len == 2 && name[1] == ':' && LowerCase[(BYTE)name[0]] >= 'a' && LowerCase[(BYTE)name[0]] <= 'z' ||
+               len > 2 && len < BWSCHED_MAX_DEVICE && name[0] == '\\' && name[1] == '\\' &&
+                   memchr(name + 2, '\\', len - 2) == NULL);
+    if (ok)
+    {
+        memcpy(device, name, len);
+        device[len] = 0;
+        if (len == 2)
+            device[0] = UpperCase[(BYTE)device[0]];
+        s++;
+        while (*s == ' ')
+            s++;
+        unsigned __int64 num = 0;
+        const char* digits = s;
+        while (*s >= '0' && *s <= '9')
+        {
+            if (num <= 0xFFFFFFFF)
+                num = num * 10 + (*s - '0');
+            s++;
+        }
+        while (*s == ' ')
+            s++;
+        ok = s > digits && num <= 0xFFFFFFFF && (*s == 0 || *s == ';');
+        *limit = (DWORD)num;
+    }
+    if (!ok) // skip the rest of the item
+    {
+        while (*s != 0 && *s != ';')
+            s++;
+        return -1;
+    }
+    return 1;
+}
+
+BOOL CBandwidthScheduler::CheckDeviceLimits(const char* limits, int* errorPos)
+{
+    const char* s = limits;
+    char device[BWSCHED_MAX_DEVICE];
+    DWORD limit;
+    int res;
+    do
+    {
+        while (*s == ';' || *s == ' ')
+            s++;
+        const char* item = s;
+        res = GetNextDeviceLimit(s, device, &limit);
+        if (res == -1)
+        {
+            if (errorPos != NULL)
+                *errorPos = (int)(item - limits);
+            return FALSE;
+        }
+    } while (res != 0);
+    return TRUE;
+}
+
+void CBandwidthScheduler::SetDeviceLimits(const char* limits)
+{
+    CALL_STACK_MESSAGE2("CBandwidthScheduler::SetDeviceLimits(%s)", limits);
+    // parse all limits first, the running members must not see a half-set state (e.g. devices
+    // without limits before their new limits are set)
+    TDirectArray<CBandwidthDevice> newLimits(10, 10);
+    const char* s = limits;
+    CBandwidthDevice d;
+    memset(&d, 0, sizeof(d));
+    int res;
+    while ((res = GetNextDeviceLimit(s, d.Name, &d.Limit)) != 0)
+    {
+        if (res == 1)
+            newLimits.Add(d);
+        else
+            TRACE_E("CBandwidthScheduler::SetDeviceLimits(): ignoring invalid limit of device in: " << limits);
+    }
+    if (!newLimits.IsGood()) // rather keep the old limits than lift some of them
+    {
+        newLimits.ResetState();
+        TRACE_E(LOW_MEMORY);
+        return;
+    }
+
+    HANDLES(EnterCriticalSection(&CS));
+    int i;
+    for (i = 0; i < Devices.Count; i++)
+        Devices[i].Limit = 0;
+    for (i = 0; i < newLimits.Count; i++)
+    {
+        int index = GetDeviceIndex(newLimits[i].Name);
+        if (index != -1)
+            Devices[index].Limit = newLimits[i].Limit;
+    }
+    HANDLES(LeaveCriticalSection(&CS));
+}
@@ -0,0 +1,162 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+// CommentsTranslationProject: TRANSLATED
+
+#pragma once
+
+//****************************************************************************
+//
+// CBandwidthScheduler
+//
+// Process-wide bandwidth budget shared by all running Copy/Move operations. Each
+// operation registers itself with the paths it reads from and writes to; the paths
+// are mapped to devices (network server or local volume) and each device can have its
+// own limit (bytes per second), there is also one global limit for all operations.
+// The limit of a device (or the global limit) is divided among the operations using
+// it that are currently transferring data, in proportion to their weights; each
+// operation has its own token bucket for each limit. Paused and finished operations
+// stop taking their share after BWSCHED_ACTIVE_TIME.
+//
+// The limits can be changed at any time, the new shares are used from the next
+// transferred block. The current time is always passed as a parameter (GetTickCount()
+// in Salamander), so the behavior of the scheduler is fully deterministic.
+//
+
+// (in ms) operation that did not transfer anything for this time does not take its share
+#define BWSCHED_ACTIVE_TIME 1000
+// (in ms) max. number of tokens the operation may save up for later (in time of transfer at its rate)
+#define BWSCHED_BURST_TIME 500
+
+#define BWSCHED_WEIGHT_NORMAL 4 // weight of a common operation
+#define BWSCHED_WEIGHT_IDLE 1   // weight of an operation started "on idle" (background copy)
+
+#define BWSCHED_MAX_DEVICE 100 // max. length of the device name (including the terminating null)
+
+#ifdef _DEBUG
+// (in ms) length of the interval after which the debug version checks that the limit was kept
+#define BWSCHED_CHECK_TIME 10000
+
+struct CBandwidthCheck
+{
+    DWORD Limit;            // limit checked since Start, 0 = no limit (nothing to check)
+    DWORD Start;            // start of the checked interval
+    unsigned __int64 Bytes; // bytes transferred by all members sharing the limit since Start
+};
+#endif // _DEBUG
+
+struct CBandwidthDevice
+{
+    char Name[BWSCHED_MAX_DEVICE]; // "\\server" or "C:"
+    DWORD Limit;                   // limit in bytes per second, 0 = no limit
+#ifdef _DEBUG
+    CBandwidthCheck Check; // is the limit of the device really kept?
+#endif // _DEBUG
+};
+
+struct CBandwidthBucket
+{
+    __int64 Tokens;   // available tokens in thousandths of byte (negative = debt)
+    DWORD LastRefill; // time of the last refill of Tokens
+};
+
+#define BWSCHED_BUCKETS 3 // global limit + source device + target device
+
+struct CBandwidthMember
+{
+    int ID;
+    DWORD Weight;
+    int Devices[BWSCHED_BUCKETS];              // indexes to Devices for buckets 1 and 2 (-1 = none), Devices[0] is not used (global limit)
+    CBandwidthBucket Buckets[BWSCHED_BUCKETS]; // bucket 0 = global limit, 1 = source device, 2 = target device
+    BOOL Started;                              // FALSE = member has not transferred anything yet
+    DWORD ActiveUntil;                         // the member takes its share till this time
+};
+
+class CBandwidthScheduler
+{
+protected:
+    CRITICAL_SECTION CS; // access from worker threads and the main thread
+
+    TIndirectArray<CBandwidthMember> Members;
+    TDirectArray<CBandwidthDevice> Devices; // devices are never removed (they keep their limits)
+    DWORD GlobalLimit;                      // limit for all operations in bytes per second, 0 = no limit
+    int LastID;                             // last assigned member ID
+#ifdef _DEBUG
+    CBandwidthCheck GlobalCheck; // is the global limit really kept?
+#endif // _DEBUG
+
+public:
+    CBandwidthScheduler();
+    ~CBandwidthScheduler();
+
+    // registers an operation reading from 'sourcePath' and writing to 'targetPath' (any
+    // of them can be NULL or empty) with weight 'weight' (see BWSCHED_WEIGHT_XXX);
+    // returns ID of the member (used in other methods) or 0 on low memory
+    int AddMember(const char* sourcePath, const char* targetPath, DWORD weight);
+
+    // unregisters member 'id' (its share is divided among the other members)
+    void RemoveMember(int id);
+
+    // changes the weight of member 'id'
+    void SetWeight(int id, DWORD weight);
+
+    // member 'id' transferred 'bytes' bytes at time 'now' (can be 0 to find out how long
+    // to wait for the previously transferred data); returns the number of milliseconds the
+    // member should wait before it transfers anything else; in 'rate' (if not NULL) returns
+    // the current share of the member in bytes per second (0 = not limited), it is a good
+    // limit for the size of blocks the member transfers
+    DWORD Consume(int id, DWORD bytes, DWORD now, DWORD* rate);
+
+    // sets the global limit in bytes per second (0 = no limit)
+    void SetGlobalLimit(DWORD limit);
+    DWORD GetGlobalLimit();
+
+    // sets the limit in bytes per second (0 = no limit) of device 'device' (see GetDeviceName);
+    // returns FALSE on low memory
+    BOOL SetDeviceLimit(const char* device, DWORD limit);
+
+    // sets limits of devices from string 'limits' in format "device=limit;device=limit",
+    // e.g. "\\nas=10485760;D:=0"; limits of devices missing in 'limits' are removed,
+    // invalid items are ignored (see CheckDeviceLimits)
+    void SetDeviceLimits(const char* limits);
+
+    // returns TRUE if string 'limits' is valid for SetDeviceLimits: each item is a drive ("D:")
+    // or a server ("\\nas") followed by "=" and a limit from 0 to 0xFFFFFFFF; otherwise returns
+    // FALSE and in 'errorPos' (if not NULL) the offset of the invalid item in 'limits'
+    static BOOL CheckDeviceLimits(const char* limits, int* errorPos);
+
+    // returns the name of the device (buffer of BWSCHED_MAX_DEVICE characters) the path
+    // 'path' is on: "\\server" for UNC paths and mapped network drives, "C:" for local
+    // drives (SUBST drives are resolved); returns FALSE if the device is unknown
+    static BOOL GetDeviceName(const char* path, char* device);
+
+protected:
+    // reads the next item from string 's' (see SetDeviceLimits) and moves 's' behind it;
+    // returns 1 and the item in 'device' (buffer of BWSCHED_MAX_DEVICE characters) and 'limit',
+    // -1 if the item is invalid or 0 at the end of the string
+    static int GetNextDeviceLimit(const char*& s, char* device, DWORD* limit);
+
+    // returns the index of device 'device' in Devices (adds it if needed), -1 on low memory;
+    // must be called from the critical section
+    int GetDeviceIndex(const char* device);
+
+    // returns the index of member 'id' in Members, -1 if not found; must be called from
+    // the critical section
+    int FindMember(int id);
+
+    // returns the limit of bucket 'bucket' of member 'm', 0 = no limit; must be called
+    // from the critical section
+    DWORD GetBucketLimit(CBandwidthMember* m, int bucket);
+
+    // returns the sum of weights of active members (at time 'now') sharing bucket 'bucket'
+    // with member 'm' (including 'm'); must be called from the critical section
+    unsigned __int64 GetActiveWeight(CBandwidthMember* m, int bucket, DWORD now);
+
+#ifdef _DEBUG
+    // adds 'bytes' transferred at time 'now' under limit 'limit' (0 = no limit) to 'check'
+    // and reports (TRACE_E) if the members sharing limit 'name' transferred more than the
+    // limit allows; must be called from the critical section
+    void CheckLimit(CBandwidthCheck* check, DWORD limit, DWORD bytes, DWORD now, const char* name);
+#endif // _DEBUG
+};
+
+extern CBandwidthScheduler BandwidthScheduler;
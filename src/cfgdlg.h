@@ -285,6 +285,10 @@ struct CConfiguration
 
     DWORD LastUsedSpeedLimit; // remembers the last used speed limit (users often repeat one number)
 
+    // limits shared by all running Copy/Move operations (see CBandwidthScheduler), Drives page of the configuration
+    DWORD SharedSpeedLimit;               // limit for all operations together in bytes per second, 0 = no limit
+    char DeviceSpeedLimits[2 * MAX_PATH]; // limits of devices: "device=limit;device=limit", e.g. "\\nas=10485760;D:=5242880"
+
     BOOL QuickSearchEnterAlt; // if it is TRUE, Quick Search is activated via Alt+letter
 
     // for displaying the items in the panel
@@ -821,6 +825,7 @@ protected:
 public:
     CCfgPageDrives(BOOL focusIfPathIsInaccessibleGoTo);
 
+    virtual void Validate(CTransferInfo& ti);
     virtual void Transfer(CTransferInfo& ti);
 
 protected:
@@ -0,0 +1,837 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+// CommentsTranslationProject: TRANSLATED
+
+#include "precomp.h"
+
+#include "dialogs.h"
+#include "md5.h"
+#include "cmpcont.h"
+
+CContentHashCache ContentHashCache;
+
+//
+// ****************************************************************************
+// CContentHashCache
+//
+
+CContentHashCache::CContentHashCache() : Entries(1024, 65536)
+{
+    HANDLES(InitializeCriticalSection(&CS));
+    Buckets = NULL;
+    BucketsCount = 0;
+}
+
+CContentHashCache::~CContentHashCache()
+{
+    if (Buckets != NULL)
+        free(Buckets);
+    HANDLES(DeleteCriticalSection(&CS));
+}
+
+unsigned __int64
+CContentHashCache::GetPathKey(const char* fileName)
+{
+    // names are case insensitive, the digest is computed from the lowercase name
+    MD5 md5;
+    unsigned char buf[256];
+    const char* s = fileName;
+    while (*s != 0)
+    {
+        int len = 0;
+        while (*s != 0 && len < 256)
+            buf[len++] = LowerCase[(BYTE)*s++];
+        md5.update(buf, len);
+    }
+    md5.finalize();
+    unsigned __int64 key;
+    memcpy(&key, md5.digest, sizeof(key));
+    return key;
+}
+
+void CContentHashCache::Clear()
+{
+    Entries.DestroyMembers();
+    if (Buckets != NULL)
+        free(Buckets);
+    Buckets = NULL;
+    BucketsCount = 0;
+}
+
+BOOL CContentHashCache::Rehash()
+{
+    if (Entries.Count < BucketsCount)
+        return TRUE; // there are still less entries than buckets
+
+    int count = max(4096, BucketsCount * 2);
+    int* buckets = (int*)malloc(count * sizeof(int));
+    if (buckets == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        return FALSE;
+    }
+    memset(buckets, 0xFF, count * sizeof(int)); // all buckets are empty (-1)
+    int i;
+    for (i = 0; i < Entries.Count; i++)
+    {
+        CContentHashCacheEntry* entry = &Entries[i];
+        int bucket = (int)(entry->PathKey & (count - 1));
+        entry->Next = buckets[bucket];
+        buckets[bucket] = i;
+    }
+    if (Buckets != NULL)
+        free(Buckets);
+    Buckets = buckets;
+    BucketsCount = count;
+    return TRUE;
+}
+
+BOOL CContentHashCache::Find(const char* fileName, const CQuadWord& size, const FILETIME& lastWrite, BYTE* digest)
+{
+    CALL_STACK_MESSAGE_NONE;
+    unsigned __int64 key = GetPathKey(fileName);
+
+    BOOL ret = FALSE;
+    HANDLES(EnterCriticalSection(&CS));
+    if (BucketsCount > 0)
+    {
+        int i = Buckets[key & (BucketsCount - 1)];
+        while (i != -1)
+        {
+            CContentHashCacheEntry* entry = &Entries[i];
+            if (entry->PathKey == key)
+            {
+                if (entry->Size == size && CompareFileTime(&entry->LastWrite, &lastWrite) == 0)
+                {
+                    memcpy(digest, entry->Digest, CONTENTHASH_DIGEST_SIZE);
+                    ret = TRUE;
+                }
+                break; // there is only one entry for each file
+            }
+            i = entry->Next;
+        }
+    }
+    HANDLES(LeaveCriticalSection(&CS));
+    return ret;
+}
+
+void CContentHashCache::Store(const char* fileName, const CQuadWord& size, const FILETIME& lastWrite, const BYTE* digest)
+{
+    CALL_STACK_MESSAGE_NONE;
+    unsigned __int64 key = GetPathKey(fileName);
+
+    HANDLES(EnterCriticalSection(&CS));
+    CContentHashCacheEntry* entry = NULL;
+    if (BucketsCount > 0) // try to find the entry for an older version of the file
+    {
+        int i = Buckets[key & (BucketsCount - 1)];
+        while (i != -1)
+        {
+            if (Entries[i].PathKey == key)
+            {
+                entry = &Entries[i];
+                break;
+            }
+            i = Entries[i].Next;
+        }
+    }
+    if (entry == NULL)
+    {
+        if (Entries.Count >= CONTENTHASHCACHE_MAX_ENTRIES)
+        {
+            TRACE_I("CContentHashCache::Store(): the cache is full, emptying it.");
+            Clear();
+        }
+        if (Rehash())
+        {
+            CContentHashCacheEntry newEntry;
+            newEntry.PathKey = key;
+            int bucket = (int)(key & (BucketsCount - 1));
+            newEntry.Next = Buckets[bucket];
+            int index = Entries.Add(newEntry);
+            if (Entries.IsGood())
+            {
+                Buckets[bucket] = index;
+                entry = &Entries[index];
+            }
+            else
+            {
+                Entries.ResetState();
+                TRACE_E(LOW_MEMORY);
+            }
+        }
+    }
+    if (entry != NULL)
+    {
+        entry->Size = size;
+        entry->LastWrite = lastWrite;
+        memcpy(entry->Digest, digest, CONTENTHASH_DIGEST_SIZE);
+    }
+    HANDLES(LeaveCriticalSection(&CS));
+}
+
+//
+// ****************************************************************************
+// CContentCmpPair
+//
+
+CContentCmpPair::CContentCmpPair(const char* leftName, const char* rightName, const CQuadWord& size,
+                                 const FILETIME& leftLastWrite, const FILETIME& rightLastWrite)
+{
+    LeftName = DupStr(leftName);
+    RightName = DupStr(rightName);
+    Size = size;
+    LeftLastWrite = leftLastWrite;
+    RightLastWrite = rightLastWrite;
+    State = ccpsWaiting;
+    Different = FALSE;
+    ErrFile = 0;
+    ErrOpen = FALSE;
+    Err = NO_ERROR;
+    Done.Set(0, 0);
+}
+
+CContentCmpPair::~CContentCmpPair()
+{
+    if (LeftName != NULL)
+        free(LeftName);
+    if (RightName != NULL)
+        free(RightName);
+}
+
+//
+// ****************************************************************************
+// CContentComparer
+//
+
+unsigned ThreadContentComparerBody(void* param)
+{
+    CALL_STACK_MESSAGE1("ThreadContentComparerBody()");
+    SetThreadNameInVCAndTrace("CmpContent");
+    TRACE_I("Begin");
+
+    ((CContentComparer*)param)->ThreadBody();
+
+    TRACE_I("End");
+    return 0;
+}
+
+unsigned ThreadContentComparerEH(void* param)
+{
+#ifndef CALLSTK_DISABLE
+    __try
+    {
+#endif // CALLSTK_DISABLE
+        return ThreadContentComparerBody(param);
+#ifndef CALLSTK_DISABLE
+    }
+    __except (CCallStack::HandleException(GetExceptionInformation()))
+    {
+        TRACE_I("Thread CmpContent: calling ExitProcess(1).");
+        //    ExitProcess(1);
+        TerminateProcess(GetCurrentProcess(), 1); // harder exit (this one calls something else)
+        return 1;
+    }
+#endif // CALLSTK_DISABLE
+}
+
+DWORD WINAPI ThreadContentComparer(void* param)
+{
+#ifndef CALLSTK_DISABLE
+    CCallStack stack;
+#endif // CALLSTK_DISABLE
+    return ThreadContentComparerEH(param);
+}
+
+CContentComparer::CContentComparer(const char* leftPath, const char* rightPath)
+    : Pairs(100, 1000), Order(100, 1000)
+{
+    HANDLES(InitializeCriticalSection(&CS));
+    NextPair = 0;
+    RunningPairs = 0;
+    LastStartedPair = -1;
+    DoneSize.Set(0, 0);
+    StopOnDifference = FALSE;
+    Stop = TRUE; // no batch is running
+    CheckedPairs = 0;
+    ReportedSize.Set(0, 0);
+    RunningThreads = 0;
+
+    // both disks must cope with parallel reading
+    ThreadsCount = min(GetThreadsForPath(leftPath), GetThreadsForPath(rightPath));
+    TRACE_I("CContentComparer: using " << ThreadsCount << " thread(s) for comparing files.");
+
+    WorkEvent = HANDLES(CreateEvent(NULL, TRUE, FALSE, NULL));      // "nonsignaled" state, manual
+    DoneEvent = HANDLES(CreateEvent(NULL, FALSE, FALSE, NULL));     // "nonsignaled" state, auto
+    TerminateEvent = HANDLES(CreateEvent(NULL, TRUE, FALSE, NULL)); // "nonsignaled" state, manual
+    if (WorkEvent == NULL || DoneEvent == NULL || TerminateEvent == NULL)
+        TRACE_E("CContentComparer: unable to create events.");
+}
+
+CContentComparer::~CContentComparer()
+{
+    if (RunningThreads > 0)
+    {
+        SetEvent(TerminateEvent);
+        int i;
+        for (i = 0; i < RunningThreads; i++)
+        {
+            WaitForSingleObject(Threads[i], INFINITE);
+            HANDLES(CloseHandle(Threads[i]));
+        }
+    }
+    if (WorkEvent != NULL)
+        HANDLES(CloseHandle(WorkEvent));
+    if (DoneEvent != NULL)
+        HANDLES(CloseHandle(DoneEvent));
+    if (TerminateEvent != NULL)
+        HANDLES(CloseHandle(TerminateEvent));
+    HANDLES(DeleteCriticalSection(&CS));
+}
+
+int CContentComparer::GetThreadsForPath(const char* path)
+{
+    char root[MAX_PATH];
+    GetRootPath(root, path);
+    switch (GetDriveType(root))
+    {
+    case DRIVE_REMOTE:
+        return CMPCONT_MAX_THREADS; // more requests in flight hide the network latency
+
+    case DRIVE_FIXED:
+        return IsPathOnSSD(path) ? CMPCONT_MAX_THREADS : 1;
+
+    default:
+        return 1; // removable disks and CD/DVD drives are read sequentially
+    }
+}
+
+BOOL CContentComparer::AddPair(const char* leftName, const char* rightName, const CQuadWord& size,
+                               const FILETIME& leftLastWrite, const FILETIME& rightLastWrite)
+{
+    CContentCmpPair* pair = new CContentCmpPair(leftName, rightName, size, leftLastWrite, rightLastWrite);
+    if (pair == NULL || !pair->IsGood())
+    {
+        TRACE_E(LOW_MEMORY);
+        if (pair != NULL)
+            delete pair;
+        return FALSE;
+    }
+    HANDLES(EnterCriticalSection(&CS));
+    Pairs.Add(pair);
+    BOOL ok = Pairs.IsGood();
+    if (!ok)
+        Pairs.ResetState();
+    HANDLES(LeaveCriticalSection(&CS));
+    if (!ok)
+    {
+        TRACE_E(LOW_MEMORY);
+        delete pair;
+    }
+    return ok;
+}
+
+BOOL CContentComparer::GetResult(int index, BOOL* different)
+{
+    CContentCmpPair* pair = Pairs[index];
+    if (pair->State == ccpsFinished && pair->ErrFile == 0)
+    {
+        *different = pair->Different;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void CContentComparer::ClearPairs()
+{
+    HANDLES(EnterCriticalSection(&CS));
+    Stop = TRUE;           // no thread may take a pair of the released batch
+    ResetEvent(WorkEvent); // a thread still waking on the previous batch finds nothing to do
+    NextPair = 0;
+    LastStartedPair = -1;
+    Pairs.DestroyMembers();
+    Order.DestroyMembers();
+    HANDLES(LeaveCriticalSection(&CS));
+}
+
+BOOL CContentComparer::StartThreads()
+{
+    while (RunningThreads < ThreadsCount)
+    {
+        DWORD threadID;
+        HANDLE thread = HANDLES(CreateThread(NULL, 0, ThreadContentComparer, this, 0, &threadID));
+        if (thread == NULL)
+        {
+            TRACE_E("CContentComparer::StartThreads(): unable to start thread.");
+            break;
+        }
+        Threads[RunningThreads++] = thread;
+    }
+    return RunningThreads > 0; // a single thread is enough for comparing
+}
+
+void CContentComparer::SortOrderBySize(int left, int right)
+{
+
+LABEL_SortOrderBySize:
+
+    int i = left, j = right;
+    CQuadWord pivot = Pairs[Order[(i + j) / 2]]->Size;
+
+    do
+    {
+        while (Pairs[Order[i]]->Size > pivot && i < right)
+            i++;
+        while (pivot > Pairs[Order[j]]->Size && j > left)
+            j--;
+
+        if (i <= j)
+        {
+            int swap = Order[i];
+            Order[i] = Order[j];
+            Order[j] = swap;
+            i++;
+            j--;
+        }
+    } while (i <= j);
+
+    // we save stack space (max. log(N) recursion depth)
+    if (left < j)
+    {
+        if (i < right)
+        {
+            if (j - left < right - i) // both halves must be sorted: send the smaller half to recursion and handle the other via "goto"
+            {
+                SortOrderBySize(left, j);
+                left = i;
+                goto LABEL_SortOrderBySize;
+            }
+            else
+            {
+                SortOrderBySize(i, right);
+                right = j;
+                goto LABEL_SortOrderBySize;
+            }
+        }
+        else
+        {
+            right = j;
+            goto LABEL_SortOrderBySize;
+        }
+    }
+    else
+    {
+        if (i < right)
+        {
+            left = i;
+            goto LABEL_SortOrderBySize;
+        }
+    }
+}
+
+void CContentComparer::AddDone(CContentCmpPair* pair, const CQuadWord& size)
+{
+    HANDLES(EnterCriticalSection(&CS));
+    pair->Done += size;
+    DoneSize += size;
+    HANDLES(LeaveCriticalSection(&CS));
+}
+
+void CContentComparer::UpdateProgress(CCmpDirProgressDialog* progressDlg)
+{
+    HANDLES(EnterCriticalSection(&CS));
+    CQuadWord done = DoneSize;
+    CContentCmpPair* pair = LastStartedPair != -1 ? Pairs[LastStartedPair] : NULL;
+    CQuadWord pairDone = pair != NULL ? pair->Done : CQuadWord(0, 0);
+    HANDLES(LeaveCriticalSection(&CS));
+
+    if (done > ReportedSize)
+    {
+        progressDlg->AddSize(done - ReportedSize);
+        ReportedSize = done;
+    }
+    if (pair != NULL) // show the last started pair, the other pairs are only in the total progress
+    {
+        progressDlg->SetSource(pair->LeftName);
+        progressDlg->SetTarget(pair->RightName);
+        progressDlg->SetFileSize(pair->Size + pair->Size);
+        progressDlg->SetActualFileSize(pairDone);
+    }
+}
+
+void CContentComparer::WaitForRunningPairs(CCmpDirProgressDialog* progressDlg)
+{
+    while (TRUE)
+    {
+        HANDLES(EnterCriticalSection(&CS));
+        int running = RunningPairs;
+        HANDLES(LeaveCriticalSection(&CS));
+        if (running == 0)
+            break;
+        WaitForSingleObject(DoneEvent, 100);
+        progressDlg->Continue(); // just keep the dialog alive, the operation is already ending
+    }
+}
+
+BOOL CContentComparer::CompareAll(HWND hWindow, CCmpDirProgressDialog* progressDlg, BOOL stopOnDifference,
+                                  BOOL* canceled)
+{
+    CALL_STACK_MESSAGE3("CContentComparer::CompareAll(%d, %d)", Pairs.Count, stopOnDifference);
+    *canceled = FALSE;
+    if (Pairs.Count == 0)
+        return TRUE;
+
+    if (!IsGood() || !StartThreads())
+    {
+        *canceled = TRUE;
+        return FALSE;
+    }
+
+    // the threads wait (Stop is TRUE since the end of the previous batch), but the new batch
+    // is prepared in the critical section anyway, a thread woken by the previous batch
+    // must not see Order being rebuilt
+    HANDLES(EnterCriticalSection(&CS));
+    Order.DestroyMembers();
+    int i;
+    for (i = 0; i < Pairs.Count; i++)
+        Order.Add(i);
+    if (!Order.IsGood())
+    {
+        Order.ResetState();
+        HANDLES(LeaveCriticalSection(&CS));
+        TRACE_E(LOW_MEMORY);
+        *canceled = TRUE;
+        return FALSE;
+    }
+    // the pairs are compared in the given order (directory order) by a single thread; when
+    // there are more threads, the biggest pairs go first, so no big pair stays at the end
+    // of the batch and the other threads have small pairs to compare meanwhile
+    if (ThreadsCount > 1 && Pairs.Count > 1)
+        SortOrderBySize(0, Pairs.Count - 1);
+    NextPair = 0;
+    RunningPairs = 0;
+    LastStartedPair = -1;
+    DoneSize.Set(0, 0);
+    StopOnDifference = stopOnDifference;
+    Stop = FALSE;
+    SetEvent(WorkEvent); // wake up the threads
+    HANDLES(LeaveCriticalSection(&CS));
+    CheckedPairs = 0;
+    ReportedSize.Set(0, 0);
+
+    char message[2 * MAX_PATH + 200]; // we need 2*MAX_PATH for the path plus room for an error message
+    BOOL ret = TRUE;
+    while (TRUE)
+    {
+        WaitForSingleObject(DoneEvent, 100);
+
+        UpdateProgress(progressDlg);
+        if (!progressDlg->Continue()) // give the dialog a chance to repaint
+            *canceled = TRUE;
+
+        // report errors of the finished pairs (in the order of comparing)
+        BOOL finished = FALSE;
+        while (!*canceled)
+        {
+            CContentCmpPair* pair = NULL;
+            HANDLES(EnterCriticalSection(&CS));
+            if (CheckedPairs < NextPair)
+            {
+                CContentCmpPair* p = Pairs[Order[CheckedPairs]];
+                if (p->State == ccpsFinished || p->State == ccpsStopped)
+                {
+                    pair = p;
+                    CheckedPairs++;
+                }
+            }
+            else
+            {
+                if (RunningPairs == 0 && (Stop || NextPair == Order.Count))
+                    finished = TRUE;
+            }
+            HANDLES(LeaveCriticalSection(&CS));
+            if (pair == NULL)
+                break;
+
+            if (pair->State == ccpsFinished && pair->ErrFile != 0)
+            {
+                _snprintf_s(message, _TRUNCATE, LoadStr(pair->ErrOpen ? IDS_ERROR_OPENING_FILE : IDS_ERROR_READING_FILE),
+                            pair->ErrFile == 1 ? pair->LeftName : pair->RightName, GetErrorText(pair->Err));
+                progressDlg->FlushDataToControls();
+                if (SalMessageBox(hWindow, message, LoadStr(IDS_ERRORTITLE),
+                                  MB_OKCANCEL | MB_ICONEXCLAMATION) == IDCANCEL)
+                {
+                    *canceled = TRUE;
+                }
+                if (stopOnDifference)
+                    ret = FALSE;
+            }
+        }
+        if (*canceled || finished)
+            break;
+    }
+
+    // end of the batch: no thread may take another pair until the next batch is prepared
+    // (WorkEvent could stay signaled till some thread finds out there is nothing to do)
+    HANDLES(EnterCriticalSection(&CS));
+    Stop = TRUE;
+    ResetEvent(WorkEvent);
+    HANDLES(LeaveCriticalSection(&CS));
+    if (*canceled)
+    {
+        ret = FALSE;
+        WaitForRunningPairs(progressDlg);
+    }
+    UpdateProgress(progressDlg);
+    return ret;
+}
+
+void CContentComparer::ThreadBody()
+{
+    char* buffer1 = (char*)malloc(CMPCONT_BLOCK_SIZE);
+    char* buffer2 = (char*)malloc(CMPCONT_BLOCK_SIZE);
+    if (buffer1 == NULL || buffer2 == NULL)
+        TRACE_E(LOW_MEMORY);
+
+    HANDLE events[2];
+    events[0] = TerminateEvent;
+    events[1] = WorkEvent;
+    while (WaitForMultipleObjects(2, events, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+    {
+        CContentCmpPair* pair = NULL;
+        HANDLES(EnterCriticalSection(&CS));
+        if (!Stop && NextPair < Order.Count)
+        {
+            LastStartedPair = Order[NextPair++];
+            pair = Pairs[LastStartedPair];
+            pair->State = ccpsRunning;
+            RunningPairs++;
+        }
+        else
+            ResetEvent(WorkEvent); // nothing to do, wait for the next batch
+        HANDLES(LeaveCriticalSection(&CS));
+
+        if (pair != NULL)
+        {
+            BOOL compared;
+            if (buffer1 != NULL && buffer2 != NULL)
+                compared = ComparePair(pair, buffer1, buffer2);
+            else
+            {
+                pair->ErrFile = 1;
+                pair->ErrOpen = FALSE;
+                pair->Err = ERROR_NOT_ENOUGH_MEMORY;
+                compared = TRUE;
+            }
+
+            HANDLES(EnterCriticalSection(&CS));
+            if (compared)
+            {
+                pair->State = ccpsFinished;
+                CQuadWord pairSize = pair->Size + pair->Size;
+                if (pair->Done < pairSize) // the rest of the pair was skipped (digest known, different content, error)
+                {
+                    DoneSize += pairSize - pair->Done;
+                    pair->Done = pairSize;
+                }
+                if (StopOnDifference && (pair->Different || pair->ErrFile != 0))
+                    Stop = TRUE;
+            }
+            else
+                pair->State = ccpsStopped;
+            RunningPairs--;
+            HANDLES(LeaveCriticalSection(&CS));
+            SetEvent(DoneEvent);
+        }
+    }
+
+    if (buffer1 != NULL)
+        free(buffer1);
+    if (buffer2 != NULL)
+        free(buffer2);
+}
+
+// reads 'size' bytes to 'buffer' from 'file' from offset 'offset'; returns the number of
+// bytes read in 'read'; returns FALSE on error (the error code is in 'err')
+static BOOL ReadContentSample(HANDLE file, const CQuadWord& offset, char* buffer, DWORD size, DWORD* read, DWORD* err)
+{
+    LONG hi = offset.HiDWord;
+    if (SetFilePointer(file, offset.LoDWord, &hi, FILE_BEGIN) == INVALID_SET_FILE_POINTER)
+    {
+        *err = GetLastError();
+        if (*err != NO_ERROR)
+            return FALSE;
+    }
+    if (!ReadFile(file, buffer, size, read, NULL))
+    {
+        *err = GetLastError();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL CContentComparer::ComparePair(CContentCmpPair* pair, char* buffer1, char* buffer2)
+{
+    CALL_STACK_MESSAGE2("CContentComparer::ComparePair(%s)", pair->LeftName);
+
+    // the digest of the unchanged file is known from a previous comparison
+    BYTE leftDigest[CONTENTHASH_DIGEST_SIZE];
+    BYTE rightDigest[CONTENTHASH_DIGEST_SIZE];
+    BOOL leftKnown = ContentHashCache.Find(pair->LeftName, pair->Size, pair->LeftLastWrite, leftDigest);
+    BOOL rightKnown = ContentHashCache.Find(pair->RightName, pair->Size, pair->RightLastWrite, rightDigest);
+    if (leftKnown && rightKnown)
+    {
+        pair->Different = memcmp(leftDigest, rightDigest, CONTENTHASH_DIGEST_SIZE) != 0;
+        return TRUE;
+    }
+
+    HANDLE hFile1 = INVALID_HANDLE_VALUE;
+    HANDLE hFile2 = INVALID_HANDLE_VALUE;
+    if (!leftKnown)
+    {
+        hFile1 = HANDLES_Q(CreateFile(pair->LeftName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                      NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+        if (hFile1 == INVALID_HANDLE_VALUE)
+        {
+            pair->Err = GetLastError();
+            pair->ErrFile = 1;
+            pair->ErrOpen = TRUE;
+            return TRUE;
+        }
+    }
+    if (!rightKnown)
+    {
+        hFile2 = HANDLES_Q(CreateFile(pair->RightName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                      NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+        if (hFile2 == INVALID_HANDLE_VALUE)
+        {
+            pair->Err = GetLastError();
+            pair->ErrFile = 2;
+            pair->ErrOpen = TRUE;
+            if (hFile1 != INVALID_HANDLE_VALUE)
+                HANDLES(CloseHandle(hFile1));
+            return TRUE;
+        }
+    }
+
+    BOOL ret = TRUE;
+    BOOL done = FALSE;
+    DWORD read1, read2;
+    DWORD err;
+
+    // both files must be read: first compare sample blocks from the middle and from the end
+    // of big files, a damaged or incompletely copied file is then found without reading
+    // it whole
+    if (!leftKnown && !rightKnown && pair->Size >= CQuadWord(CMPCONT_SAMPLE_MIN_SIZE, 0))
+    {
+        CQuadWord offsets[2];
+        offsets[0] = pair->Size / CQuadWord(2, 0);
+        offsets[0].LoDWord &= ~(DWORD)(CMPCONT_SAMPLE_SIZE - 1); // aligned offset reads faster
+        offsets[1] = pair->Size - CQuadWord(CMPCONT_SAMPLE_SIZE, 0);
+        int i;
+        for (i = 0; i < 2 && !done; i++)
+        {
+            if (!ReadContentSample(hFile1, offsets[i], buffer1, CMPCONT_SAMPLE_SIZE, &read1, &err))
+            {
+                pair->Err = err;
+                pair->ErrFile = 1;
+                done = TRUE;
+            }
+            else
+            {
+                if (!ReadContentSample(hFile2, offsets[i], buffer2, CMPCONT_SAMPLE_SIZE, &read2, &err))
+                {
+                    pair->Err = err;
+                    pair->ErrFile = 2;
+                    done = TRUE;
+                }
+                else
+                {
+                    if (read1 != read2 || memcmp(buffer1, buffer2, read1) != 0)
+                    {
+                        pair->Different = TRUE;
+                        done = TRUE;
+                    }
+                }
+            }
+        }
+        if (!done)
+        {
+            LONG hi = 0;
+            SetFilePointer(hFile1, 0, &hi, FILE_BEGIN);
+            hi = 0;
+            SetFilePointer(hFile2, 0, &hi, FILE_BEGIN);
+        }
+    }
+
+    // read the whole files, compare them and compute digests of their content
+    MD5 md5Left;
+    MD5 md5Right;
+    CQuadWord readSize(0, 0);
+    while (!done)
+    {
+        if (Stop) // canceled or another pair is different
+        {
+            ret = FALSE;
+            break;
+        }
+
+        read1 = 0;
+        if (hFile1 != INVALID_HANDLE_VALUE && !ReadFile(hFile1, buffer1, CMPCONT_BLOCK_SIZE, &read1, NULL))
+        {
+            pair->Err = GetLastError();
+            pair->ErrFile = 1;
+            break;
+        }
+        read2 = 0;
+        if (hFile2 != INVALID_HANDLE_VALUE && !ReadFile(hFile2, buffer2, CMPCONT_BLOCK_SIZE, &read2, NULL))
+        {
+            pair->Err = GetLastError();
+            pair->ErrFile = 2;
+            break;
+        }
+        if (hFile1 != INVALID_HANDLE_VALUE && hFile2 != INVALID_HANDLE_VALUE &&
+            (read1 != read2 || memcmp(buffer1, buffer2, read1) != 0))
+        { // file contents differ, no point in continuing reading
+            pair->Different = TRUE;
+            break;
+        }
+        DWORD read = hFile1 != INVALID_HANDLE_VALUE ? read1 : read2;
+        if (hFile1 != INVALID_HANDLE_VALUE)
+            md5Left.update((unsigned char*)buffer1, read1);
+        if (hFile2 != INVALID_HANDLE_VALUE)
+            md5Right.update((unsigned char*)buffer2, read2);
+        readSize += CQuadWord(read, 0);
+        AddDone(pair, CQuadWord(2 * read, 0));
+
+        if (read != CMPCONT_BLOCK_SIZE) // EOF
+        {
+            if (readSize != pair->Size) // the file was changed after listing the directory
+            {
+                pair->Different = TRUE;
+                break;
+            }
+            if (hFile1 != INVALID_HANDLE_VALUE)
+            {
+                md5Left.finalize();
+                memcpy(leftDigest, md5Left.digest, CONTENTHASH_DIGEST_SIZE);
+                ContentHashCache.Store(pair->LeftName, pair->Size, pair->LeftLastWrite, leftDigest);
+            }
+            if (hFile2 != INVALID_HANDLE_VALUE)
+            {
+                md5Right.finalize();
+                memcpy(rightDigest, md5Right.digest, CONTENTHASH_DIGEST_SIZE);
+                ContentHashCache.Store(pair->RightName, pair->Size, pair->RightLastWrite, rightDigest);
+            }
+            // if both files were read, the blocks were already compared
+            pair->Different = memcmp(leftDigest, rightDigest, CONTENTHASH_DIGEST_SIZE) != 0;
+            break;
+        }
+    }
+
+    if (hFile1 != INVALID_HANDLE_VALUE)
+        HANDLES(CloseHandle(hFile1));
+    if (hFile2 != INVALID_HANDLE_VALUE)
+        HANDLES(CloseHandle(hFile2));
+    return ret;
+}
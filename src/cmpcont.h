@@ -0,0 +1,195 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+// CommentsTranslationProject: TRANSLATED
+
+#pragma once
+
+//****************************************************************************
+//
+// Comparing files by content for Compare Directories
+//
+// CContentHashCache remembers MD5 digests of the content of already compared files,
+// the key is the full name of the file, its size and its last write time. When a file
+// is compared again and neither its size nor its last write time changed, only the other
+// file of the pair has to be read (or none of them if both digests are known).
+//
+// CContentComparer compares queued pairs of files in worker threads. The number of
+// threads depends on the devices the files are on: disks without seek penalty (SSD) and
+// network disks are read by several threads, rotating disks, removable disks and CD/DVD
+// drives by a single thread in the order of queued pairs (reading several files at once
+// would only make the heads move back and forth). Progress, message boxes and cancel are
+// handled in the main thread in CompareAll().
+//
+
+#define CONTENTHASH_DIGEST_SIZE 16 // size of MD5 digest
+
+// max. number of remembered digests (about 50 bytes per file); the cache is emptied
+// when the limit is exceeded
+#define CONTENTHASHCACHE_MAX_ENTRIES 2000000
+
+#define CMPCONT_MAX_THREADS 4                     // max. number of threads comparing files
+#define CMPCONT_BLOCK_SIZE (256 * 1024)           // size of block read from each file at once
+#define CMPCONT_SAMPLE_MIN_SIZE (4 * 1024 * 1024) // sample blocks are compared first in files of at least this size
+#define CMPCONT_SAMPLE_SIZE (64 * 1024)           // size of each sample block (from the middle and from the end of the file)
+
+struct CContentHashCacheEntry
+{
+    unsigned __int64 PathKey; // first 8 bytes of MD5 digest of the lowercase full name of the file
+    CQuadWord Size;
+    FILETIME LastWrite;
+    BYTE Digest[CONTENTHASH_DIGEST_SIZE]; // MD5 digest of the content of the file
+    int Next;                             // index of the next entry in the same bucket (-1 = none)
+};
+
+class CContentHashCache
+{
+protected:
+    CRITICAL_SECTION CS; // access from several comparing threads
+    TDirectArray<CContentHashCacheEntry> Entries;
+    int* Buckets; // indexes of the first entries in the buckets (-1 = empty bucket)
+    int BucketsCount;
+
+public:
+    CContentHashCache();
+    ~CContentHashCache();
+
+    // finds the digest of the content of file 'fileName' of size 'size' and last write time
+    // 'lastWrite'; returns TRUE if it is known and copies it to 'digest'
+    BOOL Find(const char* fileName, const CQuadWord& size, const FILETIME& lastWrite, BYTE* digest);
+
+    // remembers the digest of the content of file 'fileName' of size 'size' and last write
+    // time 'lastWrite'; the digest remembered for an older version of the file is replaced
+    void Store(const char* fileName, const CQuadWord& size, const FILETIME& lastWrite, const BYTE* digest);
+
+protected:
+    static unsigned __int64 GetPathKey(const char* fileName);
+
+    // releases all entries; must be called from the critical section
+    void Clear();
+
+    // enlarges the bucket array if there are too many entries per bucket; must be called
+    // from the critical section; returns FALSE on low memory
+    BOOL Rehash();
+};
+
+extern CContentHashCache ContentHashCache;
+
+// state of the pair of files in CContentComparer
+enum CContentCmpPairState
+{
+    ccpsWaiting,  // waiting for comparing
+    ccpsRunning,  // being compared
+    ccpsFinished, // compared or failed (see CContentCmpPair::ErrFile)
+    ccpsStopped,  // comparing was interrupted (see CContentComparer::Stop)
+};
+
+struct CContentCmpPair
+{
+    char* LeftName; // full names of the compared files (allocated)
+    char* RightName;
+    CQuadWord Size; // size of each file of the pair (sizes of the files must be the same)
+    FILETIME LeftLastWrite;
+    FILETIME RightLastWrite;
+
+    CContentCmpPairState State;
+    BOOL Different; // result of the comparison (valid if State == ccpsFinished and ErrFile == 0)
+
+    int ErrFile;  // 0 = no error, 1 = error in the left file, 2 = error in the right file
+    BOOL ErrOpen; // TRUE = error opening the file, FALSE = error reading the file
+    DWORD Err;    // error code
+
+    CQuadWord Done; // number of bytes of both files added to the progress so far
+
+    CContentCmpPair(const char* leftName, const char* rightName, const CQuadWord& size,
+                    const FILETIME& leftLastWrite, const FILETIME& rightLastWrite);
+    ~CContentCmpPair();
+
+    BOOL IsGood() { return LeftName != NULL && RightName != NULL; }
+};
+
+class CCmpDirProgressDialog;
+
+class CContentComparer
+{
+protected:
+    CRITICAL_SECTION CS; // access to the following data from the comparing threads
+
+    TIndirectArray<CContentCmpPair> Pairs; // pairs of files to compare
+    TDirectArray<int> Order;               // order in which the pairs are compared (indexes to Pairs)
+    int NextPair;                          // index to Order of the next pair to compare
+    int RunningPairs;                      // number of pairs being compared
+    int LastStartedPair;                   // index to Pairs of the last started pair (shown in the progress dialog), -1 = none
+    CQuadWord DoneSize;                    // number of bytes of both files of all pairs read so far
+    BOOL StopOnDifference;                 // TRUE = stop comparing after the first different or failed pair
+    BOOL Stop;                             // TRUE = threads should stop comparing (cancel, difference found or no batch running)
+
+    // used only in the main thread
+    int CheckedPairs;       // index to Order: all previous pairs are finished and their errors were reported
+    CQuadWord ReportedSize; // part of DoneSize already added to the progress dialog
+
+    int ThreadsCount; // number of threads used for comparing
+    HANDLE Threads[CMPCONT_MAX_THREADS];
+    int RunningThreads;    // number of started threads
+    HANDLE WorkEvent;      // manual: signaled while there are pairs waiting for comparing
+    HANDLE DoneEvent;      // auto: signaled after each compared pair
+    HANDLE TerminateEvent; // manual: threads should end
+
+public:
+    // 'leftPath' and 'rightPath' are the paths in the panels, they determine the number
+    // of threads comparing files
+    CContentComparer(const char* leftPath, const char* rightPath);
+    ~CContentComparer();
+
+    BOOL IsGood() { return WorkEvent != NULL && DoneEvent != NULL && TerminateEvent != NULL; }
+
+    // adds the pair of files of the same size 'size' for comparing; returns FALSE on low memory
+    BOOL AddPair(const char* leftName, const char* rightName, const CQuadWord& size,
+                 const FILETIME& leftLastWrite, const FILETIME& rightLastWrite);
+
+    int GetPairsCount() { return Pairs.Count; }
+
+    // returns TRUE if pair 'index' was compared, 'different' then contains the result;
+    // returns FALSE if the comparison failed or it was not performed at all
+    BOOL GetResult(int index, BOOL* different);
+
+    // compares all added pairs, shows the progress in 'progressDlg' (each pair counts as
+    // the size of both files) and errors in message boxes with parent 'hWindow'; if
+    // 'stopOnDifference' is TRUE, it stops comparing after the first different or failed
+    // pair (the remaining pairs stay uncompared); returns FALSE if the user canceled the
+    // operation ('canceled' is TRUE) or if some pair failed and 'stopOnDifference' is TRUE
+    // ('canceled' is FALSE)
+    BOOL CompareAll(HWND hWindow, CCmpDirProgressDialog* progressDlg, BOOL stopOnDifference,
+                    BOOL* canceled);
+
+    // releases all pairs, the next batch of pairs can be added
+    void ClearPairs();
+
+protected:
+    // starts the comparing threads (if they are not running yet); returns FALSE on error
+    BOOL StartThreads();
+
+    // waits for the end of comparing of the running pairs (after setting Stop)
+    void WaitForRunningPairs(CCmpDirProgressDialog* progressDlg);
+
+    // sorts Order by size of the pairs in descending order
+    void SortOrderBySize(int left, int right);
+
+    // adds the read bytes of the pairs to the progress and shows the last started pair
+    void UpdateProgress(CCmpDirProgressDialog* progressDlg);
+
+    // body of the comparing threads
+    void ThreadBody();
+
+    // compares pair 'pair' using buffers 'buffer1' and 'buffer2' (CMPCONT_BLOCK_SIZE each);
+    // sets pair->Different or the error info and returns TRUE; returns FALSE if the
+    // comparing was interrupted (Stop is TRUE)
+    BOOL ComparePair(CContentCmpPair* pair, char* buffer1, char* buffer2);
+
+    // adds 'size' read bytes of pair 'pair' to the progress
+    void AddDone(CContentCmpPair* pair, const CQuadWord& size);
+
+    // returns the number of threads suitable for reading files on the path 'path'
+    static int GetThreadsForPath(const char* path);
+
+    friend unsigned ThreadContentComparerBody(void* param);
+};
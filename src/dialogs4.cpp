@@ -370,6 +370,8 @@ CConfiguration::CConfiguration()
     ShowSLGIncomplete = TRUE;
 
     LastUsedSpeedLimit = 1024 * 1024; // default 1 MB/s
+    SharedSpeedLimit = 0;
+    DeviceSpeedLimits[0] = 0;
 
     QuickSearchEnterAlt = FALSE;
 
@@ -16,6 +16,7 @@
 #include "gui.h"
 #include "menu.h"
 #include "shellib.h"
+#include "bwsched.h"
 
 static char LastSelectedPluginDLLName[MAX_PATH] = {0}; // after reopening Plugins Manager, select the last chosen plugin
 
@@ -1810,6 +1811,33 @@ CCfgPageDrives::CCfgPageDrives(BOOL focusIfPathIsInaccessibleGoTo)
     FocusIfPathIsInaccessibleGoTo = focusIfPathIsInaccessibleGoTo;
 }
 
+void CCfgPageDrives::Validate(CTransferInfo& ti)
+{
+    CALL_STACK_MESSAGE1("CCfgPageDrives::Validate()");
+    __int64 sharedLimit;
+    ti.EditLine(IDE_DRVSPEC_SHAREDLIMIT, sharedLimit, TRUE, TRUE);
+    if (ti.IsGood() && (unsigned __int64)sharedLimit > 0xFFFFFFFF)
+    {
+        SalMessageBox(HWindow, LoadStr(IDS_BADSHAREDSPEEDLIMIT), LoadStr(IDS_ERRORTITLE),
+                      MB_OK | MB_ICONEXCLAMATION);
+        ti.ErrorOn(IDE_DRVSPEC_SHAREDLIMIT);
+        return;
+    }
+    char limits[2 * MAX_PATH];
+    ti.EditLine(IDE_DRVSPEC_DEVICELIMITS, limits, 2 * MAX_PATH);
+    int errorPos;
+    if (ti.IsGood() && !CBandwidthScheduler::CheckDeviceLimits(limits, &errorPos))
+    {
+        SalMessageBox(HWindow, LoadStr(IDS_BADDEVICESPEEDLIMITS), LoadStr(IDS_ERRORTITLE),
+                      MB_OK | MB_ICONEXCLAMATION);
+        SetFocus(GetDlgItem(HWindow, IDE_DRVSPEC_DEVICELIMITS));
+        const char* end = strchr(limits + errorPos, ';');
+        int endPos = end != NULL ? (int)(end - limits) : (int)strlen(limits);
+        SendMessage(GetDlgItem(HWindow, IDE_DRVSPEC_DEVICELIMITS), EM_SETSEL, errorPos, endPos);
+        ti.ErrorOn(IDE_DRVSPEC_DEVICELIMITS);
+    }
+}
+
 void CCfgPageDrives::Transfer(CTransferInfo& ti)
 {
     ti.CheckBox(IDC_DRVSPEC_FLOPPYMON, Configuration.DrvSpecFloppyMon);
@@ -1849,6 +1877,10 @@ void CCfgPageDrives::Transfer(CTransferInfo& ti)
             }
         }
     }
+    __int64 sharedLimit = Configuration.SharedSpeedLimit;
+    ti.EditLine(IDE_DRVSPEC_SHAREDLIMIT, sharedLimit, TRUE, TRUE);
+    Configuration.SharedSpeedLimit = (DWORD)sharedLimit; // Validate() has checked the range
+    ti.EditLine(IDE_DRVSPEC_DEVICELIMITS, Configuration.DeviceSpeedLimits, 2 * MAX_PATH);
 }
 
 INT_PTR
@@ -0,0 +1,693 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+// CommentsTranslationProject: TRANSLATED
+
+#include "precomp.h"
+
+#include "cfgdlg.h"
+#include "plugins.h"
+#include "zip.h"
+#include "md5.h"
+#include "lstcache.h"
+
+CArchiveListingCache ArchiveListingCache;
+
+//
+// ****************************************************************************
+// Cache file format
+//
+// The file consists of a header, an array of nodes (directories of the listing, node 0
+// is the root), an array of items (for each node its subdirectories followed by its
+// files) and a pool of null-terminated names. Nodes are numbered in breadth-first order,
+// so each subdirectory with content must refer to the first node which is not referenced
+// yet; this is checked during loading, so even a damaged file always yields a tree.
+//
+
+#define ARCLISTCACHE_SIGNATURE 0x43534C41 // "ALSC"
+#define ARCLISTCACHE_VERSION 1
+#define ARCLISTCACHE_NONE 0xFFFFFFFF // no DOS name / directory without content
+
+#define ARCLISTCACHE_HDRF_SORTDIRSBYEXT 0x0001 // Configuration.SortDirsByExt was TRUE (affects Ext of directories)
+
+#define ARCLISTCACHE_ITEMF_HIDDEN 0x0001
+#define ARCLISTCACHE_ITEMF_ISLINK 0x0002
+#define ARCLISTCACHE_ITEMF_ISOFFLINE 0x0004
+#define ARCLISTCACHE_ITEMF_OVERLAYSHIFT 4 // bits 4-7: CFileData::IconOverlayIndex
+
+struct CArcListCacheHeader
+{
+    DWORD Signature;
+    DWORD Version;
+    DWORD HeaderFlags;                // ARCLISTCACHE_HDRF_XXX
+    DWORD Checksum;                   // CRC-32 of all data following the header
+    unsigned __int64 ArchiveSize;     // size of the archive
+    FILETIME ArchiveLastWrite;        // last write time of the archive
+    DWORD ValidData;                  // CSalamanderDirectory::ValidData of the listing
+    DWORD SalDirFlags;                // CSalamanderDirectory::Flags of the listing
+    DWORD NodesCount;                 // number of CArcListCacheNode records
+    DWORD ItemsCount;                 // number of CArcListCacheItem records
+    DWORD NamesSize;                  // size of the name pool in bytes
+    DWORD ArchiveNameOffset;          // full name of the archive (protection against hash collisions)
+    DWORD PluginDLLNameOffset;        // CPluginData::DLLName of the plugin which made the listing
+    DWORD PluginVersionOffset;        // CPluginData::Version of the plugin which made the listing
+};
+
+struct CArcListCacheNode
+{
+    DWORD FirstItem;  // index of the first item of this directory
+    DWORD DirsCount;  // number of subdirectories (items from FirstItem)
+    DWORD FilesCount; // number of files (items following the subdirectories)
+    DWORD Reserved;   // keeps the items array 8-byte aligned
+};
+
+struct CArcListCacheItem
+{
+    unsigned __int64 Size;
+    FILETIME LastWrite;
+    DWORD NameOffset;    // offset of the name in the name pool
+    DWORD DosNameOffset; // offset of the DOS name in the name pool (ARCLISTCACHE_NONE = no DOS name)
+    DWORD Attr;
+    DWORD SubNode;   // directories only: node with the content (ARCLISTCACHE_NONE = not allocated)
+    WORD NameLen;    // CFileData::NameLen
+    WORD ExtOffset;  // CFileData::Ext - CFileData::Name
+    DWORD ItemFlags; // ARCLISTCACHE_ITEMF_XXX
+};
+
+// the cache file used to shrink the cache
+struct CArcListCacheFileInfo
+{
+    char Name[MAX_PATH];
+    CQuadWord Size;
+    FILETIME LastWrite;
+};
+
+//
+// ****************************************************************************
+// CArchiveListingCache
+//
+
+CArchiveListingCache::CArchiveListingCache()
+{
+    CacheDir[0] = 0;
+    CacheDirInitialized = FALSE;
+}
+
+const char*
+CArchiveListingCache::GetCacheDir()
+{
+    if (!CacheDirInitialized)
+    {
+        CacheDirInitialized = TRUE;
+        char path[MAX_PATH];
+        // plugins find the directory through the same constant (they store their own data there)
+        if (SHGetFolderPath(NULL, CSIDL_LOCAL_APPDATA, NULL, 0 /* SHGFP_TYPE_CURRENT */, path) == S_OK &&
+            SalPathAppend(path, SALAMANDER_LISTINGCACHE_DIR, MAX_PATH))
+        {
+            char* slash = strrchr(path, '\\'); // create "Open Salamander" first
+            *slash = 0;
+            CreateDirectory(path, NULL); // if it fails (e.g. it already exists), we don't care...
+            *slash = '\\';
+            if (CreateDirectory(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS)
+                lstrcpyn(CacheDir, path, MAX_PATH);
+            else
+                TRACE_E("CArchiveListingCache::GetCacheDir(): unable to create directory " << path);
+        }
+        else
+            TRACE_E("CArchiveListingCache::GetCacheDir(): cannot get value of CSIDL_LOCAL_APPDATA!");
+    }
+    return CacheDir[0] != 0 ? CacheDir : NULL;
+}
+
+BOOL CArchiveListingCache::GetCacheFileName(const char* archiveFileName, char* name)
+{
+    const char* dir = GetCacheDir();
+    if (dir == NULL)
+        return FALSE;
+
+    // the key is MD5 of the archive name in lower case (names are case-insensitive)
+    char lowerName[MAX_PATH];
+    int len = (int)strlen(archiveFileName);
+    if (len >= MAX_PATH)
+        return FALSE;
+    int i;
+    for (i = 0; i < len; i++)
+        lowerName[i] = LowerCase[(BYTE)archiveFileName[i]];
+    MD5 md5;
+    md5.update((unsigned char*)lowerName, len);
+    md5.finalize();
+
+    char fileName[50];
+    char* s = fileName;
+    for (i = 0; i < 16; i++)
+        s += sprintf(s, "%02x", md5.digest[i]);
+    strcpy(s, ".slc");
+
+    lstrcpyn(name, dir, MAX_PATH);
+    return SalPathAppend(name, fileName, MAX_PATH);
+}
+
+BOOL CArchiveListingCache::GetArchiveIdentity(const char* archiveFileName, CQuadWord& size, FILETIME& lastWrite)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesEx(archiveFileName, GetFileExInfoStandard, &data) ||
+        (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+    {
+        return FALSE;
+    }
+    size.Set(data.nFileSizeLow, data.nFileSizeHigh);
+    lastWrite = data.ftLastWriteTime;
+    return TRUE;
+}
+
+// returns TRUE if there is a null-terminated string at 'offset' in the name pool 'names'
+static BOOL IsValidPoolString(const char* names, DWORD namesSize, DWORD offset)
+{
+    return offset < namesSize && memchr(names + offset, 0, namesSize - offset) != NULL;
+}
+
+BOOL CArchiveListingCache::ItemToFileData(const CArcListCacheItem* item, const char* names,
+                                          DWORD namesSize, CFileData& file)
+{
+    if (item->NameLen == 0 || item->NameLen > MAX_PATH - 5 || item->ExtOffset > item->NameLen ||
+        item->NameOffset >= namesSize || namesSize - item->NameOffset <= item->NameLen)
+    {
+        return FALSE;
+    }
+    const char* name = names + item->NameOffset;
+    if (name[item->NameLen] != 0 || memchr(name, 0, item->NameLen) != NULL)
+        return FALSE;
+    if (item->DosNameOffset != ARCLISTCACHE_NONE && !IsValidPoolString(names, namesSize, item->DosNameOffset))
+        return FALSE;
+
+    file.Name = (char*)malloc(item->NameLen + 1);
+    if (file.Name == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        return FALSE;
+    }
+    memcpy(file.Name, name, item->NameLen + 1);
+    file.DosName = NULL;
+    if (item->DosNameOffset != ARCLISTCACHE_NONE)
+    {
+        file.DosName = DupStr(names + item->DosNameOffset);
+        if (file.DosName == NULL)
+        {
+            free(file.Name);
+            return FALSE;
+        }
+    }
+    file.NameLen = item->NameLen;
+    file.Ext = file.Name + item->ExtOffset;
+    file.Size.Value = item->Size;
+    file.Attr = item->Attr;
+    file.LastWrite = item->LastWrite;
+    file.PluginData = 0;
+    file.Hidden = (item->ItemFlags & ARCLISTCACHE_ITEMF_HIDDEN) != 0;
+    file.IsLink = (item->ItemFlags & ARCLISTCACHE_ITEMF_ISLINK) != 0;
+    file.IsOffline = (item->ItemFlags & ARCLISTCACHE_ITEMF_ISOFFLINE) != 0;
+    file.IconOverlayIndex = (item->ItemFlags >> ARCLISTCACHE_ITEMF_OVERLAYSHIFT) & 0x0F;
+    // private Salamander flags are reset the same way as in CSalamanderDirectory::AddFile()
+    file.Association = 0;
+    file.Selected = 0;
+    file.Shared = 0;
+    file.Archive = 0;
+    file.SizeValid = 0;
+    file.Dirty = 0;
+    file.CutToClip = 0;
+    file.IconOverlayDone = 0;
+    return TRUE;
+}
+
+void CArchiveListingCache::FileDataToItem(const CFileData& file, CArcListCacheItem* item,
+                                          char* names, DWORD& namesPos)
+{
+    item->Size = file.Size.Value;
+    item->LastWrite = file.LastWrite;
+    item->Attr = file.Attr;
+    item->SubNode = ARCLISTCACHE_NONE;
+    item->NameLen = (WORD)file.NameLen;
+    item->ExtOffset = (WORD)(file.Ext - file.Name);
+    item->ItemFlags = (file.Hidden ? ARCLISTCACHE_ITEMF_HIDDEN : 0) |
+                      (file.IsLink ? ARCLISTCACHE_ITEMF_ISLINK : 0) |
+                      (file.IsOffline ? ARCLISTCACHE_ITEMF_ISOFFLINE : 0) |
+                      (file.IconOverlayIndex << ARCLISTCACHE_ITEMF_OVERLAYSHIFT);
+    item->NameOffset = namesPos;
+    memcpy(names + namesPos, file.Name, file.NameLen + 1);
+    namesPos += file.NameLen + 1;
+    item->DosNameOffset = ARCLISTCACHE_NONE;
+    if (file.DosName != NULL)
+    {
+        int len = (int)strlen(file.DosName) + 1;
+        item->DosNameOffset = namesPos;
+        memcpy(names + namesPos, file.DosName, len);
+        namesPos += len;
+    }
+}
+
+BOOL CArchiveListingCache::BuildListing(const CArcListCacheHeader* header, const CArcListCacheNode* nodes,
+                                        const CArcListCacheItem* items, const char* names,
+                                        CSalamanderDirectory& dir)
+{
+    // directories which will receive content of nodes; filled gradually while
+    // processing the parent nodes (root is node 0)
+    CSalamanderDirectory** targets = (CSalamanderDirectory**)malloc(header->NodesCount * sizeof(CSalamanderDirectory*));
+    if (targets == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        return FALSE;
+    }
+    targets[0] = &dir;
+    dir.SetValidData(header->ValidData);
+    dir.SetFlags(header->SalDirFlags);
+
+    BOOL ok = TRUE;
+    DWORD nextNode = 1;
+    DWORD n;
+    for (n = 0; ok && n < header->NodesCount; n++)
+    {
+        if (n >= nextNode) // the node is not referenced by any directory
+        {
+            ok = FALSE;
+            break;
+        }
+        const CArcListCacheNode* node = nodes + n;
+        if (node->FirstItem > header->ItemsCount ||
+            node->DirsCount > header->ItemsCount - node->FirstItem ||
+            node->FilesCount > header->ItemsCount - node->FirstItem - node->DirsCount)
+        {
+            ok = FALSE;
+            break;
+        }
+        CSalamanderDirectory* d = targets[n];
+        d->SetApproximateCount(node->FilesCount, node->DirsCount);
+
+        const CArcListCacheItem* item = items + node->FirstItem;
+        DWORD i;
+        for (i = 0; i < node->DirsCount; i++, item++)
+        {
+            CFileData file;
+            if (!ItemToFileData(item, names, header->NamesSize, file))
+            {
+                ok = FALSE;
+                break;
+            }
+            d->Dirs.Add(file);
+            if (!d->Dirs.IsGood())
+            {
+                d->Dirs.ResetState();
+                free(file.Name);
+                if (file.DosName != NULL)
+                    free(file.DosName);
+                ok = FALSE;
+                break;
+            }
+            CSalamanderDirectory* subDir = NULL;
+            if (item->SubNode != ARCLISTCACHE_NONE)
+            {
+                if (item->SubNode != nextNode || nextNode >= header->NodesCount)
+                {
+                    ok = FALSE;
+                    break;
+                }
+                subDir = new CSalamanderDirectory(FALSE, header->ValidData, header->SalDirFlags);
+                if (subDir == NULL)
+                {
+                    TRACE_E(LOW_MEMORY);
+                    ok = FALSE;
+                    break;
+                }
+                targets[nextNode++] = subDir;
+            }
+            d->SalamDirs.Add(subDir);
+            if (!d->SalamDirs.IsGood())
+            {
+                d->SalamDirs.ResetState();
+                if (subDir != NULL)
+                    delete subDir;
+                ok = FALSE;
+                break;
+            }
+        }
+        for (i = 0; ok && i < node->FilesCount; i++, item++)
+        {
+            CFileData file;
+            if (!ItemToFileData(item, names, header->NamesSize, file))
+            {
+                ok = FALSE;
+                break;
+            }
+            d->Files.Add(file);
+            if (!d->Files.IsGood())
+            {
+                d->Files.ResetState();
+                free(file.Name);
+                if (file.DosName != NULL)
+                    free(file.DosName);
+                ok = FALSE;
+                break;
+            }
+        }
+    }
+    if (ok && nextNode != header->NodesCount)
+        ok = FALSE;
+    free(targets);
+    // on error the caller clears 'dir' (all allocated directories are already linked into it)
+    return ok;
+}
+
+BOOL CArchiveListingCache::Load(const char* archiveFileName, const CQuadWord& size, const FILETIME& lastWrite,
+                                CPluginData* plugin, CSalamanderDirectory& dir)
+{
+    CALL_STACK_MESSAGE2("CArchiveListingCache::Load(%s, , , ,)", archiveFileName);
+
+    char name[MAX_PATH];
+    if (!GetCacheFileName(archiveFileName, name))
+        return FALSE;
+
+    HANDLE file = HANDLES_Q(CreateFile(name, GENERIC_READ | FILE_WRITE_ATTRIBUTES,
+                                       FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                                       OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+    if (file == INVALID_HANDLE_VALUE)
+        return FALSE; // the archive is not cached (the most common case)
+
+    BOOL ret = FALSE;
+    BOOL damaged = FALSE;
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart >= sizeof(CArcListCacheHeader) &&
+        (unsigned __int64)fileSize.QuadPart <= ARCLISTCACHE_MAX_SIZE.Value)
+    {
+        HANDLE mapping = HANDLES(CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL));
+        if (mapping != NULL)
+        {
+            const BYTE* data = (const BYTE*)HANDLES(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            if (data != NULL)
+            {
+                const CArcListCacheHeader* header = (const CArcListCacheHeader*)data;
+                DWORD dataSize = fileSize.LowPart;
+                DWORD headerFlags = Configuration.SortDirsByExt ? ARCLISTCACHE_HDRF_SORTDIRSBYEXT : 0;
+                unsigned __int64 expectedSize = sizeof(CArcListCacheHeader) +
+                                                (unsigned __int64)header->NodesCount * sizeof(CArcListCacheNode) +
+                                                (unsigned __int64)header->ItemsCount * sizeof(CArcListCacheItem) +
+                                                header->NamesSize;
+                if (header->Signature != ARCLISTCACHE_SIGNATURE || header->Version != ARCLISTCACHE_VERSION ||
+                    expectedSize != dataSize || header->NodesCount == 0)
+                {
+                    damaged = TRUE;
+                }
+                else
+                {
+                    const CArcListCacheNode* nodes = (const CArcListCacheNode*)(data + sizeof(CArcListCacheHeader));
+                    const CArcListCacheItem* items = (const CArcListCacheItem*)(nodes + header->NodesCount);
+                    const char* names = (const char*)(items + header->ItemsCount);
+                    if (!IsValidPoolString(names, header->NamesSize, header->ArchiveNameOffset) ||
+                        !IsValidPoolString(names, header->NamesSize, header->PluginDLLNameOffset) ||
+                        !IsValidPoolString(names, header->NamesSize, header->PluginVersionOffset))
+                    {
+                        damaged = TRUE;
+                    }
+                    else
+                    {
+                        if (header->ArchiveSize == size.Value &&
+                            CompareFileTime(&header->ArchiveLastWrite, &lastWrite) == 0 &&
+                            header->HeaderFlags == headerFlags &&
+                            StrICmp(names + header->ArchiveNameOffset, archiveFileName) == 0 &&
+                            StrICmp(names + header->PluginDLLNameOffset, plugin->DLLName) == 0 &&
+                            strcmp(names + header->PluginVersionOffset, plugin->Version) == 0)
+                        {
+                            if (UpdateCrc32(data + sizeof(CArcListCacheHeader), dataSize - sizeof(CArcListCacheHeader), 0) !=
+                                    header->Checksum ||
+                                !BuildListing(header, nodes, items, names, dir))
+                            {
+                                dir.Clear(NULL);
+                                damaged = TRUE;
+                            }
+                            else
+                                ret = TRUE;
+                        }
+                        // otherwise the archive or the plugin has changed, the file will be overwritten by Store()
+                    }
+                }
+                HANDLES(UnmapViewOfFile(data));
+            }
+            HANDLES(CloseHandle(mapping));
+        }
+    }
+    else
+        damaged = TRUE;
+
+    if (ret) // mark the cache file as recently used (see Shrink())
+    {
+        FILETIME ft;
+        GetSystemTimeAsFileTime(&ft);
+        SetFileTime(file, NULL, NULL, &ft);
+    }
+    HANDLES(CloseHandle(file));
+
+    if (damaged)
+    {
+        TRACE_I("CArchiveListingCache::Load(): removing damaged cache file " << name);
+        DeleteFile(name);
+    }
+    if (ret)
+        TRACE_I("CArchiveListingCache::Load(): listing of " << archiveFileName << " was loaded from cache.");
+    return ret;
+}
+
+void CArchiveListingCache::Store(const char* archiveFileName, const CQuadWord& size, const FILETIME& lastWrite,
+                                 CPluginData* plugin, CSalamanderDirectory& dir,
+                                 CPluginDataInterfaceAbstract* pluginData, DWORD listTime)
+{
+    CALL_STACK_MESSAGE3("CArchiveListingCache::Store(%s, , , , , , %u)", archiveFileName, listTime);
+
+    if (pluginData != NULL || listTime < ARCLISTCACHE_MIN_LISTTIME)
+        return; // plugin data cannot be stored; fast listing is not worth caching
+
+    char name[MAX_PATH];
+    if (!GetCacheFileName(archiveFileName, name))
+        return;
+
+    // if the archive was changed during listing, we do not know which version was listed
+    CQuadWord curSize;
+    FILETIME curLastWrite;
+    if (!GetArchiveIdentity(archiveFileName, curSize, curLastWrite) || curSize != size ||
+        CompareFileTime(&curLastWrite, &lastWrite) != 0)
+    {
+        return;
+    }
+
+    // collect the directories in breadth-first order and compute the size of the name pool
+    TDirectArray<CSalamanderDirectory*> dirs(100, 1000);
+    dirs.Add(&dir);
+    if (!dirs.IsGood())
+        return;
+    unsigned __int64 itemsCount = 0;
+    unsigned __int64 namesSize = strlen(archiveFileName) + 1 + strlen(plugin->DLLName) + 1 +
+                                 strlen(plugin->Version) + 1;
+    int d;
+    for (d = 0; d < dirs.Count; d++)
+    {
+        CSalamanderDirectory* salDir = dirs[d];
+        int i;
+        for (i = 0; i < salDir->Dirs.Count; i++)
+        {
+            CFileData* file = &salDir->Dirs[i];
+            namesSize += file->NameLen + 1 + (file->DosName != NULL ? strlen(file->DosName) + 1 : 0);
+            if (salDir->SalamDirs[i] != NULL)
+            {
+                dirs.Add(salDir->SalamDirs[i]);
+                if (!dirs.IsGood())
+                    return;
+            }
+        }
+        for (i = 0; i < salDir->Files.Count; i++)
+        {
+            CFileData* file = &salDir->Files[i];
+            namesSize += file->NameLen + 1 + (file->DosName != NULL ? strlen(file->DosName) + 1 : 0);
+        }
+        itemsCount += salDir->Dirs.Count + salDir->Files.Count;
+        if (itemsCount > ARCLISTCACHE_MAX_ITEMS)
+        {
+            TRACE_I("CArchiveListingCache::Store(): listing of " << archiveFileName << " is too big to be cached.");
+            return;
+        }
+    }
+    unsigned __int64 totalSize = sizeof(CArcListCacheHeader) + dirs.Count * sizeof(CArcListCacheNode) +
+                                 itemsCount * sizeof(CArcListCacheItem) + namesSize;
+    if (totalSize > ARCLISTCACHE_MAX_SIZE.Value)
+    {
+        TRACE_I("CArchiveListingCache::Store(): listing of " << archiveFileName << " is too big to be cached.");
+        return;
+    }
+
+    BYTE* data = (BYTE*)malloc((size_t)totalSize);
+    if (data == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        return;
+    }
+    CArcListCacheHeader* header = (CArcListCacheHeader*)data;
+    CArcListCacheNode* nodes = (CArcListCacheNode*)(data + sizeof(CArcListCacheHeader));
+    CArcListCacheItem* items = (CArcListCacheItem*)(nodes + dirs.Count);
+    char* names = (char*)(items + itemsCount);
+
+    DWORD namesPos = 0;
+    header->Signature = ARCLISTCACHE_SIGNATURE;
+    header->Version = ARCLISTCACHE_VERSION;
+    header->HeaderFlags = Configuration.SortDirsByExt ? ARCLISTCACHE_HDRF_SORTDIRSBYEXT : 0;
+    header->ArchiveSize = size.Value;
+    header->ArchiveLastWrite = lastWrite;
+    header->ValidData = dir.GetValidData();
+    header->SalDirFlags = dir.GetFlags();
+    header->NodesCount = dirs.Count;
+    header->ItemsCount = (DWORD)itemsCount;
+    header->NamesSize = (DWORD)namesSize;
+    header->ArchiveNameOffset = namesPos;
+    strcpy(names + namesPos, archiveFileName);
+    namesPos += (DWORD)strlen(archiveFileName) + 1;
+    header->PluginDLLNameOffset = namesPos;
+    strcpy(names + namesPos, plugin->DLLName);
+    namesPos += (DWORD)strlen(plugin->DLLName) + 1;
+    header->PluginVersionOffset = namesPos;
+    strcpy(names + namesPos, plugin->Version);
+    namesPos += (DWORD)strlen(plugin->Version) + 1;
+
+    // the second pass assigns node numbers in the same order in which the first pass collected them
+    DWORD itemIndex = 0;
+    DWORD nextNode = 1;
+    for (d = 0; d < dirs.Count; d++)
+    {
+        CSalamanderDirectory* salDir = dirs[d];
+        CArcListCacheNode* node = nodes + d;
+        node->FirstItem = itemIndex;
+        node->DirsCount = salDir->Dirs.Count;
+        node->FilesCount = salDir->Files.Count;
+        node->Reserved = 0;
+        int i;
+        for (i = 0; i < salDir->Dirs.Count; i++)
+        {
+            CArcListCacheItem* item = items + itemIndex++;
+            FileDataToItem(salDir->Dirs[i], item, names, namesPos);
+            if (salDir->SalamDirs[i] != NULL)
+                item->SubNode = nextNode++;
+        }
+        for (i = 0; i < salDir->Files.Count; i++)
+            FileDataToItem(salDir->Files[i], items + itemIndex++, names, namesPos);
+    }
+    header->Checksum = UpdateCrc32(data + sizeof(CArcListCacheHeader), (DWORD)totalSize - sizeof(CArcListCacheHeader), 0);
+
+    // write into a temporary file and replace the cache file at once, so another instance
+    // of Salamander never reads a half-written file
+    char tmpName[MAX_PATH + 20];
+    sprintf(tmpName, "%s.%X.tmp", name, GetCurrentProcessId());
+    BOOL ok = FALSE;
+    HANDLE file = HANDLES_Q(CreateFile(tmpName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                       FILE_ATTRIBUTE_NORMAL, NULL));
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        DWORD written;
+        ok = WriteFile(file, data, (DWORD)totalSize, &written, NULL) && written == (DWORD)totalSize;
+        HANDLES(CloseHandle(file));
+        if (ok)
+            ok = MoveFileEx(tmpName, name, MOVEFILE_REPLACE_EXISTING);
+        if (!ok)
+        {
+            DWORD err = GetLastError();
+            TRACE_I("CArchiveListingCache::Store(): unable to write cache file " << name << ": " << GetErrorText(err));
+            DeleteFile(tmpName);
+        }
+    }
+    free(data);
+
+    if (ok)
+        Shrink(name);
+}
+
+// sorts cache files from the least recently used
+static void SortCacheFiles(TIndirectArray<CArcListCacheFileInfo>& files, int left, int right)
+{
+    int i = left, j = right;
+    FILETIME pivot = files[(i + j) / 2]->LastWrite;
+
+    do
+    {
+        while (CompareFileTime(&files[i]->LastWrite, &pivot) < 0 && i < right)
+            i++;
+        while (CompareFileTime(&pivot, &files[j]->LastWrite) < 0 && j > left)
+            j--;
+
+        if (i <= j)
+        {
+            CArcListCacheFileInfo* swap = files[i];
+            files[i] = files[j];
+            files[j] = swap;
+            i++;
+            j--;
+        }
+    } while (i <= j);
+
+    if (left < j)
+        SortCacheFiles(files, left, j);
+    if (i < right)
+        SortCacheFiles(files, i, right);
+}
+
+void CArchiveListingCache::Shrink(const char* keepName)
+{
+    CALL_STACK_MESSAGE2("CArchiveListingCache::Shrink(%s)", keepName);
+
+    const char* dir = GetCacheDir();
+    if (dir == NULL)
+        return;
+    char mask[MAX_PATH];
+    lstrcpyn(mask, dir, MAX_PATH);
+    if (!SalPathAppend(mask, "*", MAX_PATH)) // including the files of plugins (see lstcache.h)
+        return;
+
+    TIndirectArray<CArcListCacheFileInfo> files(50, 100);
+    CQuadWord totalSize(0, 0);
+    WIN32_FIND_DATA data;
+    HANDLE find = HANDLES_Q(FindFirstFile(mask, &data));
+    if (find == INVALID_HANDLE_VALUE)
+        return;
+    do
+    {
+        if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+        {
+            CArcListCacheFileInfo* info = new CArcListCacheFileInfo;
+            if (info == NULL)
+            {
+                TRACE_E(LOW_MEMORY);
+                break;
+            }
+            lstrcpyn(info->Name, dir, MAX_PATH);
+            if (!SalPathAppend(info->Name, data.cFileName, MAX_PATH))
+            {
+                delete info;
+                continue;
+            }
+            info->Size.Set(data.nFileSizeLow, data.nFileSizeHigh);
+            info->LastWrite = data.ftLastWriteTime;
+            files.Add(info);
+            if (!files.IsGood())
+            {
+                files.ResetState();
+                delete info;
+                break;
+            }
+            totalSize += info->Size;
+        }
+    } while (FindNextFile(find, &data));
+    HANDLES(FindClose(find));
+
+    if (totalSize <= ARCLISTCACHE_MAX_SIZE || files.Count == 0)
+        return;
+
+    SortCacheFiles(files, 0, files.Count - 1);
+    int i;
+    for (i = 0; i < files.Count && totalSize > ARCLISTCACHE_MAX_SIZE; i++)
+    {
+        CArcListCacheFileInfo* info = files[i];
+        if (StrICmp(info->Name, keepName) != 0 && DeleteFile(info->Name))
+            totalSize -= info->Size;
+    }
+}
@@ -0,0 +1,99 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+// CommentsTranslationProject: TRANSLATED
+
+#pragma once
+
+//****************************************************************************
+//
+// CArchiveListingCache
+//
+// Persistent cache of archive listings. Listing of some archives is expensive
+// (e.g. the whole .tar.gz must be decompressed), so the resulting CSalamanderDirectory
+// tree is stored into a compact file in "%LOCALAPPDATA%\Open Salamander\Listing Cache"
+// and next time the archive is entered, the tree is rebuilt from the memory-mapped
+// file instead of calling the plugin's ListArchive. Cache files are keyed by the full
+// name of the archive and are valid only while the size and last write time of the
+// archive and the name and version of the plugin match the stored values.
+//
+// Only plugins which called CSalamanderPluginEntryAbstract::SetArchiverCapabilities()
+// with ARCCAP_CACHEABLELISTING use the cache and only listings without plugin data
+// (ListArchive returned NULL 'pluginData') are stored, because CFileData::PluginData
+// is opaque for Salamander and cannot be persisted.
+//
+// Plugins may store their own data belonging to a cached listing into the cache
+// directory (e.g. the TAR plugin saves random access indexes of compressed archives
+// there); all files in the directory count into ARCLISTCACHE_MAX_SIZE.
+//
+
+// (64 MB) max. total size of all files in the cache directory, the least recently
+// used files are removed when the limit is exceeded (the value is documented for plugins
+// at SALAMANDER_LISTINGCACHE_DIR in spl_base.h)
+#define ARCLISTCACHE_MAX_SIZE CQuadWord(67108864, 0)
+// listings obtained faster than this (in ms) are not stored, listing them again is cheap
+#define ARCLISTCACHE_MIN_LISTTIME 500
+// listings with more items are not stored (the cache file would be too big)
+#define ARCLISTCACHE_MAX_ITEMS 1000000
+
+class CSalamanderDirectory;
+struct CPluginData;
+struct CArcListCacheHeader;
+struct CArcListCacheNode;
+struct CArcListCacheItem;
+
+class CArchiveListingCache
+{
+protected:
+    char CacheDir[MAX_PATH]; // path to the cache directory (empty = not available)
+    BOOL CacheDirInitialized;
+
+public:
+    CArchiveListingCache();
+
+    // gets the size and the last write time of the archive 'archiveFileName'; these
+    // identify the archive version for the cache; returns FALSE on error
+    BOOL GetArchiveIdentity(const char* archiveFileName, CQuadWord& size, FILETIME& lastWrite);
+
+    // tries to fill empty 'dir' with the cached listing of archive 'archiveFileName'
+    // ('size' + 'lastWrite' come from GetArchiveIdentity()) obtained from plugin 'plugin';
+    // returns TRUE on success (the listing has no plugin data); returns FALSE if there is
+    // no valid cached listing, 'dir' stays empty in that case
+    BOOL Load(const char* archiveFileName, const CQuadWord& size, const FILETIME& lastWrite,
+              CPluginData* plugin, CSalamanderDirectory& dir);
+
+    // stores listing 'dir' of archive 'archiveFileName' ('size' + 'lastWrite' must be
+    // obtained before the listing was made) obtained from plugin 'plugin' in 'listTime'
+    // milliseconds; listings with plugin data ('pluginData' is not NULL) and fast
+    // listings are not stored; errors are only traced, the cache is just an optimization
+    void Store(const char* archiveFileName, const CQuadWord& size, const FILETIME& lastWrite,
+               CPluginData* plugin, CSalamanderDirectory& dir,
+               CPluginDataInterfaceAbstract* pluginData, DWORD listTime);
+
+protected:
+    // returns the cache directory (creates it if needed), NULL if it is not available
+    const char* GetCacheDir();
+
+    // builds the name of the cache file for archive 'archiveFileName' into 'name'
+    // (buffer of MAX_PATH characters); returns FALSE if the name is too long
+    BOOL GetCacheFileName(const char* archiveFileName, char* name);
+
+    // removes the least recently used cache files until their total size fits
+    // into ARCLISTCACHE_MAX_SIZE; 'keepName' is the just stored file, it is not removed
+    void Shrink(const char* keepName);
+
+    // rebuilds the listing from the mapped cache file into empty 'dir'; returns FALSE
+    // if the data is damaged ('dir' must be cleared by the caller in that case)
+    BOOL BuildListing(const CArcListCacheHeader* header, const CArcListCacheNode* nodes,
+                      const CArcListCacheItem* items, const char* names, CSalamanderDirectory& dir);
+
+    // converts a cached item to 'file' (allocates Name and DosName); returns FALSE if
+    // the item is damaged or on low memory
+    BOOL ItemToFileData(const CArcListCacheItem* item, const char* names, DWORD namesSize,
+                        CFileData& file);
+
+    // converts 'file' to a cached item, names are copied to 'names' from offset 'namesPos'
+    // (which is moved behind them)
+    void FileDataToItem(const CFileData& file, CArcListCacheItem* item, char* names, DWORD& namesPos);
+};
+
+extern CArchiveListingCache ArchiveListingCache;
@@ -22,6 +22,7 @@
 #include "logo.h"
 #include "tasklist.h"
 #include "pwdmngr.h"
+#include "bwsched.h"
 
 //
 // ConfigVersion - version number of the loaded configuration
@@ -449,6 +450,8 @@ const char* CONFIG_IFPATHISINACCESSIBLEGOTOISMYDOCS_REG = "If Path Is Inaccessib
 const char* CONFIG_IFPATHISINACCESSIBLEGOTO_REG = "If Path Is Inaccessible Go To";
 const char* CONFIG_HOTPATH_AUTOCONFIG = "Auto Configurate Hot Paths";
 const char* CONFIG_LASTUSEDSPEEDLIM_REG = "Speed Limit";
+const char* CONFIG_SHAREDSPEEDLIM_REG = "Shared Speed Limit";
+const char* CONFIG_DEVICESPEEDLIMS_REG = "Device Speed Limits";
 const char* CONFIG_QUICKSEARCHENTER_REG = "Quick Search Enter Alt";
 const char* CONFIG_CHD_SHOWMYDOC = "Change Drive Show My Documents";
 const char* CONFIG_CHD_SHOWANOTHER = "Change Drive Show Another";
@@ -1799,6 +1802,10 @@ void CMainWindow::SaveConfig(HWND parent)
                          &Configuration.HotPathAutoConfig, sizeof(DWORD));
                 SetValue(actKey, CONFIG_LASTUSEDSPEEDLIM_REG, REG_DWORD,
                          &Configuration.LastUsedSpeedLimit, sizeof(DWORD));
+                SetValue(actKey, CONFIG_SHAREDSPEEDLIM_REG, REG_DWORD,
+                         &Configuration.SharedSpeedLimit, sizeof(DWORD));
+                SetValue(actKey, CONFIG_DEVICESPEEDLIMS_REG, REG_SZ,
+                         Configuration.DeviceSpeedLimits, -1);
                 SetValue(actKey, CONFIG_QUICKSEARCHENTER_REG, REG_DWORD,
                          &Configuration.QuickSearchEnterAlt, sizeof(DWORD));
                 SetValue(actKey, CONFIG_CHD_SHOWMYDOC, REG_DWORD,
@@ -3313,6 +3320,12 @@ BOOL CMainWindow::LoadConfig(BOOL importingOldConfig, const CCommandLineParams*
                      &Configuration.HotPathAutoConfig, sizeof(DWORD));
             GetValue(actKey, CONFIG_LASTUSEDSPEEDLIM_REG, REG_DWORD,
                      &Configuration.LastUsedSpeedLimit, sizeof(DWORD));
+            GetValue(actKey, CONFIG_SHAREDSPEEDLIM_REG, REG_DWORD,
+                     &Configuration.SharedSpeedLimit, sizeof(DWORD));
+            GetValue(actKey, CONFIG_DEVICESPEEDLIMS_REG, REG_SZ,
+                     Configuration.DeviceSpeedLimits, 2 * MAX_PATH);
+            BandwidthScheduler.SetGlobalLimit(Configuration.SharedSpeedLimit); // running operations use new limits immediately
+            BandwidthScheduler.SetDeviceLimits(Configuration.DeviceSpeedLimits);
             GetValue(actKey, CONFIG_QUICKSEARCHENTER_REG, REG_DWORD,
                      &Configuration.QuickSearchEnterAlt, sizeof(DWORD));
             GetValue(actKey, CONFIG_CHD_SHOWMYDOC, REG_DWORD,
@@ -38,6 +38,7 @@ extern "C"
 #include "worker.h"
 #include "find.h"
 #include "viewer.h"
+#include "bwsched.h"
 
 // critical shutdown: the maximum time we can spend in WM_QUERYENDSESSION (after that,
 // KILL comes from Windows). It is 5s (5s with an open message box, 10s without pumping
@@ -1916,6 +1917,10 @@ MENU_TEMPLATE_ITEM AddToSystemMenu[] =
                     RightPanel->DirectoryLine->Repaint();
             }
 
+            // running Copy/Move operations use the new speed limits from the next transferred block
+            BandwidthScheduler.SetGlobalLimit(Configuration.SharedSpeedLimit);
+            BandwidthScheduler.SetDeviceLimits(Configuration.DeviceSpeedLimits);
+
             // main window icon
             SetWindowIcon();
             // icon in progress windows
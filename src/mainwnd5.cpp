@@ -9,6 +9,7 @@
 #include "mainwnd.h"
 #include "cfgdlg.h"
 #include "dialogs.h"
+#include "cmpcont.h"
 
 void GetFileDateAndTimeFromPanel(DWORD validFileData, CPluginDataInterfaceEncapsulation* pluginData,
                                  const CFileData* f, BOOL isDir, SYSTEMTIME* st, BOOL* validDate,
@@ -257,282 +258,6 @@ int CompareFilesBySize(CFilesWindow* leftPanel, CFileData* l, CFilesWindow* righ
     return 0;
 }
 
-// compares files 'file1' and 'file2' specified by full path by their content
-// on successful comparison, it returns TRUE and sets 'different'
-// variable (TRUE if a difference was found, otherwise FALSE)
-// on error or user abort, returns FALSE and sets 'canceled' variable
-// (TRUE if the user canceled the operation, otherwise FALSE)
-
-#define COMPARE_BUFFER_SIZE (2 * 1024 * 1024) // buffer size for comparison in bytes (does not necessarily need to be fully used)
-#define COMPARE_BLOCK_SIZE (32 * 1024)        // size of a block read continuously from the file; NOTE: COMPARE_BUFFER_SIZE must be divisible by COMPARE_BLOCK_SIZE
-#define COMPARE_BLOCK_GROUP 8                 // how many blocks can be read at once when reading is fast enough (more than 1 MB/s, see COMPARE_BUF_TIME_LIMIT); NOTE: the number of blocks in the buffer (COMPARE_BUFFER_SIZE / COMPARE_BLOCK_SIZE) must be divisible by COMPARE_BLOCK_GROUP
-#define COMPARE_BUF_TIME_LIMIT 2000           // time limit in milliseconds for reading the entire buffer (COMPARE_BUFFER_SIZE) - if met, blocks are read in groups COMPARE_BLOCK_GROUP which speeds up network reading on Vista+ 2-3x; otherwise reading is done block by block (COMPARE_BLOCK_SIZE)
-
-void AddProgressSizeWithLimit(CCmpDirProgressDialog* progressDlg, DWORD read, CQuadWord* fileProgressTotal, const CQuadWord& sizeLimit)
-{
-    if (*fileProgressTotal + CQuadWord(read, 0) > sizeLimit)
-        read = (DWORD)(sizeLimit - *fileProgressTotal).Value;
-    if (read > 0)
-    {
-        progressDlg->AddSize(CQuadWord(read, 0));
-        *fileProgressTotal += CQuadWord(read, 0);
-    }
-}
-
-BOOL CompareFilesByContent(HWND hWindow, CCmpDirProgressDialog* progressDlg,
-                           const char* file1, const char* file2, const CQuadWord& bothFileSize,
-                           BOOL* different, BOOL* canceled)
-{
-    char message[2 * MAX_PATH + 200]; // we need 2*MAX_PATH for the path plus room for an error message
-    BOOL ret = FALSE;
-    *canceled = FALSE;
-
-    //  DWORD totalTi = GetTickCount();
-
-    HANDLE hFile1 = HANDLES_Q(CreateFile(file1, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
-                                         NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL));
-    HANDLE hFile2 = hFile1 != INVALID_HANDLE_VALUE ? HANDLES_Q(CreateFile(file2, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
-                                                                          NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL))
-                                                   : INVALID_HANDLE_VALUE;
-    DWORD err = GetLastError();
-
-    if (!progressDlg->Continue()) // give the dialog a chance to repaint at 100% of the previous file (opening a file is the longest step (3ms) when copying small files (0.1ms))
-        *canceled = TRUE;
-
-    // set texts in the progress dialog
-    progressDlg->SetSource(file1);
-    progressDlg->SetTarget(file2);
-
-    // set the total ('bothFileSize') and current (0%) file progress
-    CQuadWord fileProgressTotal(0, 0);
-    progressDlg->SetFileSize(bothFileSize);
-    progressDlg->SetActualFileSize(CQuadWord(0, 0));
-
-    if (hFile1 != INVALID_HANDLE_VALUE)
-    {
-        if (hFile2 != INVALID_HANDLE_VALUE)
-        {
-            if (!*canceled)
-            {
-                char* buffer1 = (char*)malloc(COMPARE_BUFFER_SIZE);
-                //        char *buffer2 = (char *)malloc(COMPARE_BUFFER_SIZE);
-                char buffer2[COMPARE_BLOCK_GROUP * COMPARE_BLOCK_SIZE];
-
-                DWORD read1;
-                DWORD read2;
-
-                //        DWORD measureStart = GetTickCount();
-                //        unsigned __int64 measuredSize = 0;
-                BOOL readErr = FALSE;
-                BOOL readingIsFast1 = FALSE; // FALSE = wait until speed reaches the limit and we can read in groups (COMPARE_BLOCK_GROUP)
-                BOOL readingIsFast2 = FALSE;
-                while (TRUE)
-                {
-                    DWORD bufSize = COMPARE_BUFFER_SIZE;
-                    int blockCount = bufSize / COMPARE_BLOCK_SIZE; // number of blocks in bufSize
-
-                    // load the next part from 'file1' into 'buffer1'
-                    // read the entire buffer in 32KB blocks from one file (on W2K and XP this is fastest when both files are on one physical disk; on Vista it's only slightly slower than sequential reading)
-                    read1 = 0;
-                    DWORD readBegTime = GetTickCount();
-                    for (int block = 0; block < blockCount;)
-                    {
-                        DWORD locRead;
-                        BOOL canReadGroup = readingIsFast1 && (block % COMPARE_BLOCK_GROUP) == 0 && block + COMPARE_BLOCK_GROUP <= blockCount;
-                        DWORD readBlockSize = canReadGroup ? COMPARE_BLOCK_GROUP * COMPARE_BLOCK_SIZE : COMPARE_BLOCK_SIZE;
-                        if (!ReadFile(hFile1, buffer1 + block * COMPARE_BLOCK_SIZE, readBlockSize, &locRead, NULL))
-                        {
-                            err = GetLastError();
-                            readErr = TRUE;
-                            _snprintf_s(message, _TRUNCATE, LoadStr(IDS_ERROR_READING_FILE), file1, GetErrorText(err));
-                            progressDlg->FlushDataToControls();
-                            if (SalMessageBox(hWindow, message, LoadStr(IDS_ERRORTITLE),
-                                              MB_OKCANCEL | MB_ICONEXCLAMATION) == IDCANCEL)
-                            {
-                                *canceled = TRUE;
-                            }
-                            break;
-                        }
-
-                        AddProgressSizeWithLimit(progressDlg, locRead, &fileProgressTotal, bothFileSize);
-                        if (!progressDlg->Continue()) // give the dialog a chance to repaint
-                        {
-                            *canceled = TRUE;
-                            break;
-                        }
-
-                        read1 += locRead;
-                        if (locRead != readBlockSize)
-                            break; // EOF
-                        if (GetTickCount() - readBegTime > 200)
-                        { // slow reading (probably a slow network disk (VPN) or floppy) - reduce the buffer, at worst we'll compare block by block
-                            blockCount = block + (canReadGroup ? COMPARE_BLOCK_GROUP : 1);
-                            bufSize = blockCount * COMPARE_BLOCK_SIZE;
-                            break;
-                        }
-                        block += canReadGroup ? COMPARE_BLOCK_GROUP : 1;
-                    }
-                    if (readErr || *canceled)
-                        break;
-                    readingIsFast1 = WindowsVistaAndLater &&                                                                                           // on W2K/XP this should not speed things up, so we will not tempt fate
-                                     GetTickCount() - readBegTime < (DWORD)(((unsigned __int64)read1 * COMPARE_BUF_TIME_LIMIT) / COMPARE_BUFFER_SIZE); // measure the speed so it is over 1 MB/s
-                                                                                                                                                       /*
-          // read the entire buffer at once from one file (on Vista, when both files are on the same physical disk and the buffer is large, this is slightly faster than reading in 32KB blocks)
-          if (!ReadFile(hFile1, buffer1, bufSize, &read1, NULL))
-          {
-            err = GetLastError();
-            sprintf(message, LoadStr(IDS_ERROR_READING_FILE), file1, GetErrorText(err));
-            progressDlg->FlushDataToControls();
-            if (SalMessageBox(hWindow, message, LoadStr(IDS_ERRORTITLE),
-                              MB_OKCANCEL | MB_ICONEXCLAMATION) == IDCANCEL)
-            {
-              *canceled = TRUE;
-            }
-            break;
-          }
-*/
-
-                    // load the next part from 'file2' into 'buffer2'
-                    // read the whole buffer in blocks from one file (on W2K and XP this is fastest when both files are on one physical disk; on Vista it's only slightly slower than sequential reading)
-                    read2 = 0;
-                    readBegTime = GetTickCount();
-                    for (int block = 0; block < blockCount;)
-                    {
-                        DWORD locRead;
-                        BOOL canReadGroup = readingIsFast2 && (block % COMPARE_BLOCK_GROUP) == 0 && block + COMPARE_BLOCK_GROUP <= blockCount;
-                        DWORD readBlockSize = canReadGroup ? COMPARE_BLOCK_GROUP * COMPARE_BLOCK_SIZE : COMPARE_BLOCK_SIZE;
-                        if (!ReadFile(hFile2, buffer2, readBlockSize, &locRead, NULL))
-                        {
-                            err = GetLastError();
-                            readErr = TRUE;
-                            _snprintf_s(message, _TRUNCATE, LoadStr(IDS_ERROR_READING_FILE), file2, GetErrorText(err));
-                            progressDlg->FlushDataToControls();
-                            if (SalMessageBox(hWindow, message, LoadStr(IDS_ERRORTITLE),
-                                              MB_OKCANCEL | MB_ICONEXCLAMATION) == IDCANCEL)
-                            {
-                                *canceled = TRUE;
-                            }
-                            break;
-                        }
-
-                        AddProgressSizeWithLimit(progressDlg, locRead, &fileProgressTotal, bothFileSize);
-                        if (!progressDlg->Continue()) // give the dialog a chance to repaint
-                        {
-                            *canceled = TRUE;
-                            break;
-                        }
-
-                        read2 += locRead;
-                        if (read1 < read2 || // files are now of different length => content differs
-                            locRead > 0 && memcmp(buffer1 + block * COMPARE_BLOCK_SIZE, buffer2, locRead) != 0)
-                        { // file contents differ, no point in continuing reading
-                            *different = TRUE;
-                            ret = TRUE;
-                            break;
-                        }
-                        if (locRead != readBlockSize)
-                        { // unable to read the entire buffer (EOF), files are identical
-                            *different = FALSE;
-                            ret = TRUE;
-                            break;
-                        }
-                        block += canReadGroup ? COMPARE_BLOCK_GROUP : 1;
-                        if (readingIsFast2 &&
-                            GetTickCount() - readBegTime > (DWORD)(((unsigned __int64)read2 * COMPARE_BUF_TIME_LIMIT) / COMPARE_BUFFER_SIZE))
-                        {
-                            // detecting slowdown, continue block by block to keep progress smooth and allow canceling
-                            readingIsFast2 = FALSE;
-                        }
-                    }
-                    if (readErr || ret || *canceled)
-                        break;
-                    readingIsFast2 = WindowsVistaAndLater &&                                                                                           // on W2K/XP this should not speed things up, so we will not tempt fate
-                                     GetTickCount() - readBegTime < (DWORD)(((unsigned __int64)read2 * COMPARE_BUF_TIME_LIMIT) / COMPARE_BUFFER_SIZE); // measure the speed so it is over 1 MB/s
-                                                                                                                                                       /*
-          // read the entire buffer at once from one file (on Vista, when both files are on the same physical disk and the buffer is large, this is slightly faster than reading in 32KB blocks)
-          if (!ReadFile(hFile2, buffer2, bufSize, &read2, NULL))
-          {
-            err = GetLastError();
-            sprintf(message, LoadStr(IDS_ERROR_READING_FILE), file2, GetErrorText(err));
-            progressDlg->FlushDataToControls();
-            if (SalMessageBox(hWindow, message, LoadStr(IDS_ERRORTITLE),
-                              MB_OKCANCEL | MB_ICONEXCLAMATION) == IDCANCEL)
-            {
-              *canceled = TRUE;
-            }
-            break;
-          }
-*/
-                                                                                                                                                       /*
-          // these tests are performed above when reading in blocks
-          AddProgressSizeWithLimit(progressDlg, read1 + read2, &fileProgressTotal, bothFileSize);
-          if (!progressDlg->Continue()) // give the dialog a chance to repaint
-          {
-            *canceled = TRUE;
-            break;
-          }
-
-          if (read1 != read2 ||  // files are now of different length => content differs
-              read1 > 0 && memcmp(buffer1, buffer2, read1) != 0)
-          {  // file contents differ, no point in continuing reading
-            *different = TRUE;
-            ret = TRUE;
-            break;
-          }
-          if (read1 != bufSize)
-          { // unable to read the entire buffer, files are identical
-            *different = FALSE;
-            ret = TRUE;
-            break;
-          }
-*/
-                                                                                                                                                       /*
-          measuredSize += bufSize;
-          DWORD ti = GetTickCount() - measureStart;
-          if (ti >= 500)
-          {
-            unsigned __int64 speed = (measuredSize * 1000) / ti;
-            TRACE_I("speed: " << (DWORD)(speed / 1024));
-            measureStart = GetTickCount();
-            measuredSize = 0;
-          }
-*/
-                }
-                free(buffer1);
-                //        free(buffer2);
-            }
-            HANDLES(CloseHandle(hFile2));
-        }
-        else
-        {
-            _snprintf_s(message, _TRUNCATE, LoadStr(IDS_ERROR_OPENING_FILE), file2, GetErrorText(err));
-            progressDlg->FlushDataToControls();
-            if (SalMessageBox(hWindow, message, LoadStr(IDS_ERRORTITLE),
-                              MB_OKCANCEL | MB_ICONEXCLAMATION) == IDCANCEL)
-            {
-                *canceled = TRUE;
-            }
-        }
-        HANDLES(CloseHandle(hFile1));
-    }
-    else
-    {
-        _snprintf_s(message, _TRUNCATE, LoadStr(IDS_ERROR_OPENING_FILE), file1, GetErrorText(err));
-        progressDlg->FlushDataToControls();
-        if (SalMessageBox(hWindow, message, LoadStr(IDS_ERRORTITLE),
-                          MB_OKCANCEL | MB_ICONEXCLAMATION) == IDCANCEL)
-        {
-            *canceled = TRUE;
-        }
-    }
-    if (!*canceled) // we must advance the total progress to the end of the file
-        progressDlg->AddSize(bothFileSize - fileProgressTotal);
-
-    //  TRACE_I("CompareFilesByContent(): total time (in secs): " << ((GetTickCount() - totalTi) / 1000));
-
-    return ret;
-}
-
 // loads directories and files into the arrays 'dirs' and 'files'
 // the source path is determined by combining the path in the 'panel' with 'subPath'
 // 'hWindow' is the window for displaying message boxes
@@ -777,6 +502,8 @@ BOOL ReadDirsAndFilesAux(HWND hWindow, DWORD flags, CCmpDirProgressDialog* progr
 // if the directories differ, otherwise FALSE).
 // on error or user abort it returns FALSE
 // and sets the variable 'canceled' (TRUE if aborted by the user, otherwise FALSE)
+// 'comparer' compares files by content (used only with COMPARE_DIRECTORIES_BYCONTENT),
+// it must not contain any pairs
 
 // supports ptDisk and ptZIPArchive
 
@@ -784,7 +511,8 @@ BOOL CompareDirsAux(HWND hWindow, CCmpDirProgressDialog* progressDlg,
                     CFilesWindow* leftPanel, const char* leftSubDir, BOOL leftFAT,
                     CFilesWindow* rightPanel, const char* rightSubDir, BOOL rightFAT,
                     DWORD flags, BOOL* different, BOOL* canceled,
-                    BOOL getTotal, CQuadWord* total, int* foundDSTShifts)
+                    BOOL getTotal, CQuadWord* total, int* foundDSTShifts,
+                    CContentComparer* comparer)
 {
     // left/rightPanel and left/rightSubDir specify the path
     // whose directories and files are stored in the arrays below
@@ -1004,20 +732,19 @@ BOOL CompareDirsAux(HWND hWindow, CCmpDirProgressDialog* progressDlg,
 
                             if (!pathAppended)
                             {
+                                comparer->ClearPairs();
                                 SalMessageBox(hWindow, LoadStr(IDS_TOOLONGNAME), LoadStr(IDS_COMPAREDIRSTITLE), MB_OK | MB_ICONEXCLAMATION);
                                 *canceled = TRUE;
                                 return FALSE;
                             }
 
-                            if (!CompareFilesByContent(hWindow, progressDlg, leftFilePath, rightFilePath,
-                                                       leftFile->Size + rightFile->Size, different, canceled))
+                            if (!comparer->AddPair(leftFilePath, rightFilePath, leftFile->Size,
+                                                   leftFile->LastWrite, rightFile->LastWrite))
                             {
+                                comparer->ClearPairs();
+                                *canceled = TRUE; // low memory
                                 return FALSE;
                             }
-
-                            // found two different files, stop
-                            if (*different)
-                                return TRUE;
                         }
                         else
                             *total += leftFile->Size + rightFile->Size;
@@ -1026,10 +753,34 @@ BOOL CompareDirsAux(HWND hWindow, CCmpDirProgressDialog* progressDlg,
                 else
                 {
                     // files have different length, they differ in content
+                    comparer->ClearPairs();
                     *different = TRUE;
                     return TRUE;
                 }
             }
+
+            // compare the collected pairs (in parallel if the disks allow it)
+            if (comparer->GetPairsCount() > 0)
+            {
+                BOOL ret = comparer->CompareAll(hWindow, progressDlg, TRUE, canceled);
+                if (ret)
+                {
+                    for (i = 0; i < comparer->GetPairsCount(); i++)
+                    {
+                        BOOL pairDifferent;
+                        if (comparer->GetResult(i, &pairDifferent) && pairDifferent)
+                        {
+                            *different = TRUE; // found two different files, stop
+                            break;
+                        }
+                    }
+                }
+                comparer->ClearPairs();
+                if (!ret)
+                    return FALSE;
+                if (*different)
+                    return TRUE;
+            }
         }
 
         // no difference found
@@ -1062,7 +813,7 @@ BOOL CompareDirsAux(HWND hWindow, CCmpDirProgressDialog* progressDlg,
                             leftPanel, newLeftSubDir, leftFAT,
                             rightPanel, newRightSubDir, rightFAT,
                             flags, different, canceled, getTotal,
-                            total, &foundDSTShiftsInSubDir))
+                            total, &foundDSTShiftsInSubDir, comparer))
         {
             return FALSE;
         }
@@ -1137,6 +888,39 @@ void SkipIgnoredNames(BOOL ignoreNames, CMaskGroup* ignoreNamesMasks, BOOL dirs,
     }
 }
 
+// results of comparing a pair of files with the same name in CMainWindow::CompareDirectories()
+struct CCmpDirsFileMarks
+{
+    CFileData* LeftFile;
+    CFileData* RightFile;
+    BOOL SelectLeft;
+    BOOL SelectRight;
+    BOOL LeftIsNewer;
+    BOOL RightIsNewer;
+    BOOL LeftIsNewerNoDSTShiftIgn;
+    BOOL RightIsNewerNoDSTShiftIgn;
+    int IsDSTShift; // 1 = times of the pair differ by exactly one or two hours, 0 = they don't (or times are not compared at all)
+};
+
+// marks files of the pair according to 'marks', clears 'identical' if some file is marked
+// and counts DST time shifts to 'foundDSTShifts'
+void MarkComparedFiles(const CCmpDirsFileMarks& marks, BOOL* identical, int* foundDSTShifts)
+{
+    if (marks.LeftIsNewerNoDSTShiftIgn && !marks.SelectLeft || marks.RightIsNewerNoDSTShiftIgn && !marks.SelectRight)
+        *foundDSTShifts += marks.IsDSTShift; // count only time differences of files that are not already marked for another reason (e.g., due to a difference by another criterion) -- motivation: if we don't need to show a complex DST warning, don't show it
+
+    if (marks.SelectLeft || marks.LeftIsNewer)
+    {
+        marks.LeftFile->Selected = 1;
+        *identical = FALSE;
+    }
+    if (marks.SelectRight || marks.RightIsNewer)
+    {
+        marks.RightFile->Selected = 1;
+        *identical = FALSE;
+    }
+}
+
 void CMainWindow::CompareDirectories(DWORD flags)
 {
     CALL_STACK_MESSAGE2("CMainWindow::CompareDirectories(%u)", flags);
@@ -1215,7 +999,17 @@ void CMainWindow::CompareDirectories(DWORD flags)
     CFilesArray* rightFiles = GetShallowCopy(RightPanel->Files);
     CFilesArray* rightDirs = GetShallowCopy(RightPanel->Dirs);
 
-    if (leftFiles != NULL && leftDirs != NULL && rightFiles != NULL && rightDirs != NULL)
+    // compares files by content (in several threads if both disks allow it)
+    CContentComparer* comparer = NULL;
+    if (flags & COMPARE_DIRECTORIES_BYCONTENT)
+    {
+        comparer = new CContentComparer(LeftPanel->GetPath(), RightPanel->GetPath());
+        if (comparer == NULL)
+            TRACE_E(LOW_MEMORY);
+    }
+
+    if (leftFiles != NULL && leftDirs != NULL && rightFiles != NULL && rightDirs != NULL &&
+        (comparer != NULL || (flags & COMPARE_DIRECTORIES_BYCONTENT) == 0))
     {
         // shallow copies were created successfully
         //--- determine FAT file system because of lastWrite accuracy
@@ -1257,6 +1051,10 @@ void CMainWindow::CompareDirectories(DWORD flags)
         TDirectArray<CQuadWord> dirSubTotal(max(1, min(leftDirs->Count, rightDirs->Count)), 1);
         int subTotalIndex; // index into the dirSubTotal array
 
+        // marks of the pairs of files waiting for the comparison by content in 'comparer'
+        // (the same indexes as the pairs in 'comparer')
+        TDirectArray<CCmpDirsFileMarks> pairMarks(100, 1000);
+
     ONCE_MORE:
         // first the files from the left and right directory
         CFilesArray *left = leftFiles, *right = rightFiles;
@@ -1301,22 +1099,20 @@ void CMainWindow::CompareDirectories(DWORD flags)
                         }
                         else // left == right
                         {
-                            BOOL selectLeft = FALSE;
-                            BOOL selectRight = FALSE;
-                            BOOL leftIsNewer = FALSE;
-                            BOOL rightIsNewer = FALSE;
-                            BOOL leftIsNewerNoDSTShiftIgn = FALSE;
-                            BOOL rightIsNewerNoDSTShiftIgn = FALSE;
-                            int isDSTShift = 0; // 1 = times of the currently compared file pair differ by exactly one or two hours, 0 = they don't (or times are not compared at all)
+                            CCmpDirsFileMarks marks;
+                            memset(&marks, 0, sizeof(marks));
+                            marks.LeftFile = leftFile;
+                            marks.RightFile = rightFile;
+                            BOOL comparedLater = FALSE; // TRUE = the pair is compared by content later, the files are marked after that
 
                             // By Size
                             if (flags & COMPARE_DIRECTORIES_BYSIZE)
                             {
                                 compRes = CompareFilesBySize(LeftPanel, leftFile, RightPanel, rightFile);
                                 if (compRes == 1)
-                                    selectLeft = TRUE;
+                                    marks.SelectLeft = TRUE;
                                 if (compRes == -1)
-                                    selectRight = TRUE;
+                                    marks.SelectRight = TRUE;
                             }
 
                             // By Time
@@ -1324,15 +1120,15 @@ void CMainWindow::CompareDirectories(DWORD flags)
                             {
                                 int compResNoDSTShiftIgn;
                                 compRes = CompareFilesByTime(LeftPanel, leftFile, leftFAT, RightPanel,
-                                                             rightFile, rightFAT, &isDSTShift, &compResNoDSTShiftIgn);
+                                                             rightFile, rightFAT, &marks.IsDSTShift, &compResNoDSTShiftIgn);
                                 if (compRes == 1)
-                                    leftIsNewer = TRUE;
+                                    marks.LeftIsNewer = TRUE;
                                 if (compRes == -1)
-                                    rightIsNewer = TRUE;
+                                    marks.RightIsNewer = TRUE;
                                 if (compResNoDSTShiftIgn == 1)
-                                    leftIsNewerNoDSTShiftIgn = TRUE;
+                                    marks.LeftIsNewerNoDSTShiftIgn = TRUE;
                                 if (compResNoDSTShiftIgn == -1)
-                                    rightIsNewerNoDSTShiftIgn = TRUE;
+                                    marks.RightIsNewerNoDSTShiftIgn = TRUE;
                             }
 
                             // By Attributes
@@ -1343,8 +1139,8 @@ void CMainWindow::CompareDirectories(DWORD flags)
                                 {
                                     if ((leftFile->Attr & DISPLAYED_ATTRIBUTES) != (rightFile->Attr & DISPLAYED_ATTRIBUTES))
                                     {
-                                        selectLeft = TRUE;
-                                        selectRight = TRUE;
+                                        marks.SelectLeft = TRUE;
+                                        marks.SelectRight = TRUE;
                                     }
                                 }
                             }
@@ -1354,7 +1150,7 @@ void CMainWindow::CompareDirectories(DWORD flags)
                             {
                                 if (leftFile->Size == rightFile->Size) // size test is intentionally not covered by the following optimization so both files are marked and unnecessary DST warnings don't pop up
                                 {
-                                    if (!selectLeft && !leftIsNewer || !selectRight && !rightIsNewer) // if both files are already flagged, there is no point in comparing them by content
+                                    if (!marks.SelectLeft && !marks.LeftIsNewer || !marks.SelectRight && !marks.RightIsNewer) // if both files are already flagged, there is no point in comparing them by content
                                     {
                                         // if both files are zero length, they must be identical in content
                                         if (leftFile->Size != CQuadWord(0, 0))
@@ -1375,26 +1171,23 @@ void CMainWindow::CompareDirectories(DWORD flags)
                                                     goto ABORT_COMPARE;
                                                 }
 
-                                                BOOL different;
-
-                                                BOOL ret = CompareFilesByContent(progressDlg.HWindow, &progressDlg, leftFilePath,
-                                                                                 rightFilePath, leftFile->Size + rightFile->Size,
-                                                                                 &different, &canceled);
-                                                if (ret)
+                                                // the pair is compared later together with the other pairs, the files
+                                                // are marked after the comparison
+                                                if (!comparer->AddPair(leftFilePath, rightFilePath, leftFile->Size,
+                                                                       leftFile->LastWrite, rightFile->LastWrite))
                                                 {
-                                                    if (different)
-                                                    {
-                                                        selectLeft = TRUE;
-                                                        selectRight = TRUE;
-                                                    }
+                                                    canceled = TRUE; // low memory
+                                                    goto ABORT_COMPARE;
                                                 }
-                                                else
+                                                pairMarks.Add(marks);
+                                                if (!pairMarks.IsGood())
                                                 {
-                                                    if (canceled)
-                                                        goto ABORT_COMPARE;
-                                                    selectLeft = TRUE; // on read error mark the pair as if it had different content (it might)
-                                                    selectRight = TRUE;
+                                                    pairMarks.ResetState();
+                                                    TRACE_E(LOW_MEMORY);
+                                                    canceled = TRUE;
+                                                    goto ABORT_COMPARE;
                                                 }
+                                                comparedLater = TRUE;
                                             }
                                             else
                                                 total += leftFile->Size + rightFile->Size;
@@ -1404,27 +1197,13 @@ void CMainWindow::CompareDirectories(DWORD flags)
                                 else
                                 {
                                     // files have different length, so they must differ in content
-                                    selectLeft = TRUE;
-                                    selectRight = TRUE;
+                                    marks.SelectLeft = TRUE;
+                                    marks.SelectRight = TRUE;
                                 }
                             }
 
-                            if (!getTotal)
-                            {
-                                if (leftIsNewerNoDSTShiftIgn && !selectLeft || rightIsNewerNoDSTShiftIgn && !selectRight)
-                                    foundDSTShifts += isDSTShift; // count only time differences of files that are not already marked for another reason (e.g., due to a difference by another criterion) -- motivation: if we don't need to show a complex DST warning, don't show it
-
-                                if (selectLeft || leftIsNewer)
-                                {
-                                    leftFile->Selected = 1;
-                                    identical = FALSE;
-                                }
-                                if (selectRight || rightIsNewer)
-                                {
-                                    rightFile->Selected = 1;
-                                    identical = FALSE;
-                                }
-                            }
+                            if (!getTotal && !comparedLater)
+                                MarkComparedFiles(marks, &identical, &foundDSTShifts);
                             if (++l < left->Count)
                                 leftFile = &left->At(l);
                             if (++r < right->Count)
@@ -1458,6 +1237,27 @@ void CMainWindow::CompareDirectories(DWORD flags)
             }
         }
 
+        // compare the collected pairs of files by content and mark them
+        if (!getTotal && comparer != NULL && comparer->GetPairsCount() > 0)
+        {
+            comparer->CompareAll(progressDlg.HWindow, &progressDlg, FALSE, &canceled);
+            if (canceled)
+                goto ABORT_COMPARE;
+            int i;
+            for (i = 0; i < pairMarks.Count; i++)
+            {
+                BOOL different;
+                if (!comparer->GetResult(i, &different) || different) // on read error mark the pair as if it had different content (it might)
+                {
+                    pairMarks[i].SelectLeft = TRUE;
+                    pairMarks[i].SelectRight = TRUE;
+                }
+                MarkComparedFiles(pairMarks[i], &identical, &foundDSTShifts);
+            }
+            comparer->ClearPairs();
+            pairMarks.DestroyMembers();
+        }
+
         // Sal2.0 and TC compare without directories in such a way that they even ignore their names
         // people kept pointing this out to us, so we'll behave the same (with
         // COMPARE_DIRECTORIES_ONEPANELDIRS disabled)
@@ -1592,7 +1392,7 @@ void CMainWindow::CompareDirectories(DWORD flags)
                                                               LeftPanel, leftSubDir, leftFAT,
                                                               RightPanel, rightSubDir, rightFAT,
                                                               flags, &different, &canceled,
-                                                              getTotal, &subTotal, &foundDSTShiftsInSubDir);
+                                                              getTotal, &subTotal, &foundDSTShiftsInSubDir, comparer);
                                     if (ret)
                                     {
                                         if (different)
@@ -1741,6 +1541,8 @@ void CMainWindow::CompareDirectories(DWORD flags)
         delete rightFiles;
     if (rightDirs != NULL)
         delete rightDirs;
+    if (comparer != NULL)
+        delete comparer;
 
     //--- mark the appropriate files
     LeftPanel->RepaintListBox(DRAWFLAG_DIRTY_ONLY | DRAWFLAG_SKIP_VISTEST);
@@ -11,6 +11,7 @@
 #include "fileswnd.h"
 #include "zip.h"
 #include "pack.h"
+#include "lstcache.h"
 
 //
 // ****************************************************************************
@@ -606,7 +607,23 @@ BOOL PackList(CFilesWindow* panel, const char* archiveFileName, CSalamanderDirec
         {
             return (*PackErrorHandlerPtr)(NULL, IDS_PACKERR_ARCNAME_UNSUP);
         }
-        return plugin->ListArchive(panel, archiveFileName, dir, pluginData);
+
+        // the plugin must be loaded to know whether it allows caching of its listings
+        CQuadWord arcSize;
+        FILETIME arcLastWrite;
+        BOOL useCache = plugin->InitDLL(MainWindow->HWindow) && plugin->ArcListingCacheable &&
+                        ArchiveListingCache.GetArchiveIdentity(archiveFileName, arcSize, arcLastWrite);
+        if (useCache && ArchiveListingCache.Load(archiveFileName, arcSize, arcLastWrite, plugin, dir))
+            return TRUE; // listing without plugin data was restored from the cache
+
+        DWORD listStart = GetTickCount();
+        BOOL ret = plugin->ListArchive(panel, archiveFileName, dir, pluginData);
+        if (ret && useCache)
+        {
+            ArchiveListingCache.Store(archiveFileName, arcSize, arcLastWrite, plugin, dir, pluginData,
+                                      GetTickCount() - listStart);
+        }
+        return ret;
     }
 
     // if we have not determined the spawn path yet, do it now
@@ -2441,6 +2441,7 @@ public:
 
     BOOL PluginIsNethood;           // TRUE = plugin je nahrada za Network polozku z Change Drive menu (pridano pro plugin Nethood)
     BOOL PluginUsesPasswordManager; // TRUE = plugin pouziva Password Manager
+    BOOL ArcListingCacheable;       // TRUE = listing archivu lze ukladat do ArchiveListingCache (viz ARCCAP_CACHEABLELISTING)
 
     int IconOverlaysCount; // pocet trojic icon-overlays v poli IconOverlays
     HICON* IconOverlays;   // alokovane pole icon-overlays, pocet prvku = 3 * IconOverlaysCount (velikosti: 16 + 32 + 48)
@@ -3271,6 +3272,8 @@ public:
     virtual void WINAPI SetPluginHomePageURL(const char* url);
 
     virtual BOOL WINAPI AddFSName(const char* fsName, int* newFSNameIndex);
+
+    virtual void WINAPI SetArchiverCapabilities(DWORD capabilities);
 };
 
 //
@@ -0,0 +1,318 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+#include "blake3.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// The algorithm follows the BLAKE3 specification and its reference implementation
+// (https://github.com/BLAKE3-team/BLAKE3, CC0 1.0 / Apache License 2.0).
+
+#if defined(_M_IX86) || defined(_M_X64)
+static BOOL Blake3UseSSE2 = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+#endif
+
+// domain separation flags
+#define CHUNK_START 1
+#define CHUNK_END 2
+#define PARENT 4
+#define ROOT 8
+
+static const DWORD Blake3IV[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                                  0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+
+// message words used by the rounds (the message permutation applied 0 - 6 times)
+static const BYTE Blake3Schedule[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+static inline DWORD Rotr32(DWORD x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+#define G(a, b, c, d, x, y) \
+    { \
+        v[a] += v[b] + (x); \
+        v[d] = Rotr32(v[d] ^ v[a], 16); \
+        v[c] += v[d]; \
+        v[b] = Rotr32(v[b] ^ v[c], 12); \
+        v[a] += v[b] + (y); \
+        v[d] = Rotr32(v[d] ^ v[a], 8); \
+        v[c] += v[d]; \
+        v[b] = Rotr32(v[b] ^ v[c], 7); \
+    }
+
+// compresses 'block' into chaining value 'cv' (only the first half of the output
+// is calculated, the longer output is not needed)
+static void Compress(DWORD* cv, const BYTE* block, UINT64 counter, DWORD blockLen, DWORD flags)
+{
+    DWORD m[16];
+    memcpy(m, block, sizeof(m)); // all supported platforms are little endian
+    DWORD v[16] = {cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+                   Blake3IV[0], Blake3IV[1], Blake3IV[2], Blake3IV[3],
+                   (DWORD)counter, (DWORD)(counter >> 32), blockLen, flags};
+    int r;
+    for (r = 0; r < 7; r++)
+    {
+        const BYTE* s = Blake3Schedule[r];
+        G(0, 4, 8, 12, m[s[0]], m[s[1]]);
+        G(1, 5, 9, 13, m[s[2]], m[s[3]]);
+        G(2, 6, 10, 14, m[s[4]], m[s[5]]);
+        G(3, 7, 11, 15, m[s[6]], m[s[7]]);
+        G(0, 5, 10, 15, m[s[8]], m[s[9]]);
+        G(1, 6, 11, 12, m[s[10]], m[s[11]]);
+        G(2, 7, 8, 13, m[s[12]], m[s[13]]);
+        G(3, 4, 9, 14, m[s[14]], m[s[15]]);
+    }
+    int i;
+    for (i = 0; i < 8; i++)
+        cv[i] = v[i] ^ v[i + 8];
+}
+
+#undef G
+
+static void HashChunk(const BYTE* chunk, UINT64 counter, DWORD* cv)
+{
+    memcpy(cv, Blake3IV, sizeof(Blake3IV));
+    int i;
+    for (i = 0; i < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; i++)
+    {
+        DWORD flags = (i == 0 ? CHUNK_START : 0) | (i == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1 ? CHUNK_END : 0);
+        Compress(cv, chunk + i * BLAKE3_BLOCK_LEN, counter, BLAKE3_BLOCK_LEN, flags);
+    }
+}
+
+#if defined(_M_IX86) || defined(_M_X64)
+
+#define ROTR16(x) _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xB1), 0xB1)
+#define ROTR(x, n) _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - (n)))
+
+#define G(a, b, c, d, x, y) \
+    { \
+        v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), x); \
+        v[d] = ROTR16(_mm_xor_si128(v[d], v[a])); \
+        v[c] = _mm_add_epi32(v[c], v[d]); \
+        v[b] = ROTR(_mm_xor_si128(v[b], v[c]), 12); \
+        v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), y); \
+        v[d] = ROTR(_mm_xor_si128(v[d], v[a]), 8); \
+        v[c] = _mm_add_epi32(v[c], v[d]); \
+        v[b] = ROTR(_mm_xor_si128(v[b], v[c]), 7); \
+    }
+
+// transposes 4x4 matrix of 32-bit words in 'r0' - 'r3'
+static inline void Transpose4(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+{
+    __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+    __m128i t1 = _mm_unpackhi_epi32(r0, r1);
+    __m128i t2 = _mm_unpacklo_epi32(r2, r3);
+    __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+    r0 = _mm_unpacklo_epi64(t0, t2);
+    r1 = _mm_unpackhi_epi64(t0, t2);
+    r2 = _mm_unpacklo_epi64(t1, t3);
+    r3 = _mm_unpackhi_epi64(t1, t3);
+}
+
+// hashes four consecutive chunks at once, every 32-bit lane of the vectors belongs
+// to one of the chunks
+static void HashChunks4SSE2(const BYTE* input, UINT64 counter, DWORD (*cvs)[8])
+{
+    __m128i h[8];
+    int i;
+    for (i = 0; i < 8; i++)
+        h[i] = _mm_set1_epi32((int)Blake3IV[i]);
+    __m128i counterLo = _mm_setr_epi32((int)counter, (int)(counter + 1), (int)(counter + 2), (int)(counter + 3));
+    __m128i counterHi = _mm_setr_epi32((int)(counter >> 32), (int)((counter + 1) >> 32),
+                                       (int)((counter + 2) >> 32), (int)((counter + 3) >> 32));
+    int b;
+    for (b = 0; b < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; b++)
+    {
+        __m128i m[16];
+        for (i = 0; i < 4; i++)
+        {
+            const BYTE* block = input + b * BLAKE3_BLOCK_LEN + i * 16;
+            m[4 * i] = _mm_loadu_si128((const __m128i*)block);
+            m[4 * i + 1] = _mm_loadu_si128((const __m128i*)(block + BLAKE3_CHUNK_LEN));
+            m[4 * i + 2] = _mm_loadu_si128((const __m128i*)(block + 2 * BLAKE3_CHUNK_LEN));
+            m[4 * i + 3] = _mm_loadu_si128((const __m128i*)(block + 3 * BLAKE3_CHUNK_LEN));
+            Transpose4(m[4 * i], m[4 * i + 1], m[4 * i + 2], m[4 * i + 3]);
+        }
+        DWORD flags = (b == 0 ? CHUNK_START : 0) | (b == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1 ? CHUNK_END : 0);
+        __m128i v[16] = {h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7],
+                         _mm_set1_epi32((int)Blake3IV[0]), _mm_set1_epi32((int)Blake3IV[1]),
+                         _mm_set1_epi32((int)Blake3IV[2]), _mm_set1_epi32((int)Blake3IV[3]),
+                         counterLo, counterHi, _mm_set1_epi32(BLAKE3_BLOCK_LEN), _mm_set1_epi32((int)flags)};
+        int r;
+        for (r = 0; r < 7; r++)
+        {
+            const BYTE* s = Blake3Schedule[r];
+            G(0, 4, 8, 12, m[s[0]], m[s[1]]);
+            G(1, 5, 9, 13, m[s[2]], m[s[3]]);
+            G(2, 6, 10, 14, m[s[4]], m[s[5]]);
+            G(3, 7, 11, 15, m[s[6]], m[s[7]]);
+            G(0, 5, 10, 15, m[s[8]], m[s[9]]);
+            G(1, 6, 11, 12, m[s[10]], m[s[11]]);
+            G(2, 7, 8, 13, m[s[12]], m[s[13]]);
+            G(3, 4, 9, 14, m[s[14]], m[s[15]]);
+        }
+        for (i = 0; i < 8; i++)
+            h[i] = _mm_xor_si128(v[i], v[i + 8]);
+    }
+    Transpose4(h[0], h[1], h[2], h[3]);
+    Transpose4(h[4], h[5], h[6], h[7]);
+    for (i = 0; i < 4; i++)
+    {
+        _mm_storeu_si128((__m128i*)cvs[i], h[i]);
+        _mm_storeu_si128((__m128i*)(cvs[i] + 4), h[i + 4]);
+    }
+}
+
+#undef G
+#undef ROTR
+#undef ROTR16
+
+#endif // defined(_M_IX86) || defined(_M_X64)
+
+void Blake3HashChunks(const BYTE* input, size_t count, UINT64 counter, DWORD (*cvs)[8])
+{
+#if defined(_M_IX86) || defined(_M_X64)
+    if (Blake3UseSSE2)
+    {
+        for (; count >= 4; count -= 4, input += 4 * BLAKE3_CHUNK_LEN, counter += 4, cvs += 4)
+            HashChunks4SSE2(input, counter, cvs);
+    }
+#endif
+    for (; count > 0; count--, input += BLAKE3_CHUNK_LEN, counter++, cvs++)
+        HashChunk(input, counter, *cvs);
+}
+
+// ****************************************************************************
+//
+// CBlake3Hasher
+//
+
+void CBlake3Hasher::Init()
+{
+    memcpy(ChunkCV, Blake3IV, sizeof(Blake3IV));
+    ChunkCounter = 0;
+    BlockLen = 0;
+    BlocksCompressed = 0;
+    StackLen = 0;
+}
+
+void CBlake3Hasher::HashChunks(const BYTE* input, size_t count, UINT64 counter, DWORD (*cvs)[8])
+{
+    Blake3HashChunks(input, count, counter, cvs);
+}
+
+// adds the chaining value of a finished chunk to the tree; 'totalChunks' is the number of
+// chunks finished so far, its trailing zero bits give the number of subtrees completed
+// by the chunk ('cv' is overwritten)
+void CBlake3Hasher::PushChunkCV(DWORD* cv, UINT64 totalChunks)
+{
+    for (; (totalChunks & 1) == 0; totalChunks >>= 1)
+    {
+        DWORD block[16];
+        StackLen--;
+        memcpy(block, Stack[StackLen], 8 * sizeof(DWORD));
+        memcpy(block + 8, cv, 8 * sizeof(DWORD));
+        memcpy(cv, Blake3IV, sizeof(Blake3IV));
+        Compress(cv, (const BYTE*)block, 0, BLAKE3_BLOCK_LEN, PARENT);
+    }
+    memcpy(Stack[StackLen], cv, 8 * sizeof(DWORD));
+    StackLen++;
+}
+
+void CBlake3Hasher::Update(const BYTE* input, size_t size)
+{
+    while (size > 0)
+    {
+        DWORD chunkLen = BlocksCompressed * BLAKE3_BLOCK_LEN + BlockLen;
+        if (chunkLen == BLAKE3_CHUNK_LEN)
+        {
+            // more input follows, so the current chunk is not the root and can be finished
+            Compress(ChunkCV, Block, ChunkCounter, BLAKE3_BLOCK_LEN, CHUNK_END);
+            ChunkCounter++;
+            PushChunkCV(ChunkCV, ChunkCounter);
+            memcpy(ChunkCV, Blake3IV, sizeof(Blake3IV));
+            BlockLen = 0;
+            BlocksCompressed = 0;
+            chunkLen = 0;
+        }
+
+        if (chunkLen == 0 && size > BLAKE3_CHUNK_LEN)
+        {
+            // whole chunks are hashed in one batch; at least one byte is left for the chunk state,
+            // the last chunk is the root if the input ends with it
+            size_t count = (size - 1) / BLAKE3_CHUNK_LEN;
+            if (count > BLAKE3_MAX_BATCH)
+                count = BLAKE3_MAX_BATCH;
+            HashChunks(input, count, ChunkCounter, BatchCVs);
+            size_t i;
+            for (i = 0; i < count; i++)
+            {
+                ChunkCounter++;
+                PushChunkCV(BatchCVs[i], ChunkCounter);
+            }
+            input += count * BLAKE3_CHUNK_LEN;
+            size -= count * BLAKE3_CHUNK_LEN;
+            continue;
+        }
+
+        // fill the current chunk, its last block stays in 'Block' until more input arrives
+        while (size > 0 && chunkLen < BLAKE3_CHUNK_LEN)
+        {
+            if (BlockLen == BLAKE3_BLOCK_LEN)
+            {
+                Compress(ChunkCV, Block, ChunkCounter, BLAKE3_BLOCK_LEN, BlocksCompressed == 0 ? CHUNK_START : 0);
+                BlocksCompressed++;
+                BlockLen = 0;
+            }
+            DWORD take = BLAKE3_BLOCK_LEN - BlockLen;
+            if (take > size)
+                take = (DWORD)size;
+            memcpy(Block + BlockLen, input, take);
+            BlockLen += take;
+            chunkLen += take;
+            input += take;
+            size -= take;
+        }
+    }
+}
+
+void CBlake3Hasher::GetDigest(BYTE* digest)
+{
+    // the output of the current chunk: the last block is compressed with ROOT flag
+    // unless there are parent nodes above it
+    DWORD cv[8];
+    BYTE block[BLAKE3_BLOCK_LEN];
+    memcpy(cv, ChunkCV, sizeof(cv));
+    memset(block, 0, sizeof(block));
+    memcpy(block, Block, BlockLen);
+    UINT64 counter = ChunkCounter;
+    DWORD blockLen = BlockLen;
+    DWORD flags = (BlocksCompressed == 0 ? CHUNK_START : 0) | CHUNK_END;
+
+    int i;
+    for (i = StackLen - 1; i >= 0; i--)
+    {
+        Compress(cv, block, counter, blockLen, flags);
+        memcpy(block, Stack[i], 8 * sizeof(DWORD));
+        memcpy(block + 8 * sizeof(DWORD), cv, 8 * sizeof(DWORD));
+        memcpy(cv, Blake3IV, sizeof(Blake3IV));
+        counter = 0;
+        blockLen = BLAKE3_BLOCK_LEN;
+        flags = PARENT;
+    }
+    Compress(cv, block, 0, blockLen, flags | ROOT);
+    memcpy(digest, cv, BLAKE3_DIGEST_SIZE);
+}
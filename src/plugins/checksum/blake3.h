@@ -0,0 +1,57 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#define BLAKE3_DIGEST_SIZE 32
+#define BLAKE3_BLOCK_LEN 64
+#define BLAKE3_CHUNK_LEN 1024
+#define BLAKE3_MAX_DEPTH 54  // enough for 2^64 bytes of input
+#define BLAKE3_MAX_BATCH 256 // the highest number of chunks passed to HashChunks() at once
+
+// calculates the chaining values of 'count' whole chunks from 'input' to 'cvs' ('counter'
+// is the index of the first chunk in the input); can be called from any thread
+void Blake3HashChunks(const BYTE* input, size_t count, UINT64 counter, DWORD (*cvs)[8]);
+
+// ****************************************************************************
+//
+// CBlake3Hasher
+//
+// Calculates the 256-bit BLAKE3 hash (the default hash mode without a key). The
+// input is split to 1 KB chunks which are the leaves of a binary tree; the whole
+// chunks are hashed independently of each other by HashChunks(), so a descendant
+// can spread them over several threads.
+//
+
+class CBlake3Hasher
+{
+public:
+    CBlake3Hasher() { Init(); }
+    virtual ~CBlake3Hasher() {}
+
+    void Init();
+    void Update(const BYTE* input, size_t size);
+
+    // stores the hash to 'digest' (BLAKE3_DIGEST_SIZE bytes); the hasher may be updated further
+    void GetDigest(BYTE* digest);
+
+protected:
+    // calculates the chaining values of 'count' whole chunks (at most BLAKE3_MAX_BATCH),
+    // see Blake3HashChunks()
+    virtual void HashChunks(const BYTE* input, size_t count, UINT64 counter, DWORD (*cvs)[8]);
+
+    void PushChunkCV(DWORD* cv, UINT64 totalChunks);
+
+    // the chunk being hashed
+    DWORD ChunkCV[8];    // chaining value after the compressed blocks
+    UINT64 ChunkCounter; // index of the chunk in the input
+    BYTE Block[BLAKE3_BLOCK_LEN];
+    DWORD BlockLen;         // number of bytes in 'Block'
+    DWORD BlocksCompressed; // number of blocks compressed into 'ChunkCV'
+
+    // chaining values of the complete subtrees on the left of the current chunk
+    DWORD Stack[BLAKE3_MAX_DEPTH][8];
+    int StackLen;
+
+    DWORD BatchCVs[BLAKE3_MAX_BATCH][8]; // output of HashChunks()
+};
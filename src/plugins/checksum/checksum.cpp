@@ -32,16 +32,18 @@ int SalamanderVersion = 0;
 CSalamanderGUIAbstract* SalamanderGUI;
 
 SConfig Config = {
-    HT_MD5,                                      // HashType - the default format for SaveAs
-    {662, 301, 230, 80, 80, 229, 279, 430, 860}, // CalcDlgWidths
-    {433, 301, 230, 80, 80},                     // VerDlgWidths
+    HT_MD5,                                                // HashType - the default format for SaveAs
+    {662, 301, 230, 80, 80, 229, 279, 430, 860, 430, 229}, // CalcDlgWidths
+    {433, 301, 230, 80, 80},                               // VerDlgWidths
     {
         // Register all known algorthms here
         {HT_CRC, true, IDS_COLUMN_CRC, IDS_COPYTOCBOARD_CRC, IDS_SAVE_FILTER_CRC, IDS_VERIFY_CRC, _T(".sfv"), "CRC", CRCFactory},
         {HT_MD5, true, IDS_COLUMN_MD5, IDS_COPYTOCBOARD_MD5, IDS_SAVE_FILTER_MD5, IDS_VERIFY_MD5, _T(".md5"), "MD5", MD5Factory},
         {HT_SHA1, true, IDS_COLUMN_SHA1, IDS_COPYTOCBOARD_SHA1, IDS_SAVE_FILTER_SHA1, IDS_VERIFY_SHA1, _T(".sha1"), "SHA1", SHA1Factory},
         {HT_SHA256, true, IDS_COLUMN_SHA256, IDS_COPYTOCBOARD_SHA256, IDS_SAVE_FILTER_SHA256, IDS_VERIFY_SHA256, _T(".sha256"), "SHA256", SHA256Factory},
-        {HT_SHA512, true, IDS_COLUMN_SHA512, IDS_COPYTOCBOARD_SHA512, IDS_SAVE_FILTER_SHA512, IDS_VERIFY_SHA512, _T(".sha512"), "SHA512", SHA512Factory}}};
+        {HT_SHA512, true, IDS_COLUMN_SHA512, IDS_COPYTOCBOARD_SHA512, IDS_SAVE_FILTER_SHA512, IDS_VERIFY_SHA512, _T(".sha512"), "SHA512", SHA512Factory},
+        {HT_BLAKE3, false, IDS_COLUMN_BLAKE3, IDS_COPYTOCBOARD_BLAKE3, IDS_SAVE_FILTER_BLAKE3, IDS_VERIFY_BLAKE3, _T(".blake3"), "BLAKE3", BLAKE3Factory},
+        {HT_XXH3, false, IDS_COLUMN_XXH3, IDS_COPYTOCBOARD_XXH3, IDS_SAVE_FILTER_XXH3, IDS_VERIFY_XXH3, _T(".xxh128"), "XXH3", XXH3Factory}}};
 
 // Current config version
 #define CURRENT_CONFIG_VERSION 1 // AS 2.52b1 with CRC/MD5/SHA1/SHA256 columns
@@ -14,6 +14,8 @@ typedef enum eHASH_TYPE
     HT_SHA1,
     HT_SHA256,
     HT_SHA512,
+    HT_BLAKE3,
+    HT_XXH3,
     HT_COUNT // Not a hash type but # of known hash types
 } eHASH_TYPE;
 
@@ -7,6 +7,7 @@
 #include "checksum.rh2"
 #include "lang\lang.rh"
 #include "dialogs.h"
+#include "parallel.h"
 #include "misc.h"
 
 CWindowQueue ModelessQueue("CheckSum Modeless Windows");  // list of all modeless windows
@@ -180,8 +181,9 @@ void CSFVMD5Dialog::OnThreadEnd()
     ShowWindow(GetDlgItem(HWindow, IDC_PROGRESS), SW_HIDE);
     bThreadRunning = FALSE;
     if (ScrollIndex < FileList.Count) // the worker already stopped counting (it may still be running), no sync needed
-    {                                 // update the last "calculated" item so it does not remain calculating / verifying ...
-        SetRowsDirty(ScrollIndex, ScrollIndex);
+    {                                 // update the last "calculated" item so it does not remain calculating / verifying
+                                      // and the items after it which could be finished by the helper threads
+        SetRowsDirty(ScrollIndex, FileList.Count - 1);
     }
 }
 
@@ -201,8 +203,8 @@ void CSFVMD5Dialog::SetItemTextAndIcon(int row, int col, const char* text, int i
     FILELISTITEM* item = FileList[row]; // while the worker thread runs, the array is not modified (index is OK)
 
     // hashes and icon do not need synchronization; while the worker thread is running, the dialog thread
-    // only reads items before ScrollIndex (which is at most ScheduledScrollIndex) and the worker writes
-    // only to the ScheduledScrollIndex item, so there is no conflict
+    // only reads items before ScrollIndex (which is at most ScheduledScrollIndex) and the worker (and its
+    // helper threads) write only to the ScheduledScrollIndex item and the items after it, so there is no conflict
     if (text != NULL)
     {
         if (col < 2 || col - 2 >= HT_COUNT)
@@ -261,7 +263,8 @@ void CSFVMD5Dialog::ScrollToItem(int i)
 {
     CALL_STACK_MESSAGE2("CSFVMD5Dialog::ScrollToItem(%d)", i);
     EnterDataCS();
-    ScheduledScrollIndex = i;
+    if (i > ScheduledScrollIndex) // files are finished by several threads, a late call must not move back
+        ScheduledScrollIndex = i;
     LeaveDataCS();
 }
 
@@ -638,6 +641,13 @@ BOOL CCalculateDialog::GetFileList()
     return ret;
 }
 
+// Files are hashed by the worker thread and, on SSD, also by several helper threads at once (see
+// GetFileReadersCount()); each of them reads a file only once and hands its buffers over to
+// CHashPipeline which updates all selected algorithms at once. Only the worker thread asks the user
+// about errors, the helper threads return the files they cannot read to the schedule.
+
+class CCalculateWorker;
+
 class CCalculateThread : public CCRCMD5Thread
 {
 public:
@@ -646,165 +656,330 @@ public:
 
 protected:
     CCalculateDialog* dialog;
+    CFileSchedule* Schedule;
+    int Silent;             // used only by the worker thread
+    BOOL SkipAllReadErrors; // used only by the worker thread
+
+    friend class CCalculateWorker;
 };
 
-unsigned CCalculateThread::Body()
+class CCalculateWorker
 {
-    CALL_STACK_MESSAGE1("CCalculateThread::Body()");
-    TRACE_I("Begin");
+public:
+    CCalculateWorker(CCalculateThread* thread);
+    ~CCalculateWorker();
 
-    BOOL skippedReadError = FALSE;
-    BOOL skipAllReadErrors = FALSE;
-    BOOL skip;
-    CHashAlgo* pCalculators[HT_COUNT];
-    int nCalculators = 0;
+    // creates the selected algorithms; returns FALSE on failure
+    BOOL Init();
+
+    // calculates the hashes of file 'i'; 'interactive' is TRUE in the worker thread (the user is
+    // asked about errors), FALSE in the helper threads (files with errors are returned to the
+    // schedule); 'counted' is the part of the file already added to the progress; returns FALSE
+    // if the work should end
+    BOOL CalculateFile(int i, BOOL interactive, CQuadWord counted);
+
+    static unsigned WINAPI HelperBody(void* param);
+
+protected:
+    void AddSkippedProgress(const char* path, const CQuadWord& counted);
+    void FinishFile(int i);
+
+    CCalculateThread* Thread;
+    CHashAlgo* Calculators[HT_COUNT];
+    int CalculatorsCount;
+    CHashPipeline Pipeline;
+    char* Buffer; // two buffers of BUFSIZE bytes: one is read while the other one is hashed
+};
+
+CCalculateWorker::CCalculateWorker(CCalculateThread* thread)
+{
+    Thread = thread;
+    CalculatorsCount = 0;
+    Buffer = NULL;
+}
+
+CCalculateWorker::~CCalculateWorker()
+{
+    Pipeline.Stop();
+    while (CalculatorsCount > 0)
+        delete Calculators[--CalculatorsCount];
+    if (Buffer != NULL)
+        free(Buffer);
+}
 
+BOOL CCalculateWorker::Init()
+{
+    CALL_STACK_MESSAGE1("CCalculateWorker::Init()");
+    CCalculateDialog* dialog = Thread->dialog;
     int ii;
     for (ii = 0; ii < HT_COUNT; ii++)
     {
         if (dialog->HashInfo[ii].bCalculate)
         {
-            pCalculators[nCalculators] = dialog->HashInfo[ii].Factory();
-            if (!pCalculators[nCalculators])
+            Calculators[CalculatorsCount] = dialog->HashInfo[ii].Factory();
+            if (!Calculators[CalculatorsCount])
             {
-                while (nCalculators-- > 0)
-                    delete pCalculators[nCalculators];
                 TRACE_E("Could not initialize " << dialog->HashInfo[ii].sRegID);
-                if (dialog->FileList.Count > 0)
-                    dialog->SetItemTextAndIcon(0, 2, LoadStr(IDS_CANCELED));
-                TRACE_I("End");
-                PostMessage(dialog->HWindow, WM_USER_ENDWORK, 0, 0);
-                return 0;
+                return FALSE;
             }
-            nCalculators++;
+            CalculatorsCount++;
         }
     }
-
-    // while the worker thread runs, the array is not modified (the number of items + indices do
-    // not change = no need to synchronize access to them)
-    int silent = 0;
-    for (int i = 0; i < dialog->FileList.Count && !*Terminate; i++)
+    Buffer = (char*)malloc(2 * BUFSIZE);
+    if (Buffer == NULL)
     {
-        // scroll to the current item (only if the previous one is visible, i.e. the user did not jump to the top)
-        dialog->ScrollToItem(i);
+        TRACE_E("CCalculateWorker::Init(): Low memory!");
+        return FALSE;
+    }
+    Pipeline.Start(Calculators, CalculatorsCount);
+    return TRUE;
+}
 
-        // open the file
-        HANDLE hFile;
-        char path[MAX_PATH];
-        strcpy(path, dialog->SourcePath);
-        // should not happen - the name length was already verified in CCalculateDialog::GetFileList()
-        // FILELISTITEM::Name does not change after being added to the array = no need for synchronized access
-        if (!SalamanderGeneral->SalPathAppend(path, dialog->FileList[i]->Name, MAX_PATH))
+void CCalculateWorker::AddSkippedProgress(const char* path, const CQuadWord& counted)
+{
+    // advance progress by the rest of the size of the skipped file
+    WIN32_FIND_DATA fd;
+    memset(&fd, 0, sizeof(fd));
+    HANDLE find = HANDLES_Q(FindFirstFile(path, &fd));
+    if (find != INVALID_HANDLE_VALUE)
+    {
+        HANDLES(FindClose(find));
+        CQuadWord size(fd.nFileSizeLow, fd.nFileSizeHigh);
+        if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 &&
+            (fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
         {
-            TRACE_E("CCalculateThread::Body(): unexpected situation: SalPathAppend() has failed");
-            break;
+            if (!SalamanderGeneral->SalGetFileSize2(path, size, NULL))
+                size.Set(fd.nFileSizeLow, fd.nFileSizeHigh);
         }
+        if (size >= counted)
+            Thread->dialog->IncreaseProgress(size - counted);
+    }
+}
+
+BOOL CCalculateWorker::CalculateFile(int i, BOOL interactive, CQuadWord counted)
+{
+    CALL_STACK_MESSAGE3("CCalculateWorker::CalculateFile(%d, %d, )", i, interactive);
+    CCalculateDialog* dialog = Thread->dialog;
+    BOOL* terminate = Thread->Terminate;
+
+    // open the file
+    HANDLE hFile;
+    char path[MAX_PATH];
+    strcpy(path, dialog->SourcePath);
+    // should not happen - the name length was already verified in CCalculateDialog::GetFileList()
+    // FILELISTITEM::Name does not change after being added to the array = no need for synchronized access
+    if (!SalamanderGeneral->SalPathAppend(path, dialog->FileList[i]->Name, MAX_PATH))
+    {
+        TRACE_E("CCalculateWorker::CalculateFile(): unexpected situation: SalPathAppend() has failed");
+        return FALSE;
+    }
+    if (interactive)
+    {
+        BOOL skip;
         if (!SafeOpenCreateFile(path, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
-                                &hFile, &skip, &silent, dialog->HWindow))
-            break;
+                                &hFile, &skip, &Thread->Silent, dialog->HWindow))
+            return FALSE;
         if (skip)
         {
             dialog->SetItemTextAndIcon(i, 2, LoadStr(IDS_SKIPPED));
-            // advance progress by the size of the skipped file
-            WIN32_FIND_DATA fd;
-            memset(&fd, 0, sizeof(fd));
-            HANDLE find = HANDLES_Q(FindFirstFile(path, &fd));
-            if (find != INVALID_HANDLE_VALUE)
-            {
-                HANDLES(FindClose(find));
-                CQuadWord size(fd.nFileSizeLow, fd.nFileSizeHigh);
-                if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 &&
-                    (fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
-                {
-                    if (!SalamanderGeneral->SalGetFileSize2(path, size, NULL))
-                        size.Set(fd.nFileSizeLow, fd.nFileSizeHigh);
-                }
-                dialog->IncreaseProgress(size + CQuadWord(FILE_SIZE_FIX, 0));
-            }
-            continue;
+            AddSkippedProgress(path, counted);
+            dialog->IncreaseProgress(CQuadWord(FILE_SIZE_FIX, 0));
+            FinishFile(i);
+            return TRUE;
+        }
+    }
+    else
+    {
+        hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            Thread->Schedule->Retry(i, counted); // the worker thread will ask the user
+            return TRUE;
         }
+    }
 
-        // Now calculates the hashes
-        int j;
-        for (j = 0; j < nCalculators; j++)
-            pCalculators[j]->Init();
+    // Now calculates the hashes
+    Pipeline.Init();
 
-        DWORD nr;
-        CQuadWord done(0, 0);
-        do
+    BOOL skippedReadError = FALSE;
+    BOOL retry = FALSE;
+    char* buffer = Buffer;
+    DWORD nr;
+    CQuadWord done(0, 0);
+    do
+    {
+        BOOL read;
+        if (interactive)
+            read = SafeReadFile(hFile, buffer, BUFSIZE, &nr, path, dialog->HWindow, &skippedReadError, &Thread->SkipAllReadErrors);
+        else
+            read = ReadFile(hFile, buffer, BUFSIZE, &nr, NULL);
+        if (!read)
         {
-            char buffer[BUFSIZE];
-            if (!SafeReadFile(hFile, buffer, BUFSIZE, &nr, path, dialog->HWindow, &skippedReadError, &skipAllReadErrors))
+            nr = 0; // read error
+            if (!interactive)
+                retry = TRUE; // the worker thread will ask the user
+            else
             {
-                nr = 0; // read error
                 if (skippedReadError)
                 {
                     dialog->SetItemTextAndIcon(i, 2, LoadStr(IDS_SKIPPED));
-                    // advance progress by the size of the skipped file
-                    WIN32_FIND_DATA fd;
-                    memset(&fd, 0, sizeof(fd));
-                    HANDLE find = HANDLES_Q(FindFirstFile(path, &fd));
-                    if (find != INVALID_HANDLE_VALUE)
-                    {
-                        HANDLES(FindClose(find));
-                        CQuadWord size(fd.nFileSizeLow, fd.nFileSizeHigh);
-                        if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 &&
-                            (fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
-                        {
-                            if (!SalamanderGeneral->SalGetFileSize2(path, size, NULL))
-                                size.Set(fd.nFileSizeLow, fd.nFileSizeHigh);
-                        }
-                        if (size >= done)
-                        {
-                            size -= done;
-                            dialog->IncreaseProgress(size);
-                        }
-                    }
+                    AddSkippedProgress(path, done > counted ? done : counted);
                 }
                 else
-                    *Terminate = TRUE;
+                    *terminate = TRUE;
             }
-            if (nr > 0)
-            {
-                for (int j2 = 0; j2 < nCalculators; j2++)
-                    pCalculators[j2]->Update(buffer, nr);
-                dialog->IncreaseProgress(CQuadWord(nr, 0));
-                done += CQuadWord(nr, 0);
-            }
-        } while (nr == BUFSIZE && !*Terminate && !skippedReadError);
-        if (!*Terminate)
-            dialog->IncreaseProgress(CQuadWord(FILE_SIZE_FIX, 0));
-        CloseHandle(hFile);
+        }
+        if (nr > 0)
+        {
+            // the hashes are calculated while the other buffer is being read
+            Pipeline.Update(buffer, nr);
+            buffer = buffer == Buffer ? Buffer + BUFSIZE : Buffer;
+            // the part of the file counted by a helper thread is not added to the progress again
+            CQuadWord next = done + CQuadWord(nr, 0);
+            if (next > counted)
+                dialog->IncreaseProgress(next - (done > counted ? done : counted));
+            done = next;
+        }
+    } while (nr == BUFSIZE && !*terminate && !skippedReadError && !retry);
+    Pipeline.Wait();
+    CloseHandle(hFile);
 
-        // store the results in the list
-        if (!*Terminate && !skippedReadError)
+    if (retry)
+    {
+        Thread->Schedule->Retry(i, done > counted ? done : counted);
+        return TRUE;
+    }
+    if (!*terminate)
+        dialog->IncreaseProgress(CQuadWord(FILE_SIZE_FIX, 0));
+
+    // store the results in the list
+    if (!*terminate && !skippedReadError)
+    {
+        Pipeline.Finalize();
+
+        char digest[DIGEST_MAX_SIZE];
+        char text[2 * DIGEST_MAX_SIZE + 1];
+
+        int j2;
+        for (j2 = 0; j2 < CalculatorsCount; j2++)
         {
-            for (int k = 0; k < nCalculators; k++)
-                pCalculators[k]->Finalize();
+            int len = Calculators[j2]->GetDigest(digest, SizeOf(digest));
+            text[0] = 0;
+            int k2;
+            for (k2 = 0; k2 < len; k2++)
+                sprintf(text + k2 * 2, "%02X", digest[k2]);
+            dialog->SetItemTextAndIcon(i, 2 + j2, text);
+        }
+    }
+    else
+    {
+        if (*terminate)
+            dialog->SetItemTextAndIcon(i, 2, LoadStr(IDS_CANCELED));
+    }
+    FinishFile(i);
+    return TRUE;
+}
 
-            char digest[DIGEST_MAX_SIZE];
-            char text[2 * DIGEST_MAX_SIZE + 1];
+void CCalculateWorker::FinishFile(int i)
+{
+    // scroll to the first unfinished item (files finished after it are shown when it is done)
+    int first = Thread->Schedule->Finish(i);
+    Thread->dialog->ScrollToItem(min(first, Thread->dialog->FileList.Count - 1));
+}
 
-            int j2;
-            for (j2 = 0; j2 < nCalculators; j2++)
-            {
-                int len = pCalculators[j2]->GetDigest(digest, SizeOf(digest));
-                text[0] = 0;
-                int k2;
-                for (k2 = 0; k2 < len; k2++)
-                    sprintf(text + k2 * 2, "%02X", digest[k2]);
-                dialog->SetItemTextAndIcon(i, 2 + j2, text);
-            }
+unsigned WINAPI
+CCalculateWorker::HelperBody(void* param)
+{
+    CALL_STACK_MESSAGE1("CCalculateWorker::HelperBody()");
+    CCalculateWorker* worker = (CCalculateWorker*)param;
+    CCalculateThread* thread = worker->Thread;
+    int i;
+    while (!*thread->Terminate && (i = thread->Schedule->GetNext()) != -1)
+    {
+        if (!worker->CalculateFile(i, FALSE, CQuadWord(0, 0)))
+            break;
+    }
+    return 0;
+}
+
+unsigned CCalculateThread::Body()
+{
+    CALL_STACK_MESSAGE1("CCalculateThread::Body()");
+    TRACE_I("Begin");
+
+    Silent = 0;
+    SkipAllReadErrors = FALSE;
+
+    // while the worker thread runs, the array is not modified (the number of items + indices do
+    // not change = no need to synchronize access to them)
+    CFileSchedule schedule(dialog->FileList.Count);
+    Schedule = &schedule;
+    CCalculateWorker worker(this);
+    if (!schedule.IsGood() || !worker.Init())
+    {
+        if (dialog->FileList.Count > 0)
+            dialog->SetItemTextAndIcon(0, 2, LoadStr(IDS_CANCELED));
+        TRACE_I("End");
+        PostMessage(dialog->HWindow, WM_USER_ENDWORK, 0, 0);
+        return 0;
+    }
+
+    // start the helper threads hashing other files at once (only if the device can read several files)
+    CCalculateWorker* helpers[MAX_FILE_READERS];
+    HANDLE helperThreads[MAX_FILE_READERS];
+    int helpersCount = 0;
+    int readers = GetFileReadersCount(dialog->SourcePath);
+    readers = min(readers, dialog->FileList.Count);
+    while (helpersCount < readers - 1)
+    {
+        CCalculateWorker* helper = new CCalculateWorker(this);
+        HANDLE thread = NULL;
+        if (helper != NULL && helper->Init())
+            thread = ThreadQueue.StartThread(CCalculateWorker::HelperBody, helper);
+        if (thread == NULL)
+        {
+            if (helper != NULL)
+                delete helper;
+            break; // we will manage with fewer threads
         }
-        else
+        helpers[helpersCount] = helper;
+        helperThreads[helpersCount++] = thread;
+    }
+    int fileReaders = helpersCount + 1; // the hash algorithms share the processors with the other readers
+    AddFileReaders(fileReaders);
+
+    while (!*Terminate)
+    {
+        // files returned by the helper threads go first, they hold up the results of the following files
+        CQuadWord counted(0, 0);
+        int i = schedule.GetRetry(counted);
+        if (i == -1)
+            i = schedule.GetNext();
+        if (i == -1 && helpersCount > 0)
         {
-            if (*Terminate)
-                dialog->SetItemTextAndIcon(i, 2, LoadStr(IDS_CANCELED));
+            // wait for the helper threads, they may still return files they cannot read
+            while (helpersCount > 0)
+            {
+                helpersCount--;
+                ThreadQueue.WaitForExit(helperThreads[helpersCount]);
+                delete helpers[helpersCount];
+            }
+            i = schedule.GetRetry(counted);
         }
+        if (i == -1 || !worker.CalculateFile(i, TRUE, counted))
+            break;
+    }
+
+    // let the helper threads finish their files
+    schedule.Stop();
+    while (helpersCount > 0)
+    {
+        helpersCount--;
+        ThreadQueue.WaitForExit(helperThreads[helpersCount]);
+        delete helpers[helpersCount];
     }
+    AddFileReaders(-fileReaders);
 
-    while (nCalculators > 0)
-        delete pCalculators[--nCalculators];
     TRACE_I("End");
     PostMessage(dialog->HWindow, WM_USER_ENDWORK, 0, 0);
     return 0;
@@ -1050,6 +1225,8 @@ MENU_TEMPLATE_ITEM CalculateDialogMenu[] =
   {MNTT_IT, IDS_COPYTOCBOARD_SHA1
   {MNTT_IT, IDS_COPYTOCBOARD_SHA256
   {MNTT_IT, IDS_COPYTOCBOARD_SHA512
+  {MNTT_IT, IDS_COPYTOCBOARD_BLAKE3
+  {MNTT_IT, IDS_COPYTOCBOARD_XXH3
   {MNTT_IT, IDS_REMOVEITEM
   {MNTT_PE, 0
 };
@@ -1371,6 +1548,12 @@ INT_PTR CCalculateDialog::DialogProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
                     case '5':
                         hashType = HT_SHA512;
                         break;
+                    case 'B':
+                        hashType = HT_BLAKE3;
+                        break;
+                    case 'X':
+                        hashType = HT_XXH3;
+                        break;
                     }
                     if (hashType != HT_COUNT)
                         OnContextMenu(0, 0, hashType);
@@ -1477,7 +1660,7 @@ BOOL CVerifyDialog::AnalyzeSourceFile()
         return FALSE;
     char* line = strtok(text, "\r\n");
 
-    BOOL isSFV = TRUE, isMD5 = TRUE, isSHA1 = TRUE, isSHA256 = TRUE, isSHA512 = TRUE;
+    BOOL isSFV = TRUE, isMD5 = TRUE, isSHA1 = TRUE, isSHA256 = TRUE, isSHA512 = TRUE, isBLAKE3 = TRUE, isXXH3 = TRUE;
     while (line != NULL)
     {
         LTrimStr(line);
@@ -1533,15 +1716,47 @@ BOOL CVerifyDialog::AnalyzeSourceFile()
             {                     // does not start with a checksum, nor is it: SHA512 (README) = baaa5da257f848a4eece4fcf7653a7a58930124ef244bda374a6e906207d8a73baaa5da257f848a4eece4fcf7653a7a58930124ef244bda374a6e906207d8a73
                 isSHA512 = FALSE; // not a SHA512
             }
+            if (isBLAKE3 &&
+                (lenFirst != 64 || !firstIsHex) &&
+                (lenLast != 64 || !lastIsHex || lenFirstHashName != 6 || memcmp(line + posFirstHashName, "BLAKE3", 6) != 0))
+            {                     // does not start with a checksum, nor is it: BLAKE3 (README) = 6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85
+                isBLAKE3 = FALSE; // not a BLAKE3
+            }
+            if (isXXH3 &&
+                (lenFirst != 32 || !firstIsHex) &&
+                (lenLast != 32 || !lastIsHex || lenFirstHashName != 6 || memcmp(line + posFirstHashName, "XXH128", 6) != 0))
+            {                   // does not start with a checksum, nor is it: XXH128 (README) = 06b05ab6733a618578af5f94892f3950
+                isXXH3 = FALSE; // not a XXH3-128
+            }
         }
         line = strtok(NULL, "\r\n");
     }
 
     delete[] text;
-    if (!isMD5 && !isSFV && !isSHA1 && !isSHA256 && !isSHA512)
+    if (!isMD5 && !isSFV && !isSHA1 && !isSHA256 && !isSHA512 && !isBLAKE3 && !isXXH3)
         return Error(HWindow, 0, IDS_VERIFYTITLE, IDS_BADFILE);
 
-    eHASH_TYPE HashType = isSFV ? HT_CRC : (isMD5 ? HT_MD5 : (isSHA1 ? HT_SHA1 : (isSHA256 ? HT_SHA256 : HT_SHA512)));
+    // checksums without the hash name cannot be told apart from the checksums of the same
+    // length (BLAKE3 and SHA256, XXH3-128 and MD5), the extension of the file decides
+    const char* ext = _tcsrchr(sourceFile, '.');
+    if (ext == NULL || _tcschr(ext, '\\') != NULL)
+        ext = "";
+    if (isBLAKE3 && isSHA256)
+    {
+        if (!_tcsicmp(ext, Config.HashInfo[HT_BLAKE3].sSaveAsExt))
+            isSHA256 = FALSE;
+        else
+            isBLAKE3 = FALSE;
+    }
+    if (isXXH3 && isMD5)
+    {
+        if (!_tcsicmp(ext, Config.HashInfo[HT_XXH3].sSaveAsExt))
+            isMD5 = FALSE;
+        else
+            isXXH3 = FALSE;
+    }
+
+    eHASH_TYPE HashType = isSFV ? HT_CRC : (isMD5 ? HT_MD5 : (isSHA1 ? HT_SHA1 : (isSHA256 ? HT_SHA256 : (isSHA512 ? HT_SHA512 : (isBLAKE3 ? HT_BLAKE3 : HT_XXH3)))));
     for (int i = 0; i < HT_COUNT; i++)
         if (HashType == Config.HashInfo[i].Type)
         {
@@ -1690,6 +1905,13 @@ BOOL CVerifyDialog::LoadSourceFile()
     return ret;
 }
 
+// Files are verified by the worker thread and, on SSD, also by several helper threads at once (see
+// GetFileReadersCount()). Only one file is read at a time from seeking disks, they get the files
+// sorted by directories instead, so the disk does not seek back and forth between the directories
+// mixed in the source file. The results are shown in the order of the source file in both cases.
+// Only the worker thread asks the user about errors, the helper threads return the files they
+// cannot read to the schedule.
+
 class CVerifyThread : public CCRCMD5Thread
 {
 public:
@@ -1697,103 +1919,354 @@ public:
     virtual unsigned Body();
 
 protected:
+    int* GetDirectoryOrder();
+
     CVerifyDialog* dialog;
+    CFileSchedule* Schedule;
+    int Silent; // used only by the worker thread
+
+    friend class CVerifyWorker;
 };
 
-unsigned CVerifyThread::Body()
+class CVerifyWorker
 {
-    CALL_STACK_MESSAGE1("CVerifyThread::Body()");
-    TRACE_I("Begin");
+public:
+    CVerifyWorker(CVerifyThread* thread);
+    ~CVerifyWorker();
+
+    // creates the algorithm; returns FALSE on failure
+    BOOL Init();
+
+    // verifies file 'i'; 'interactive' is TRUE in the worker thread (the user is asked about
+    // errors), FALSE in the helper threads (files with errors are returned to the schedule);
+    // 'counted' is the part of the file already added to the progress; returns FALSE if the
+    // work should end
+    BOOL VerifyFile(int i, BOOL interactive, CQuadWord counted);
+
+    static unsigned WINAPI HelperBody(void* param);
+
+protected:
+    void FinishFile(int i);
+
+    CVerifyThread* Thread;
+    CHashAlgo* Calculator;
+    CHashPipeline Pipeline;
+    char* Buffer; // two buffers of BUFSIZE bytes: one is read while the other one is hashed
+};
 
-    CHashAlgo* pCalculator = dialog->pHashInfo->Factory();
+CVerifyWorker::CVerifyWorker(CVerifyThread* thread)
+{
+    Thread = thread;
+    Calculator = NULL;
+    Buffer = NULL;
+}
 
-    if (NULL == pCalculator)
+CVerifyWorker::~CVerifyWorker()
+{
+    Pipeline.Stop();
+    if (Calculator != NULL)
+        delete Calculator;
+    if (Buffer != NULL)
+        free(Buffer);
+}
+
+BOOL CVerifyWorker::Init()
+{
+    CALL_STACK_MESSAGE1("CVerifyWorker::Init()");
+    Calculator = Thread->dialog->pHashInfo->Factory();
+    if (Calculator == NULL)
     {
-        TRACE_E("CVerifyThread::Body(): Could not instantiate calculator");
-        TRACE_I("End");
-        if (dialog->fileList.Count > 0)
-            dialog->SetItemTextAndIcon(0, 2, LoadStr(IDS_CANCELED));
-        dialog->bCanceled = TRUE;
-        PostMessage(dialog->HWindow, WM_USER_ENDWORK, 0, 0);
-        return 0;
+        TRACE_E("CVerifyWorker::Init(): Could not instantiate calculator");
+        return FALSE;
+    }
+    Buffer = (char*)malloc(2 * BUFSIZE);
+    if (Buffer == NULL)
+    {
+        TRACE_E("CVerifyWorker::Init(): Low memory!");
+        return FALSE;
     }
+    Pipeline.Start(&Calculator, 1);
+    return TRUE;
+}
 
-    BOOL skip;
+BOOL CVerifyWorker::VerifyFile(int i, BOOL interactive, CQuadWord counted)
+{
+    CALL_STACK_MESSAGE3("CVerifyWorker::VerifyFile(%d, %d, )", i, interactive);
+    CVerifyDialog* dialog = Thread->dialog;
+    BOOL* terminate = Thread->Terminate;
 
     // while the worker thread runs, the array is not modified (item count + indices
     // do not change = no need to synchronize access)
-    for (int i = 0, silent = 0; i < dialog->fileList.Count && !*Terminate; i++)
-    {
-        FILEINFO* info = dialog->fileList[i];
-
-        // scroll to the current item
-        dialog->ScrollToItem(i);
+    FILEINFO* info = dialog->fileList[i];
 
-        if (!info->bFileExist)
-        {
-            dialog->SetItemTextAndIcon(i, 0, NULL, 1);
-            dialog->nMissing++; // used only from the thread + from the main thread when it is not running -> no sync
-            continue;
-        }
+    if (!info->bFileExist)
+    {
+        dialog->SetItemTextAndIcon(i, 0, NULL, 1);
+        InterlockedIncrement(&dialog->nMissing);
+        FinishFile(i);
+        return TRUE;
+    }
 
-        // open the file
-        HANDLE hFile;
+    // open the file
+    HANDLE hFile;
+    if (interactive)
+    {
+        BOOL skip;
         if (!SafeOpenCreateFile(info->fileName, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
-                                &hFile, &skip, &silent, dialog->HWindow))
+                                &hFile, &skip, &Thread->Silent, dialog->HWindow))
         {
             dialog->SetItemTextAndIcon(i, 2, LoadStr(IDS_CANCELED));
             dialog->bCanceled = TRUE;
-            break;
+            return FALSE;
         }
         if (skip)
         {
             dialog->SetItemTextAndIcon(i, 2, LoadStr(IDS_SKIPPED));
-            // advance progress by the size of the skipped file
-            dialog->IncreaseProgress(info->size + CQuadWord(FILE_SIZE_FIX, 0));
-            dialog->nSkipped++; // used only from the thread + from the main thread when it is not running -> no sync
-            continue;
+            // advance progress by the rest of the size of the skipped file
+            if (info->size >= counted)
+                dialog->IncreaseProgress(info->size - counted);
+            dialog->IncreaseProgress(CQuadWord(FILE_SIZE_FIX, 0));
+            InterlockedIncrement(&dialog->nSkipped);
+            FinishFile(i);
+            return TRUE;
         }
+    }
+    else
+    {
+        hFile = CreateFile(info->fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            Thread->Schedule->Retry(i, counted); // the worker thread will ask the user
+            return TRUE;
+        }
+    }
 
-        // compute CRC or MD5
-        pCalculator->Init();
-        DWORD nr;
-        do
+    // compute the hash
+    Pipeline.Init();
+
+    BOOL retry = FALSE;
+    char* buffer = Buffer;
+    DWORD nr;
+    CQuadWord done(0, 0);
+    do
+    {
+        BOOL read;
+        if (interactive)
+            read = SafeReadFile(hFile, buffer, BUFSIZE, &nr, info->fileName, dialog->HWindow);
+        else
+            read = ReadFile(hFile, buffer, BUFSIZE, &nr, NULL);
+        if (!read)
         {
-            char buffer[BUFSIZE];
-            if (!SafeReadFile(hFile, buffer, BUFSIZE, &nr, info->fileName, dialog->HWindow))
+            nr = 0; // read error
+            if (!interactive)
+                retry = TRUE; // the worker thread will ask the user
+            else
             {
                 dialog->bCanceled = TRUE;
-                *Terminate = TRUE;
-            }
-            if (!*Terminate)
-            {
-                dialog->IncreaseProgress(CQuadWord(nr, 0));
-                pCalculator->Update(buffer, nr);
+                *terminate = TRUE;
             }
-        } while (nr == BUFSIZE && !*Terminate);
-        if (!*Terminate)
+        }
+        if (nr > 0 && !*terminate)
         {
-            pCalculator->Finalize();
-            dialog->IncreaseProgress(CQuadWord(FILE_SIZE_FIX, 0));
+            // the hash is calculated while the other buffer is being read
+            Pipeline.Update(buffer, nr);
+            buffer = buffer == Buffer ? Buffer + BUFSIZE : Buffer;
+            // the part of the file counted by a helper thread is not added to the progress again
+            CQuadWord next = done + CQuadWord(nr, 0);
+            if (next > counted)
+                dialog->IncreaseProgress(next - (done > counted ? done : counted));
+            done = next;
         }
-        CloseHandle(hFile);
+    } while (nr == BUFSIZE && !*terminate && !retry);
+    Pipeline.Wait();
+    CloseHandle(hFile);
 
-        // store the results into the list
-        if (!*Terminate)
+    if (retry)
+    {
+        Thread->Schedule->Retry(i, done > counted ? done : counted);
+        return TRUE;
+    }
+
+    // store the results into the list
+    if (!*terminate)
+    {
+        Pipeline.Finalize();
+        dialog->IncreaseProgress(CQuadWord(FILE_SIZE_FIX, 0));
+
+        char digest[DIGEST_MAX_SIZE];
+        int len = Calculator->GetDigest(digest, SizeOf(digest));
+        BOOL ok = (len > 0) && !memcmp(info->digest, digest, len);
+
+        dialog->SetItemTextAndIcon(i, 2, LoadStr(ok ? IDS_OK : IDS_CORRUPT), ok ? 3 : 2);
+        InterlockedIncrement(ok ? &dialog->nOK : &dialog->nCorrupt);
+    }
+    else
+        dialog->SetItemTextAndIcon(i, 2, LoadStr(IDS_CANCELED));
+    FinishFile(i);
+    return TRUE;
+}
+
+void CVerifyWorker::FinishFile(int i)
+{
+    // scroll to the first unfinished item (files finished after it are shown when it is done)
+    int first = Thread->Schedule->Finish(i);
+    Thread->dialog->ScrollToItem(min(first, Thread->dialog->fileList.Count - 1));
+}
+
+unsigned WINAPI
+CVerifyWorker::HelperBody(void* param)
+{
+    CALL_STACK_MESSAGE1("CVerifyWorker::HelperBody()");
+    CVerifyWorker* worker = (CVerifyWorker*)param;
+    CVerifyThread* thread = worker->Thread;
+    int i;
+    while (!*thread->Terminate && (i = thread->Schedule->GetNext()) != -1)
+    {
+        if (!worker->VerifyFile(i, FALSE, CQuadWord(0, 0)))
+            break;
+    }
+    return 0;
+}
+
+struct CDirectoryOrderItem
+{
+    const char* Name;
+    int DirLen; // length of the directory part of 'Name'
+    int Index;  // index in CVerifyDialog::fileList
+};
+
+static int __cdecl CompareDirectoryOrderItems(const void* p1, const void* p2)
+{
+    const CDirectoryOrderItem* item1 = (const CDirectoryOrderItem*)p1;
+    const CDirectoryOrderItem* item2 = (const CDirectoryOrderItem*)p2;
+    int res = _strnicmp(item1->Name, item2->Name, min(item1->DirLen, item2->DirLen));
+    if (res == 0)
+        res = item1->DirLen - item2->DirLen; // a directory goes before its subdirectories
+    if (res == 0)
+        res = item1->Index - item2->Index; // keep the order of the source file inside a directory
+    return res;
+}
+
+int* CVerifyThread::GetDirectoryOrder()
+{
+    CALL_STACK_MESSAGE1("CVerifyThread::GetDirectoryOrder()");
+    int count = dialog->fileList.Count;
+    CDirectoryOrderItem* items = (CDirectoryOrderItem*)malloc(count * sizeof(CDirectoryOrderItem));
+    int* order = (int*)malloc(count * sizeof(int));
+    if (items == NULL || order == NULL)
+    {
+        TRACE_E("CVerifyThread::GetDirectoryOrder(): Low memory!");
+        if (items != NULL)
+            free(items);
+        if (order != NULL)
+            free(order);
+        return NULL; // the files are verified in the order of the source file
+    }
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        const char* name = dialog->fileList[i]->fileName; // full name, see CVerifyDialog::LoadSourceFile()
+        const char* s = strrchr(name, '\\');
+        items[i].Name = name;
+        items[i].DirLen = s != NULL ? (int)(s - name) : 0;
+        items[i].Index = i;
+    }
+    qsort(items, count, sizeof(CDirectoryOrderItem), CompareDirectoryOrderItems);
+    for (i = 0; i < count; i++)
+        order[i] = items[i].Index;
+    free(items);
+    return order;
+}
+
+unsigned CVerifyThread::Body()
+{
+    CALL_STACK_MESSAGE1("CVerifyThread::Body()");
+    TRACE_I("Begin");
+
+    Silent = 0;
+
+    // while the worker thread runs, the array is not modified (item count + indices
+    // do not change = no need to synchronize access)
+    CFileSchedule schedule(dialog->fileList.Count);
+    Schedule = &schedule;
+    CVerifyWorker worker(this);
+    if (!schedule.IsGood() || !worker.Init())
+    {
+        if (dialog->fileList.Count > 0)
+            dialog->SetItemTextAndIcon(0, 2, LoadStr(IDS_CANCELED));
+        dialog->bCanceled = TRUE;
+        TRACE_I("End");
+        PostMessage(dialog->HWindow, WM_USER_ENDWORK, 0, 0);
+        return 0;
+    }
+
+    // several files are read at once only from SSD, the other devices read the files sorted by directories
+    int readers = GetFileReadersCount(dialog->sourcePath);
+    readers = min(readers, dialog->fileList.Count);
+    int* order = NULL;
+    if (readers <= 1 && dialog->fileList.Count > 1)
+    {
+        order = GetDirectoryOrder();
+        if (order != NULL)
+            schedule.SetOrder(order);
+    }
+
+    // start the helper threads verifying other files at once
+    CVerifyWorker* helpers[MAX_FILE_READERS];
+    HANDLE helperThreads[MAX_FILE_READERS];
+    int helpersCount = 0;
+    while (helpersCount < readers - 1)
+    {
+        CVerifyWorker* helper = new CVerifyWorker(this);
+        HANDLE thread = NULL;
+        if (helper != NULL && helper->Init())
+            thread = ThreadQueue.StartThread(CVerifyWorker::HelperBody, helper);
+        if (thread == NULL)
         {
-            char digest[DIGEST_MAX_SIZE];
-            int len = pCalculator->GetDigest(digest, SizeOf(digest));
-            BOOL ok = (len > 0) && !memcmp(info->digest, digest, len);
+            if (helper != NULL)
+                delete helper;
+            break; // we will manage with fewer threads
+        }
+        helpers[helpersCount] = helper;
+        helperThreads[helpersCount++] = thread;
+    }
+    int fileReaders = helpersCount + 1; // the hash algorithms share the processors with the other readers
+    AddFileReaders(fileReaders);
 
-            dialog->SetItemTextAndIcon(i, 2, LoadStr(ok ? IDS_OK : IDS_CORRUPT), ok ? 3 : 2);
-            if (!ok)
-                dialog->nCorrupt++; // used only from the thread + from the main thread when it is not running -> no sync
+    while (!*Terminate)
+    {
+        // files returned by the helper threads go first, they hold up the results of the following files
+        CQuadWord counted(0, 0);
+        int i = schedule.GetRetry(counted);
+        if (i == -1)
+            i = schedule.GetNext();
+        if (i == -1 && helpersCount > 0)
+        {
+            // wait for the helper threads, they may still return files they cannot read
+            while (helpersCount > 0)
+            {
+                helpersCount--;
+                ThreadQueue.WaitForExit(helperThreads[helpersCount]);
+                delete helpers[helpersCount];
+            }
+            i = schedule.GetRetry(counted);
         }
-        else
-            dialog->SetItemTextAndIcon(i, 2, LoadStr(IDS_CANCELED));
+        if (i == -1 || !worker.VerifyFile(i, TRUE, counted))
+            break;
     }
 
-    delete pCalculator;
+    // let the helper threads finish their files
+    schedule.Stop();
+    while (helpersCount > 0)
+    {
+        helpersCount--;
+        ThreadQueue.WaitForExit(helperThreads[helpersCount]);
+        delete helpers[helpersCount];
+    }
+    AddFileReaders(-fileReaders);
+    if (order != NULL)
+        free(order);
+
     TRACE_I("End");
     PostMessage(dialog->HWindow, WM_USER_ENDWORK, 0, 0);
     return 0;
@@ -1817,7 +2290,7 @@ void CVerifyDialog::OnThreadEnd()
         }
         else
         {
-            sprintf(text, LoadStr(IDS_RESULT), nCorrupt, nMissing, nSkipped);
+            sprintf(text, LoadStr(IDS_RESULT), nOK, nCorrupt, nMissing, nSkipped);
         }
     }
     SetDlgItemText(HWindow, IDC_LABEL_RESULT, text);
@@ -1841,7 +2314,7 @@ INT_PTR CVerifyDialog::DialogProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
         SalamanderGeneral->MultiMonCenterWindow(HWindow, hParent, TRUE);
         SendMessage(GetDlgItem(HWindow, IDC_PROGRESS), PBM_SETRANGE, 0, MAKELPARAM(0, 1024));
         ShowWindow(GetDlgItem(HWindow, IDC_LABEL_RESULT), SW_HIDE);
-        nMissing = nCorrupt = nSkipped = 0;
+        nOK = nMissing = nCorrupt = nSkipped = 0;
         bCanceled = FALSE;
         ModelessQueue.Add(new CWindowQueueItem(HWindow));
         SetWindowText(HWindow, LoadStr(IDS_VERIFYTITLE)); // provisional title (avoid empty caption if an error pops up)
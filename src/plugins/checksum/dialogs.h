@@ -97,6 +97,7 @@ protected:
     TIndirectArray<FILELISTITEM> FileList;
 
     friend class CCalculateThread;
+    friend class CCalculateWorker;
     friend class CVerifyThread;
     friend class CSFVMD5ListView;
 };
@@ -161,6 +162,7 @@ protected:
     DWORD RefreshCounter;
 
     friend class CCalculateThread;
+    friend class CCalculateWorker;
 };
 
 #define DIGEST_MAX_SIZE 64
@@ -194,9 +196,10 @@ protected:
     char* sourceFile;
     SHashInfo* pHashInfo;
     BOOL bCanceled;
-    int nCorrupt, nMissing, nSkipped;
+    LONG nOK, nCorrupt, nMissing, nSkipped; // changed by several threads at once, see CVerifyWorker
 
     friend class CVerifyThread;
+    friend class CVerifyWorker;
 };
 
 BOOL OpenCalculateDialog(HWND parent);
@@ -0,0 +1,275 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+#include "checksum.h"
+#include "dialogs.h"
+#include "parallel.h"
+#include "jobpool.h"
+
+int GetFileReadersCount(const char* path)
+{
+    CALL_STACK_MESSAGE2("GetFileReadersCount(%s)", path);
+    if (!SalamanderGeneral->IsPathOnSSD(path))
+        return 1; // seeking between several files would only slow the disk down
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int count = (int)si.dwNumberOfProcessors;
+    if (count < 1)
+        count = 1;
+    return min(count, MAX_FILE_READERS);
+}
+
+// number of files read at once by all running workers (both Calculate and Verify can run)
+static LONG FileReaders = 0;
+
+void AddFileReaders(int count)
+{
+    InterlockedExchangeAdd(&FileReaders, count);
+}
+
+int GetHashThreadsCount()
+{
+    LONG readers = FileReaders;
+    int threads = CParallelJob::GetThreadsCount();
+    if (readers > 1)
+        threads /= readers;
+    return max(threads, 1);
+}
+
+// ****************************************************************************
+//
+// CHashPipeline
+//
+
+CHashPipeline::CHashPipeline()
+{
+    StagesCount = 0;
+    Threaded = FALSE;
+    Pending = FALSE;
+    Exit = FALSE;
+    Data = NULL;
+    DataSize = 0;
+}
+
+CHashPipeline::~CHashPipeline()
+{
+    Stop();
+}
+
+void CHashPipeline::Start(CHashAlgo** algos, int count)
+{
+    CALL_STACK_MESSAGE2("CHashPipeline::Start(, %d)", count);
+    Stop();
+    StagesCount = min(count, HT_COUNT);
+    Exit = FALSE;
+    Threaded = TRUE;
+    int i;
+    for (i = 0; i < StagesCount; i++)
+    {
+        CHashStage* stage = &Stages[i];
+        stage->Pipeline = this;
+        stage->Algo = algos[i];
+        stage->Thread = NULL;
+        stage->Go = HANDLES(CreateEvent(NULL, FALSE, FALSE, NULL));
+        stage->Done = HANDLES(CreateEvent(NULL, FALSE, FALSE, NULL));
+        if (stage->Go != NULL && stage->Done != NULL)
+            stage->Thread = ThreadQueue.StartThread(ThreadBody, stage);
+        if (stage->Thread == NULL)
+            Threaded = FALSE;
+    }
+    if (!Threaded)
+    {
+        TRACE_E("CHashPipeline::Start(): Failed to start helper threads, hashing sequentially.");
+        Stop();
+        StagesCount = min(count, HT_COUNT); // the algorithms are updated in the calling thread
+    }
+}
+
+void CHashPipeline::Stop()
+{
+    CALL_STACK_MESSAGE1("CHashPipeline::Stop()");
+    Wait();
+    Exit = TRUE;
+    int i;
+    for (i = 0; i < StagesCount; i++)
+    {
+        CHashStage* stage = &Stages[i];
+        if (stage->Thread != NULL)
+        {
+            SetEvent(stage->Go);
+            ThreadQueue.WaitForExit(stage->Thread);
+            stage->Thread = NULL;
+        }
+        if (stage->Go != NULL)
+            HANDLES(CloseHandle(stage->Go));
+        if (stage->Done != NULL)
+            HANDLES(CloseHandle(stage->Done));
+        stage->Go = NULL;
+        stage->Done = NULL;
+    }
+    StagesCount = 0;
+    Threaded = FALSE;
+}
+
+void CHashPipeline::Init()
+{
+    CALL_STACK_MESSAGE1("CHashPipeline::Init()");
+    Wait();
+    int i;
+    for (i = 0; i < StagesCount; i++)
+        Stages[i].Algo->Init();
+}
+
+void CHashPipeline::Update(const char* buf, DWORD size)
+{
+    CALL_STACK_MESSAGE_NONE // frequently called function
+    // CALL_STACK_MESSAGE2("CHashPipeline::Update(, %u)", size);
+    Wait();
+    int i;
+    if (!Threaded)
+    {
+        for (i = 0; i < StagesCount; i++)
+            Stages[i].Algo->Update(buf, size);
+        return;
+    }
+    Data = buf;
+    DataSize = size;
+    Pending = TRUE;
+    for (i = 0; i < StagesCount; i++)
+        SetEvent(Stages[i].Go);
+}
+
+void CHashPipeline::Wait()
+{
+    CALL_STACK_MESSAGE_NONE // frequently called function
+    if (Pending)
+    {
+        HANDLE done[HT_COUNT];
+        int i;
+        for (i = 0; i < StagesCount; i++)
+            done[i] = Stages[i].Done;
+        WaitForMultipleObjects(StagesCount, done, TRUE, INFINITE);
+        Pending = FALSE;
+    }
+}
+
+void CHashPipeline::Finalize()
+{
+    CALL_STACK_MESSAGE1("CHashPipeline::Finalize()");
+    Wait();
+    int i;
+    for (i = 0; i < StagesCount; i++)
+        Stages[i].Algo->Finalize();
+}
+
+unsigned WINAPI
+CHashPipeline::ThreadBody(void* param)
+{
+    CALL_STACK_MESSAGE1("CHashPipeline::ThreadBody()");
+    CHashStage* stage = (CHashStage*)param;
+    CHashPipeline* pipeline = stage->Pipeline;
+    while (WaitForSingleObject(stage->Go, INFINITE) == WAIT_OBJECT_0 && !pipeline->Exit)
+    {
+        stage->Algo->Update(pipeline->Data, pipeline->DataSize);
+        SetEvent(stage->Done);
+    }
+    return 0;
+}
+
+// ****************************************************************************
+//
+// CFileSchedule
+//
+
+CFileSchedule::CFileSchedule(int count) : Retries(16, 16)
+{
+    HANDLES(InitializeCriticalSection(&CS));
+    Count = count;
+    Next = 0;
+    Order = NULL;
+    FirstUnfinished = 0;
+    Finished = (BYTE*)calloc(max(count, 1), sizeof(BYTE));
+    if (Finished == NULL)
+        TRACE_E("CFileSchedule::CFileSchedule(): Low memory!");
+}
+
+CFileSchedule::~CFileSchedule()
+{
+    if (Finished != NULL)
+        free(Finished);
+    HANDLES(DeleteCriticalSection(&CS));
+}
+
+int CFileSchedule::GetNext()
+{
+    CALL_STACK_MESSAGE1("CFileSchedule::GetNext()");
+    HANDLES(EnterCriticalSection(&CS));
+    int index = -1;
+    if (Next < Count)
+    {
+        index = Order != NULL ? Order[Next] : Next;
+        Next++;
+    }
+    HANDLES(LeaveCriticalSection(&CS));
+    return index;
+}
+
+int CFileSchedule::GetRetry(CQuadWord& counted)
+{
+    CALL_STACK_MESSAGE1("CFileSchedule::GetRetry()");
+    int index = -1;
+    HANDLES(EnterCriticalSection(&CS));
+    if (Retries.Count > 0)
+    {
+        // the file closest to the beginning of the list holds up the results most
+        int best = 0;
+        int i;
+        for (i = 1; i < Retries.Count; i++)
+        {
+            if (Retries[i].Index < Retries[best].Index)
+                best = i;
+        }
+        index = Retries[best].Index;
+        counted = Retries[best].Counted;
+        Retries.Delete(best);
+    }
+    HANDLES(LeaveCriticalSection(&CS));
+    return index;
+}
+
+void CFileSchedule::Retry(int index, const CQuadWord& counted)
+{
+    CALL_STACK_MESSAGE2("CFileSchedule::Retry(%d, )", index);
+    CRetryFile file;
+    file.Index = index;
+    file.Counted = counted;
+    HANDLES(EnterCriticalSection(&CS));
+    Retries.Add(file);
+    BOOL added = Retries.IsGood();
+    if (!added)
+        Retries.ResetState();
+    HANDLES(LeaveCriticalSection(&CS));
+    if (!added) // low memory, the file is left without hashes, the following files must not wait for it
+        Finish(index);
+}
+
+int CFileSchedule::Finish(int index)
+{
+    CALL_STACK_MESSAGE2("CFileSchedule::Finish(%d)", index);
+    HANDLES(EnterCriticalSection(&CS));
+    Finished[index] = TRUE;
+    while (FirstUnfinished < Count && Finished[FirstUnfinished])
+        FirstUnfinished++;
+    int first = FirstUnfinished;
+    HANDLES(LeaveCriticalSection(&CS));
+    return first;
+}
+
+void CFileSchedule::Stop()
+{
+    CALL_STACK_MESSAGE1("CFileSchedule::Stop()");
+    HANDLES(EnterCriticalSection(&CS));
+    Next = Count;
+    HANDLES(LeaveCriticalSection(&CS));
+}
@@ -0,0 +1,139 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// the highest number of files read at once from one device (see GetFileReadersCount())
+#define MAX_FILE_READERS 4
+
+// returns how many files may be read at once from the device with 'path': seeking
+// disks (and network paths which cannot be tested) read one file at a time, several
+// files are read at once only from SSD
+int GetFileReadersCount(const char* path);
+
+// the workers register the files they read at once ('count' readers when they start, -'count'
+// when they end), the algorithms hashing one file in several threads then share the processors
+// with the other readers (see GetHashThreadsCount())
+void AddFileReaders(int count);
+
+// returns the number of threads one algorithm may use for hashing one file: the processors
+// divided among all files being read at once, at least 1
+int GetHashThreadsCount();
+
+// ****************************************************************************
+//
+// CHashPipeline
+//
+// Hands the buffers read from one file to several hash algorithms at once: every
+// algorithm is updated by its own helper thread, so the file is read only once,
+// the next buffer is read while the previous one is hashed and the time spent
+// on one buffer is given by the slowest algorithm instead of by the sum of all
+// of them.
+//
+
+class CHashPipeline;
+
+struct CHashStage
+{
+    CHashPipeline* Pipeline;
+    CHashAlgo* Algo;
+    HANDLE Thread; // NULL = the helper thread is not running
+    HANDLE Go;     // signaled when there is a new buffer for 'Algo'
+    HANDLE Done;   // signaled when 'Algo' has processed the buffer
+};
+
+class CHashPipeline
+{
+public:
+    CHashPipeline();
+    ~CHashPipeline();
+
+    // starts the helper threads for 'count' algorithms from 'algos' (they are not
+    // deallocated by the pipeline); if the threads cannot be started, the algorithms
+    // are updated sequentially in the calling thread
+    void Start(CHashAlgo** algos, int count);
+
+    // ends the helper threads
+    void Stop();
+
+    // calls Init() of all algorithms, the previous file must be finished
+    void Init();
+
+    // hands 'buf' over to the algorithms and returns without waiting for them; 'buf'
+    // must not be changed until the next call to Update() or Wait()
+    void Update(const char* buf, DWORD size);
+
+    // waits until all algorithms have processed the last buffer
+    void Wait();
+
+    // waits for the last buffer and calls Finalize() of all algorithms
+    void Finalize();
+
+protected:
+    static unsigned WINAPI ThreadBody(void* param);
+
+    CHashStage Stages[HT_COUNT];
+    int StagesCount;
+    BOOL Threaded; // TRUE = the algorithms are updated by the helper threads
+    BOOL Pending;  // TRUE = the helper threads are processing a buffer
+    BOOL Exit;     // TRUE = the helper threads should end
+
+    const char* Data; // the buffer being processed by the helper threads
+    DWORD DataSize;
+};
+
+// ****************************************************************************
+//
+// CFileSchedule
+//
+// Distributes the files of a list among several threads hashing them at once and
+// keeps track of the files done, so the results can be shown in the list order.
+// The files are processed in the list order or in the order given by SetOrder().
+// The files which a helper thread could not read are returned to the schedule and
+// processed by the worker thread which may ask the user what to do.
+//
+
+struct CRetryFile
+{
+    int Index;
+    CQuadWord Counted; // the part of the file already added to the progress
+};
+
+class CFileSchedule
+{
+public:
+    CFileSchedule(int count);
+    ~CFileSchedule();
+
+    BOOL IsGood() { return Finished != NULL; }
+
+    // GetNext() will return the files in the order of indexes from 'order' ('count' items
+    // given to the constructor); the array must exist until the schedule is deallocated
+    void SetOrder(const int* order) { Order = order; }
+
+    // returns the next file to process, -1 if there are no more files
+    int GetNext();
+
+    // returns a file passed to Retry(), -1 if there is none; 'counted' receives the part
+    // of the file already added to the progress
+    int GetRetry(CQuadWord& counted);
+
+    // returns file 'index' which could not be processed without asking the user
+    void Retry(int index, const CQuadWord& counted);
+
+    // marks file 'index' as done; returns the index of the first file which is not done
+    // yet (all files before it are done)
+    int Finish(int index);
+
+    // GetNext() will not return any other file
+    void Stop();
+
+protected:
+    CRITICAL_SECTION CS;
+    int Count;
+    int Next;            // the position of the file returned by the next call to GetNext()
+    const int* Order;    // NULL = the list order, see SetOrder()
+    int FirstUnfinished; // all files before this one are done
+    BYTE* Finished;      // TRUE for the files which are done
+    TDirectArray<CRetryFile> Retries;
+};
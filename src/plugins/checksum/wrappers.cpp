@@ -5,6 +5,10 @@
 #include "checksum.h"
 #include "wrappers.h"
 #include "misc.h"
+#include "jobpool.h"
+#include "parallel.h"
+#include "blake3.h"
+#include "xxh3.h"
 #include "tomcrypt\tomcrypt.h"
 
 class CCRCAlgo : public CHashAlgo
@@ -119,6 +123,71 @@ private:
     hash_state sha512;
 };
 
+// the lowest number of chunks worth splitting among several threads
+#define BLAKE3_PARALLEL_MIN 32
+
+// BLAKE3 hasher spreading the whole chunks of big buffers over several threads
+class CParallelBlake3Hasher : public CBlake3Hasher, public CParallelJob
+{
+public:
+    CParallelBlake3Hasher();
+
+protected:
+    virtual void HashChunks(const BYTE* input, size_t count, UINT64 counter, DWORD (*cvs)[8]);
+    virtual void Run(int part);
+
+    BOOL Started; // TRUE = the helper threads were started (they are started on first use)
+
+    // the chunks being hashed
+    const BYTE* Input;
+    size_t Count;
+    UINT64 Counter;
+    DWORD (*CVs)[8];
+    size_t PartSize; // number of chunks hashed by one call to Run()
+};
+
+class CBLAKE3Algo : public CGenericHashAlgo
+{
+public:
+    CBLAKE3Algo();
+    ~CBLAKE3Algo();
+
+    virtual bool IsOK(); // Was constructed successfully?
+    virtual bool Init(); // Init for a new file. true on success
+    virtual bool Update(const char* buf, DWORD size);
+    virtual bool Finalize();
+    virtual int GetDigest(char* buf, DWORD bufsize); // Returns # of copied binary bytes
+
+protected:
+    virtual const char* GetID() { return "BLAKE3"; };
+    virtual int GetIDLen() { return 6; };
+    virtual int GetDigestLen() { return BLAKE3_DIGEST_SIZE; }; // ensure DIGEST_MAX_SIZE remains large enough!
+
+private:
+    CParallelBlake3Hasher blake3;
+};
+
+class CXXH3Algo : public CGenericHashAlgo
+{
+public:
+    CXXH3Algo();
+    ~CXXH3Algo();
+
+    virtual bool IsOK(); // Was constructed successfully?
+    virtual bool Init(); // Init for a new file. true on success
+    virtual bool Update(const char* buf, DWORD size);
+    virtual bool Finalize();
+    virtual int GetDigest(char* buf, DWORD bufsize); // Returns # of copied binary bytes
+
+protected:
+    virtual const char* GetID() { return "XXH128"; }; // the tag written by "xxhsum --tag -H2"
+    virtual int GetIDLen() { return 6; };
+    virtual int GetDigestLen() { return XXH3_DIGEST_SIZE; }; // ensure DIGEST_MAX_SIZE remains large enough!
+
+private:
+    CXXH3Hasher xxh3;
+};
+
 CHashAlgo* CRCFactory()
 {
     CCRCAlgo* pCalculator;
@@ -184,6 +253,32 @@ CHashAlgo* SHA512Factory()
     return NULL;
 }
 
+CHashAlgo* BLAKE3Factory()
+{
+    CBLAKE3Algo* pCalculator;
+
+    pCalculator = new CBLAKE3Algo();
+    if (pCalculator->IsOK())
+    {
+        return pCalculator;
+    }
+    delete pCalculator;
+    return NULL;
+}
+
+CHashAlgo* XXH3Factory()
+{
+    CXXH3Algo* pCalculator;
+
+    pCalculator = new CXXH3Algo();
+    if (pCalculator->IsOK())
+    {
+        return pCalculator;
+    }
+    delete pCalculator;
+    return NULL;
+}
+
 ////////////////////////////// CRC algorithm ///////////////////////////
 
 CCRCAlgo::CCRCAlgo()
@@ -524,3 +619,136 @@ int CSHA512Algo::GetDigest(char* buf, DWORD bufsize)
     }
     return 0;
 }
+
+////////////////////////////// BLAKE3 algorithm ///////////////////////////
+
+CParallelBlake3Hasher::CParallelBlake3Hasher()
+{
+    Started = FALSE;
+    Input = NULL;
+    Count = 0;
+    Counter = 0;
+    CVs = NULL;
+    PartSize = 0;
+}
+
+void CParallelBlake3Hasher::HashChunks(const BYTE* input, size_t count, UINT64 counter, DWORD (*cvs)[8])
+{
+    if (count >= BLAKE3_PARALLEL_MIN && !Started)
+    {
+        Start(GetHashThreadsCount()); // the other files being read at once use the other processors
+        Started = TRUE;
+    }
+    int workers = Started ? GetWorkers() : 1;
+    if (count < BLAKE3_PARALLEL_MIN || workers == 1)
+    {
+        Blake3HashChunks(input, count, counter, cvs);
+        return;
+    }
+    Input = input;
+    Count = count;
+    Counter = counter;
+    CVs = cvs;
+    // SSE2 code hashes four chunks at once, so the parts are multiples of four
+    PartSize = ((count + workers - 1) / workers + 3) & ~(size_t)3;
+    Execute((int)((count + PartSize - 1) / PartSize));
+}
+
+void CParallelBlake3Hasher::Run(int part)
+{
+    size_t first = part * PartSize;
+    size_t count = Count - first;
+    if (count > PartSize)
+        count = PartSize;
+    Blake3HashChunks(Input + first * BLAKE3_CHUNK_LEN, count, Counter + first, CVs + first);
+}
+
+CBLAKE3Algo::CBLAKE3Algo()
+{
+}
+
+CBLAKE3Algo::~CBLAKE3Algo()
+{
+}
+
+bool CBLAKE3Algo::IsOK()
+{
+    return true;
+}
+
+bool CBLAKE3Algo::Init()
+{
+    blake3.Init();
+    return true;
+}
+
+bool CBLAKE3Algo::Update(const char* buf, DWORD size)
+{
+    blake3.Update((const BYTE*)buf, size);
+    return true;
+}
+
+bool CBLAKE3Algo::Finalize()
+{
+    return true;
+}
+
+int CBLAKE3Algo::GetDigest(char* buf, DWORD bufsize)
+{
+    if (bufsize >= BLAKE3_DIGEST_SIZE)
+    {
+        blake3.GetDigest((BYTE*)buf);
+        return BLAKE3_DIGEST_SIZE;
+    }
+    else
+    {
+        TRACE_E("Small buffer size!");
+    }
+    return 0;
+}
+
+////////////////////////////// XXH3 algorithm ///////////////////////////
+
+CXXH3Algo::CXXH3Algo()
+{
+}
+
+CXXH3Algo::~CXXH3Algo()
+{
+}
+
+bool CXXH3Algo::IsOK()
+{
+    return true;
+}
+
+bool CXXH3Algo::Init()
+{
+    xxh3.Init();
+    return true;
+}
+
+bool CXXH3Algo::Update(const char* buf, DWORD size)
+{
+    xxh3.Update((const BYTE*)buf, size);
+    return true;
+}
+
+bool CXXH3Algo::Finalize()
+{
+    return true;
+}
+
+int CXXH3Algo::GetDigest(char* buf, DWORD bufsize)
+{
+    if (bufsize >= XXH3_DIGEST_SIZE)
+    {
+        xxh3.GetDigest((BYTE*)buf);
+        return XXH3_DIGEST_SIZE;
+    }
+    else
+    {
+        TRACE_E("Small buffer size!");
+    }
+    return 0;
+}
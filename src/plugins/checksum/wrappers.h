@@ -24,3 +24,5 @@ CHashAlgo* MD5Factory();
 CHashAlgo* SHA1Factory();
 CHashAlgo* SHA256Factory();
 CHashAlgo* SHA512Factory();
+CHashAlgo* BLAKE3Factory();
+CHashAlgo* XXH3Factory();
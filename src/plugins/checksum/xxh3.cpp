@@ -0,0 +1,458 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+#include "xxh3.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// The algorithm follows the reference implementation of XXH3 (xxhash.h by Yann Collet,
+// BSD 2-Clause License, https://github.com/Cyan4973/xxHash), only the 128-bit variant
+// with the default secret and zero seed is implemented.
+
+#if defined(_M_IX86) || defined(_M_X64)
+static BOOL XXH3UseSSE2 = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+#endif
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+#define XXH_PRIME_MX1 0x165667919E3779F9ULL
+#define XXH_PRIME_MX2 0x9FB21C651E98DF25ULL
+
+#define XXH_STRIPE_LEN 64
+#define XXH_SECRET_SIZE 192 // size of the default secret
+// the secret for scrambling, the secret moves by 8 bytes per stripe up to this offset
+#define XXH_SECRET_LIMIT (XXH_SECRET_SIZE - XXH_STRIPE_LEN)
+#define XXH_STRIPES_PER_BLOCK (XXH_SECRET_LIMIT / 8)
+#define XXH_SECRET_LASTACC_START 7
+#define XXH_SECRET_MERGEACCS_START 11
+#define XXH_SECRET_SIZE_MIN 136
+#define XXH_MIDSIZE_MAX 240
+#define XXH_MIDSIZE_STARTOFFSET 3
+#define XXH_MIDSIZE_LASTOFFSET 17
+
+// pseudorandom secret taken from FARSH
+static const BYTE XXH3Secret[XXH_SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+struct CXXH128
+{
+    UINT64 Low;
+    UINT64 High;
+};
+
+static inline DWORD ReadLE32(const BYTE* p)
+{
+    DWORD v;
+    memcpy(&v, p, sizeof(v)); // all supported platforms are little endian
+    return v;
+}
+
+static inline UINT64 ReadLE64(const BYTE* p)
+{
+    UINT64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline DWORD Swap32(DWORD v)
+{
+    return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+}
+
+static inline UINT64 Swap64(UINT64 v)
+{
+    return ((UINT64)Swap32((DWORD)v) << 32) | Swap32((DWORD)(v >> 32));
+}
+
+static inline UINT64 XorShift64(UINT64 v, int shift)
+{
+    return v ^ (v >> shift);
+}
+
+// returns the full 128-bit product of 'lhs' and 'rhs'
+static inline CXXH128 Mult64To128(UINT64 lhs, UINT64 rhs)
+{
+    CXXH128 r;
+#if defined(_M_X64)
+    r.Low = _umul128(lhs, rhs, &r.High);
+#else
+    UINT64 loLo = (UINT64)(DWORD)lhs * (DWORD)rhs;
+    UINT64 hiLo = (lhs >> 32) * (DWORD)rhs;
+    UINT64 loHi = (UINT64)(DWORD)lhs * (rhs >> 32);
+    UINT64 hiHi = (lhs >> 32) * (rhs >> 32);
+    UINT64 cross = (loLo >> 32) + (DWORD)hiLo + loHi;
+    r.High = (hiLo >> 32) + (cross >> 32) + hiHi;
+    r.Low = (cross << 32) | (DWORD)loLo;
+#endif
+    return r;
+}
+
+static inline UINT64 Mul128Fold64(UINT64 lhs, UINT64 rhs)
+{
+    CXXH128 product = Mult64To128(lhs, rhs);
+    return product.Low ^ product.High;
+}
+
+static UINT64 XXH64Avalanche(UINT64 h)
+{
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static UINT64 XXH3Avalanche(UINT64 h)
+{
+    h = XorShift64(h, 37);
+    h *= XXH_PRIME_MX1;
+    return XorShift64(h, 32);
+}
+
+// ****************************************************************************
+//
+// Short inputs (up to XXH_MIDSIZE_MAX bytes)
+//
+
+static CXXH128 Hash0To16(const BYTE* input, size_t len, const BYTE* secret)
+{
+    CXXH128 h;
+    if (len > 8)
+    {
+        UINT64 bitflipl = ReadLE64(secret + 32) ^ ReadLE64(secret + 40);
+        UINT64 bitfliph = ReadLE64(secret + 48) ^ ReadLE64(secret + 56);
+        UINT64 inputLo = ReadLE64(input);
+        UINT64 inputHi = ReadLE64(input + len - 8);
+        CXXH128 m = Mult64To128(inputLo ^ inputHi ^ bitflipl, XXH_PRIME64_1);
+        m.Low += (UINT64)(len - 1) << 54;
+        inputHi ^= bitfliph;
+        m.High += (inputHi & 0xFFFFFFFF00000000ULL) + (UINT64)(DWORD)inputHi * XXH_PRIME32_2;
+        m.Low ^= Swap64(m.High);
+        h = Mult64To128(m.Low, XXH_PRIME64_2);
+        h.High += m.High * XXH_PRIME64_2;
+        h.Low = XXH3Avalanche(h.Low);
+        h.High = XXH3Avalanche(h.High);
+        return h;
+    }
+    if (len >= 4)
+    {
+        UINT64 input64 = ReadLE32(input) + ((UINT64)ReadLE32(input + len - 4) << 32);
+        UINT64 keyed = input64 ^ (ReadLE64(secret + 16) ^ ReadLE64(secret + 24));
+        // 'len' is shifted to the left to make it even, this avoids even multiplies
+        h = Mult64To128(keyed, XXH_PRIME64_1 + (len << 2));
+        h.High += h.Low << 1;
+        h.Low ^= h.High >> 3;
+        h.Low = XorShift64(h.Low, 35);
+        h.Low *= XXH_PRIME_MX2;
+        h.Low = XorShift64(h.Low, 28);
+        h.High = XXH3Avalanche(h.High);
+        return h;
+    }
+    if (len > 0)
+    {
+        DWORD combinedl = ((DWORD)input[0] << 16) | ((DWORD)input[len >> 1] << 24) |
+                          (DWORD)input[len - 1] | ((DWORD)len << 8);
+        DWORD swapped = Swap32(combinedl);
+        DWORD combinedh = (swapped << 13) | (swapped >> 19);
+        h.Low = XXH64Avalanche(combinedl ^ (UINT64)(ReadLE32(secret) ^ ReadLE32(secret + 4)));
+        h.High = XXH64Avalanche(combinedh ^ (UINT64)(ReadLE32(secret + 8) ^ ReadLE32(secret + 12)));
+        return h;
+    }
+    h.Low = XXH64Avalanche(ReadLE64(secret + 64) ^ ReadLE64(secret + 72));
+    h.High = XXH64Avalanche(ReadLE64(secret + 80) ^ ReadLE64(secret + 88));
+    return h;
+}
+
+static inline UINT64 Mix16B(const BYTE* input, const BYTE* secret)
+{
+    return Mul128Fold64(ReadLE64(input) ^ ReadLE64(secret), ReadLE64(input + 8) ^ ReadLE64(secret + 8));
+}
+
+static inline void Mix32B(CXXH128& acc, const BYTE* input1, const BYTE* input2, const BYTE* secret)
+{
+    acc.Low += Mix16B(input1, secret);
+    acc.Low ^= ReadLE64(input2) + ReadLE64(input2 + 8);
+    acc.High += Mix16B(input2, secret + 16);
+    acc.High ^= ReadLE64(input1) + ReadLE64(input1 + 8);
+}
+
+static CXXH128 FinishMidSize(const CXXH128& acc, size_t len)
+{
+    CXXH128 h;
+    h.Low = XXH3Avalanche(acc.Low + acc.High);
+    h.High = 0 - XXH3Avalanche(acc.Low * XXH_PRIME64_1 + acc.High * XXH_PRIME64_4 + len * XXH_PRIME64_2);
+    return h;
+}
+
+static CXXH128 Hash17To128(const BYTE* input, size_t len, const BYTE* secret)
+{
+    CXXH128 acc;
+    acc.Low = len * XXH_PRIME64_1;
+    acc.High = 0;
+    if (len > 32)
+    {
+        if (len > 64)
+        {
+            if (len > 96)
+                Mix32B(acc, input + 48, input + len - 64, secret + 96);
+            Mix32B(acc, input + 32, input + len - 48, secret + 64);
+        }
+        Mix32B(acc, input + 16, input + len - 32, secret + 32);
+    }
+    Mix32B(acc, input, input + len - 16, secret);
+    return FinishMidSize(acc, len);
+}
+
+static CXXH128 Hash129To240(const BYTE* input, size_t len, const BYTE* secret)
+{
+    CXXH128 acc;
+    acc.Low = len * XXH_PRIME64_1;
+    acc.High = 0;
+    size_t i;
+    for (i = 32; i < 160; i += 32)
+        Mix32B(acc, input + i - 32, input + i - 16, secret + i - 32);
+    acc.Low = XXH3Avalanche(acc.Low);
+    acc.High = XXH3Avalanche(acc.High);
+    // 'i <= len' duplicates the last 32 bytes if 'len' is a multiple of 32, the reference
+    // implementation does the same
+    for (i = 160; i <= len; i += 32)
+        Mix32B(acc, input + i - 32, input + i - 16, secret + XXH_MIDSIZE_STARTOFFSET + i - 160);
+    Mix32B(acc, input + len - 16, input + len - 32, secret + XXH_SECRET_SIZE_MIN - XXH_MIDSIZE_LASTOFFSET - 16);
+    return FinishMidSize(acc, len);
+}
+
+// ****************************************************************************
+//
+// Long inputs
+//
+
+// processes 'stripes' stripes of 'input', the secret moves by 8 bytes per stripe
+static void Accumulate(UINT64* acc, const BYTE* input, const BYTE* secret, size_t stripes)
+{
+#if defined(_M_IX86) || defined(_M_X64)
+    if (XXH3UseSSE2)
+    {
+        __m128i xacc[4];
+        int i;
+        for (i = 0; i < 4; i++)
+            xacc[i] = _mm_loadu_si128((const __m128i*)acc + i);
+        for (; stripes > 0; stripes--, input += XXH_STRIPE_LEN, secret += 8)
+        {
+            for (i = 0; i < 4; i++)
+            {
+                __m128i data = _mm_loadu_si128((const __m128i*)input + i);
+                __m128i key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i*)secret + i));
+                // (key & 0xFFFFFFFF) * (key >> 32) for both lanes
+                __m128i product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+                // the input is added to the adjacent lane
+                __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+                xacc[i] = _mm_add_epi64(xacc[i], _mm_add_epi64(product, swapped));
+            }
+        }
+        for (i = 0; i < 4; i++)
+            _mm_storeu_si128((__m128i*)acc + i, xacc[i]);
+        return;
+    }
+#endif
+    for (; stripes > 0; stripes--, input += XXH_STRIPE_LEN, secret += 8)
+    {
+        int lane;
+        for (lane = 0; lane < 8; lane++)
+        {
+            UINT64 data = ReadLE64(input + lane * 8);
+            UINT64 key = data ^ ReadLE64(secret + lane * 8);
+            acc[lane ^ 1] += data;
+            acc[lane] += (UINT64)(DWORD)key * (key >> 32);
+        }
+    }
+}
+
+static void ScrambleAcc(UINT64* acc, const BYTE* secret)
+{
+#if defined(_M_IX86) || defined(_M_X64)
+    if (XXH3UseSSE2)
+    {
+        const __m128i prime = _mm_set1_epi32((int)XXH_PRIME32_1);
+        int i;
+        for (i = 0; i < 4; i++)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)acc + i);
+            a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+            a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i*)secret + i));
+            // 64-bit multiply by a 32-bit constant composed of two 32x32 multiplies
+            __m128i productLo = _mm_mul_epu32(a, prime);
+            __m128i productHi = _mm_mul_epu32(_mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+            _mm_storeu_si128((__m128i*)acc + i, _mm_add_epi64(productLo, _mm_slli_epi64(productHi, 32)));
+        }
+        return;
+    }
+#endif
+    int lane;
+    for (lane = 0; lane < 8; lane++)
+    {
+        UINT64 a = acc[lane];
+        a = XorShift64(a, 47);
+        a ^= ReadLE64(secret + lane * 8);
+        acc[lane] = a * XXH_PRIME32_1;
+    }
+}
+
+static UINT64 MergeAccs(const UINT64* acc, const BYTE* secret, UINT64 start)
+{
+    UINT64 result = start;
+    int i;
+    for (i = 0; i < 4; i++)
+        result += Mul128Fold64(acc[2 * i] ^ ReadLE64(secret + 16 * i), acc[2 * i + 1] ^ ReadLE64(secret + 16 * i + 8));
+    return XXH3Avalanche(result);
+}
+
+// processes 'stripes' stripes of 'input' continuing in the current block of 'stripesSoFar'
+// stripes, 'stripesSoFar' is updated
+static void ConsumeStripes(UINT64* acc, DWORD& stripesSoFar, const BYTE* input, size_t stripes)
+{
+    const BYTE* secret = XXH3Secret + stripesSoFar * 8;
+    if (stripes >= XXH_STRIPES_PER_BLOCK - stripesSoFar)
+    {
+        // finish the current block and process whole blocks
+        size_t count = XXH_STRIPES_PER_BLOCK - stripesSoFar;
+        do
+        {
+            Accumulate(acc, input, secret, count);
+            ScrambleAcc(acc, XXH3Secret + XXH_SECRET_LIMIT);
+            input += count * XXH_STRIPE_LEN;
+            stripes -= count;
+            count = XXH_STRIPES_PER_BLOCK;
+            secret = XXH3Secret;
+        } while (stripes >= XXH_STRIPES_PER_BLOCK);
+        stripesSoFar = 0;
+    }
+    if (stripes > 0)
+    {
+        Accumulate(acc, input, secret, stripes);
+        stripesSoFar += (DWORD)stripes;
+    }
+}
+
+// ****************************************************************************
+//
+// CXXH3Hasher
+//
+
+void CXXH3Hasher::Init()
+{
+    Acc[0] = XXH_PRIME32_3;
+    Acc[1] = XXH_PRIME64_1;
+    Acc[2] = XXH_PRIME64_2;
+    Acc[3] = XXH_PRIME64_3;
+    Acc[4] = XXH_PRIME64_4;
+    Acc[5] = XXH_PRIME32_2;
+    Acc[6] = XXH_PRIME64_5;
+    Acc[7] = XXH_PRIME32_1;
+    BufferedSize = 0;
+    StripesSoFar = 0;
+    TotalLen = 0;
+}
+
+void CXXH3Hasher::Update(const BYTE* input, size_t size)
+{
+    TotalLen += size;
+    if (size <= sizeof(Buffer) - BufferedSize)
+    {
+        memcpy(Buffer + BufferedSize, input, size);
+        BufferedSize += (DWORD)size;
+        return;
+    }
+
+    // the buffer is always consumed only when more input follows, the last stripe has
+    // to be processed differently by GetDigest()
+    const BYTE* end = input + size;
+    if (BufferedSize > 0)
+    {
+        size_t load = sizeof(Buffer) - BufferedSize;
+        memcpy(Buffer + BufferedSize, input, load);
+        input += load;
+        ConsumeStripes(Acc, StripesSoFar, Buffer, sizeof(Buffer) / XXH_STRIPE_LEN);
+        BufferedSize = 0;
+    }
+    if (end - input > (ptrdiff_t)sizeof(Buffer))
+    {
+        size_t stripes = (size_t)(end - 1 - input) / XXH_STRIPE_LEN;
+        ConsumeStripes(Acc, StripesSoFar, input, stripes);
+        input += stripes * XXH_STRIPE_LEN;
+        // GetDigest() may need the end of the last consumed stripe
+        memcpy(Buffer + sizeof(Buffer) - XXH_STRIPE_LEN, input - XXH_STRIPE_LEN, XXH_STRIPE_LEN);
+    }
+    memcpy(Buffer, input, end - input);
+    BufferedSize = (DWORD)(end - input);
+}
+
+void CXXH3Hasher::GetDigest(BYTE* digest)
+{
+    CXXH128 h;
+    if (TotalLen > XXH_MIDSIZE_MAX)
+    {
+        // the state is not changed, work on a copy of it
+        UINT64 acc[8];
+        memcpy(acc, Acc, sizeof(acc));
+        DWORD stripesSoFar = StripesSoFar;
+        BYTE lastStripe[XXH_STRIPE_LEN];
+        const BYTE* lastStripePtr;
+        if (BufferedSize >= XXH_STRIPE_LEN)
+        {
+            ConsumeStripes(acc, stripesSoFar, Buffer, (BufferedSize - 1) / XXH_STRIPE_LEN);
+            lastStripePtr = Buffer + BufferedSize - XXH_STRIPE_LEN;
+        }
+        else
+        {
+            // the last stripe is completed from the end of the previous one
+            size_t catchup = XXH_STRIPE_LEN - BufferedSize;
+            memcpy(lastStripe, Buffer + sizeof(Buffer) - catchup, catchup);
+            memcpy(lastStripe + catchup, Buffer, BufferedSize);
+            lastStripePtr = lastStripe;
+        }
+        Accumulate(acc, lastStripePtr, XXH3Secret + XXH_SECRET_LIMIT - XXH_SECRET_LASTACC_START, 1);
+        h.Low = MergeAccs(acc, XXH3Secret + XXH_SECRET_MERGEACCS_START, TotalLen * XXH_PRIME64_1);
+        h.High = MergeAccs(acc, XXH3Secret + XXH_SECRET_SIZE - sizeof(acc) - XXH_SECRET_MERGEACCS_START,
+                           ~(TotalLen * XXH_PRIME64_2));
+    }
+    else
+    {
+        // all input is in the buffer
+        if (TotalLen <= 16)
+            h = Hash0To16(Buffer, (size_t)TotalLen, XXH3Secret);
+        else if (TotalLen <= 128)
+            h = Hash17To128(Buffer, (size_t)TotalLen, XXH3Secret);
+        else
+            h = Hash129To240(Buffer, (size_t)TotalLen, XXH3Secret);
+    }
+
+    // canonical representation: big endian, the high half first
+    int i;
+    for (i = 0; i < 8; i++)
+    {
+        digest[i] = (BYTE)(h.High >> (56 - 8 * i));
+        digest[8 + i] = (BYTE)(h.Low >> (56 - 8 * i));
+    }
+}
@@ -0,0 +1,35 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// ****************************************************************************
+//
+// CXXH3Hasher
+//
+// Calculates 128-bit XXH3 (XXH128 with the default secret and zero seed), the
+// non-cryptographic hash of the xxHash project; its digest matches the output
+// of "xxhsum -H2".
+//
+
+#define XXH3_DIGEST_SIZE 16
+
+class CXXH3Hasher
+{
+public:
+    CXXH3Hasher() { Init(); }
+
+    void Init();
+    void Update(const BYTE* input, size_t size);
+
+    // stores the digest to 'digest' (XXH3_DIGEST_SIZE bytes, big endian like in
+    // the output of xxhsum); the hasher may be updated further
+    void GetDigest(BYTE* digest);
+
+protected:
+    UINT64 Acc[8];
+    BYTE Buffer[256];   // the input not consumed yet (all input if there is not more than 240 bytes)
+    DWORD BufferedSize; // number of bytes in 'Buffer'
+    DWORD StripesSoFar; // number of stripes consumed in the current block
+    UINT64 TotalLen;    // number of bytes passed to Update()
+};
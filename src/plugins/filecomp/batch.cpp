@@ -0,0 +1,565 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+
+using namespace std;
+
+#define BATCH_BLOCK_SIZE (256 * 1024) // size of the blocks compared by the binary fast path
+
+// ****************************************************************************
+//
+// CBatchPair
+//
+
+CBatchPair::CBatchPair(const char* name, const char* path1, const char* path2)
+{
+    lstrcpyn(Name, name, MAX_PATH);
+    lstrcpyn(Paths[0], path1, MAX_PATH);
+    lstrcpyn(Paths[1], path2, MAX_PATH);
+    Result = brWaiting;
+    Sizes[0] = Sizes[1] = 0;
+    Text = FALSE;
+    Changes = 0;
+    Lines[0] = Lines[1] = 0;
+    FirstChange = (QWORD)-1;
+    *Error = 0;
+}
+
+// ****************************************************************************
+//
+// CBatchCompareJob
+//
+
+class CBatchCompareJob : public CFilecompJob
+{
+public:
+    CBatchCompareJob(CBatchCompareWorker* worker, CBatchPairs& pairs, HWND window)
+        : Worker(worker), Pairs(pairs), Window(window) {}
+
+    virtual void RunPart(size_t index)
+    {
+        Worker->ComparePair(Pairs[index]);
+        PostMessage(Window, WM_USER_BATCHNOTIFIES, BWN_PAIR_COMPARED, (LPARAM)index);
+    }
+
+protected:
+    CBatchCompareWorker* Worker;
+    CBatchPairs& Pairs;
+    HWND Window;
+};
+
+// ****************************************************************************
+//
+// CBatchCompareWorker
+//
+
+CBatchCompareWorker::CBatchCompareWorker(HWND window, CBatchPairs& pairs, const CCompareOptions& options,
+                                         const int& cancelFlag, HANDLE event)
+    : CThread("Filecomp Batch Worker"), Pairs(pairs), CancelFlag(cancelFlag)
+{
+    Window = window;
+    Options = options;
+    Event = event;
+
+    if (Options.IgnoreLineBreakChanges)
+    {
+        Options.IgnoreSpaceChange = 1; // safety measure
+        Options.DetailedDifferences = 1;
+    }
+    Options.IgnoreSomeSpace = Options.IgnoreSpaceChange || Options.IgnoreAllSpace;
+}
+
+unsigned
+CBatchCompareWorker::Body()
+{
+    CALL_STACK_MESSAGE1("CBatchCompareWorker::Body()");
+    try
+    {
+        // errors of single pairs are stored in the pairs, only cancel gets here
+        CBatchCompareJob job(this, Pairs, Window);
+        job.Execute(Pairs.size());
+    }
+    catch (CFilecompWorker::CAbortByUserException e)
+    {
+        TRACE_I("Operation canceled. CancelFlag = " << CancelFlag);
+    }
+    catch (CFilecompWorker::CException e)
+    {
+        TRACE_E("Error in batch worker. " << e.what());
+    }
+    PostMessage(Window, WM_USER_BATCHNOTIFIES, BWN_FINISHED, 0);
+    SetEvent(Event);
+    return 0;
+}
+
+void CBatchCompareWorker::ComparePair(CBatchPair& pair)
+{
+    CALL_STACK_MESSAGE2("CBatchCompareWorker::ComparePair(%s)", pair.Name);
+    try
+    {
+        GuardedComparePair(pair);
+    }
+    catch (CFilecompWorker::CException e)
+    {
+        lstrcpyn(pair.Error, e.what(), SizeOf(pair.Error));
+        pair.Result = brError;
+    }
+    catch (std::bad_alloc e)
+    {
+        // too large text files, the remaining pairs can still be compared
+        lstrcpyn(pair.Error, LoadStr(IDS_LOWMEM), SizeOf(pair.Error));
+        pair.Result = brError;
+    }
+    catch (diff_exception e)
+    {
+        throw CFilecompWorker::CAbortByUserException();
+    }
+}
+
+// NOTE: pair.Result is set as the last member, the batch window reads the other
+// members only once the result is known
+void CBatchCompareWorker::GuardedComparePair(CBatchPair& pair)
+{
+    // open the files
+    CWorkerFileData files[2];
+    BOOL canBeText = !Options.ForceBinary;
+    int i;
+    for (i = 0; i <= 1; i++)
+    {
+        strcpy(files[i].Name, pair.Paths[i]);
+        files[i].File = CreateFile(files[i].Name, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                   NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (files[i].File == INVALID_HANDLE_VALUE)
+            CFilecompWorker::CException::Raise(IDS_OPEN, GetLastError(), files[i].Name);
+
+        CQuadWord size;
+        DWORD err;
+        if (!SG->SalGetFileSize(files[i].File, size, err))
+            CFilecompWorker::CException::Raise(IDS_ACCESFILE, err, files[i].Name);
+        files[i].Size = size.Value;
+        pair.Sizes[i] = files[i].Size;
+
+        if (files[i].Size > QWORD(numeric_limits<int>::max() - 1))
+        {
+            if (Options.ForceText)
+                CFilecompWorker::CException::Raise(IDS_LARGEFILE, 0, files[i].Name);
+            canBeText = FALSE;
+        }
+    }
+
+    // binary fast path: most pairs in a batch are usually identical and we do not
+    // need to decode them as text to find it out
+    if (files[0].Size == files[1].Size)
+    {
+        QWORD firstChange;
+        if (CompareBytes(files, firstChange))
+        {
+            pair.Result = brIdentical;
+            return;
+        }
+        pair.FirstChange = firstChange;
+    }
+
+    // the files differ, compare text files to learn whether the differences are
+    // ignored and how many lines they affect
+    if (canBeText)
+    {
+        CTextFileReader reader[2];
+        for (i = 0; i <= 1; i++)
+        {
+            reader[i].Set(files[i].Name, files[i].File, size_t(files[i].Size),
+                          Options.EolConversion[i], (CTextFileReader::eEncoding)Options.Encoding[i],
+                          (CTextFileReader::eEndian)Options.Endians[i], Options.PerformASCII8InputEnc[i],
+                          Options.ASCII8InputEncTableName[i], Options.NormalizationForm, false);
+            if (Options.ForceText)
+                reader[i].ForceType(CTextFileReader::ftText);
+        }
+
+        if (reader[0].GetType() == CTextFileReader::ftText &&
+            reader[1].GetType() == CTextFileReader::ftText)
+        {
+            CCompareOptions options = Options;
+            if (reader[0].GetEncoding() == CTextFileReader::encASCII8 &&
+                reader[1].GetEncoding() == CTextFileReader::encASCII8)
+            {
+                CFilecompCoWorkerOptimized<char>(NULL, options, CancelFlag).CountChanges(reader, pair.Changes, pair.Lines);
+            }
+            else
+            {
+                CFilecompCoWorkerOptimized<wchar_t>(NULL, options, CancelFlag).CountChanges(reader, pair.Changes, pair.Lines);
+            }
+            pair.Text = TRUE;
+            pair.Result = pair.Changes == 0 ? brIgnored : brDifferent;
+            return;
+        }
+    }
+    pair.Result = brDifferent;
+}
+
+// Compares files of the same size block by block. Returns TRUE if they are
+// identical, otherwise 'firstChange' receives the offset of the first different byte.
+BOOL CBatchCompareWorker::CompareBytes(CWorkerFileData (&files)[2], QWORD& firstChange)
+{
+    vector<BYTE> buffer(2 * BATCH_BLOCK_SIZE);
+    BYTE* data[2] = {&buffer[0], &buffer[BATCH_BLOCK_SIZE]};
+    QWORD offset = 0;
+    while (offset < files[0].Size)
+    {
+        if (CancelFlag)
+            throw CFilecompWorker::CAbortByUserException();
+
+        DWORD size = DWORD(min(QWORD(BATCH_BLOCK_SIZE), files[0].Size - offset));
+        int i;
+        for (i = 0; i <= 1; i++)
+        {
+            DWORD read;
+            if (!ReadFile(files[i].File, data[i], size, &read, NULL) || read != size)
+                CFilecompWorker::CException::Raise(IDS_READFILE, GetLastError(), files[i].Name);
+        }
+
+        DWORD equal = CountEqualBytes(data[0], data[1], size);
+        if (equal < size)
+        {
+            firstChange = offset + equal;
+            return FALSE;
+        }
+        offset += size;
+    }
+    return TRUE;
+}
+
+// ****************************************************************************
+//
+// CBatchCompareDialog
+//
+
+CBatchCompareDialog::CBatchCompareDialog(CBatchPairs& pairs, const CCompareOptions& options)
+    : CCommonDialog(IDD_BATCHCOMPARE, NULL)
+{
+    CALL_STACK_MESSAGE_NONE
+    Pairs.swap(pairs);
+    Options = options;
+    CancelWorker = CW_CONTINUE;
+    WorkerEvent = CreateEvent(NULL, TRUE, TRUE, NULL);
+    Compared = 0;
+    Different = 0;
+    Finished = FALSE;
+    DifferentOnly = FALSE;
+    List = NULL;
+}
+
+CBatchCompareDialog::~CBatchCompareDialog()
+{
+    if (WorkerEvent)
+        CloseHandle(WorkerEvent);
+    MainWindowQueue.Remove(HWindow);
+}
+
+void CBatchCompareDialog::SpawnWorker()
+{
+    CALL_STACK_MESSAGE1("CBatchCompareDialog::SpawnWorker()");
+    CancelWorker = CW_CONTINUE;
+    CBatchCompareWorker* worker = new CBatchCompareWorker(HWindow, Pairs, Options, CancelWorker, WorkerEvent);
+    if (!worker)
+    {
+        Error(HWindow, IDS_LOWMEM);
+        Finished = TRUE;
+        return;
+    }
+    ResetEvent(WorkerEvent);
+    if (!worker->Create(ThreadQueue))
+    {
+        delete worker;
+        SetEvent(WorkerEvent); // so we do not wait for it in vain
+        Finished = TRUE;
+        TRACE_E("Unable to start the batch worker thread.");
+    }
+}
+
+void CBatchCompareDialog::StopWorker()
+{
+    CALL_STACK_MESSAGE1("CBatchCompareDialog::StopWorker()");
+    // the worker only posts messages to us, we do not have to dispatch them
+    CancelWorker = CW_SILENT;
+    WaitForSingleObject(WorkerEvent, INFINITE);
+}
+
+BOOL CBatchCompareDialog::IsListed(const CBatchPair& pair)
+{
+    return !DifferentOnly || pair.Result != brIdentical && pair.Result != brIgnored;
+}
+
+void CBatchCompareDialog::FillList()
+{
+    CALL_STACK_MESSAGE1("CBatchCompareDialog::FillList()");
+    SendMessage(List, WM_SETREDRAW, FALSE, 0);
+    ListView_DeleteAllItems(List);
+    LVITEM lvi;
+    lvi.mask = LVIF_TEXT | LVIF_PARAM;
+    lvi.iSubItem = 0;
+    int item = 0;
+    size_t i;
+    for (i = 0; i < Pairs.size(); i++)
+    {
+        if (!IsListed(Pairs[i]))
+            continue;
+        lvi.iItem = item;
+        lvi.pszText = Pairs[i].Name;
+        lvi.lParam = (LPARAM)i;
+        item = ListView_InsertItem(List, &lvi);
+        if (item == -1)
+            break;
+        SetItemTexts(item, Pairs[i]);
+        item++;
+    }
+    if (item > 0)
+        ListView_SetItemState(List, 0, LVIS_FOCUSED | LVIS_SELECTED, LVIS_FOCUSED | LVIS_SELECTED);
+    SendMessage(List, WM_SETREDRAW, TRUE, 0);
+}
+
+void CBatchCompareDialog::SetItemTexts(int item, const CBatchPair& pair)
+{
+    char details[300];
+    char fmt[200];
+    char buf[50];
+    int result;
+    *details = 0;
+    switch (pair.Result)
+    {
+    case brIdentical:
+        result = IDS_BATCH_IDENTICAL;
+        break;
+
+    case brIgnored:
+        result = IDS_BATCH_IGNORED;
+        break;
+
+    case brDifferent:
+    {
+        result = IDS_BATCH_DIFFERENT;
+        if (pair.Text)
+        {
+            CQuadWord counts[3];
+            counts[0].SetUI64(pair.Changes);
+            counts[1].SetUI64(pair.Lines[0]);
+            counts[2].SetUI64(pair.Lines[1]);
+            SG->ExpandPluralString(fmt, SizeOf(fmt), LoadStr(IDS_BATCH_TEXTDIFFS), 3, counts);
+            sprintf(details, fmt, pair.Changes, pair.Lines[0], pair.Lines[1]);
+        }
+        else if (pair.FirstChange != (QWORD)-1)
+        {
+            sprintf(details, LoadStr(IDS_BATCH_BINARYDIFF),
+                    QWord2Ascii(pair.FirstChange, buf, ComputeAddressCharWidth(pair.Sizes[0], pair.Sizes[1])));
+        }
+        else
+            lstrcpyn(details, LoadStr(IDS_BATCH_SIZESDIFFER), SizeOf(details));
+        break;
+    }
+
+    case brError:
+        result = IDS_BATCH_ERROR;
+        lstrcpyn(details, pair.Error, SizeOf(details));
+        break;
+
+    default:
+        result = IDS_BATCH_WAITING;
+        break;
+    }
+    ListView_SetItemText(List, item, 1, LoadStr(result));
+    ListView_SetItemText(List, item, 2, details);
+    int i;
+    for (i = 0; i <= 1; i++)
+    {
+        *buf = 0;
+        if (pair.Result != brWaiting && pair.Result != brError)
+            SG->NumberToStr(buf, CQuadWord().SetUI64(pair.Sizes[i]));
+        ListView_SetItemText(List, item, 3 + i, buf);
+    }
+}
+
+void CBatchCompareDialog::UpdateStatus()
+{
+    char buf[200];
+    sprintf(buf, LoadStr(Finished ? IDS_BATCH_FINISHED : IDS_BATCH_PROGRESS),
+            Compared, (int)Pairs.size(), Different);
+    SetDlgItemText(HWindow, IDC_BATCHSTATUS, buf);
+}
+
+void CBatchCompareDialog::CompareSelected()
+{
+    CALL_STACK_MESSAGE1("CBatchCompareDialog::CompareSelected()");
+    LVITEM lvi;
+    lvi.mask = LVIF_PARAM;
+    lvi.iItem = ListView_GetNextItem(List, -1, LVNI_SELECTED);
+    lvi.iSubItem = 0;
+    if (lvi.iItem == -1 || !ListView_GetItem(List, &lvi))
+        return;
+
+    // open the pair in a new File Comparator window
+    CBatchPair& pair = Pairs[lvi.lParam];
+    CFilecompThread* d = new CFilecompThread(pair.Paths[0], pair.Paths[1], TRUE, "");
+    if (!d)
+    {
+        Error(HWindow, IDS_LOWMEM);
+        return;
+    }
+    if (!d->Create(ThreadQueue))
+        delete d;
+}
+
+INT_PTR
+CBatchCompareDialog::DialogProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+    CALL_STACK_MESSAGE4("CBatchCompareDialog::DialogProc(0x%X, 0x%IX, 0x%IX)",
+                        uMsg, wParam, lParam);
+    switch (uMsg)
+    {
+    case WM_INITDIALOG:
+    {
+        List = GetDlgItem(HWindow, IDC_BATCHLIST);
+        ListView_SetExtendedListViewStyle(List, LVS_EX_FULLROWSELECT);
+
+        // columns: name, result, details, sizes of the first and the second file
+        static const int columnTexts[] = {IDS_BATCH_NAME, IDS_BATCH_RESULT, IDS_BATCH_DETAILS,
+                                          IDS_BATCH_SIZE1, IDS_BATCH_SIZE2};
+        static const int columnWidths[] = {28, 14, 34, 12, 12}; // in percents of the list width
+        RECT r;
+        GetClientRect(List, &r);
+        int width = r.right - GetSystemMetrics(SM_CXVSCROLL);
+        LVCOLUMN lvc;
+        lvc.mask = LVCF_FMT | LVCF_TEXT | LVCF_WIDTH | LVCF_SUBITEM;
+        int i;
+        for (i = 0; i < int(SizeOf(columnTexts)); i++)
+        {
+            lvc.fmt = i >= 3 ? LVCFMT_RIGHT : LVCFMT_LEFT;
+            lvc.pszText = LoadStr(columnTexts[i]);
+            lvc.cx = width * columnWidths[i] / 100;
+            lvc.iSubItem = i;
+            ListView_InsertColumn(List, i, &lvc);
+        }
+
+        SetWindowPos(HWindow, AlwaysOnTop ? HWND_TOPMOST : HWND_NOTOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE);
+        SendMessage(HWindow, WM_SETICON, ICON_BIG, (LPARAM)LoadIcon(DLLInstance, MAKEINTRESOURCE(IDI_FCICO)));
+
+        FillList();
+        SpawnWorker();
+        UpdateStatus();
+        break;
+    }
+
+    case WM_COMMAND:
+    {
+        switch (LOWORD(wParam))
+        {
+        case IDB_BATCHCOMPARE:
+            CompareSelected();
+            return 0;
+
+        case IDC_BATCHDIFFONLY:
+            if (HIWORD(wParam) == BN_CLICKED)
+            {
+                DifferentOnly = IsDlgButtonChecked(HWindow, IDC_BATCHDIFFONLY) == BST_CHECKED;
+                FillList();
+            }
+            return 0;
+        }
+        break;
+    }
+
+    case WM_NOTIFY:
+    {
+        LPNMHDR nmh = (LPNMHDR)lParam;
+        if (nmh->idFrom == IDC_BATCHLIST && nmh->code == NM_DBLCLK)
+        {
+            CompareSelected();
+            return TRUE;
+        }
+        break;
+    }
+
+    case WM_USER_BATCHNOTIFIES:
+    {
+        switch (wParam)
+        {
+        case BWN_PAIR_COMPARED:
+        {
+            CBatchPair& pair = Pairs[lParam];
+            Compared++;
+            if (pair.Result == brDifferent || pair.Result == brError)
+                Different++;
+
+            LVFINDINFO lvfi;
+            lvfi.flags = LVFI_PARAM;
+            lvfi.lParam = lParam;
+            int item = ListView_FindItem(List, -1, &lvfi);
+            if (item != -1)
+            {
+                if (IsListed(pair))
+                    SetItemTexts(item, pair);
+                else
+                    ListView_DeleteItem(List, item);
+            }
+            UpdateStatus();
+            break;
+        }
+
+        case BWN_FINISHED:
+        {
+            Finished = TRUE;
+            UpdateStatus();
+            break;
+        }
+        }
+        return TRUE;
+    }
+
+    case WM_DESTROY:
+        StopWorker();
+        break;
+    }
+
+    return CCommonDialog::DialogProc(uMsg, wParam, lParam);
+}
+
+// ****************************************************************************
+//
+// CBatchCompareThread
+//
+
+unsigned
+CBatchCompareThread::Body()
+{
+    CALL_STACK_MESSAGE1("CBatchCompareThread::Body()");
+    CBatchCompareDialog* dlg = new CBatchCompareDialog(Pairs, DefCompareOptions);
+    if (!dlg)
+    {
+        Error(HWND(NULL), IDS_LOWMEM);
+        return 0;
+    }
+    HWND wnd = dlg->Create();
+    if (!wnd)
+    {
+        TRACE_E("Unable to create the batch comparison dialog.");
+        return 0;
+    }
+    SetForegroundWindow(wnd);
+
+    if (!MainWindowQueue.Add(new CWindowQueueItem(wnd)))
+    {
+        TRACE_E("Low memory");
+        DestroyWindow(wnd);
+        return 0;
+    }
+
+    MSG msg;
+    while (IsWindow(wnd) && GetMessage(&msg, NULL, 0, 0))
+    {
+        if (!IsDialogMessage(wnd, &msg))
+        {
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// ****************************************************************************
+//
+// CBatchPair
+//
+
+enum CBatchResult
+{
+    brWaiting,   // not compared yet
+    brIdentical, // files are binary identical
+    brIgnored,   // text files differ only in ignored differences
+    brDifferent, // files differ
+    brError      // files cannot be compared, see Error
+};
+
+struct CBatchPair
+{
+    char Name[MAX_PATH];     // name of the file in the source panel
+    char Paths[2][MAX_PATH]; // full names of the first and the second file
+    int Result;              // see CBatchResult
+    QWORD Sizes[2];
+    BOOL Text;         // TRUE if the files were compared as text files
+    int Changes;       // text files: number of differences that are not ignored
+    int Lines[2];      // text files: lines deleted from the first file and inserted to the second one
+    QWORD FirstChange; // binary files of the same size: offset of the first different byte, otherwise -1
+    char Error[300];
+
+    CBatchPair(const char* name, const char* path1, const char* path2);
+};
+
+typedef std::vector<CBatchPair> CBatchPairs;
+
+// ****************************************************************************
+//
+// CBatchCompareWorker
+//
+// Compares all pairs in parallel, reports every compared pair to the batch window
+// and sets Event once it finishes.
+//
+
+class CBatchCompareWorker : public CThread
+{
+public:
+    CBatchCompareWorker(HWND window, CBatchPairs& pairs, const CCompareOptions& options,
+                        const int& cancelFlag, HANDLE event);
+
+    // compares one pair, called from the threads of the parallel job
+    void ComparePair(CBatchPair& pair);
+
+protected:
+    HWND Window; // the window receiving WM_USER_BATCHNOTIFIES
+    CBatchPairs& Pairs;
+    CCompareOptions Options;
+    const int& CancelFlag; // 0 ... keep going, any other value terminates the worker
+    HANDLE Event;
+
+    virtual unsigned Body();
+    void GuardedComparePair(CBatchPair& pair);
+    BOOL CompareBytes(CWorkerFileData (&files)[2], QWORD& firstChange);
+};
+
+// ****************************************************************************
+//
+// CBatchCompareDialog
+//
+
+class CBatchCompareDialog : public CCommonDialog
+{
+public:
+    CBatchCompareDialog(CBatchPairs& pairs, const CCompareOptions& options);
+    virtual ~CBatchCompareDialog();
+
+protected:
+    CBatchPairs Pairs;
+    CCompareOptions Options;
+    int CancelWorker; // CW_CONTINUE or CW_SILENT
+    HANDLE WorkerEvent;
+    int Compared;  // number of compared pairs
+    int Different; // number of differing pairs (including errors)
+    BOOL Finished;
+    BOOL DifferentOnly; // list only the pairs that differ
+    HWND List;
+
+    virtual INT_PTR DialogProc(UINT uMsg, WPARAM wParam, LPARAM lParam);
+
+    void SpawnWorker();
+    void StopWorker();
+    void FillList();
+    BOOL IsListed(const CBatchPair& pair);
+    void SetItemTexts(int item, const CBatchPair& pair);
+    void UpdateStatus();
+    void CompareSelected();
+};
+
+// ****************************************************************************
+//
+// CBatchCompareThread
+//
+
+class CBatchCompareThread : public CThread
+{
+public:
+    CBatchPairs Pairs;
+
+    CBatchCompareThread() : CThread("Filecomp Batch Thread") {}
+
+    virtual unsigned Body();
+};
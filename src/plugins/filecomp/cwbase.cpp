@@ -18,6 +18,56 @@ CFilecompCoWorkerBase<CChar>::CFilecompCoWorkerBase(HWND mainWindow,
 {
 }
 
+// files are split to chunks of at least this number of characters for finding lines
+#define FINDLINES_MIN_CHUNK (1024 * 1024)
+
+template <class CChar>
+class CFindLinesJob : public CFilecompJob
+{
+public:
+    struct CChunk
+    {
+        CChar* Begin;
+        CChar* End;
+        std::vector<CChar*> Lines; // beginnings of the lines following '\n' characters of the chunk
+    };
+
+    std::vector<CChunk> Chunks;
+
+    CFindLinesJob(const int& cancelFlag) : CancelFlag(cancelFlag) {}
+
+    // splits text from 'begin' to 'end' to chunks (roughly one per thread)
+    void AddChunks(CChar* begin, CChar* end, int threads)
+    {
+        size_t chunkSize = max(size_t(FINDLINES_MIN_CHUNK), size_t(end - begin) / threads + 1);
+        while (begin < end)
+        {
+            CChunk chunk;
+            chunk.Begin = begin;
+            chunk.End = size_t(end - begin) > chunkSize ? begin + chunkSize : end;
+            Chunks.push_back(chunk);
+            begin = chunk.End;
+        }
+    }
+
+    virtual void RunPart(size_t index)
+    {
+        CChunk& chunk = Chunks[index];
+        for (CChar* iterator = chunk.Begin; iterator < chunk.End; ++iterator)
+        {
+            if (*iterator == '\n')
+            {
+                chunk.Lines.push_back(iterator + 1);
+                if (CancelFlag)
+                    throw CFilecompWorker::CAbortByUserException();
+            }
+        }
+    }
+
+protected:
+    const int& CancelFlag;
+};
+
 template <class CChar>
 void CFilecompCoWorkerBase<CChar>::ReadFilesAndFindLines(CTextFileReader (&reader)[2], bool& binaryIdentical)
 {
@@ -41,32 +91,45 @@ void CFilecompCoWorkerBase<CChar>::ReadFilesAndFindLines(CTextFileReader (&reade
         binaryIdentical = memcmp(md5_1, md5_2, 16) == 0;
     }
 
-    // find the beginnings of lines
+    // find the beginnings of lines, chunks of both files are searched in parallel
+    typedef CFindLinesJob<CChar> CJob;
+    CJob job(CancelFlag);
+    CChar* firstLine[2];
+    size_t firstChunk[3];
+    int threads = CParallelJob::GetThreadsCount();
     for (i = 0; i < 2; i++)
     {
-        CChar* lineStart = Files[i].Begin;
+        firstLine[i] = Files[i].Begin;
         // skip BOM
-        if (lineStart < Files[i].End && TCharSpecific<CChar>::IsBOM(*lineStart))
-            lineStart++;
-        for (CChar* iterator = lineStart; iterator < Files[i].End;)
+        if (firstLine[i] < Files[i].End && TCharSpecific<CChar>::IsBOM(*firstLine[i]))
+            firstLine[i]++;
+        firstChunk[i] = job.Chunks.size();
+        job.AddChunks(firstLine[i], Files[i].End, threads);
+    }
+    firstChunk[2] = job.Chunks.size();
+    job.Execute(job.Chunks.size());
+
+    for (i = 0; i < 2; i++)
+    {
+        size_t count = 1; // the first line
+        size_t c;
+        for (c = firstChunk[i]; c < firstChunk[i + 1]; c++)
+            count += job.Chunks[c].Lines.size();
+
+        // just for peace of mind
+        if (count >= size_t(CLineSpec::MaxLines()))
+            CFilecompWorker::CException::Raise(IDS_MAXLINES, 0);
+
+        // the beginning of the line following the last '\n' is the pointer past the last line
+        Files[i].Lines.reserve(count);
+        Files[i].Lines.push_back(firstLine[i]);
+        for (c = firstChunk[i]; c < firstChunk[i + 1]; c++)
         {
-            if (*iterator == '\n')
-            {
-                Files[i].Lines.push_back(lineStart);
-                lineStart = ++iterator;
-                if (CancelFlag)
-                    throw CFilecompWorker::CAbortByUserException();
-            }
-            else
-                ++iterator;
+            typename CJob::CChunk& chunk = job.Chunks[c];
+            Files[i].Lines.insert(Files[i].Lines.end(), chunk.Lines.begin(), chunk.Lines.end());
+            CLineBuffer().swap(chunk.Lines); // release the memory early
         }
-        // pointer past the last line
-        Files[i].Lines.push_back(lineStart);
     }
-
-    // just for peace of mind
-    if (Files[i].Lines.size() >= size_t(CLineSpec::MaxLines()))
-        CFilecompWorker::CException::Raise(IDS_MAXLINES, 0);
 }
 
 template <class CChar>
@@ -2,21 +2,18 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 
 #include "precomp.h"
-#include <unordered_map>
 #include <iterator>
 
 using namespace std;
 
-#if (_MSC_VER < 1910) // MSVC 2017 complains about the non-standard namespace std::tr1 (deprecated);
-                      // it is apparently just unordered_map, which used to live in std::tr1 and is now directly in std
-using namespace std::tr1;
-#endif
-
 // ****************************************************************************
 //
 // CFilecompCoWorkerOptimized
 //
 
+// daAuto uses the histogram diff if both files together have more lines
+#define HISTOGRAM_DIFF_MIN_LINES 200000
+
 template <class CChar>
 CFilecompCoWorkerOptimized<CChar>::CFilecompCoWorkerOptimized(HWND mainWindow,
                                                               CCompareOptions& options, const int& cancelFlag) : CFilecompCoWorkerBase<CChar>(mainWindow, options, cancelFlag)
@@ -131,40 +128,182 @@ struct CLineEqual
     }
 };
 
+// Hash table of lines with precomputed hash values (open addressing, no allocation
+// per line), each line has a value assigned.
+template <class CChar, class CLineIterator, class CCaseConverter>
+class CLineTable
+{
+public:
+    CLineTable() : Shift(0) {}
+
+    // prepares an empty table for at most 'count' lines
+    void Init(size_t count)
+    {
+        size_t size = 16;
+        Shift = 64 - 4;
+        while (size < count + count / 2)
+        {
+            size <<= 1;
+            Shift--;
+        }
+        Entries.assign(size, CEntry());
+    }
+
+    // returns the value of the line equal to 'line' with hash 'hash'; if there is no
+    // such line, adds 'line' with value 'value' and returns 'value'
+    size_t Insert(const CChar* line, DWORD hash, size_t value)
+    {
+        // Fibonacci hashing, the low bits of line hashes are poorly distributed
+        size_t mask = Entries.size() - 1;
+        size_t i = size_t((hash * 0x9E3779B97F4A7C15ui64) >> Shift);
+        for (;; i = (i + 1) & mask)
+        {
+            CEntry& entry = Entries[i];
+            if (entry.Line == NULL)
+            {
+                entry.Line = line;
+                entry.Hash = hash;
+                entry.Value = value;
+                return value;
+            }
+            if (entry.Hash == hash && Equal(entry.Line, line))
+                return entry.Value;
+        }
+    }
+
+protected:
+    struct CEntry
+    {
+        const CChar* Line; // NULL = empty entry
+        DWORD Hash;
+        size_t Value;
+        CEntry() : Line(NULL), Hash(0), Value(0) {}
+    };
+
+    std::vector<CEntry> Entries; // the number of entries is a power of two
+    int Shift;                   // 64 - log2(Entries.size())
+    CLineEqual<CChar, CLineIterator, CCaseConverter> Equal;
+};
+
+// files are split to chunks of at least this number of lines for identifying lines
+#define IDENTIFYLINES_MIN_CHUNK 65536
+
+// The first phase of IdentifyLines: chunks of both files are processed in parallel,
+// each line is hashed and looked up among the previous lines of its chunk. The line
+// gets the index of the first equal line of the chunk (its own index if there is
+// none). The sequential second phase then assigns class IDs only to these first lines
+// in the order of lines, so the IDs are the same as if the lines were identified
+// one by one.
+template <class CChar, class CLineIterator, class CCaseConverter>
+class CHashLinesJob : public CFilecompJob
+{
+public:
+    struct CChunk
+    {
+        int File;
+        size_t First;  // index of the first line of the chunk
+        size_t End;    // index of the line past the chunk
+        size_t Unique; // number of lines without an equal line earlier in the chunk
+    };
+
+    std::vector<CChunk> Chunks;
+    std::vector<DWORD> Hashes[2]; // hash values of lines of both files
+
+    CHashLinesJob(const int& cancel) : Cancel(cancel) {}
+
+    // adds lines 'lines' of file 'file' and splits them to chunks (roughly one per thread);
+    // 'firstEqual' must already have the size of the number of lines, it receives the
+    // indexes of the first equal lines
+    void AddFile(int file, CChar* const* lines, CIndexes& firstEqual, int threads)
+    {
+        size_t count = firstEqual.size();
+        Lines[file] = lines;
+        FirstEqual[file] = &firstEqual;
+        Hashes[file].resize(count);
+
+        size_t chunkSize = max(size_t(IDENTIFYLINES_MIN_CHUNK), count / threads + 1);
+        CChunk chunk;
+        chunk.File = file;
+        chunk.Unique = 0;
+        for (chunk.First = 0; chunk.First < count; chunk.First = chunk.End)
+        {
+            chunk.End = min(chunk.First + chunkSize, count);
+            Chunks.push_back(chunk);
+        }
+    }
+
+    virtual void RunPart(size_t index)
+    {
+        CChunk& chunk = Chunks[index];
+        CChar* const* lines = Lines[chunk.File];
+        CIndexes& firstEqual = *FirstEqual[chunk.File];
+        std::vector<DWORD>& hashes = Hashes[chunk.File];
+
+        CHash<CChar, CLineIterator, CCaseConverter> hash;
+        CLineTable<CChar, CLineIterator, CCaseConverter> table;
+        table.Init(chunk.End - chunk.First);
+        size_t i;
+        for (i = chunk.First; i < chunk.End; ++i)
+        {
+            hashes[i] = DWORD(hash(lines[i]));
+            firstEqual[i] = table.Insert(lines[i], hashes[i], i);
+            if (firstEqual[i] == i)
+                chunk.Unique++;
+            if (Cancel)
+                throw CFilecompWorker::CAbortByUserException();
+        }
+    }
+
+protected:
+    CChar* const* Lines[2];
+    CIndexes* FirstEqual[2];
+    const int& Cancel;
+};
+
 template <class CChar>
 template <class CCaseConverter, class CLineIterator>
-void CFilecompCoWorkerOptimized<CChar>::IdentifyLines(CFilecompCoWorkerBase<CChar>::CFCFileData (&files)[2], CIndexes (&compareData)[2], const int& cancel)
+size_t CFilecompCoWorkerOptimized<CChar>::IdentifyLines(CFilecompCoWorkerBase<CChar>::CFCFileData (&files)[2], CIndexes (&compareData)[2], const int& cancel)
 {
-    typedef vector<CChar*> CLineBuffer;
-    typedef unordered_map<
-        const CChar*, size_t,
-        CHash<CChar, CLineIterator, CCaseConverter>,
-        CLineEqual<CChar, CLineIterator, CCaseConverter>>
-        CLineClasses;
-
-    CLineClasses classes;
-    size_t next = 0; // next class ID
-
+    // hash lines of both files and find equal lines within chunks in parallel
+    CHashLinesJob<CChar, CLineIterator, CCaseConverter> job(cancel);
+    int threads = CParallelJob::GetThreadsCount();
     int i;
     for (i = 0; i < 2; ++i)
     {
         // reserve space
         compareData[i].resize(files[i].Lines.size() - 1);
+        job.AddFile(i, &files[i].Lines[0], compareData[i], threads);
+    }
+    job.Execute(job.Chunks.size());
+
+    size_t unique = 0;
+    size_t c;
+    for (c = 0; c < job.Chunks.size(); ++c)
+        unique += job.Chunks[c].Unique;
+    CLineTable<CChar, CLineIterator, CCaseConverter> classes;
+    classes.Init(unique);
+    size_t next = 0; // next class ID
+
+    for (i = 0; i < 2; ++i)
+    {
         // indentify each line
-        typename CLineBuffer::iterator line = files[i].Lines.begin();
-        CIndexes::iterator eqvclass = compareData[i].begin();
-        for (; line < files[i].Lines.end() - 1; ++line, ++eqvclass)
+        CIndexes& eqvclass = compareData[i];
+        size_t line;
+        for (line = 0; line < eqvclass.size(); ++line)
         {
-
-            std::pair<CLineClasses::iterator, bool> ir =
-                classes.insert(CLineClasses::value_type(*line, next));
-            if (ir.second)
-                next++; // new class created
-            *eqvclass = ir.first->second;
+            if (eqvclass[line] == line) // the first of equal lines in its chunk
+            {
+                eqvclass[line] = classes.Insert(files[i].Lines[line], job.Hashes[i][line], next);
+                if (eqvclass[line] == next)
+                    next++; // new class created
+            }
+            else // the first equal line precedes this one, its class is already known
+                eqvclass[line] = eqvclass[eqvclass[line]];
             if (cancel)
                 throw CFilecompWorker::CAbortByUserException();
         }
     }
+    return next;
 }
 
 template <class CChar>
@@ -188,15 +327,11 @@ bool CFilecompCoWorkerOptimized<CChar>::IsChangeIgnorable(const CChange& change)
 }
 
 template <class CChar>
-void CFilecompCoWorkerOptimized<CChar>::Compare(CTextFileReader (&reader)[2])
+ptrdiff_t CFilecompCoWorkerOptimized<CChar>::FindChanges(CTextFileReader (&reader)[2], CEditScript& editScript,
+                                                          bool& binaryIdentical)
 {
-    //  CCounterDriver tr(TotalRuntime);
-
-    bool binaryIdentical; // Are files binary identical?
-
     this->ReadFilesAndFindLines(reader, binaryIdentical);
 
-    CEditScript editScript;
     ptrdiff_t d = 0;
     if (!binaryIdentical)
     {
@@ -204,32 +339,52 @@ void CFilecompCoWorkerOptimized<CChar>::Compare(CTextFileReader (&reader)[2])
 
         // prepare compare data
         CIndexes compareData[2];
+        size_t classes; // number of equivalence classes of lines
         if (this->Options.IgnoreCase)
         {
             if (this->Options.IgnoreAllSpace)
-                IdentifyLines<CToLowerCase<CChar>, CIgnoringSpace<CChar>>(this->Files, compareData, this->CancelFlag);
+                classes = IdentifyLines<CToLowerCase<CChar>, CIgnoringSpace<CChar>>(this->Files, compareData, this->CancelFlag);
             elif (this->Options.IgnoreSpaceChange)
-                IdentifyLines<CToLowerCase<CChar>, CIgnoringSpaceChange<CChar>>(this->Files, compareData, this->CancelFlag);
-            else IdentifyLines<CToLowerCase<CChar>, const CChar*>(this->Files, compareData, this->CancelFlag);
+                classes = IdentifyLines<CToLowerCase<CChar>, CIgnoringSpaceChange<CChar>>(this->Files, compareData, this->CancelFlag);
+            else classes = IdentifyLines<CToLowerCase<CChar>, const CChar*>(this->Files, compareData, this->CancelFlag);
         }
         else
         {
             if (this->Options.IgnoreAllSpace)
-                IdentifyLines<::identity<CChar>, CIgnoringSpace<CChar>>(this->Files, compareData, this->CancelFlag);
+                classes = IdentifyLines<::identity<CChar>, CIgnoringSpace<CChar>>(this->Files, compareData, this->CancelFlag);
             elif (this->Options.IgnoreSpaceChange)
-                IdentifyLines<::identity<CChar>, CIgnoringSpaceChange<CChar>>(this->Files, compareData, this->CancelFlag);
-            else IdentifyLines<::identity<CChar>, const CChar*>(this->Files, compareData, this->CancelFlag);
+                classes = IdentifyLines<::identity<CChar>, CIgnoringSpaceChange<CChar>>(this->Files, compareData, this->CancelFlag);
+            else classes = IdentifyLines<::identity<CChar>, const CChar*>(this->Files, compareData, this->CancelFlag);
         }
 
         // compare the two sequences sequence
-        d = diff(
-            0, compareData[0].size(),
-            0, compareData[1].size(),
-            sequence_comparator(
-                compareData[0].begin(),
-                compareData[1].begin()),
-            CEditScriptBuilder(editScript),
-            this->CancelFlag);
+        int algorithm = this->Options.DiffAlgorithm;
+        if (algorithm == daAuto)
+        {
+            // Myers' algorithm needs O((N+M)D) time, it is too slow for big files
+            // with many differences
+            algorithm = compareData[0].size() + compareData[1].size() > HISTOGRAM_DIFF_MIN_LINES ? daHistogram : daMyers;
+        }
+        if (algorithm == daHistogram)
+        {
+            d = histogram_diff(
+                compareData[0].begin(), compareData[0].size(),
+                compareData[1].begin(), compareData[1].size(),
+                classes,
+                CEditScriptBuilder(editScript),
+                this->CancelFlag);
+        }
+        else
+        {
+            d = diff(
+                0, compareData[0].size(),
+                0, compareData[1].size(),
+                sequence_comparator(
+                    compareData[0].begin(),
+                    compareData[1].begin()),
+                CEditScriptBuilder(editScript),
+                this->CancelFlag);
+        }
         if (d == -1)
             CFilecompWorker::CException::Raise(IDS_INTERNALERROR, 0);
         /*  if (d == 0) We now let the file display
@@ -241,6 +396,17 @@ void CFilecompCoWorkerOptimized<CChar>::Compare(CTextFileReader (&reader)[2])
         // shift-boundaries, call before RemoveSingleCharMatches
         this->ShiftBoundaries(editScript, compareData);
     }
+    return d;
+}
+
+template <class CChar>
+void CFilecompCoWorkerOptimized<CChar>::Compare(CTextFileReader (&reader)[2])
+{
+    //  CCounterDriver tr(TotalRuntime);
+
+    bool binaryIdentical; // Are files binary identical?
+    CEditScript editScript;
+    ptrdiff_t d = FindChanges(reader, editScript, binaryIdentical);
 
     // let main window know that we finished basic comparison
     if (this->Options.DetailedDifferences)
@@ -345,5 +511,29 @@ void CFilecompCoWorkerOptimized<CChar>::Compare(CTextFileReader (&reader)[2])
     SendMessage(this->MainWindow, WM_USER_WORKERNOTIFIES, WN_COMPARE_FINISHED, 0);
 }
 
+template <class CChar>
+void CFilecompCoWorkerOptimized<CChar>::CountChanges(CTextFileReader (&reader)[2], int& changes, int (&lines)[2])
+{
+    bool binaryIdentical;
+    CEditScript editScript;
+    FindChanges(reader, editScript, binaryIdentical);
+
+    changes = 0;
+    lines[0] = lines[1] = 0;
+    for (CEditScript::iterator esi = editScript.begin(); esi < editScript.end(); ++esi)
+    {
+        if (this->CancelFlag)
+            throw CFilecompWorker::CAbortByUserException();
+        if ((this->Options.IgnoreSpaceChange || this->Options.IgnoreAllSpace) &&
+            IsChangeIgnorable(*esi))
+        {
+            continue;
+        }
+        changes++;
+        lines[0] += int(esi->Length[0]);
+        lines[1] += int(esi->Length[1]);
+    }
+}
+
 template class CFilecompCoWorkerOptimized<char>;
 template class CFilecompCoWorkerOptimized<wchar_t>;
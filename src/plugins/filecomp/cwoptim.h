@@ -15,10 +15,17 @@ class CFilecompCoWorkerOptimized : public CFilecompCoWorkerBase<CChar>
 
 public:
     CFilecompCoWorkerOptimized(HWND mainWindow, CCompareOptions& options, const int& cancelFlag);
+    // returns the number of found equivalence classes of lines
     template <class CCaseConverter, class CLineIterator>
-    void IdentifyLines(CFilecompCoWorkerBase<CChar>::CFCFileData (&files)[2], CIndexes (&compareData)[2], const int& cancel);
+    size_t IdentifyLines(CFilecompCoWorkerBase<CChar>::CFCFileData (&files)[2], CIndexes (&compareData)[2], const int& cancel);
     bool IsChangeIgnorable(const CChange& change);
     void Compare(CTextFileReader (&reader)[2]);
+    // compares the files like Compare() but it does not send the results to the main
+    // window, it only counts the differences which are not ignored; 'lines' receives
+    // the number of lines deleted from the first file and inserted to the second one
+    void CountChanges(CTextFileReader (&reader)[2], int& changes, int (&lines)[2]);
 
 protected:
+    // reads the files and builds the edit script, returns the edit distance (0 = no differences)
+    ptrdiff_t FindChanges(CTextFileReader (&reader)[2], CEditScript& editScript, bool& binaryIdentical);
 };
@@ -151,6 +151,26 @@ int crIDs[] = {IDC_CR1, IDC_CR2};
 int lfIDs[] = {IDC_LF1, IDC_LF2};
 int nullIDs[] = {IDC_NULL1, IDC_NULL2};
 
+// transfers 'algorithm' (see CDiffAlgorithm) to/from combo box IDC_DIFFALGORITHM of 'hWindow',
+// the items are in the order of CDiffAlgorithm
+static void TransferDiffAlgorithm(CTransferInfo& ti, HWND hWindow, int& algorithm)
+{
+    HWND combo = GetDlgItem(hWindow, IDC_DIFFALGORITHM);
+    if (ti.Type == ttDataToWindow)
+    {
+        SendMessage(combo, CB_RESETCONTENT, 0, 0);
+        SendMessage(combo, CB_ADDSTRING, 0, (LPARAM)LoadStr(IDS_DIFFALG_AUTO));
+        SendMessage(combo, CB_ADDSTRING, 0, (LPARAM)LoadStr(IDS_DIFFALG_MYERS));
+        SendMessage(combo, CB_ADDSTRING, 0, (LPARAM)LoadStr(IDS_DIFFALG_HISTOGRAM));
+        SendMessage(combo, CB_SETCURSEL, algorithm >= daAuto && algorithm <= daHistogram ? algorithm : daAuto, 0);
+    }
+    else
+    {
+        int sel = (int)SendMessage(combo, CB_GETCURSEL, 0, 0);
+        algorithm = sel != CB_ERR ? sel : daAuto;
+    }
+}
+
 CAdvancedOptionsDialog::CAdvancedOptionsDialog(HWND parent, CCompareOptions* options,
                                                BOOL* setDefault)
     : CCommonDialog(IDD_ADVANCEDOPTIONS, IDD_ADVANCEDOPTIONS, parent)
@@ -193,6 +213,8 @@ void CAdvancedOptionsDialog::Transfer(CTransferInfo& ti)
         Options.ForceBinary = 1;
         break;
     }
+    ti.CheckBox(IDC_BINARYRESYNC, Options.BinaryResync);
+    TransferDiffAlgorithm(ti, HWindow, Options.DiffAlgorithm);
     // line ends
     BOOL select;
     if (ti.Type == ttDataToWindow)
@@ -391,6 +413,8 @@ void CPropPageDefaultOptions::Transfer(CTransferInfo& ti)
         Options.ForceBinary = 1;
         break;
     }
+    ti.CheckBox(IDC_BINARYRESYNC, Options.BinaryResync);
+    TransferDiffAlgorithm(ti, HWindow, Options.DiffAlgorithm);
     ti.CheckBox(IDC_NORMALIZATION_FORM, Options.NormalizationForm);
     // line ends
     BOOL select;
@@ -40,6 +40,16 @@ enum
 #define WM_USER_GETHEADERHEIGHT (WM_APP + 12)
 #define WM_USER_AUTOCOPY_CHANGED (WM_APP + 13)
 
+// for the batch comparison window; the batch worker reports compared pairs
+#define WM_USER_BATCHNOTIFIES (WM_APP + 14)
+
+// wParam:
+enum
+{
+    BWN_PAIR_COMPARED, // (int)lParam is the index of the compared pair
+    BWN_FINISHED       // lParam is ignored
+};
+
 // [wParam, (HWND)lParam] - for open plugin windows: plugin configuration has changed
 #define WM_USER_CFGCHNG (WM_APP + 3246)
 
@@ -6,8 +6,10 @@
 #include <assert.h>
 
 #define SECTOR_SIZE 4096              // We seek at offsets being multiples of SECTOR_SIZE
-#define BUFFER_SIZE (2 * 1024 * 1024) // We read at most this amount from a file at a sequence of BLOCK_READ_SIZE reads
+#define BUFFER_SIZE (4 * 1024 * 1024) // We read at most this amount from a file at a sequence of BLOCK_READ_SIZE reads
 #define BLOCK_READ_SIZE (32 * 1024)   // Atomic size of one ReadFile. BUFFER_SIZE must be a multiple of BLOCK_READ_SIZE
+#define AHEAD_READ_SIZE (256 * 1024)  // Atomic size of one ReadFile of readahead. BUFFER_SIZE must be a multiple of AHEAD_READ_SIZE
+#define CARRY_SIZE (1024 * 1024)      // Max. size of data moved from Buffer to the readahead data when ReadBuffer asks for both
 
 CCachedFile::CCachedFile(/*DWORD minViewSize*/)
 {
@@ -15,23 +17,40 @@ CCachedFile::CCachedFile(/*DWORD minViewSize*/)
     File = INVALID_HANDLE_VALUE;
     BufferOffset = FileSize = 0;
     BufferSize = DataInBufSize = 0;
+    Memory[0] = Memory[1] = NULL;
+    Current = 0;
     Buffer = NULL;
+    AheadThread = NULL;
+    AheadStop = FALSE;
 }
 
 void CCachedFile::Destroy()
 {
     CALL_STACK_MESSAGE1("CCachedFile::Destroy()");
+    if (AheadThread != NULL)
+    {
+        AheadStop = TRUE;
+        ThreadQueue.WaitForExit(AheadThread);
+        AheadThread = NULL;
+    }
     if (File != INVALID_HANDLE_VALUE)
     {
         CloseHandle(File);
         File = INVALID_HANDLE_VALUE;
     }
-    if (Buffer)
+    int i;
+    for (i = 0; i < 2; i++)
     {
-        free(Buffer);
-        Buffer = NULL;
-        BufferSize = 0;
+        if (Memory[i])
+        {
+            free(Memory[i]);
+            Memory[i] = NULL;
+        }
     }
+    Buffer = NULL;
+    BufferSize = 0;
+    BufferOffset = 0;
+    DataInBufSize = 0;
 }
 
 DWORD CCachedFile::GetMinViewSize()
@@ -49,12 +68,19 @@ int CCachedFile::SetFile(HANDLE file)
     {
         return 1;
     }
-    // Allocate slightly more to accomodate aligned seeking in ReadBuffer
-    Buffer = (LPBYTE)malloc(BUFFER_SIZE + SECTOR_SIZE);
-    if (!Buffer)
+    // Allocate slightly more to accomodate aligned seeking in ReadBuffer and data
+    // moved in front of the readahead data
+    int i;
+    for (i = 0; i < 2; i++)
     {
-        return 2;
+        Memory[i] = (LPBYTE)malloc(CARRY_SIZE + BUFFER_SIZE + SECTOR_SIZE);
+        if (!Memory[i])
+        {
+            return 2;
+        }
     }
+    Current = 0;
+    Buffer = Memory[Current] + CARRY_SIZE;
     BufferSize = BUFFER_SIZE;
     FileSize = MAKEQWORD(fi.nFileSizeLow, fi.nFileSizeHigh);
     if (!DuplicateHandle(GetCurrentProcess(), file, GetCurrentProcess(), &File, 0, FALSE, DUPLICATE_SAME_ACCESS))
@@ -71,58 +97,145 @@ LPBYTE CCachedFile::ReadBuffer(QWORD offset, DWORD size, const int& CancelFlag)
     if (FileSize == 0)
         return NULL;
 
-    if ((offset < BufferOffset) || (offset + size > BufferOffset + DataInBufSize))
+    if ((offset >= BufferOffset) && (offset + size <= BufferOffset + DataInBufSize))
+        return Buffer + (offset - BufferOffset);
+
+    if (AheadThread != NULL)
     {
-        LARGE_INTEGER li;
-        ;
-        DWORD err;
-
-        // Space for optimization: Instead of dummy SetFilePointer and possibly partially rereading
-        // what we already have, we can do some memcpy. But then we might not read from sector boundary
-        BufferOffset = offset / SECTOR_SIZE * SECTOR_SIZE; // Align to "cluster" size
-        li.QuadPart = BufferOffset;
-        DataInBufSize = 0;
-        err = SetFilePointer(File, li.LowPart, &li.HighPart, FILE_BEGIN);
-        if ((0xFFFFFFFF == err) && (GetLastError() != NO_ERROR))
-        {
+        // the data usually follows Buffer and it is being read by the readahead
+        if (!WaitForReadahead(CancelFlag))
             return NULL;
+        QWORD aheadEnd = AheadOffset + AheadSize;
+        if (!AheadFailed && offset + size <= aheadEnd &&
+            (offset >= AheadOffset ||
+             offset >= BufferOffset && AheadOffset == BufferOffset + DataInBufSize && AheadOffset - offset <= CARRY_SIZE))
+        {
+            // switch to the readahead buffer; the beginning of the requested data
+            // still in Buffer is moved in front of the readahead data
+            LPBYTE data = Memory[1 - Current] + CARRY_SIZE;
+            DWORD carry = 0;
+            if (offset < AheadOffset)
+            {
+                carry = (DWORD)(AheadOffset - offset);
+                memcpy(data - carry, Buffer + (offset - BufferOffset), carry);
+            }
+            Current = 1 - Current;
+            Buffer = data - carry;
+            BufferOffset = AheadOffset - carry;
+            DataInBufSize = carry + AheadSize;
+            StartReadahead();
+            return Buffer + (offset - BufferOffset);
         }
+    }
 
-        size_t nOfs = 0;
-        DWORD nTotalToRead = (DWORD)__max(size + (offset - BufferOffset), (DWORD)__min(BufferSize, FileSize - BufferOffset));
-        DWORD initialTicks = GetTickCount();
+    LARGE_INTEGER li;
+    DWORD err;
 
-        // Reading 32KB chunks bases on code for File Compare in Salamand.exe
-        // Reading 2MB in 32KB blocks is reportedly the fastest approach on W2K & WXP,
-        // but slightly slower on Vista, when both files reside on the same HDD,
-        // than reading 2MB at once.
-        // Reading small chunks also improves performance on slow networks.
-        while (nTotalToRead > 0)
+    // Space for optimization: Instead of dummy SetFilePointer and possibly partially rereading
+    // what we already have, we can do some memcpy. But then we might not read from sector boundary
+    Buffer = Memory[Current] + CARRY_SIZE;
+    BufferOffset = offset / SECTOR_SIZE * SECTOR_SIZE; // Align to "cluster" size
+    li.QuadPart = BufferOffset;
+    DataInBufSize = 0;
+    err = SetFilePointer(File, li.LowPart, &li.HighPart, FILE_BEGIN);
+    if ((0xFFFFFFFF == err) && (GetLastError() != NO_ERROR))
+    {
+        return NULL;
+    }
+
+    size_t nOfs = 0;
+    DWORD nTotalToRead = (DWORD)__max(size + (offset - BufferOffset), (DWORD)__min(BufferSize, FileSize - BufferOffset));
+    DWORD initialTicks = GetTickCount();
+
+    // Reading 32KB chunks bases on code for File Compare in Salamand.exe
+    // Reading 2MB in 32KB blocks is reportedly the fastest approach on W2K & WXP,
+    // but slightly slower on Vista, when both files reside on the same HDD,
+    // than reading 2MB at once.
+    // Reading small chunks also improves performance on slow networks.
+    while (nTotalToRead > 0)
+    {
+        DWORD nBytesRead, nBytesToRead = __min(nTotalToRead, BLOCK_READ_SIZE);
+        DWORD ticks = GetTickCount();
+        if (!ReadFile(File, Buffer + nOfs, nBytesToRead, &nBytesRead, NULL) || (nBytesRead != nBytesToRead))
         {
-            DWORD nBytesRead, nBytesToRead = __min(nTotalToRead, BLOCK_READ_SIZE);
-            DWORD ticks = GetTickCount();
-            if (!ReadFile(File, Buffer + nOfs, nBytesToRead, &nBytesRead, NULL) || (nBytesRead != nBytesToRead))
-            {
-                return NULL;
-            }
-            nOfs += nBytesRead;
-            nTotalToRead -= nBytesRead;
-            DataInBufSize += nBytesRead;
-            if (CancelFlag)
-            {
-                return NULL;
-            }
-            if ((GetTickCount() - ticks > 200) || (GetTickCount() - initialTicks > 2000))
+            DataInBufSize = 0; // do not leave a partially read buffer behind
+            return NULL;
+        }
+        nOfs += nBytesRead;
+        nTotalToRead -= nBytesRead;
+        DataInBufSize += nBytesRead;
+        if (CancelFlag)
+        {
+            DataInBufSize = 0;
+            return NULL;
+        }
+        if ((GetTickCount() - ticks > 200) || (GetTickCount() - initialTicks > 2000))
+        {
+            // Too slow network (or FDD or ...)
+            // We have read enough -> break
+            assert(offset - BufferOffset + size <= DataInBufSize);
+            if (offset - BufferOffset + size <= DataInBufSize)
             {
-                // Too slow network (or FDD or ...)
-                // We have read enough -> break
-                assert(offset - BufferOffset + size <= DataInBufSize);
-                if (offset - BufferOffset + size <= DataInBufSize)
-                {
-                    break;
-                }
+                break;
             }
         }
     }
+    StartReadahead();
     return Buffer + (offset - BufferOffset);
 }
+
+// starts reading the data following Buffer to the other buffer in Memory
+void CCachedFile::StartReadahead()
+{
+    QWORD end = BufferOffset + DataInBufSize;
+    if (end >= FileSize)
+        return; // nothing to read
+    AheadOffset = end;
+    AheadSize = (DWORD)__min(BufferSize, FileSize - end);
+    AheadFailed = FALSE;
+    AheadStop = FALSE;
+    AheadThread = ThreadQueue.StartThread(ReadaheadBody, this);
+    // if the thread cannot be started, we will read the data when needed
+}
+
+// waits for the readahead started by StartReadahead(); returns FALSE on cancel
+BOOL CCachedFile::WaitForReadahead(const int& CancelFlag)
+{
+    while (!ThreadQueue.WaitForExit(AheadThread, 100))
+    {
+        if (CancelFlag)
+            AheadStop = TRUE; // the thread ends after reading of the current block
+    }
+    AheadThread = NULL;
+    return !AheadStop;
+}
+
+unsigned WINAPI
+CCachedFile::ReadaheadBody(void* param)
+{
+    CALL_STACK_MESSAGE1("CCachedFile::ReadaheadBody()");
+    CCachedFile* cf = (CCachedFile*)param;
+    LPBYTE data = cf->Memory[1 - cf->Current] + CARRY_SIZE;
+
+    LARGE_INTEGER li;
+    li.QuadPart = cf->AheadOffset;
+    DWORD err = SetFilePointer(cf->File, li.LowPart, &li.HighPart, FILE_BEGIN);
+    if ((0xFFFFFFFF == err) && (GetLastError() != NO_ERROR))
+    {
+        cf->AheadFailed = TRUE;
+        return 0;
+    }
+
+    DWORD nOfs = 0;
+    while (nOfs < cf->AheadSize && !cf->AheadStop)
+    {
+        DWORD nBytesRead, nBytesToRead = __min(cf->AheadSize - nOfs, AHEAD_READ_SIZE);
+        if (!ReadFile(cf->File, data + nOfs, nBytesToRead, &nBytesRead, NULL) || (nBytesRead != nBytesToRead))
+        {
+            cf->AheadFailed = TRUE;
+            break;
+        }
+        nOfs += nBytesRead;
+    }
+    return 0;
+}
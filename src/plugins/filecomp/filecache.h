@@ -3,15 +3,27 @@
 
 #pragma once
 
+// Reads a file sequentially through a buffer. While the caller works with the data
+// in the buffer, a helper thread reads the data following it to the second buffer
+// (readahead), so reading of the file overlaps with the processing of its data.
+
 class CCachedFile
 {
     HANDLE File;
     QWORD FileSize;
-    LPBYTE Buffer;
+    LPBYTE Memory[2];    // Two allocated buffers, Memory[Current] holds Buffer, the other one is used by readahead
+    int Current;         // Index of the buffer in Memory holding Buffer
+    LPBYTE Buffer;       // Valid data in Memory[Current]
     DWORD BufferSize;    // Size of allocated Buffer
     DWORD DataInBufSize; // Size of valid data in Buffer
     QWORD BufferOffset;  // Offset of Buffer in file
 
+    HANDLE AheadThread;      // Thread reading to Memory[1 - Current], NULL = readahead is not running
+    QWORD AheadOffset;       // Offset of the data read by AheadThread in file
+    DWORD AheadSize;         // Size of the data read by AheadThread (valid after the thread finished)
+    BOOL AheadFailed;        // TRUE = AheadThread failed to read the data
+    volatile BOOL AheadStop; // TRUE = AheadThread should stop reading (cancel)
+
 public:
     CCachedFile(/*DWORD minViewSize = 512*1024*/);
     ~CCachedFile() { Destroy(); }
@@ -20,4 +32,9 @@ public:
     DWORD GetMinViewSize();
     LPBYTE ReadBuffer(QWORD offset, DWORD size, const int& CancelFlag);
     QWORD GetFileSize() { return FileSize; }
+
+protected:
+    void StartReadahead();
+    BOOL WaitForReadahead(const int& CancelFlag);
+    static unsigned WINAPI ReadaheadBody(void* param);
 };
@@ -40,6 +40,8 @@ const char* CONFIG_LOADONSTART = "Load On Start";
 const char* CONFIG_VIEW_HORIZONTAL = "Horizontal View";
 const char* CONFIG_AUTO_COPY = "Auto-Copy Selection";
 const char* CONFIG_NORMALIZATION_FORM = "Normalization Form";
+const char* CONFIG_DIFFALGORITHM = "Diff Algorithm";
+const char* CONFIG_BINARYRESYNC = "Binary Resync";
 const char* CONFIG_ENCODING0 = "Encoding 0";
 const char* CONFIG_ENCODING1 = "Encoding 1";
 const char* CONFIG_ENDIANS0 = "Endians 0";
@@ -281,6 +283,10 @@ void CPluginInterface::LoadConfiguration(HWND parent, HKEY regKey, CSalamanderRe
                 DWORD dw;
                 if (registry->GetValue(regKey, CONFIG_NORMALIZATION_FORM, REG_DWORD, &dw, sizeof(DWORD)))
                     DefCompareOptions.NormalizationForm = dw ? TRUE : FALSE;
+                if (registry->GetValue(regKey, CONFIG_DIFFALGORITHM, REG_DWORD, &dw, sizeof(DWORD)) && dw <= daHistogram)
+                    DefCompareOptions.DiffAlgorithm = dw;
+                if (registry->GetValue(regKey, CONFIG_BINARYRESYNC, REG_DWORD, &dw, sizeof(DWORD)))
+                    DefCompareOptions.BinaryResync = dw ? 1 : 0;
             }
             // history of recently used files
             TCHAR buf[32];
@@ -366,6 +372,8 @@ void CPluginInterface::SaveConfiguration(HWND parent, HKEY regKey, CSalamanderRe
     registry->SetValue(regKey, CONFIG_INPUTENCTABLE1, REG_SZ, DefCompareOptions.ASCII8InputEncTableName[1], int(strlen(DefCompareOptions.ASCII8InputEncTableName[1])));
     dw = DefCompareOptions.NormalizationForm;
     registry->SetValue(regKey, CONFIG_NORMALIZATION_FORM, REG_DWORD, &dw, sizeof(DWORD));
+    registry->SetValue(regKey, CONFIG_DIFFALGORITHM, REG_DWORD, &DefCompareOptions.DiffAlgorithm, 4);
+    registry->SetValue(regKey, CONFIG_BINARYRESYNC, REG_DWORD, &DefCompareOptions.BinaryResync, 4);
     // history of recently used files
     BOOL b;
     if (SG->GetConfigParameter(SALCFG_SAVEHISTORY, &b, sizeof(BOOL), NULL) && b)
@@ -423,11 +431,14 @@ MENU_TEMPLATE_ITEM PluginMenu[] =
 {
   {MNTT_PB, 0
   {MNTT_IT, IDS_COMPAREFILES
+  {MNTT_IT, IDS_COMPAREMULTIPLE
   {MNTT_PE, 0
 };
 */
     salamander->AddMenuItem(-1, LoadStr(IDS_COMPAREFILES), SALHOTKEY('C', HOTKEYF_CONTROL | HOTKEYF_SHIFT), MID_COMPAREFILES, FALSE,
                             MENU_EVENT_DISK, 0, MENU_SKILLLEVEL_ALL);
+    salamander->AddMenuItem(-1, LoadStr(IDS_COMPAREMULTIPLE), 0, MID_COMPAREMULTIPLE, FALSE,
+                            MENU_EVENT_DISK, MENU_EVENT_DISK | MENU_EVENT_TARGET_DISK, MENU_SKILLLEVEL_ALL);
     // assign the plugin icon
     HBITMAP hBmp = (HBITMAP)LoadImage(DLLInstance, MAKEINTRESOURCE(IDB_FILECOMP),
                                       IMAGE_BITMAP, 16, 16, LR_DEFAULTCOLOR);
@@ -485,6 +496,11 @@ void CPluginInterface::ClearHistory(HWND parent)
 // CPluginInterfaceForMenu
 //
 
+static bool FileNameLess(const char* name1, const char* name2)
+{
+    return SG->StrICmp(name1, name2) < 0;
+}
+
 BOOL CPluginInterfaceForMenu::ExecuteMenuItem(CSalamanderForOperationsAbstract* salamander, HWND parent,
                                               int id, DWORD eventMask)
 {
@@ -612,6 +628,76 @@ BOOL CPluginInterfaceForMenu::ExecuteMenuItem(CSalamanderForOperationsAbstract*
 
         return FALSE;
     }
+
+    case MID_COMPAREMULTIPLE:
+    {
+        char path[2][MAX_PATH]; // paths of the source and the target panel
+        int pathType[2];
+        if (!SG->GetPanelPath(PANEL_SOURCE, path[0], MAX_PATH, &pathType[0], NULL) ||
+            !SG->GetPanelPath(PANEL_TARGET, path[1], MAX_PATH, &pathType[1], NULL) ||
+            pathType[0] != PATH_TYPE_WINDOWS || pathType[1] != PATH_TYPE_WINDOWS)
+        {
+            return Error((HWND)-1, IDS_BATCH_NOTDISK);
+        }
+
+        // names of the files in the target panel sorted for looking up their namesakes
+        std::vector<const char*> targetNames;
+        const CFileData* fd;
+        int index = 0;
+        BOOL isDir;
+        while ((fd = SG->GetPanelItem(PANEL_TARGET, &index, &isDir)) != NULL)
+        {
+            if (!isDir)
+                targetNames.push_back(fd->Name);
+        }
+        std::sort(targetNames.begin(), targetNames.end(), FileNameLess);
+
+        CBatchCompareThread* d = new CBatchCompareThread();
+        if (!d)
+            return Error((HWND)-1, IDS_LOWMEM);
+
+        // pair the selected files of the source panel (all its files if none is selected)
+        // with the files of the same names in the target panel; like Compare Files, the
+        // first file is the one from the left panel
+        BOOL sourceIsLeft = SG->GetSourcePanel() == PANEL_LEFT;
+        int selectedFiles = 0;
+        SG->GetPanelSelection(PANEL_SOURCE, &selectedFiles, NULL);
+        index = 0;
+        while ((fd = selectedFiles > 0 ? SG->GetPanelSelectedItem(PANEL_SOURCE, &index, &isDir) : SG->GetPanelItem(PANEL_SOURCE, &index, &isDir)) != NULL)
+        {
+            if (isDir)
+                continue;
+            std::vector<const char*>::iterator target = std::lower_bound(targetNames.begin(), targetNames.end(),
+                                                                         fd->Name, FileNameLess);
+            if (target == targetNames.end() || SG->StrICmp(*target, fd->Name) != 0)
+                continue;
+
+            char file1[MAX_PATH];
+            char file2[MAX_PATH];
+            strcpy(file1, path[0]);
+            strcpy(file2, path[1]);
+            if (!SG->SalPathAppend(file1, fd->Name, MAX_PATH) ||
+                !SG->SalPathAppend(file2, *target, MAX_PATH))
+            {
+                continue; // too long name
+            }
+            d->Pairs.push_back(CBatchPair(fd->Name, sourceIsLeft ? file1 : file2, sourceIsLeft ? file2 : file1));
+        }
+
+        if (d->Pairs.empty())
+        {
+            delete d;
+            return Error((HWND)-1, IDS_BATCH_NOPAIRS);
+        }
+
+        SG->GetConfigParameter(SALCFG_ALWAYSONTOP, &AlwaysOnTop, sizeof(AlwaysOnTop), NULL);
+        if (!d->Create(ThreadQueue))
+            delete d;
+        SG->SetUserWorkedOnPanelPath(PANEL_SOURCE); // treat this command as working with the path (appears in Alt+F12)
+        SG->SetUserWorkedOnPanelPath(PANEL_TARGET); // also record the target panel
+
+        return FALSE;
+    }
     }
     return FALSE;
 }
@@ -5,6 +5,7 @@
 
 // menu ID definitions
 #define MID_COMPAREFILES 1
+#define MID_COMPAREMULTIPLE 2
 
 #define CURRENT_CONFIG_VERSION_PRESEPARATEOPTIONS 6
 #define CURRENT_CONFIG_VERSION_NORECOMPAREBUTTON 7
@@ -411,8 +411,8 @@ void CMainWindow::SelectDifference(int i, int cmd, BOOL setSel, BOOL center)
     }
     else
     {
-        QWORD offset;
-        QWORD length = 0;
+        QWORD offset, offset2;
+        QWORD length = 0, length2 = 0;
 
         //if (DifferencesCount && (i < 0 || i >= DifferencesCount)) i = DifferencesCount - 1;
 
@@ -423,6 +423,8 @@ void CMainWindow::SelectDifference(int i, int cmd, BOOL setSel, BOOL center)
         {
             offset = Changes[i].Offset;
             length = Changes[i].Length;
+            offset2 = Changes[i].Offset2;
+            length2 = Changes[i].Length2;
         }
         else
         {
@@ -430,13 +432,20 @@ void CMainWindow::SelectDifference(int i, int cmd, BOOL setSel, BOOL center)
             {
                 OutOfRange = TRUE;
                 length = ((CHexFileViewWindow*)FileView[fviLeft])->FindDifference(cmd, &offset);
+                offset2 = offset; // FindDifference compares bytes at the same offsets
+                length2 = length;
             }
         }
 
-        if (length)
+        if (length || length2)
         {
+            // realigned files (CCompareOptions::BinaryResync): show the bytes following
+            // the difference side by side
+            __int64 shift = (__int64)(offset2 + length2) - (__int64)(offset + length);
+            ((CHexFileViewWindow*)FileView[fviLeft])->SetSiblinkShift(shift);
+            ((CHexFileViewWindow*)FileView[fviRight])->SetSiblinkShift(-shift);
             ((CHexFileViewWindow*)FileView[fviLeft])->SelectDifference(offset, length, center);
-            ((CHexFileViewWindow*)FileView[fviRight])->SelectDifference(offset, length, center);
+            ((CHexFileViewWindow*)FileView[fviRight])->SelectDifference(offset2, length2, center);
 
             if (OutOfRange)
                 SelectedDifference = FindDifference(offset);
@@ -0,0 +1,73 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+
+// ****************************************************************************
+//
+// CFilecompJob
+//
+
+CFilecompJob::CFilecompJob()
+{
+    Failure = fNone;
+    *Error = 0;
+}
+
+void CFilecompJob::Execute(size_t count)
+{
+    CALL_STACK_MESSAGE2("CFilecompJob::Execute(%u)", (unsigned)count);
+    Failure = fNone;
+    *Error = 0;
+
+    // the helper threads are needed only for this job
+    Start((int)min(size_t(GetThreadsCount()), count));
+    CParallelJob::Execute((int)count);
+    Stop();
+
+    switch (Failure)
+    {
+    case fAbortByUser:
+        throw CFilecompWorker::CAbortByUserException();
+    case fError:
+        throw CFilecompWorker::CException(Error);
+    case fLowMemory:
+        throw std::bad_alloc();
+    case fUnknown:
+        CFilecompWorker::CException::Raise(IDS_INTERNALERROR, 0);
+    }
+}
+
+void CFilecompJob::Run(int part)
+{
+    CFailure failure = fNone;
+    const char* error = NULL;
+    try
+    {
+        RunPart(part);
+    }
+    catch (CFilecompWorker::CAbortByUserException&)
+    {
+        failure = fAbortByUser;
+    }
+    catch (CFilecompWorker::CException& e)
+    {
+        failure = fError;
+        error = e.what();
+    }
+    catch (std::bad_alloc&)
+    {
+        failure = fLowMemory;
+    }
+    catch (...)
+    {
+        failure = fUnknown;
+    }
+    if (failure != fNone)
+    {
+        // only the first failure is reported, the remaining parts are skipped
+        if (InterlockedCompareExchange(&Failure, failure, fNone) == fNone && error != NULL)
+            lstrcpyn(Error, error, 1024);
+        InterlockedExchange(&NextPart, PartsCount);
+    }
+}
@@ -0,0 +1,41 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// ****************************************************************************
+//
+// CFilecompJob
+//
+// Parallel job (see CParallelJob in jobpool.h) whose parts may throw the
+// exceptions of the workers. An exception thrown from RunPart() stops handing
+// out of the remaining parts and it is rethrown from Execute() in the calling
+// thread once all threads have finished.
+//
+
+class CFilecompJob : public CParallelJob
+{
+public:
+    CFilecompJob();
+
+    // processes part 'index' of the job, called from any thread
+    virtual void RunPart(size_t index) = 0;
+
+    // processes all 'count' parts of the job and waits for them
+    void Execute(size_t count);
+
+protected:
+    enum CFailure
+    {
+        fNone,
+        fAbortByUser, // CFilecompWorker::CAbortByUserException
+        fError,       // CFilecompWorker::CException, message in Error
+        fLowMemory,   // std::bad_alloc
+        fUnknown      // any other exception
+    };
+
+    volatile LONG Failure; // CFailure of the first failed part
+    char Error[1024];
+
+    virtual void Run(int part);
+};
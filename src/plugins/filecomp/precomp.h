@@ -58,6 +58,7 @@
 #include "lcutils.h"
 #include "str.h"
 #include "diff.h"
+#include "histdiff.h"
 
 //#include "counter.h"
 //#include "profile.h"
@@ -72,6 +73,8 @@
 #include "filecache.h"
 #include "textio.h"
 #include "worker.h"
+#include "jobpool.h"
+#include "parallel.h"
 #include "cwbase.h"
 #include "cwstrict.h"
 #include "cwoptim.h"
@@ -82,6 +85,7 @@
 #include "viewwnd.h"
 #include "viewtext.h"
 #include "mainwnd.h"
+#include "batch.h"
 #include "messages.h"
 #include "remotmsg.h"
 #include "remote.h"
@@ -3,8 +3,113 @@
 
 #include "precomp.h"
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 
+#if defined(_M_IX86) || defined(_M_X64)
+static BOOL TextUseSSE2 = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+#endif
+
+// returns the number of ASCII characters (0x00 - 0x7F) at the beginning of 'text'
+static size_t
+CountASCIIBytes(const BYTE* text, size_t size)
+{
+    size_t i = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+    if (TextUseSSE2)
+    {
+        // the exact position of a non-ASCII character is found below
+        for (; i + 16 <= size; i += 16)
+        {
+            if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(text + i))) != 0)
+                break;
+        }
+    }
+#endif
+    while (i < size && text[i] < 0x80)
+        i++;
+    return i;
+}
+
+// converts 'size' ASCII characters from 'src' to UTF-16 characters in 'dst'
+static void
+WidenASCII(wchar_t* dst, const BYTE* src, size_t size)
+{
+    size_t i = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+    if (TextUseSSE2)
+    {
+        __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= size; i += 16)
+        {
+            __m128i chars = _mm_loadu_si128((const __m128i*)(src + i));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi8(chars, zero));
+            _mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpackhi_epi8(chars, zero));
+        }
+    }
+#endif
+    for (; i < size; i++)
+        dst[i] = src[i];
+}
+
+// swaps bytes of 'size' UTF-16 characters (big endian <-> little endian)
+static void
+SwapUTF16Bytes(wchar_t* text, size_t size)
+{
+    size_t i = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+    if (TextUseSSE2)
+    {
+        for (; i + 8 <= size; i += 8)
+        {
+            __m128i chars = _mm_loadu_si128((const __m128i*)(text + i));
+            chars = _mm_or_si128(_mm_slli_epi16(chars, 8), _mm_srli_epi16(chars, 8));
+            _mm_storeu_si128((__m128i*)(text + i), chars);
+        }
+    }
+#endif
+    for (; i < size; i++)
+        text[i] = ((text[i] >> 8) | (text[i] << 8)) & 0xffff;
+}
+
+// returns the number of characters at the beginning of 'text' which are not
+// changed by the end of line conversion, i.e. the position of the first '\r'
+// (if 'cr' is set) or '\0' (if 'null' is set)
+template <class CChar>
+static size_t
+CountPlainChars(const CChar* text, size_t size, bool cr, bool null)
+{
+    size_t i = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+    if (TextUseSSE2)
+    {
+        // both characters are searched at once, the one not converted is replaced
+        // by the other one
+        CChar char1 = cr ? '\r' : 0;
+        CChar char2 = null ? 0 : '\r';
+        __m128i chars1 = sizeof(CChar) == 1 ? _mm_set1_epi8(char(char1)) : _mm_set1_epi16(short(char1));
+        __m128i chars2 = sizeof(CChar) == 1 ? _mm_set1_epi8(char(char2)) : _mm_set1_epi16(short(char2));
+        for (; i + 16 / sizeof(CChar) <= size; i += 16 / sizeof(CChar))
+        {
+            __m128i chars = _mm_loadu_si128((const __m128i*)(text + i));
+            __m128i found;
+            if (sizeof(CChar) == 1)
+                found = _mm_or_si128(_mm_cmpeq_epi8(chars, chars1), _mm_cmpeq_epi8(chars, chars2));
+            else
+                found = _mm_or_si128(_mm_cmpeq_epi16(chars, chars1), _mm_cmpeq_epi16(chars, chars2));
+            if (_mm_movemask_epi8(found) != 0)
+                break;
+        }
+    }
+#endif
+    while (i < size && !(cr && text[i] == '\r' || null && text[i] == 0))
+        i++;
+    return i;
+}
+
 // ****************************************************************************
 //
 // CTextFileReader::CByteReader
@@ -52,6 +157,15 @@ bool CTextFileReader::CByteReader::ReloadBuffer(unsigned char& byte)
     return true;
 }
 
+size_t CTextFileReader::CByteReader::GetASCII(wchar_t* text, size_t size)
+{
+    const BYTE* buffer = (const BYTE*)Buffer + InPtr;
+    size_t count = CountASCIIBytes(buffer, min(size, size_t(BufferedCharacters - InPtr)));
+    WidenASCII(text, buffer, count);
+    InPtr += int(count);
+    return count;
+}
+
 // ****************************************************************************
 //
 // CTextFileReader
@@ -399,7 +513,10 @@ bool CTextFileReader::IsUTF8Text()
         }
         else
         {
-            s++;
+            // skip the whole run of ASCII characters
+            int ascii = int(CountASCIIBytes((const BYTE*)s, cnt + 1));
+            s += ascii;
+            cnt -= ascii - 1;
         }
     }
 
@@ -673,23 +790,23 @@ CTextFileReader::ConvertEols(CChar* buffer, size_t size)
 
     CChar* src = buffer;
     CChar* dst = buffer;
-    for (; src < buffer + size; ++src, ++dst)
+    CChar* end = buffer + size;
+    while (src < end)
     {
-        if (*src == '\r' && crconv)
-        {
-            if (crlf && src + 1 < buffer + size && src[1] == '\n')
-                src++;
-            *dst = '\n';
-        }
-        elif (*src == 0 && null)
-        {
-            *dst = '\n';
-        }
-        else
-        {
-            if (dst < src)
-                *dst = *src;
-        }
+        // move the whole run of characters which are not converted
+        size_t plain = CountPlainChars(src, size_t(end - src), crconv, null);
+        if (dst < src)
+            memmove(dst, src, plain * sizeof(CChar));
+        src += plain;
+        dst += plain;
+        if (src >= end)
+            break;
+
+        // '\r' or '\0' to convert
+        if (*src == '\r' && crlf && src + 1 < end && src[1] == '\n')
+            src++;
+        *dst++ = '\n';
+        src++;
     }
     return dst - buffer;
 }
@@ -736,11 +853,15 @@ void CTextFileReader::ReadASCII8(wchar_t*& buffer, size_t& size, const int& canc
 
     // TODO what if the file has zero length? MultiByteToWideChar fails?
 
+    // ASCII characters are the same in all ANSI code pages, the leading run of them
+    // is converted directly and MultiByteToWideChar gets only the rest of the file
+    size_t ascii = CountASCIIBytes((const BYTE*)Buffer, Size);
+
     int ret = 0;
-    if (Size > 0)
+    if (ascii < Size)
     {
         // estimage length
-        ret = MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, Buffer, int(Size), NULL, 0);
+        ret = MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, Buffer + ascii, int(Size - ascii), NULL, 0);
         if (ret == 0)
             CFilecompWorker::CException::Raise(IDS_ERRORUNICODE, GetLastError(), Name);
     }
@@ -750,15 +871,16 @@ void CTextFileReader::ReadASCII8(wchar_t*& buffer, size_t& size, const int& canc
         throw CFilecompWorker::CAbortByUserException();
 
     // reserve 1 char more at the end, for possible new-line insertion
-    size = ret;
+    size = ascii + ret;
     buffer = (wchar_t*)malloc((size + 1) * sizeof(wchar_t));
     if (!buffer)
         CFilecompWorker::CException::Raise(IDS_LOWMEM, 0);
 
-    if (size > 0)
+    WidenASCII(buffer, (const BYTE*)Buffer, ascii);
+    if (ret > 0)
     {
         // do the conversion
-        ret = MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, Buffer, int(Size), buffer, int(size));
+        ret = MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, Buffer + ascii, int(Size - ascii), buffer + ascii, ret);
         if (ret == 0)
             CFilecompWorker::CException::Raise(IDS_ERRORUNICODE, GetLastError(), Name);
     }
@@ -785,8 +907,13 @@ void CTextFileReader::ReadUTF8(wchar_t*& buffer, size_t& size, const int& cancel
 
     DWORD utf32;
     unsigned char z, y, x, w, v, u;
-    while (input.GetByte(z))
+    while (1)
     {
+        // convert the whole run of ASCII characters at once
+        size += input.GetASCII(buffer + size, allocated - size);
+        if (!input.GetByte(z))
+            break; // EOF
+
         // R.5 Mapping from UTF-8 form to UCS-4 form
         // (see http://www.cl.cam.ac.uk/~mgk25/ucs/ISO-10646-UTF-8.html)
         //
@@ -950,10 +1077,7 @@ void CTextFileReader::ReadUTF16(wchar_t*& buffer, size_t& size, const int& cance
 
     // convert to little endian
     if (Endian == endianBig)
-    {
-        for (wchar_t* iterator = buffer; iterator < buffer + size; ++iterator)
-            *iterator = ((*iterator >> 8) | (*iterator << 8)) & 0xffff;
-    }
+        SwapUTF16Bytes(buffer, size);
 }
 
 void CTextFileReader::ReadUTF32(wchar_t*& buffer, size_t& size, const int& cancel)
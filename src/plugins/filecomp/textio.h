@@ -93,6 +93,9 @@ protected:
             byte = Buffer[InPtr++];
             return true;
         }
+        // converts the ASCII characters following in the buffer (at most 'size')
+        // to 'text', returns their number
+        size_t GetASCII(wchar_t* text, size_t size);
 
     private:
         const char* Name;
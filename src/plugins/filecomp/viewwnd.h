@@ -254,6 +254,7 @@ protected:
     int BytesPerLine;
     QWORD ViewOffset;
     QWORD SiblinkSize;
+    __int64 SiblinkShift; // byte at offset X is shown next to the byte at offset X + SiblinkShift in Siblink
     char Path[MAX_PATH];
     BOOL PaintEnabled;
     int HScrollOffs;
@@ -272,6 +273,7 @@ public:
     virtual void SetSiblink(CFileViewWindow* wnd);
     virtual void UpdateScrollBars(BOOL repaint = TRUE);
     virtual BOOL SetData(QWORD firstDiff, const char* path, QWORD siblinkSize);
+    void SetSiblinkShift(__int64 shift) { SiblinkShift = shift; }
     virtual void Paint();
     void EnablePaint() { PaintEnabled = TRUE; }
     void DisablePaint() { PaintEnabled = FALSE; }
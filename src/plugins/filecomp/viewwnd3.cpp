@@ -43,6 +43,7 @@ CHexFileViewWindow::CHexFileViewWindow(CFileViewID id) : CFileViewWindow(id, fvt
     SelectedOffset = -1;
     SelectedLength = 0;
     FocusedDiffOffset = -1;
+    SiblinkShift = 0;
     ViewMode = fvmStandard;
 }
 
@@ -171,6 +172,7 @@ BOOL CHexFileViewWindow::SetData(QWORD firstDiff, const char* path, QWORD siblin
     else
         FirstDiff = 0; // Files are actually equal
     SiblinkSize = siblinkSize;
+    SiblinkShift = 0;
 
     // determine the size of the area reserved for the offset
     LineNumDigits = ComputeAddressCharWidth(Mapping.GetFileSize(), SiblinkSize);
@@ -224,6 +226,7 @@ void CHexFileViewWindow::Paint()
     char* data;
     int size;
     char* siblinkData;
+    int siblinkFirst; // index of the first byte in 'data' having its counterpart in 'siblinkData'
     int siblinkSize;
     RECT r;
 
@@ -249,11 +252,19 @@ void CHexFileViewWindow::Paint()
             goto LERASE_WINDOW;
         }
 
-        if (ViewOffset + clipFirstRow * BytesPerLine < SiblinkSize)
+        // counterparts of the shown bytes in Siblink, see SiblinkShift
+        __int64 siblinkBegin = (__int64)(ViewOffset + clipFirstRow * BytesPerLine) + SiblinkShift;
+        __int64 siblinkEnd = __min((__int64)(ViewOffset + clipLastRow * BytesPerLine + 1) + SiblinkShift, (__int64)SiblinkSize);
+        siblinkFirst = 0;
+        if (siblinkBegin < 0)
         {
-            siblinkSize = (int)(__min(ViewOffset + clipLastRow * BytesPerLine + 1, SiblinkSize) -
-                                (ViewOffset + clipFirstRow * BytesPerLine));
-            siblinkData = (char*)((CHexFileViewWindow*)Siblink)->Mapping.MapViewOfFile(ViewOffset + clipFirstRow * BytesPerLine, siblinkSize);
+            siblinkFirst = (int)__min(-siblinkBegin, (__int64)size);
+            siblinkBegin = 0;
+        }
+        if (siblinkBegin < siblinkEnd)
+        {
+            siblinkSize = (int)(siblinkEnd - siblinkBegin);
+            siblinkData = (char*)((CHexFileViewWindow*)Siblink)->Mapping.MapViewOfFile(siblinkBegin, siblinkSize);
             if (!siblinkData)
             {
                 HandleFileError(((CHexFileViewWindow*)Siblink)->GetPath(), GetLastError());
@@ -310,7 +321,7 @@ void CHexFileViewWindow::Paint()
 
                 if ((j + ViewOffset < SelectedOffset) || (j + ViewOffset >= SelectedOffset + SelectedLength))
                 {
-                    if (j >= siblinkSize || siblinkData[j] != data[j])
+                    if (j < siblinkFirst || j - siblinkFirst >= siblinkSize || siblinkData[j - siblinkFirst] != data[j])
                     {
                         QWORD currentAddr = ViewOffset + clipFirstRow * BytesPerLine + j;
                         if (currentAddr >= FocusedDiffOffset &&
@@ -350,7 +361,7 @@ void CHexFileViewWindow::Paint()
 
                     int k = j + 1;
                     if (colorScheme == LC_NORMAL ||
-                        k < maxj && (k >= siblinkSize || siblinkData[k] != data[k]))
+                        k < maxj && (k < siblinkFirst || k - siblinkFirst >= siblinkSize || siblinkData[k - siblinkFirst] != data[k]))
                     {
                         // draw the entire triplet ('XX ') in one color
                         r = r2;
@@ -1043,7 +1054,13 @@ CHexFileViewWindow::WindowProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
         default:
             return 0;
         }
-        SendMessage(Siblink->HWindow, WM_USER_VSCROLL, MAKELONG(SB_THUMBTRACK, pos >> 32), (LPARAM)pos);
+        // keep the counterparts of the shown bytes in Siblink (see SiblinkShift)
+        __int64 siblinkPos = pos + SiblinkShift / BytesPerLine;
+        if (siblinkPos < 0)
+            siblinkPos = 0;
+        if (siblinkPos > maxPos) // both views have the same scroll range
+            siblinkPos = maxPos;
+        SendMessage(Siblink->HWindow, WM_USER_VSCROLL, MAKELONG(SB_THUMBTRACK, siblinkPos >> 32), (LPARAM)siblinkPos);
         lParam = (LPARAM)pos;
         wParam = (WPARAM)(pos >> 32);
     }
@@ -34,7 +34,9 @@ CCompareOptions DefaultCompareOptions =
         {// char ASCII8InputEncTableName[2][101];
          "",
          ""},
-        TRUE //  BOOL           NormalizationForm;
+        TRUE,   //  BOOL           NormalizationForm;
+        daAuto, // int DiffAlgorithm;
+        0       // int BinaryResync;
 };
 
 // ****************************************************************************
@@ -57,6 +57,20 @@ struct CCompareOptions
 
     // Normalize Unicode texts to Normalization Form C using normaliz.dll
     BOOL NormalizationForm;
+
+    // Algorithm used to compare lines of text files, see CDiffAlgorithm
+    int DiffAlgorithm;
+
+    // Realign binary files after inserted and deleted bytes, otherwise bytes at
+    // the same offsets are compared
+    int BinaryResync;
+};
+
+enum CDiffAlgorithm
+{
+    daAuto,     // daHistogram for big files, daMyers otherwise
+    daMyers,    // shortest edit script (Myers' algorithm, like GNU diff)
+    daHistogram // histogram diff (anchored by rare lines, linear time and memory for very different files)
 };
 
 extern CCompareOptions DefaultCompareOptions;
@@ -102,13 +116,25 @@ enum
 
 struct CBinaryChange
 {
-    QWORD Offset;
+    QWORD Offset; // position and length of the change in the first file
     QWORD Length;
+    QWORD Offset2;   // position and length of the change in the second file, the same
+    QWORD Length2;   // as in the first file unless the files are realigned (BinaryResync)
+    QWORD MovedFrom; // inserted bytes only: offset of the same bytes in the first file, -1 = none
 
     CBinaryChange(QWORD offset, QWORD length)
+    {
+        Offset = Offset2 = offset;
+        Length = Length2 = length;
+        MovedFrom = (QWORD)-1;
+    }
+    CBinaryChange(QWORD offset, QWORD length, QWORD offset2, QWORD length2, QWORD movedFrom)
     {
         Offset = offset;
         Length = length;
+        Offset2 = offset2;
+        Length2 = length2;
+        MovedFrom = movedFrom;
     }
 };
 
@@ -267,6 +293,10 @@ struct CWorkerFileData
     HANDLE DetachHFile();
 };
 
+// returns the number of equal bytes at the beginning of 'ptr0' and 'ptr1' ('size' if
+// all of them are equal)
+DWORD CountEqualBytes(const BYTE* ptr0, const BYTE* ptr1, DWORD size);
+
 // ****************************************************************************
 //
 // CFilecompWorker
@@ -318,6 +348,11 @@ protected:
     void CompareBinaryFiles();
     int CompareBinaryFilesAux(CCachedFile (&cf)[2], QWORD& changeOffs);
     int FindDifferencesBody(CCachedFile (&cf)[2], QWORD changeOffs, CBinaryChanges& changes);
+    int FindResyncDifferencesBody(CCachedFile (&cf)[2], QWORD changeOffs, CBinaryChanges& changes);
+    int SkipEqualBytes(CCachedFile (&cf)[2], QWORD (&offset)[2], DWORD changes,
+                       int& pct, DWORD& lastChangesSize, DWORD& tickCount);
+    BOOL AddBinaryChangeToCombo(CBinaryChanges& changes);
+    void FormatBinaryChange(const CBinaryChange& change, size_t number, int digits, TCHAR* report);
 
     template <class CChar>
     void CompareTextFiles(CTextFileReader (&reader)[2])
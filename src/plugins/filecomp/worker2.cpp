@@ -3,6 +3,52 @@
 
 #include "precomp.h"
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#define BINRESYNC_BLOCK 32             // minimal number of equal bytes the files are realigned at
+#define BINRESYNC_WINDOW (1024 * 1024) // max. distance of realigned bytes, must fit in the buffer of CCachedFile
+#define BINRESYNC_INDEX_BITS 16        // size of the index of blocks of the first file (2^BINRESYNC_INDEX_BITS slots)
+#define BINRESYNC_HASH_MUL 0x01000193  // multiplier of the rolling hash of blocks
+
+#if defined(_M_IX86) || defined(_M_X64)
+static BOOL CompareUseSSE2 = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+#endif
+
+// returns the number of equal bytes at the beginning of 'ptr0' and 'ptr1' ('size' if
+// all of them are equal)
+DWORD
+CountEqualBytes(const BYTE* ptr0, const BYTE* ptr1, DWORD size)
+{
+    DWORD i = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+    if (CompareUseSSE2)
+    {
+        // 64 bytes at once, the exact position of a difference is found below
+        for (; i + 64 <= size; i += 64)
+        {
+            __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(ptr0 + i)), _mm_loadu_si128((const __m128i*)(ptr1 + i)));
+            eq = _mm_and_si128(eq, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(ptr0 + i + 16)), _mm_loadu_si128((const __m128i*)(ptr1 + i + 16))));
+            eq = _mm_and_si128(eq, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(ptr0 + i + 32)), _mm_loadu_si128((const __m128i*)(ptr1 + i + 32))));
+            eq = _mm_and_si128(eq, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(ptr0 + i + 48)), _mm_loadu_si128((const __m128i*)(ptr1 + i + 48))));
+            if (_mm_movemask_epi8(eq) != 0xFFFF)
+                break;
+        }
+        for (; i + 16 <= size; i += 16)
+        {
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(ptr0 + i)), _mm_loadu_si128((const __m128i*)(ptr1 + i)))) != 0xFFFF)
+                break;
+        }
+    }
+#endif
+    while (i + sizeof(int) <= size && *(int*)(ptr0 + i) == *(int*)(ptr1 + i))
+        i += sizeof(int);
+    while (i < size && ptr0[i] == ptr1[i])
+        i++;
+    return i;
+}
+
 void CFilecompWorker::CompareBinaryFiles()
 {
     CCachedFile cf[2];
@@ -52,7 +98,10 @@ void CFilecompWorker::CompareBinaryFiles()
         CBinaryChanges changes;
 
         TRACE_I("FindingDifferences");
-        ret = FindDifferencesBody(cf, changeOffs, changes);
+        if (Options.BinaryResync)
+            ret = FindResyncDifferencesBody(cf, changeOffs, changes);
+        else
+            ret = FindDifferencesBody(cf, changeOffs, changes);
         if (ret == 0)
         {
             HWND comboHWnd = (HWND)SendMessage(MainWindow, WM_USER_WORKERNOTIFIES, WN_SETCHANGES, (LPARAM)&changes);
@@ -65,11 +114,8 @@ void CFilecompWorker::CompareBinaryFiles()
                 size_t j;
                 for (j = 0; j < changes.size(); j++)
                 {
-                    TCHAR buf1[32], buf2[32], report[200], fmt[128];
-                    SG->ExpandPluralString(fmt, SizeOf(fmt), LoadStr(IDS_BINREPORT1), 1, &CQuadWord().SetUI64(changes[j].Length));
-                    _stprintf(report, fmt, j + 1,
-                              _ui64toa(changes[j].Length, buf1, 10),
-                              QWord2Ascii(changes[j].Offset, buf2, digits));
+                    TCHAR report[300];
+                    FormatBinaryChange(changes[j], j + 1, digits, report);
                     LRESULT ret2 = SendMessage(comboHWnd, CB_ADDSTRING, 0, (LPARAM)report);
                     if (ret2 == CB_ERR || ret2 == CB_ERRSPACE)
                     {
@@ -156,16 +202,7 @@ int CFilecompWorker::CompareBinaryFilesAux(CCachedFile (&cf)[2], QWORD& changeOf
 
         start = ptr0;
         end = ptr0 + size;
-        if (size > sizeof(int) - 1)
-        {
-            end -= sizeof(int) - 1;
-            while (ptr0 < end && *(int*)ptr0 == *(int*)ptr1)
-                ptr0 += sizeof(int), ptr1 += sizeof(int);
-            end += sizeof(int) - 1;
-        }
-
-        while (ptr0 < end && *ptr0 == *ptr1)
-            ptr0++, ptr1++;
+        ptr0 += CountEqualBytes(ptr0, ptr1, size);
 
         if (ptr0 < end)
         {
@@ -282,30 +319,8 @@ int CFilecompWorker::FindDifferencesBody(CCachedFile (&cf)[2], QWORD changeOffs,
         if (lenghtSave)
         {
             changes.push_back(CBinaryChange(offsetSave, lenghtSave));
-            if (changes.size() == MaxBinChanges)
-                break; // stop searching; we already have plenty
-            HWND hComboWnd = (HWND)SendMessage(MainWindow, WM_USER_WORKERNOTIFIES, WN_GET_CHANGESCOMBO, NULL);
-            if (hComboWnd)
-            {
-                TCHAR report[200], buf1[32], buf2[32], fmt[128];
-                int digits = ComputeAddressCharWidth(Files[0].Size, Files[1].Size);
-                SG->ExpandPluralString(fmt, SizeOf(fmt), LoadStr(IDS_BINREPORT1), 1, &CQuadWord().SetUI64(lenghtSave));
-                _stprintf(report, fmt, changes.size(),
-                          _ui64toa(lenghtSave, buf1, 10),
-                          QWord2Ascii(offsetSave, buf2, digits));
-                if (changes.size() == 1)
-                    SendMessage(hComboWnd, CB_RESETCONTENT, 0, 0); // Hack
-                LRESULT ret = SendMessage(hComboWnd, CB_ADDSTRING, 0, (LPARAM)report);
-                if (changes.size() == 1)
-                    SendMessage(hComboWnd, CB_SETCURSEL, 0, 0); // Hack
-                if (ret == CB_ERR || ret == CB_ERRSPACE)
-                {
-                    TRACE_E("CB_ADDSTRING has failed");
-                    break;
-                }
-            }
-            CBinaryChange* change = &changes.back();
-            SendMessage(MainWindow, WM_USER_WORKERNOTIFIES, WN_ADD_CHANGE, (LPARAM)change);
+            if (!AddBinaryChangeToCombo(changes))
+                break;
         }
         else
             break;
@@ -344,16 +359,7 @@ int CFilecompWorker::FindDifferencesBody(CCachedFile (&cf)[2], QWORD changeOffs,
 
             start = ptr0;
             end = ptr0 + size;
-            if (size > sizeof(int) - 1)
-            {
-                end -= sizeof(int) - 1;
-                while (ptr0 < end && *(int*)ptr0 == *(int*)ptr1)
-                    ptr0 += sizeof(int), ptr1 += sizeof(int);
-                end += sizeof(int) - 1;
-            }
-
-            while (ptr0 < end && *ptr0 == *ptr1)
-                ptr0++, ptr1++;
+            ptr0 += CountEqualBytes(ptr0, ptr1, size);
 
             if (ptr0 < end)
                 break;
@@ -373,3 +379,284 @@ int CFilecompWorker::FindDifferencesBody(CCachedFile (&cf)[2], QWORD changeOffs,
 
     return 0; // succes
 }
+
+// Reports the last change in 'changes' to the main window and adds it to the combo
+// box with differences; returns FALSE if searching for other differences should stop.
+BOOL CFilecompWorker::AddBinaryChangeToCombo(CBinaryChanges& changes)
+{
+    if (changes.size() == MaxBinChanges)
+        return FALSE; // stop searching; we already have plenty
+    HWND hComboWnd = (HWND)SendMessage(MainWindow, WM_USER_WORKERNOTIFIES, WN_GET_CHANGESCOMBO, NULL);
+    if (hComboWnd)
+    {
+        TCHAR report[300];
+        FormatBinaryChange(changes.back(), changes.size(), ComputeAddressCharWidth(Files[0].Size, Files[1].Size), report);
+        if (changes.size() == 1)
+            SendMessage(hComboWnd, CB_RESETCONTENT, 0, 0); // Hack
+        LRESULT ret = SendMessage(hComboWnd, CB_ADDSTRING, 0, (LPARAM)report);
+        if (changes.size() == 1)
+            SendMessage(hComboWnd, CB_SETCURSEL, 0, 0); // Hack
+        if (ret == CB_ERR || ret == CB_ERRSPACE)
+        {
+            TRACE_E("CB_ADDSTRING has failed");
+            return FALSE;
+        }
+    }
+    CBinaryChange* change = &changes.back();
+    SendMessage(MainWindow, WM_USER_WORKERNOTIFIES, WN_ADD_CHANGE, (LPARAM)change);
+    return TRUE;
+}
+
+// Fills 'report' (at least 300 characters) with the description of the change
+// 'number' for the combo box with differences.
+void CFilecompWorker::FormatBinaryChange(const CBinaryChange& change, size_t number, int digits, TCHAR* report)
+{
+    TCHAR buf1[32], buf2[32], buf3[32], buf4[32], fmt[200];
+    if (change.Offset == change.Offset2 && change.Length == change.Length2)
+    {
+        // bytes at the same offsets differ
+        SG->ExpandPluralString(fmt, SizeOf(fmt), LoadStr(IDS_BINREPORT1), 1, &CQuadWord().SetUI64(change.Length));
+        _stprintf(report, fmt, (int)number,
+                  _ui64toa(change.Length, buf1, 10),
+                  QWord2Ascii(change.Offset, buf2, digits));
+    }
+    else if (change.Length == 0)
+    {
+        SG->ExpandPluralString(fmt, SizeOf(fmt), LoadStr(change.MovedFrom != (QWORD)-1 ? IDS_BINREPORT_COPIED : IDS_BINREPORT_INSERTED),
+                               1, &CQuadWord().SetUI64(change.Length2));
+        _stprintf(report, fmt, (int)number,
+                  _ui64toa(change.Length2, buf1, 10),
+                  QWord2Ascii(change.Offset2, buf2, digits),
+                  QWord2Ascii(change.MovedFrom, buf3, digits)); // ignored by IDS_BINREPORT_INSERTED
+    }
+    else if (change.Length2 == 0)
+    {
+        SG->ExpandPluralString(fmt, SizeOf(fmt), LoadStr(IDS_BINREPORT_DELETED), 1, &CQuadWord().SetUI64(change.Length));
+        _stprintf(report, fmt, (int)number,
+                  _ui64toa(change.Length, buf1, 10),
+                  QWord2Ascii(change.Offset, buf2, digits));
+    }
+    else
+    {
+        CQuadWord lengths[2];
+        lengths[0].SetUI64(change.Length);
+        lengths[1].SetUI64(change.Length2);
+        SG->ExpandPluralString(fmt, SizeOf(fmt), LoadStr(IDS_BINREPORT_REPLACED), 2, lengths);
+        _stprintf(report, fmt, (int)number,
+                  _ui64toa(change.Length, buf1, 10),
+                  QWord2Ascii(change.Offset, buf2, digits),
+                  _ui64toa(change.Length2, buf3, 10),
+                  QWord2Ascii(change.Offset2, buf4, digits));
+    }
+}
+
+// Skips bytes that are equal in both files at the same distance from 'offset'
+// (in lockstep), on return 'offset' points to the first different bytes or to
+// the end of the shorter file. Returns 0 on success, 1 or 2 on read error in the
+// first or second file, 4 on cancel.
+int CFilecompWorker::SkipEqualBytes(CCachedFile (&cf)[2], QWORD (&offset)[2], DWORD changes,
+                                    int& pct, DWORD& lastChangesSize, DWORD& tickCount)
+{
+    unsigned int blokSize = cf[0].GetMinViewSize();
+    QWORD totalSize = Files[0].Size + Files[1].Size;
+
+    for (;;)
+    {
+        QWORD remain = __min(Files[0].Size - offset[0], Files[1].Size - offset[1]);
+        if (!remain)
+            return 0; // at the end of one of the files
+
+        int newPct = (int)((100 * (offset[0] + offset[1])) / totalSize);
+
+        if (pct != newPct || lastChangesSize != changes)
+        {
+            if ((GetTickCount() - tickCount) > 500)
+            {
+                tickCount = GetTickCount();
+                pct = newPct;
+                lastChangesSize = changes;
+                SendMessage(MainWindow, WM_USER_WORKERNOTIFIES, WN_SET_PROGRESS, MAKELPARAM(pct, lastChangesSize));
+            }
+        }
+
+        DWORD size = (DWORD)__min(blokSize, remain);
+
+        LPBYTE ptr0 = cf[0].ReadBuffer(offset[0], size, CancelFlag);
+        if (!ptr0)
+            return CancelFlag ? 4 : 1;
+
+        LPBYTE ptr1 = cf[1].ReadBuffer(offset[1], size, CancelFlag);
+        if (!ptr1)
+            return CancelFlag ? 4 : 2;
+
+        DWORD i = CountEqualBytes(ptr0, ptr1, size);
+
+        offset[0] += i;
+        offset[1] += i;
+        if (i < size)
+            return 0; // found a difference
+
+        if (CancelFlag)
+            return 4;
+    }
+}
+
+static DWORD
+BinResyncHash(const BYTE* data)
+{
+    DWORD hash = 0;
+    int i;
+    for (i = 0; i < BINRESYNC_BLOCK; i++)
+        hash = hash * BINRESYNC_HASH_MUL + data[i];
+    return hash;
+}
+
+static DWORD
+BinResyncHashSlot(DWORD hash)
+{
+    return (hash * 0x9E3779B1) >> (32 - BINRESYNC_INDEX_BITS);
+}
+
+// Looks for the nearest place where both windows continue with the same bytes
+// (at least BINRESYNC_BLOCK of them), "nearest" means the least number of bytes
+// skipped in both windows together. Blocks of 'data0' starting at multiples of
+// BINRESYNC_BLOCK are indexed in 'index' (index of the first such block with the
+// given hash plus one, 0 = empty slot), so the equal bytes are found if there are at
+// least 2 * BINRESYNC_BLOCK - 1 of them. Returns FALSE if the windows cannot be
+// realigned, otherwise returns in 'skip0' and 'skip1' the numbers of bytes preceding
+// the equal bytes in both windows.
+static BOOL
+FindResyncPoint(const BYTE* data0, DWORD size0, const BYTE* data1, DWORD size1,
+                std::vector<DWORD>& index, DWORD& skip0, DWORD& skip1)
+{
+    std::fill(index.begin(), index.end(), 0);
+    DWORD blocks = size0 / BINRESYNC_BLOCK;
+    DWORD k;
+    for (k = 0; k < blocks; k++)
+    {
+        DWORD& slot = index[BinResyncHashSlot(BinResyncHash(data0 + k * BINRESYNC_BLOCK))];
+        if (slot == 0)
+            slot = k + 1;
+    }
+    if (blocks == 0 || size1 < BINRESYNC_BLOCK)
+        return FALSE;
+
+    // BINRESYNC_HASH_MUL^BINRESYNC_BLOCK, removes the leaving byte from the rolling hash
+    DWORD outMul = 1;
+    int i;
+    for (i = 0; i < BINRESYNC_BLOCK; i++)
+        outMul *= BINRESYNC_HASH_MUL;
+
+    DWORD best = 0xFFFFFFFF;
+    DWORD hash = BinResyncHash(data1);
+    DWORD p;
+    for (p = 0;; p++)
+    {
+        DWORD slot = index[BinResyncHashSlot(hash)];
+        if (slot != 0 && memcmp(data0 + (slot - 1) * BINRESYNC_BLOCK, data1 + p, BINRESYNC_BLOCK) == 0)
+        {
+            // the equal bytes may start before the block, the previous block was not
+            // found (hash collision) or they start less than a block before
+            DWORD a0 = (slot - 1) * BINRESYNC_BLOCK;
+            DWORD a1 = p;
+            DWORD n = 0;
+            while (n < BINRESYNC_BLOCK && a0 > 0 && a1 > 0 && data0[a0 - 1] == data1[a1 - 1])
+                a0--, a1--, n++;
+            if (a0 + a1 < best)
+            {
+                best = a0 + a1;
+                skip0 = a0;
+                skip1 = a1;
+            }
+        }
+        // any later match skips at least p + 1 - BINRESYNC_BLOCK bytes of 'data1'
+        if (p + 1 + BINRESYNC_BLOCK > size1 || best != 0xFFFFFFFF && p + 1 >= best + BINRESYNC_BLOCK)
+            break;
+        hash = hash * BINRESYNC_HASH_MUL + data1[p + BINRESYNC_BLOCK] - data1[p] * outMul;
+    }
+    return best != 0xFFFFFFFF;
+}
+
+// Variant of FindDifferencesBody realigning the files after inserted and deleted
+// bytes: when the files differ, the nearest place where they continue with the same
+// bytes (see FindResyncPoint) is searched for in the windows of BINRESYNC_WINDOW bytes
+// following the difference. Bytes skipped in both files make one change. If there is
+// no such place, the whole windows are reported as changed and the search continues
+// behind them.
+int CFilecompWorker::FindResyncDifferencesBody(CCachedFile (&cf)[2], QWORD changeOffs, CBinaryChanges& changes)
+{
+    CALL_STACK_MESSAGE1("CFilecompWorker::FindResyncDifferencesBody(, , )");
+
+    QWORD offset[2] = {changeOffs, changeOffs};
+    int pct = 0;
+    DWORD lastChangesSize = -1;
+    DWORD tickCount = GetTickCount() - 1000;
+    std::vector<DWORD> index(1 << BINRESYNC_INDEX_BITS); // see FindResyncPoint
+
+    for (;;)
+    {
+        int ret = SkipEqualBytes(cf, offset, (DWORD)changes.size(), pct, lastChangesSize, tickCount);
+        if (ret != 0)
+            return ret;
+        if (offset[0] == Files[0].Size && offset[1] == Files[1].Size)
+            break; // both files are at the end
+
+        // offset points to the start of the difference, read the windows following it
+        LPBYTE data[2];
+        DWORD size[2];
+        int i;
+        for (i = 0; i < 2; i++)
+        {
+            size[i] = (DWORD)__min(BINRESYNC_WINDOW, Files[i].Size - offset[i]);
+            data[i] = NULL;
+            if (size[i] > 0)
+            {
+                data[i] = cf[i].ReadBuffer(offset[i], size[i], CancelFlag);
+                if (!data[i])
+                    return CancelFlag ? 4 : i + 1;
+            }
+        }
+
+        DWORD skip[2];
+        if (!FindResyncPoint(data[0], size[0], data[1], size[1], index, skip[0], skip[1]))
+        {
+            if (size[0] == 0 || size[1] == 0 ||
+                offset[0] + size[0] == Files[0].Size && offset[1] + size[1] == Files[1].Size)
+            {
+                // the rest of the files differs
+                skip[0] = size[0];
+                skip[1] = size[1];
+            }
+            else
+            {
+                // no equal bytes near, give up realigning the windows
+                skip[0] = skip[1] = __min(size[0], size[1]);
+            }
+        }
+
+        // bytes inserted into the second file may be copied from the first file
+        QWORD movedFrom = (QWORD)-1;
+        if (skip[0] == 0 && skip[1] >= BINRESYNC_BLOCK)
+        {
+            DWORD slot = index[BinResyncHashSlot(BinResyncHash(data[1]))];
+            if (slot != 0)
+            {
+                DWORD from = (slot - 1) * BINRESYNC_BLOCK;
+                if (size[0] - from >= skip[1] && memcmp(data[0] + from, data[1], skip[1]) == 0)
+                    movedFrom = offset[0] + from;
+            }
+        }
+
+        changes.push_back(CBinaryChange(offset[0], skip[0], offset[1], skip[1], movedFrom));
+        if (!AddBinaryChangeToCombo(changes))
+            break;
+
+        offset[0] += skip[0];
+        offset[1] += skip[1];
+
+        if (CancelFlag)
+            return 4;
+    }
+
+    return 0; // succes
+}
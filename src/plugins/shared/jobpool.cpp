@@ -0,0 +1,238 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+#include <process.h>
+
+#include "jobpool.h"
+
+struct CPoolThreadData
+{
+    unsigned(WINAPI* Body)(void*);
+    void* Param;
+};
+
+static unsigned __stdcall PoolThreadProc(void* param)
+{
+    CPoolThreadData data = *(CPoolThreadData*)param;
+    delete (CPoolThreadData*)param;
+    return SalamanderDebug->CallWithCallStack(data.Body, data.Param);
+}
+
+static HANDLE StartPoolThread(unsigned(WINAPI* body)(void*), void* param)
+{
+    CALL_STACK_MESSAGE1("StartPoolThread(, )");
+    CPoolThreadData* data = new CPoolThreadData;
+    if (data == NULL)
+        return NULL;
+    data->Body = body;
+    data->Param = param;
+    unsigned tid;
+    HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, PoolThreadProc, data, CREATE_SUSPENDED, &tid);
+    if (thread == NULL)
+    {
+        TRACE_E("StartPoolThread(): unable to start the thread");
+        delete data;
+        return NULL;
+    }
+    SalamanderDebug->TraceAttachThread(thread, tid);
+    ResumeThread(thread);
+    return thread;
+}
+
+// ****************************************************************************
+//
+// CJobPool
+//
+
+CJobPool::CJobPool()
+{
+    ThreadsCount = 0;
+    InitializeCriticalSection(&Lock);
+    Work = NULL;
+    Finished = NULL;
+    First = NULL;
+    Last = NULL;
+    Exit = FALSE;
+}
+
+CJobPool::~CJobPool()
+{
+    if (ThreadsCount > 0)
+        TRACE_E("CJobPool::~CJobPool(): Stop() was not called");
+    DeleteCriticalSection(&Lock);
+}
+
+int CJobPool::GetThreadsCount()
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int count = (int)si.dwNumberOfProcessors;
+    if (count < 1)
+        count = 1;
+    return min(count, MAX_POOL_THREADS);
+}
+
+int CJobPool::Start(int threads)
+{
+    CALL_STACK_MESSAGE2("CJobPool::Start(%d)", threads);
+    Stop();
+    Work = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+    Finished = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (Work == NULL || Finished == NULL)
+    {
+        TRACE_E("CJobPool::Start(): unable to create synchronization objects");
+        Stop();
+        return 0;
+    }
+    Exit = FALSE;
+    threads = min(threads, MAX_POOL_THREADS);
+    while (ThreadsCount < threads)
+    {
+        Threads[ThreadsCount] = StartPoolThread(ThreadBody, this);
+        if (Threads[ThreadsCount] == NULL)
+            break; // we will manage with fewer threads
+        ThreadsCount++;
+    }
+    return ThreadsCount;
+}
+
+void CJobPool::Stop()
+{
+    CALL_STACK_MESSAGE1("CJobPool::Stop()");
+    if (ThreadsCount > 0)
+    {
+        EnterCriticalSection(&Lock);
+        Exit = TRUE;
+        LeaveCriticalSection(&Lock);
+        ReleaseSemaphore(Work, ThreadsCount, NULL);
+        WaitForMultipleObjects(ThreadsCount, Threads, TRUE, INFINITE);
+        int i;
+        for (i = 0; i < ThreadsCount; i++)
+            CloseHandle(Threads[i]);
+        ThreadsCount = 0;
+    }
+    if (Work != NULL)
+        CloseHandle(Work);
+    if (Finished != NULL)
+        CloseHandle(Finished);
+    Work = NULL;
+    Finished = NULL;
+    First = NULL;
+    Last = NULL;
+}
+
+void CJobPool::Submit(CPoolJob* job)
+{
+    job->Done = FALSE;
+    job->Next = NULL;
+    EnterCriticalSection(&Lock);
+    if (Last != NULL)
+        Last->Next = job;
+    else
+        First = job;
+    Last = job;
+    LeaveCriticalSection(&Lock);
+    ReleaseSemaphore(Work, 1, NULL);
+}
+
+void CJobPool::Wait(CPoolJob* job)
+{
+    while (TRUE)
+    {
+        EnterCriticalSection(&Lock);
+        BOOL done = job->Done;
+        LeaveCriticalSection(&Lock);
+        if (done)
+            break;
+        // 'Finished' is signaled by any job, so check ours again
+        WaitForSingleObject(Finished, INFINITE);
+    }
+}
+
+unsigned WINAPI
+CJobPool::ThreadBody(void* param)
+{
+    CALL_STACK_MESSAGE1("CJobPool::ThreadBody()");
+    CJobPool* pool = (CJobPool*)param;
+    void* state = NULL;
+    while (WaitForSingleObject(pool->Work, INFINITE) == WAIT_OBJECT_0)
+    {
+        EnterCriticalSection(&pool->Lock);
+        BOOL exit = pool->Exit;
+        CPoolJob* job = exit ? NULL : pool->First;
+        if (job != NULL)
+        {
+            pool->First = job->Next;
+            if (pool->First == NULL)
+                pool->Last = NULL;
+        }
+        LeaveCriticalSection(&pool->Lock);
+        if (exit)
+            break;
+        if (job == NULL)
+            continue;
+
+        if (!pool->Run(&state, job) && state != NULL)
+        {
+            pool->FreeState(state);
+            state = NULL;
+        }
+
+        EnterCriticalSection(&pool->Lock);
+        job->Done = TRUE;
+        LeaveCriticalSection(&pool->Lock);
+        SetEvent(pool->Finished);
+    }
+    if (state != NULL)
+        pool->FreeState(state);
+    return 0;
+}
+
+// ****************************************************************************
+//
+// CParallelJob
+//
+
+BOOL CParallelJobPool::Run(void** state, CPoolJob* job)
+{
+    Job->RunParts();
+    return TRUE;
+}
+
+CParallelJob::CParallelJob()
+{
+    Pool.Job = this;
+    NextPart = 0;
+    PartsCount = 0;
+}
+
+int CParallelJob::Start(int threads)
+{
+    CALL_STACK_MESSAGE2("CParallelJob::Start(%d)", threads);
+    Stop();
+    if (threads > 1)
+        Pool.Start(min(threads, MAX_POOL_THREADS) - 1); // the calling thread is one of them
+    return GetWorkers();
+}
+
+void CParallelJob::Execute(int count)
+{
+    CALL_STACK_MESSAGE_NONE // frequently called function
+    NextPart = 0;
+    PartsCount = count;
+    int helpers = min(Pool.GetThreads(), count - 1); // the calling thread runs parts too
+    int i;
+    for (i = 0; i < helpers; i++)
+        Pool.Submit(&Helpers[i]);
+    RunParts();
+    for (i = 0; i < helpers; i++)
+        Pool.Wait(&Helpers[i]);
+}
+
+void CParallelJob::RunParts()
+{
+    LONG part;
+    while ((part = InterlockedIncrement(&NextPart) - 1) < PartsCount)
+        Run(part);
+}
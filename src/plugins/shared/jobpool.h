@@ -0,0 +1,143 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// the highest number of helper threads of one pool
+#define MAX_POOL_THREADS 8
+
+// ****************************************************************************
+//
+// CPoolJob
+//
+// A piece of work done by a helper thread of CJobPool.
+//
+
+struct CPoolJob
+{
+    BOOL Done;      // TRUE = the job was run, guarded by CJobPool::Lock
+    CPoolJob* Next; // next job in the queue
+
+    CPoolJob()
+    {
+        Done = FALSE;
+        Next = NULL;
+    }
+    virtual ~CPoolJob() {}
+};
+
+// ****************************************************************************
+//
+// CJobPool
+//
+// Helper threads running the queued jobs in the order they were queued, the
+// results are collected by the caller using Wait(). Every thread can keep its
+// own state (e.g. a compression object) for all the jobs it runs. Derived
+// classes must call Stop() in their destructors.
+//
+
+class CJobPool
+{
+public:
+    CJobPool();
+    virtual ~CJobPool();
+
+    // returns the number of threads worth starting on this machine
+    static int GetThreadsCount();
+
+    // starts up to 'threads' helper threads, returns the number of threads started
+    int Start(int threads);
+
+    // ends the helper threads, all queued jobs must be done
+    void Stop();
+
+    int GetThreads() { return ThreadsCount; }
+
+    // queues 'job' (the pool must be started), returns without waiting for it
+    void Submit(CPoolJob* job);
+
+    // waits until 'job' is done
+    void Wait(CPoolJob* job);
+
+protected:
+    // runs 'job' in a helper thread; '*state' is the state of the thread, NULL
+    // at first; returns FALSE if '*state' cannot be used for further jobs
+    virtual BOOL Run(void** state, CPoolJob* job) = 0;
+
+    // releases the state of a helper thread
+    virtual void FreeState(void* state) = 0;
+
+    static unsigned WINAPI ThreadBody(void* param);
+
+    HANDLE Threads[MAX_POOL_THREADS];
+    int ThreadsCount;
+
+    CRITICAL_SECTION Lock; // guards the queue and CPoolJob::Done
+    HANDLE Work;           // semaphore, released for every queued job
+    HANDLE Finished;       // signaled whenever a job is done
+    CPoolJob* First;       // queued jobs
+    CPoolJob* Last;
+    BOOL Exit; // TRUE = the helper threads should end
+};
+
+// ****************************************************************************
+//
+// CParallelJob
+//
+// Job divided into independent parts that are run by the calling thread and by
+// the helper threads of a CJobPool at once. The helper threads are started by
+// Start() and wait for the next job between calls to Execute(), so even short
+// jobs can be split among them. Parts are handed out in the order of their
+// indexes.
+//
+
+class CParallelJob;
+
+class CParallelJobPool : public CJobPool
+{
+public:
+    CParallelJobPool() { Job = NULL; }
+    ~CParallelJobPool() { Stop(); }
+
+    CParallelJob* Job; // the job whose parts are run by the helper threads
+
+protected:
+    virtual BOOL Run(void** state, CPoolJob* job);
+    virtual void FreeState(void* state) {}
+};
+
+class CParallelJob
+{
+public:
+    CParallelJob();
+    virtual ~CParallelJob() { Stop(); }
+
+    // returns the number of threads worth starting for a job on this machine
+    static int GetThreadsCount() { return CJobPool::GetThreadsCount(); }
+
+    // starts helper threads so that 'threads' threads (including the calling one) work
+    // on each job; returns the number of threads really working on the jobs
+    int Start(int threads);
+
+    // ends the helper threads
+    void Stop() { Pool.Stop(); }
+
+    // returns the number of threads working on each job
+    int GetWorkers() { return Pool.GetThreads() + 1; }
+
+    // calls Run() for parts 0 to 'count' - 1 and returns when all of them are done
+    void Execute(int count);
+
+protected:
+    // runs part 'part' of the job; called from several threads at once
+    virtual void Run(int part) = 0;
+
+    void RunParts();
+
+    CParallelJobPool Pool;
+    CPoolJob Helpers[MAX_POOL_THREADS]; // one for every helper thread working on the job
+    volatile LONG NextPart;             // the part run by the next thread which asks for work
+    LONG PartsCount;
+
+    friend class CParallelJobPool;
+};
@@ -0,0 +1,407 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// ****************************************************************************
+//
+// histogram_diff - computes an edit script of two sequences of equivalence
+// class IDs using the patience/histogram diff algorithm
+//
+// Prototype
+//
+//   template<class iterator, class edit_t>
+//   ptrdiff_t histogram_diff(const iterator a, size_t n, const iterator b,
+//       size_t m, size_t classes, const edit_t& edit, const int& cancel = 0,
+//       size_t max_memory = histogram_diff_max_memory);
+//
+// Description
+//
+//   `a' and `b' are random access iterators to the beginning of two sequences
+//   with lengths `n' and `m'. Their items are IDs of equivalence classes of
+//   the compared items (e.g. lines identified by a hash table), each ID must
+//   be smaller than `classes'.
+//
+//   The edit script is reported by calling `edit(op, off, len)' in the same
+//   way as `diff' (see diff.h) does, so the same edit builders can be used.
+//   Returns the number of deleted and inserted items.
+//
+//   Whenever value of `cancel' becomes true, computation is terminated by
+//   throwing a C++ exception of type `diff_exception'.
+//
+//   Each region of the sequences is split by anchors: first by the longest
+//   increasing sequence of items unique in both regions (patience diff), if
+//   there is none, by the longest common part whose items occur the lowest
+//   number of times in the first sequence (histogram diff). The parts between
+//   the anchors are processed in the same way. Occurrence tables are reused for
+//   all regions, so the memory is linear to `n + m + classes'; regions are kept
+//   on an explicit stack, so there is no deep recursion even for very long
+//   sequences.
+//
+//   Items occurring more than `histogram_diff_max_chain' times are never used
+//   as anchors. Regions containing only such items are compared by `diff'
+//   limited to `histogram_diff_myers_dmax' edits and if even that fails,
+//   the region is reported as deleted and inserted as a whole. The same
+//   heuristic is used for all remaining regions when the scanning of regions
+//   exceeds `histogram_diff_max_work' times the length of the sequences and
+//   for the whole sequences if the occurrence tables do not fit into
+//   `max_memory' bytes. The edit script is not the shortest possible one, but
+//   it is usually more readable: it does not match common items like blank
+//   lines or braces between unrelated blocks.
+//
+//
+// ****************************************************************************
+//
+// The algorithm is based on the patience diff by Bram Cohen and on the
+// histogram diff from JGit by Shawn O. Pearce.
+//
+
+enum
+{
+    histogram_diff_max_chain = 64,       // max. number of occurrences of an anchor item
+    histogram_diff_myers_dmax = 256,     // max. edit script length computed by Myers' diff in regions without anchors
+    histogram_diff_max_work = 64,        // max. number of scans of each item while searching for anchors
+    histogram_diff_max_memory = 1 << 28, // default memory budget for the occurrence tables (256 MB)
+};
+
+template <class iterator, class edit_t>
+class histogram_diff_t : public diff_base
+{
+public:
+    histogram_diff_t(const iterator& a, const iterator& b, size_t classes,
+                     const edit_t& edit, const int& cancel, std::vector<ptrdiff_t>& buf)
+        : diff_base(cancel, INT_MAX, buf), a(a), b(b), classes(classes), edit(edit) {}
+
+    ptrdiff_t operator()(size_t n, size_t m, size_t max_memory);
+
+protected:
+    typedef unsigned int index_t;
+    enum
+    {
+        none = ~0u
+    };
+
+    // region waiting for comparison (`op' == ed_insert) or a common region
+    // waiting for reporting (`op' == ed_match)
+    struct region
+    {
+        char op;
+        size_t aoff, n, boff, m;
+        region(char op, size_t aoff, size_t n, size_t boff, size_t m)
+            : op(op), aoff(aoff), n(n), boff(boff), m(m) {}
+    };
+
+    const iterator a;
+    const iterator b;
+    size_t classes;
+    edit_t edit;
+    unsigned __int64 work; // remaining number of items which can be scanned while searching for anchors
+
+    std::vector<index_t> head;   // first occurrence of each class in the current region of `a'
+    std::vector<index_t> count;  // number of occurrences of each class in the current region of `a'
+    std::vector<index_t> countb; // number of occurrences of each class in the current region of `b'
+    std::vector<index_t> next;   // next occurrence of the class of each item of `a'
+    std::vector<index_t> unique; // positions in `b' of the items unique in both regions
+    std::vector<index_t> tails;  // patience sorting: indexes to `unique' of the tops of piles
+    std::vector<index_t> prev;   // patience sorting: index to `unique' of the previous item in the sequence
+    std::vector<region> stack;
+
+    ptrdiff_t process(size_t aoff, size_t n, size_t boff, size_t m);
+    bool split_by_unique(size_t aoff, size_t n, size_t boff, size_t m);
+    int find_anchor(size_t aoff, size_t n, size_t boff, size_t m,
+                    size_t& as, size_t& bs, size_t& len);
+    ptrdiff_t fallback(size_t aoff, size_t n, size_t boff, size_t m);
+};
+
+template <class iterator, class edit_t>
+ptrdiff_t
+histogram_diff(const iterator a, size_t n, const iterator b, size_t m,
+               size_t classes, const edit_t& edit, const int& cancel = 0,
+               size_t max_memory = histogram_diff_max_memory)
+{
+    std::vector<ptrdiff_t> buf;
+    return histogram_diff_t<iterator, edit_t>(a, b, classes, edit, cancel, buf)(n, m, max_memory);
+}
+
+// ****************************************************************************
+//
+// histogram_diff -- implementation
+//
+
+template <class iterator, class edit_t>
+ptrdiff_t
+histogram_diff_t<iterator, edit_t>::operator()(size_t n, size_t m, size_t max_memory)
+{
+    if (n >= none || m >= none || classes >= none ||
+        (3 * (unsigned __int64)classes + (unsigned __int64)n + 3 * (unsigned __int64)m) >
+            max_memory / sizeof(index_t))
+    {
+        // the occurrence tables do not fit into the memory budget
+        return fallback(0, n, 0, m);
+    }
+
+    head.resize(classes);
+    count.resize(classes, 0);
+    countb.resize(classes, 0);
+    next.resize(n);
+    work = (unsigned __int64)histogram_diff_max_work * (n + m);
+
+    ptrdiff_t d = 0;
+    stack.push_back(region(ed_insert, 0, n, 0, m));
+    while (!stack.empty())
+    {
+        region r = stack.back();
+        stack.pop_back();
+        if (r.op == ed_match)
+            edit(ed_match, r.aoff, r.n);
+        else
+            d += process(r.aoff, r.n, r.boff, r.m);
+    }
+    return d;
+}
+
+template <class iterator, class edit_t>
+ptrdiff_t
+histogram_diff_t<iterator, edit_t>::process(size_t aoff, size_t n, size_t boff, size_t m)
+{
+    if (cancel)
+        throw diff_exception();
+
+    // eat common prefix
+    size_t p = 0;
+    while (p < n && p < m && a[aoff + p] == b[boff + p])
+        p++;
+    edit(ed_match, aoff, p);
+    aoff += p;
+    boff += p;
+    n -= p;
+    m -= p;
+
+    // eat common suffix, it is reported after the middle part
+    size_t s = 0;
+    while (s < n && s < m && a[aoff + n - s - 1] == b[boff + m - s - 1])
+        s++;
+    n -= s;
+    m -= s;
+    if (s > 0)
+        stack.push_back(region(ed_match, aoff + n, s, boff + m, s));
+
+    if (n == 0 || m == 0)
+    {
+        edit(ed_delete, aoff, n);
+        edit(ed_insert, boff, m);
+        return n + m;
+    }
+
+    if (work < n + m)
+        return fallback(aoff, n, boff, m); // searching for anchors takes too long
+    work -= n + m;
+
+    // build the occurrence tables of the regions (chains are in ascending order)
+    size_t i;
+    for (i = aoff + n; i-- > aoff;)
+    {
+        size_t c = a[i];
+        next[i] = count[c] == 0 ? index_t(none) : head[c];
+        head[c] = index_t(i);
+        count[c]++;
+    }
+    for (i = boff; i < boff + m; i++)
+        countb[b[i]]++;
+
+    size_t as, bs, len;
+    int found = split_by_unique(aoff, n, boff, m) ? 2 : find_anchor(aoff, n, boff, m, as, bs, len);
+
+    // clear the occurrence tables for the next region
+    for (i = aoff; i < aoff + n; i++)
+        count[a[i]] = 0;
+    for (i = boff; i < boff + m; i++)
+        countb[b[i]] = 0;
+
+    switch (found)
+    {
+    case 2: // the region was split by unique items
+        return 0;
+
+    case 1: // split the region by the anchor, the left part is processed first
+    {
+        stack.push_back(region(ed_insert, as + len, aoff + n - as - len, bs + len, boff + m - bs - len));
+        stack.push_back(region(ed_match, as, len, bs, len));
+        stack.push_back(region(ed_insert, aoff, as - aoff, boff, bs - boff));
+        return 0;
+    }
+
+    case 0: // no common item, the whole region was replaced
+    {
+        edit(ed_delete, aoff, n);
+        edit(ed_insert, boff, m);
+        return n + m;
+    }
+
+    default: // only too frequent common items
+        return fallback(aoff, n, boff, m);
+    }
+}
+
+// finds the longest sequence of items unique in both regions and having the same
+// order in both regions; if it exists, pushes the parts between these items to
+// the stack and returns true
+template <class iterator, class edit_t>
+bool histogram_diff_t<iterator, edit_t>::split_by_unique(size_t aoff, size_t n, size_t boff, size_t m)
+{
+    unique.clear();
+    tails.clear();
+    size_t i;
+    for (i = boff; i < boff + m; i++)
+    {
+        size_t c = b[i];
+        if (count[c] == 1 && countb[c] == 1)
+            unique.push_back(index_t(i));
+    }
+    if (unique.empty())
+        return false;
+
+    // patience sorting: the longest increasing sequence of positions in `a'
+    // (taken in the order of positions in `b')
+    prev.resize(unique.size());
+    for (i = 0; i < unique.size(); i++)
+    {
+        index_t pos = head[b[unique[i]]];
+        size_t lo = 0, hi = tails.size();
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            if (head[b[unique[tails[mid]]]] < pos)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        prev[i] = lo > 0 ? tails[lo - 1] : index_t(none);
+        if (lo == tails.size())
+            tails.push_back(index_t(i));
+        else
+            tails[lo] = index_t(i);
+    }
+
+    // push the parts from the right to the left, so the left part is processed first;
+    // adjacent unique items are joined into one common region
+    size_t aend = aoff + n; // end of the part which was not pushed yet
+    size_t bend = boff + m;
+    size_t ms = 0, ns = 0, len = 0; // common region waiting for pushing
+    index_t u;
+    for (u = tails.back(); u != none; u = prev[u])
+    {
+        size_t bi = unique[u];
+        size_t ai = head[b[bi]];
+        if (len > 0 && ai + 1 == ms && bi + 1 == ns)
+        {
+            ms = ai, ns = bi, len++;
+            continue;
+        }
+        if (len > 0)
+        {
+            if (ms + len < aend || ns + len < bend)
+                stack.push_back(region(ed_insert, ms + len, aend - ms - len, ns + len, bend - ns - len));
+            stack.push_back(region(ed_match, ms, len, ns, len));
+            aend = ms;
+            bend = ns;
+        }
+        ms = ai, ns = bi, len = 1;
+    }
+    if (ms + len < aend || ns + len < bend)
+        stack.push_back(region(ed_insert, ms + len, aend - ms - len, ns + len, bend - ns - len));
+    stack.push_back(region(ed_match, ms, len, ns, len));
+    if (aoff < ms || boff < ns)
+        stack.push_back(region(ed_insert, aoff, ms - aoff, boff, ns - boff));
+    return true;
+}
+
+// returns 1 if the anchor was found (it is returned in `as', `bs' and `len'),
+// 0 if the regions have no common item and -1 if all common items occur too
+// many times in `a'
+template <class iterator, class edit_t>
+int histogram_diff_t<iterator, edit_t>::find_anchor(size_t aoff, size_t n, size_t boff, size_t m,
+                                                    size_t& as, size_t& bs, size_t& len)
+{
+    bool common = false;
+    index_t best_count = histogram_diff_max_chain + 1;
+    len = 0;
+    size_t aend = aoff + n;
+    size_t bend = boff + m;
+    size_t bi = boff;
+    while (bi < bend)
+    {
+        size_t c = b[bi];
+        index_t cnt = count[c];
+        if (cnt == 0)
+        {
+            bi++;
+            continue;
+        }
+        common = true;
+        if (cnt > histogram_diff_max_chain || cnt > best_count)
+        {
+            bi++;
+            continue;
+        }
+
+        size_t bnext = bi + 1;
+        index_t ai = head[c];
+        while (ai != none)
+        {
+            // extend the match on both sides
+            size_t ms = ai, ns = bi, me = ai + 1, ne = bi + 1;
+            index_t rc = cnt;
+            while (ms > aoff && ns > boff && a[ms - 1] == b[ns - 1])
+            {
+                ms--, ns--;
+                if (rc > count[a[ms]])
+                    rc = count[a[ms]];
+            }
+            while (me < aend && ne < bend && a[me] == b[ne])
+            {
+                if (rc > count[a[me]])
+                    rc = count[a[me]];
+                me++, ne++;
+            }
+            if (bnext < ne)
+                bnext = ne;
+            if (me - ms > len || rc < best_count)
+            {
+                as = ms;
+                bs = ns;
+                len = me - ms;
+                best_count = rc;
+            }
+            // skip the occurrences inside the just found match
+            while (next[ai] != none && next[ai] < me)
+                ai = next[ai];
+            ai = next[ai];
+        }
+        bi = bnext;
+    }
+
+    if (len > 0)
+        return 1;
+    return common ? -1 : 0;
+}
+
+template <class iterator, class edit_t>
+ptrdiff_t
+histogram_diff_t<iterator, edit_t>::fallback(size_t aoff, size_t n, size_t boff, size_t m)
+{
+    ed_script_builder::ed_script ses;
+    ptrdiff_t d = diff(aoff, n, boff, m, sequence_comparator(a, b), ed_script_builder(ses),
+                       cancel, histogram_diff_myers_dmax, buf);
+    if (d < histogram_diff_myers_dmax)
+    {
+        ed_script_builder::ed_iterator e;
+        for (e = ses.begin(); e < ses.end(); ++e)
+            edit(e->op, e->off, e->len);
+        return d;
+    }
+    // too many differences, report the region as replaced
+    edit(ed_delete, aoff, n);
+    edit(ed_insert, boff, m);
+    return n + m;
+}
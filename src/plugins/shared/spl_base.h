@@ -797,8 +797,32 @@ public:
     // vraci FALSE pri fatalni chybe - v tomto pripade se 'newFSNameIndex' ignoruje
     // omezeni: nesmi se volat pred metodou SetBasicPluginData
     virtual BOOL WINAPI AddFSName(const char* fsName, int* newFSNameIndex) = 0;
+
+    // nastavi schopnosti archivatoru (kombinace ARCCAP_XXX); hodnota plati jen do
+    // pristiho loadu pluginu (pri kazdem loadu je nutne ji nastavit znovu); ma smysl
+    // jen pro pluginy s FUNCTION_PANELARCHIVERVIEW; metoda je k dispozici az od verze
+    // SALAMANDER_VERSION_ARCCAP (pred volanim je nutne otestovat GetVersion())
+    virtual void WINAPI SetArchiverCapabilities(DWORD capabilities) = 0;
 };
 
+// schopnosti archivatoru pro CSalamanderPluginEntryAbstract::SetArchiverCapabilities():
+// listing archivu (CPluginInterfaceForArchiverAbstract::ListArchive) zavisi jen na obsahu
+// souboru archivu (ne na konfiguraci pluginu ani na dalsich souborech) a nevraci plugin-data
+// ('pluginData' je NULL), Salamander si proto muze listing ulozit do perzistentni cache
+// a pri dalsim vstupu do nezmeneneho archivu (stejna velikost a cas posledniho zapisu)
+// ho pouzit misto volani ListArchive
+#define ARCCAP_CACHEABLELISTING 0x0001
+
+// prvni verze Salamandera (viz LAST_VERSION_OF_SALAMANDER), ktera obsahuje metodu
+// CSalamanderPluginEntryAbstract::SetArchiverCapabilities()
+#define SALAMANDER_VERSION_ARCCAP 104
+
+// adresar persistentni cache listingu archivu (relativne k CSIDL_LOCAL_APPDATA); plugin
+// s ARCCAP_CACHEABLELISTING do nej muze ukladat sva data k archivum, vsechny soubory
+// v adresari se pocitaji do limitu velikosti cache (64 MB) a nejdele nepouzite soubory
+// Salamander maze; data pluginu by proto mela byt vyrazne mensi nez tento limit
+#define SALAMANDER_LISTINGCACHE_DIR "Open Salamander\\Listing Cache"
+
 //
 // ****************************************************************************
 // FSalamanderPluginEntry
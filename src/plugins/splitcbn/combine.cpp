@@ -9,6 +9,7 @@
 #include "lang\lang.rh"
 #include "combine.h"
 #include "dialogs.h"
+#include "pipeline.h"
 
 // *****************************************************************************
 //
@@ -71,8 +72,8 @@ BOOL CombineFiles(TIndirectArray<char>& files, LPTSTR targetName,
         }
     }
 
-    // merge the files
-    char* pBuffer = new char[BUFSIZE];
+    // merge the files: one buffer is read while the other one is written (and its CRC calculated)
+    char* pBuffer = new char[2 * BUFSIZE];
     if (pBuffer == NULL)
     {
         SalamanderGeneral->ShowMessageBox(LoadStr(IDS_OUTOFMEM), LoadStr(idTitle), MSGBOX_ERROR);
@@ -81,7 +82,9 @@ BOOL CombineFiles(TIndirectArray<char>& files, LPTSTR targetName,
         return FALSE;
     }
 
-    UINT32 CrcVal = 0;
+    CCopyPipeline pipeline;
+    pipeline.Start();
+    char* buffer = pBuffer;
 
     // open the progress dialog
     salamander->OpenProgressDialog(LoadStr(idTitle), TRUE, parent, FALSE);
@@ -104,27 +107,24 @@ BOOL CombineFiles(TIndirectArray<char>& files, LPTSTR targetName,
             break;
         }
 
-        DWORD numread, numwr;
+        DWORD numread;
         CQuadWord currentProgress = CQuadWord(0, 0), size;
         size.LoDWord = GetFileSize(file.HFile, &size.HiDWord);
         salamander->ProgressSetTotalSize(size, CQuadWord(-1, -1));
         salamander->ProgressSetSize(CQuadWord(0, 0), CQuadWord(-1, -1), TRUE);
         do
         {
-            if (!SalamanderSafeFile->SafeFileRead(&file, pBuffer, BUFSIZE, &numread, parent, BUTTONS_RETRYCANCEL, NULL, NULL))
+            if (!SalamanderSafeFile->SafeFileRead(&file, buffer, BUFSIZE, &numread, parent, BUTTONS_RETRYCANCEL, NULL, NULL))
             {
                 ret = FALSE;
                 break;
             }
-            if (!bOnlyCrc && numread)
+            if (!pipeline.Process(bOnlyCrc ? NULL : &outfile, buffer, numread, parent))
             {
-                if (!SalamanderSafeFile->SafeFileWrite(&outfile, pBuffer, numread, &numwr, parent, BUTTONS_RETRYCANCEL, NULL, NULL))
-                {
-                    ret = FALSE;
-                    break;
-                }
+                ret = FALSE;
+                break;
             }
-            CrcVal = SalamanderGeneral->UpdateCrc32(pBuffer, numread, CrcVal);
+            buffer = buffer == pBuffer ? pBuffer + BUFSIZE : pBuffer;
             currentProgress += CQuadWord(numread, 0);
             if (!salamander->ProgressSetSize(currentProgress, totalProgress + currentProgress, TRUE))
             {
@@ -139,6 +139,12 @@ BOOL CombineFiles(TIndirectArray<char>& files, LPTSTR targetName,
             break;
     }
 
+    // the CRC of the combined file is calculated from the written data, so the file does not have to be read again
+    if (!pipeline.Wait(parent))
+        ret = FALSE;
+    pipeline.Stop();
+    UINT32 CrcVal = pipeline.GetCrc();
+
     salamander->CloseProgressDialog();
     delete[] pBuffer;
     if (!bOnlyCrc)
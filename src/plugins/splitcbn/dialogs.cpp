@@ -847,6 +847,7 @@ static INT_PTR CALLBACK ConfigDlgProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARA
         CheckDlgButton(hWnd, IDC_CHECK_COMBINEOTHER, configCombineToOther ? BST_CHECKED : BST_UNCHECKED);
         CheckDlgButton(hWnd, IDC_CHECK_SPLITSUB, configSplitToSubdir /*&& configSplitToOther*/ ? BST_CHECKED : BST_UNCHECKED);
         //EnableWindow(GetDlgItem(hWnd, IDC_CHECK_SPLITSUB), configSplitToOther);
+        CheckDlgButton(hWnd, IDC_CHECK_SPLITPARALLEL, configSplitParallel ? BST_CHECKED : BST_UNCHECKED);
         return TRUE;
 
     case WM_HELP:
@@ -870,6 +871,7 @@ static INT_PTR CALLBACK ConfigDlgProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARA
             configSplitToOther = IsDlgButtonChecked(hWnd, IDC_CHECK_SPLITOTHER) == BST_CHECKED;
             configCombineToOther = IsDlgButtonChecked(hWnd, IDC_CHECK_COMBINEOTHER) == BST_CHECKED;
             configSplitToSubdir = IsDlgButtonChecked(hWnd, IDC_CHECK_SPLITSUB) == BST_CHECKED;
+            configSplitParallel = IsDlgButtonChecked(hWnd, IDC_CHECK_SPLITPARALLEL) == BST_CHECKED;
             // FALL THROUGH
         case IDCANCEL:
             EndDialog(hWnd, 0);
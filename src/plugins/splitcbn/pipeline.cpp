@@ -0,0 +1,236 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+#include <process.h>
+#include "splitcbn.h"
+#include "pipeline.h"
+
+// *****************************************************************************
+//
+//  StartHelperThread
+//
+
+struct CHelperThreadData
+{
+    unsigned(WINAPI* Body)(void*);
+    void* Param;
+};
+
+static unsigned __stdcall HelperThreadProc(void* param)
+{
+    CHelperThreadData data = *(CHelperThreadData*)param;
+    delete (CHelperThreadData*)param;
+    return SalamanderDebug->CallWithCallStack(data.Body, data.Param);
+}
+
+HANDLE StartHelperThread(unsigned(WINAPI* body)(void*), void* param)
+{
+    CALL_STACK_MESSAGE1("StartHelperThread(, )");
+    CHelperThreadData* data = new CHelperThreadData;
+    if (data == NULL)
+        return NULL;
+    data->Body = body;
+    data->Param = param;
+    unsigned tid;
+    HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, HelperThreadProc, data, CREATE_SUSPENDED, &tid);
+    if (thread == NULL)
+    {
+        TRACE_E("StartHelperThread(): unable to start the thread");
+        delete data;
+        return NULL;
+    }
+    SalamanderDebug->TraceAttachThread(thread, tid);
+    ResumeThread(thread);
+    return thread;
+}
+
+// *****************************************************************************
+//
+//  CCopyPipeline
+//
+
+CCopyPipeline::CCopyPipeline()
+{
+    Thread = NULL;
+    Go = NULL;
+    Done = NULL;
+    Exit = FALSE;
+    Pending = FALSE;
+    File = NULL;
+    Data = NULL;
+    DataSize = 0;
+    Written = 0;
+    Crc = 0;
+}
+
+CCopyPipeline::~CCopyPipeline()
+{
+    Stop();
+}
+
+void CCopyPipeline::Start()
+{
+    CALL_STACK_MESSAGE1("CCopyPipeline::Start()");
+    Go = CreateEvent(NULL, FALSE, FALSE, NULL);
+    Done = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (Go != NULL && Done != NULL)
+    {
+        Exit = FALSE;
+        Thread = StartHelperThread(ThreadBody, this);
+    }
+    if (Thread == NULL)
+        TRACE_E("CCopyPipeline::Start(): the buffers will be processed in the calling thread");
+}
+
+void CCopyPipeline::Stop()
+{
+    CALL_STACK_MESSAGE1("CCopyPipeline::Stop()");
+    if (Thread != NULL)
+    {
+        if (Pending)
+        {
+            WaitForSingleObject(Done, INFINITE);
+            Pending = FALSE;
+        }
+        Exit = TRUE;
+        SetEvent(Go);
+        WaitForSingleObject(Thread, INFINITE);
+        CloseHandle(Thread);
+        Thread = NULL;
+    }
+    if (Go != NULL)
+    {
+        CloseHandle(Go);
+        Go = NULL;
+    }
+    if (Done != NULL)
+    {
+        CloseHandle(Done);
+        Done = NULL;
+    }
+}
+
+void CCopyPipeline::ProcessData()
+{
+    Crc = SalamanderGeneral->UpdateCrc32(Data, DataSize, Crc);
+    Written = 0;
+    if (File != NULL && !WriteFile(File->HFile, Data, DataSize, &Written, NULL))
+        TRACE_I("CCopyPipeline::ProcessData(): write error " << GetLastError() << ", the write will be retried");
+}
+
+BOOL CCopyPipeline::Process(SAFE_FILE* file, const char* buf, DWORD size, HWND parent)
+{
+    if (!Wait(parent))
+        return FALSE;
+    File = file;
+    Data = buf;
+    DataSize = size;
+    Pending = TRUE;
+    if (Thread != NULL)
+        SetEvent(Go);
+    else
+        ProcessData();
+    return TRUE;
+}
+
+BOOL CCopyPipeline::Wait(HWND parent)
+{
+    if (!Pending)
+        return TRUE;
+    Pending = FALSE;
+    if (Thread != NULL)
+        WaitForSingleObject(Done, INFINITE);
+    if (File != NULL && Written < DataSize)
+    {
+        // write the rest of the buffer again, SafeFileWrite() asks the user what to do if it fails
+        // (the file pointer has been moved only by the bytes really written)
+        DWORD numwr;
+        return SalamanderSafeFile->SafeFileWrite(File, Data + Written, DataSize - Written, &numwr,
+                                                 parent, BUTTONS_RETRYCANCEL, NULL, NULL);
+    }
+    return TRUE;
+}
+
+unsigned WINAPI
+CCopyPipeline::ThreadBody(void* param)
+{
+    CALL_STACK_MESSAGE1("CCopyPipeline::ThreadBody()");
+    CCopyPipeline* pipeline = (CCopyPipeline*)param;
+    while (1)
+    {
+        WaitForSingleObject(pipeline->Go, INFINITE);
+        if (pipeline->Exit)
+            break;
+        pipeline->ProcessData();
+        SetEvent(pipeline->Done);
+    }
+    return 0;
+}
+
+// *****************************************************************************
+//
+//  CombineCrc32
+//
+//  Appending 'len2' zero bytes to the first block is a linear operation on its CRC,
+//  the operator for 2^n zero bits is obtained by squaring the operator for one zero
+//  bit n times (see crc32_combine() in zlib).
+//
+
+static UINT32 Gf2MatrixTimes(const UINT32* mat, UINT32 vec)
+{
+    UINT32 sum = 0;
+    while (vec != 0)
+    {
+        if (vec & 1)
+            sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static void Gf2MatrixSquare(UINT32* square, const UINT32* mat)
+{
+    int n;
+    for (n = 0; n < 32; n++)
+        square[n] = Gf2MatrixTimes(mat, mat[n]);
+}
+
+UINT32 CombineCrc32(UINT32 crc1, UINT32 crc2, CQuadWord len2)
+{
+    unsigned __int64 len = len2.Value;
+    if (len == 0)
+        return crc1;
+
+    UINT32 even[32]; // operator for an even power of two zero bits
+    UINT32 odd[32];  // operator for an odd power of two zero bits
+
+    // operator for one zero bit
+    odd[0] = 0xEDB88320; // CRC-32 polynomial
+    UINT32 row = 1;
+    int n;
+    for (n = 1; n < 32; n++)
+    {
+        odd[n] = row;
+        row <<= 1;
+    }
+    Gf2MatrixSquare(even, odd); // operator for two zero bits
+    Gf2MatrixSquare(odd, even); // operator for four zero bits
+
+    // apply 'len' zero bytes to 'crc1' (the first square gives the operator for one zero byte)
+    do
+    {
+        Gf2MatrixSquare(even, odd);
+        if (len & 1)
+            crc1 = Gf2MatrixTimes(even, crc1);
+        len >>= 1;
+        if (len == 0)
+            break;
+        Gf2MatrixSquare(odd, even);
+        if (len & 1)
+            crc1 = Gf2MatrixTimes(odd, crc1);
+        len >>= 1;
+    } while (len != 0);
+    return crc1 ^ crc2;
+}
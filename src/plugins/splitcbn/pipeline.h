@@ -0,0 +1,64 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// *****************************************************************************
+//
+//  CCopyPipeline
+//
+//  Calculates CRC of the buffers read by the caller and writes them to the output
+//  file in a helper thread, so the next buffer is read while the previous one is
+//  being processed. Write errors are reported to the user (and the writes retried)
+//  in the calling thread.
+//
+
+class CCopyPipeline
+{
+public:
+    CCopyPipeline();
+    ~CCopyPipeline();
+
+    // starts the helper thread; if it cannot be started, the buffers are processed
+    // in the calling thread
+    void Start();
+
+    // waits for the last buffer and ends the helper thread
+    void Stop();
+
+    // hands 'buf' over to the helper thread: CRC is updated and if 'file' is not NULL,
+    // 'buf' is written to 'file'; returns without waiting, 'buf' must not be changed
+    // until the next call to Process() or Wait(); returns FALSE if the previous buffer
+    // could not be written (the user has canceled the operation)
+    BOOL Process(SAFE_FILE* file, const char* buf, DWORD size, HWND parent);
+
+    // waits until the last buffer is processed; returns FALSE if it could not be written
+    BOOL Wait(HWND parent);
+
+    // returns CRC of all buffers processed so far, call after Wait()
+    UINT32 GetCrc() { return Crc; }
+
+protected:
+    void ProcessData();
+    static unsigned WINAPI ThreadBody(void* param);
+
+    HANDLE Thread; // NULL = the buffers are processed in the calling thread
+    HANDLE Go;     // signaled when there is a new buffer
+    HANDLE Done;   // signaled when the buffer is processed
+    BOOL Exit;     // TRUE = the helper thread should end
+    BOOL Pending;  // TRUE = the helper thread is processing a buffer
+
+    SAFE_FILE* File; // the output file, NULL = only CRC is calculated
+    const char* Data;
+    DWORD DataSize;
+    DWORD Written; // the part of 'Data' written by the helper thread
+    UINT32 Crc;
+};
+
+// starts 'body' with 'param' in a new thread which can use CALL_STACK_MESSAGE; returns
+// the handle of the thread (the caller closes it) or NULL on failure
+HANDLE StartHelperThread(unsigned(WINAPI* body)(void*), void* param);
+
+// returns CRC of two concatenated blocks of data from their CRCs 'crc1' and 'crc2'
+// and the length 'len2' of the second block
+UINT32 CombineCrc32(UINT32 crc1, UINT32 crc2, CQuadWord len2);
@@ -8,6 +8,7 @@
 #include "lang\lang.rh"
 #include "split.h"
 #include "dialogs.h"
+#include "pipeline.h"
 
 // *****************************************************************************
 //
@@ -87,6 +88,276 @@ static BOOL EnsureDiskInsertedEtc(LPTSTR targetDir, CQuadWord& qwPartSize, CQuad
     return TRUE;
 }
 
+// *****************************************************************************
+//
+//  CParallelSplit
+//
+//  Writes the parts of a file to a fixed disk by several threads at once, each of
+//  them reads its parts of the source file through its own handle. The parts which
+//  a helper thread could not read or write are copied again in the main thread,
+//  which reports the errors to the user.
+//
+
+#define MAX_SPLIT_THREADS 4
+
+struct CSplitPart
+{
+    char Name[MAX_PATH];
+    SAFE_FILE File;   // the created part, closed by CParallelSplit
+    CQuadWord Offset; // position of the part in the source file
+    CQuadWord Size;
+    CQuadWord Done; // written bytes of the part, guarded by CParallelSplit::CS
+    UINT32 Crc;
+    BOOL Finished; // the part is written
+};
+
+class CParallelSplit
+{
+public:
+    CParallelSplit(const char* fileName);
+    ~CParallelSplit();
+
+    // adds the part created in 'file' (it is closed by this object), 'offset' is
+    // the position of the part in the source file; returns FALSE on low memory
+    BOOL AddPart(const char* name, SAFE_FILE* file, const CQuadWord& offset, const CQuadWord& size);
+
+    // writes all parts; 'source' and 'buffer' of 'bufSize' bytes are used for the parts
+    // written in the main thread, 'totalSize' is the size of the source file (the skipped
+    // parts are shown as done in the total progress); returns FALSE if the operation failed
+    // or was canceled
+    BOOL WriteParts(SAFE_FILE* source, char* buffer, DWORD bufSize, const CQuadWord& totalSize,
+                    HWND parent, CSalamanderForOperationsAbstract* salamander, BOOL delayed);
+
+    // closes the parts, the unfinished ones are deleted
+    void CloseParts();
+
+    // returns CRC of all parts in their order
+    UINT32 GetCrc();
+
+protected:
+    void WritePart(CSplitPart* part, HANDLE source, char* buffer);
+    BOOL WritePartSafe(CSplitPart* part, SAFE_FILE* source, char* buffer, DWORD bufSize, HWND parent);
+    static unsigned WINAPI ThreadBody(void* param);
+
+    const char* FileName;
+    TIndirectArray<CSplitPart> Parts;
+    CRITICAL_SECTION CS;
+    LONG NextPart;  // the part written by the next thread which asks for work
+    BOOL Cancel;    // TRUE = the helper threads should end
+    CQuadWord Done; // written bytes of all parts, guarded by 'CS'
+};
+
+CParallelSplit::CParallelSplit(const char* fileName) : Parts(16, 16, dtDelete)
+{
+    FileName = fileName;
+    InitializeCriticalSection(&CS);
+    NextPart = 0;
+    Cancel = FALSE;
+    Done = CQuadWord(0, 0);
+}
+
+CParallelSplit::~CParallelSplit()
+{
+    CloseParts();
+    DeleteCriticalSection(&CS);
+}
+
+BOOL CParallelSplit::AddPart(const char* name, SAFE_FILE* file, const CQuadWord& offset, const CQuadWord& size)
+{
+    CSplitPart* part = new CSplitPart;
+    if (part == NULL)
+        return FALSE;
+    strcpy(part->Name, name);
+    part->File = *file;
+    part->Offset = offset;
+    part->Size = size;
+    part->Done = CQuadWord(0, 0);
+    part->Crc = 0;
+    part->Finished = FALSE;
+    Parts.Add(part);
+    if (!Parts.IsGood())
+    {
+        Parts.ResetState();
+        delete part;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void CParallelSplit::WritePart(CSplitPart* part, HANDLE source, char* buffer)
+{
+    LARGE_INTEGER offset;
+    offset.QuadPart = part->Offset.Value;
+    BOOL ok = SetFilePointerEx(source, offset, NULL, FILE_BEGIN);
+    UINT32 crc = 0;
+    CQuadWord numBytes = part->Size;
+    while (ok && numBytes.Value && !Cancel)
+    {
+        DWORD toread = (numBytes > CQuadWord(BUFSIZE2, 0)) ? BUFSIZE2 : numBytes.LoDWord;
+        DWORD numread, numwr;
+        ok = ReadFile(source, buffer, toread, &numread, NULL) && numread == toread &&
+             WriteFile(part->File.HFile, buffer, numread, &numwr, NULL) && numwr == numread;
+        if (ok)
+        {
+            crc = SalamanderGeneral->UpdateCrc32(buffer, numread, crc);
+            CQuadWord qwnr(numread, 0);
+            numBytes -= qwnr;
+            EnterCriticalSection(&CS);
+            part->Done += qwnr;
+            Done += qwnr;
+            LeaveCriticalSection(&CS);
+        }
+    }
+    if (numBytes.Value == 0)
+    {
+        part->Crc = crc;
+        part->Finished = TRUE;
+    }
+}
+
+BOOL CParallelSplit::WritePartSafe(CSplitPart* part, SAFE_FILE* source, char* buffer, DWORD bufSize, HWND parent)
+{
+    CALL_STACK_MESSAGE2("CParallelSplit::WritePartSafe(%s, , , , )", part->Name);
+    // start the part from its beginning
+    CQuadWord distance = part->Offset;
+    CQuadWord zero = CQuadWord(0, 0);
+    if (!SalamanderSafeFile->SafeFileSeekMsg(source, &distance, FILE_BEGIN, parent, BUTTONS_RETRYCANCEL, NULL, NULL, TRUE) ||
+        !SalamanderSafeFile->SafeFileSeekMsg(&part->File, &zero, FILE_BEGIN, parent, BUTTONS_RETRYCANCEL, NULL, NULL, FALSE))
+        return FALSE;
+    Done -= part->Done; // the helper threads have ended, no synchronization needed
+    part->Done = CQuadWord(0, 0);
+
+    UINT32 crc = 0;
+    CQuadWord numBytes = part->Size;
+    while (numBytes.Value)
+    {
+        DWORD toread = (numBytes > CQuadWord(bufSize, 0)) ? bufSize : numBytes.LoDWord;
+        DWORD numread, numwr;
+        if (!SalamanderSafeFile->SafeFileRead(source, buffer, toread, &numread, parent, BUTTONS_RETRYCANCEL, NULL, NULL) ||
+            !SalamanderSafeFile->SafeFileWrite(&part->File, buffer, numread, &numwr, parent, BUTTONS_RETRYCANCEL, NULL, NULL))
+            return FALSE;
+        if (numread == 0)
+            return FALSE; // the source file has been shortened
+        crc = SalamanderGeneral->UpdateCrc32(buffer, numread, crc);
+        CQuadWord qwnr(numread, 0);
+        numBytes -= qwnr;
+        part->Done += qwnr;
+        Done += qwnr;
+    }
+    part->Crc = crc;
+    part->Finished = TRUE;
+    return TRUE;
+}
+
+unsigned WINAPI
+CParallelSplit::ThreadBody(void* param)
+{
+    CALL_STACK_MESSAGE1("CParallelSplit::ThreadBody()");
+    CParallelSplit* split = (CParallelSplit*)param;
+    HANDLE source = CreateFile(split->FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    char* buffer = (char*)malloc(BUFSIZE2);
+    if (source != INVALID_HANDLE_VALUE && buffer != NULL)
+    {
+        // the parts left by this thread are written in the main thread
+        LONG i;
+        while (!split->Cancel && (i = InterlockedIncrement(&split->NextPart) - 1) < split->Parts.Count)
+            split->WritePart(split->Parts[i], source, buffer);
+    }
+    if (buffer != NULL)
+        free(buffer);
+    if (source != INVALID_HANDLE_VALUE)
+        CloseHandle(source);
+    return 0;
+}
+
+BOOL CParallelSplit::WriteParts(SAFE_FILE* source, char* buffer, DWORD bufSize, const CQuadWord& totalSize,
+                                HWND parent, CSalamanderForOperationsAbstract* salamander, BOOL delayed)
+{
+    CALL_STACK_MESSAGE1("CParallelSplit::WriteParts(, , , , , ,)");
+    if (Parts.Count == 0)
+        return TRUE; // all parts were skipped
+    CQuadWord size = CQuadWord(0, 0);
+    int i;
+    for (i = 0; i < Parts.Count; i++)
+        size += Parts[i]->Size;
+    CQuadWord progress = totalSize - size;
+    char text[2 * MAX_PATH + 50];
+    sprintf(text, "%s %s - %s...", LoadStr(IDS_WRITING), SalamanderGeneral->SalPathFindFileName(Parts[0]->Name),
+            SalamanderGeneral->SalPathFindFileName(Parts[Parts.Count - 1]->Name));
+    salamander->ProgressDialogAddText(text, delayed);
+    salamander->ProgressSetTotalSize(size, CQuadWord(-1, -1));
+    salamander->ProgressSetSize(CQuadWord(0, 0), progress, delayed);
+
+    // the parts are written by the helper threads, the main thread shows the progress
+    HANDLE threads[MAX_SPLIT_THREADS];
+    int threadsCount = 0;
+    while (threadsCount < MAX_SPLIT_THREADS && threadsCount < Parts.Count)
+    {
+        threads[threadsCount] = StartHelperThread(ThreadBody, this);
+        if (threads[threadsCount] == NULL)
+            break; // we will manage with fewer threads (or write the parts in the main thread)
+        threadsCount++;
+    }
+    BOOL ret = TRUE;
+    while (threadsCount > 0 &&
+           WaitForMultipleObjects(threadsCount, threads, TRUE, 200) == WAIT_TIMEOUT)
+    {
+        EnterCriticalSection(&CS);
+        CQuadWord done = Done;
+        LeaveCriticalSection(&CS);
+        if (ret && !salamander->ProgressSetSize(done, progress + done, delayed))
+        {
+            ret = FALSE;
+            Cancel = TRUE; // let the helper threads end, the parts are deleted
+        }
+    }
+    for (i = 0; i < threadsCount; i++)
+        CloseHandle(threads[i]);
+
+    // write the parts which the helper threads could not write
+    for (i = 0; ret && i < Parts.Count; i++)
+    {
+        CSplitPart* part = Parts[i];
+        if (!part->Finished)
+        {
+            sprintf(text, "%s %s...", LoadStr(IDS_WRITING), SalamanderGeneral->SalPathFindFileName(part->Name));
+            salamander->ProgressDialogAddText(text, delayed);
+            if (!WritePartSafe(part, source, buffer, bufSize, parent))
+                ret = FALSE;
+        }
+        if (ret && !salamander->ProgressSetSize(Done, progress + Done, delayed))
+            ret = FALSE;
+    }
+    return ret;
+}
+
+void CParallelSplit::CloseParts()
+{
+    CALL_STACK_MESSAGE1("CParallelSplit::CloseParts()");
+    int i;
+    for (i = 0; i < Parts.Count; i++)
+    {
+        CSplitPart* part = Parts[i];
+        if (part->File.HFile != NULL)
+        {
+            SalamanderSafeFile->SafeFileClose(&part->File);
+            part->File.HFile = NULL;
+            if (!part->Finished)
+                DeleteFile(part->Name);
+        }
+    }
+}
+
+UINT32 CParallelSplit::GetCrc()
+{
+    UINT32 crc = 0;
+    int i;
+    for (i = 0; i < Parts.Count; i++)
+        crc = CombineCrc32(crc, Parts[i]->Crc, Parts[i]->Size);
+    return crc;
+}
+
 static void AddEchoEscapeCharacters(char* buf, const char* name)
 {
     char* d = buf;
@@ -176,9 +447,13 @@ static BOOL SplitFile(LPTSTR fileName, LPTSTR targetDir, CQuadWord& qwPartSize,
         return TRUE;
     }
 
-    // allocate the buffer
+    // with fixed part size on a fixed disk, the parts can be written at once (see CParallelSplit)
+    BOOL parallel = configSplitParallel && driveType != DRIVE_REMOVABLE && qwPartSize != SIZE_AUTODETECT;
+    CParallelSplit parallelSplit(fileName);
+
+    // allocate the buffers: one is read while the other one is written (and its CRC calculated)
     DWORD dwBufSize = (driveType == DRIVE_REMOVABLE) ? BUFSIZE1 : BUFSIZE2;
-    char* pBuffer = new char[dwBufSize];
+    char* pBuffer = new char[2 * dwBufSize];
     if (pBuffer == NULL)
     {
         SalamanderGeneral->ShowMessageBox(LoadStr(IDS_OUTOFMEM), LoadStr(IDS_SPLIT), MSGBOX_ERROR);
@@ -186,8 +461,11 @@ static BOOL SplitFile(LPTSTR fileName, LPTSTR targetDir, CQuadWord& qwPartSize,
         return FALSE;
     }
 
-    // init CRC
+    // CRC is calculated by the pipeline
     UINT32 Crc = 0;
+    CCopyPipeline pipeline;
+    pipeline.Start();
+    char* buffer = pBuffer;
 
     // progress dialog
     salamander->OpenProgressDialog(LoadStr(IDS_SPLIT), TRUE, NULL, FALSE);
@@ -240,7 +518,19 @@ static BOOL SplitFile(LPTSTR fileName, LPTSTR targetDir, CQuadWord& qwPartSize,
         salamander->ProgressSetTotalSize(thisPartSize, CQuadWord(-1, -1));
         salamander->ProgressSetSize(CQuadWord(0, 0), CQuadWord(-1, -1), delayed);
         fileProgress = CQuadWord(0, 0);
-        if (!bSkip)
+        if (!bSkip && parallel)
+        {
+            // the part is written later, together with the other parts
+            if (!parallelSplit.AddPart(text, &outfile, totalProgress, thisPartSize))
+            {
+                SalamanderSafeFile->SafeFileClose(&outfile);
+                DeleteFile(text);
+                SalamanderGeneral->ShowMessageBox(LoadStr(IDS_OUTOFMEM), LoadStr(IDS_SPLIT), MSGBOX_ERROR);
+                ret = FALSE;
+                break;
+            }
+        }
+        else if (!bSkip)
         {
             char text2[MAX_PATH + 50];
             sprintf(text2, "%s %s...", LoadStr(IDS_WRITING), name2);
@@ -250,14 +540,14 @@ static BOOL SplitFile(LPTSTR fileName, LPTSTR targetDir, CQuadWord& qwPartSize,
             while (numBytes.Value)
             {
                 DWORD toread = (numBytes > CQuadWord(dwBufSize, 0)) ? dwBufSize : numBytes.LoDWord;
-                DWORD numread, numwr;
-                if (!SalamanderSafeFile->SafeFileRead(&file, pBuffer, toread, &numread, parent, BUTTONS_RETRYCANCEL, NULL, NULL) ||
-                    !SalamanderSafeFile->SafeFileWrite(&outfile, pBuffer, numread, &numwr, parent, BUTTONS_RETRYCANCEL, NULL, NULL))
+                DWORD numread;
+                if (!SalamanderSafeFile->SafeFileRead(&file, buffer, toread, &numread, parent, BUTTONS_RETRYCANCEL, NULL, NULL) ||
+                    !pipeline.Process(&outfile, buffer, numread, parent))
                 {
                     ret = FALSE;
                     break;
                 }
-                Crc = SalamanderGeneral->UpdateCrc32(pBuffer, numread, Crc);
+                buffer = buffer == pBuffer ? pBuffer + dwBufSize : pBuffer;
                 CQuadWord qwnr(numread, 0);
                 numBytes -= qwnr;
                 fileProgress += qwnr;
@@ -267,6 +557,8 @@ static BOOL SplitFile(LPTSTR fileName, LPTSTR targetDir, CQuadWord& qwPartSize,
                     break;
                 }
             }
+            if (!pipeline.Wait(parent)) // the last buffer must be written before the part is closed
+                ret = FALSE;
             SalamanderSafeFile->SafeFileClose(&outfile);
             if (ret == FALSE)
             {
@@ -297,6 +589,18 @@ static BOOL SplitFile(LPTSTR fileName, LPTSTR targetDir, CQuadWord& qwPartSize,
         }
     }
 
+    pipeline.Stop();
+    Crc = pipeline.GetCrc();
+    if (parallel)
+    {
+        if (ret)
+        {
+            ret = parallelSplit.WriteParts(&file, pBuffer, dwBufSize, totalProgress, parent, salamander, delayed);
+            Crc = parallelSplit.GetCrc();
+        }
+        parallelSplit.CloseParts(); // also deletes the unfinished parts
+    }
+
     delete[] pBuffer;
     SalamanderSafeFile->SafeFileClose(&file);
 
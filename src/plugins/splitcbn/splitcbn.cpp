@@ -34,12 +34,14 @@ BOOL configCreateBatchFile;
 BOOL configSplitToOther;
 BOOL configCombineToOther;
 BOOL configSplitToSubdir;
+BOOL configSplitParallel;
 
 static const char* KEY_INCLUDEFILEEXT = "Include Original Extension";
 static const char* KEY_CREATEBATCHFILE = "Create Batch File";
 static const char* KEY_SPLITTOOTHER = "Split To Other Panel";
 static const char* KEY_COMBINETOOTHER = "Combine To Other Panel";
 static const char* KEY_SPLITTOSUBDIR = "Split To Subdirectory";
+static const char* KEY_SPLITPARALLEL = "Split In Parallel";
 
 // ****************************************************************************
 
@@ -131,6 +133,7 @@ void CPluginInterface::LoadConfiguration(HWND parent, HKEY regKey, CSalamanderRe
     CALL_STACK_MESSAGE1("CPluginInterface::LoadConfiguration(, ,)");
     configIncludeFileExt = TRUE;
     configCreateBatchFile = TRUE;
+    configSplitParallel = FALSE;
     SalamanderGeneral->GetConfigParameter(SALCFG_ARCOTHERPANELFORUNPACK, &configSplitToOther, sizeof(BOOL), NULL);
     SalamanderGeneral->GetConfigParameter(SALCFG_ARCOTHERPANELFORPACK, &configCombineToOther, sizeof(BOOL), NULL);
     SalamanderGeneral->GetConfigParameter(SALCFG_ARCSUBDIRBYARCFORUNPACK, &configSplitToSubdir, sizeof(BOOL), NULL);
@@ -141,6 +144,7 @@ void CPluginInterface::LoadConfiguration(HWND parent, HKEY regKey, CSalamanderRe
         registry->GetValue(regKey, KEY_SPLITTOOTHER, REG_DWORD, &configSplitToOther, sizeof(DWORD));
         registry->GetValue(regKey, KEY_COMBINETOOTHER, REG_DWORD, &configCombineToOther, sizeof(DWORD));
         registry->GetValue(regKey, KEY_SPLITTOSUBDIR, REG_DWORD, &configSplitToSubdir, sizeof(DWORD));
+        registry->GetValue(regKey, KEY_SPLITPARALLEL, REG_DWORD, &configSplitParallel, sizeof(DWORD));
     }
     //if (!configSplitToOther) configSplitToSubdir = FALSE;
 }
@@ -153,6 +157,7 @@ void CPluginInterface::SaveConfiguration(HWND parent, HKEY regKey, CSalamanderRe
     registry->SetValue(regKey, KEY_SPLITTOOTHER, REG_DWORD, &configSplitToOther, sizeof(DWORD));
     registry->SetValue(regKey, KEY_COMBINETOOTHER, REG_DWORD, &configCombineToOther, sizeof(DWORD));
     registry->SetValue(regKey, KEY_SPLITTOSUBDIR, REG_DWORD, &configSplitToSubdir, sizeof(DWORD));
+    registry->SetValue(regKey, KEY_SPLITPARALLEL, REG_DWORD, &configSplitParallel, sizeof(DWORD));
 }
 
 void CPluginInterface::Configuration(HWND parent)
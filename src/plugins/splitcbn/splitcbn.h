@@ -50,6 +50,7 @@ extern BOOL configCreateBatchFile;
 extern BOOL configSplitToOther;
 extern BOOL configCombineToOther;
 extern BOOL configSplitToSubdir;
+extern BOOL configSplitParallel;
 
 extern HINSTANCE DLLInstance; // handle to SPL - language-independent resources
 extern HINSTANCE HLanguage;   // handle to SLG - language-dependent resources
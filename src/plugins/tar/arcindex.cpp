@@ -0,0 +1,369 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+#include <shlobj.h>
+
+#include "dlldefs.h"
+#include "fileio.h"
+#include "arcindex.h"
+
+CArchiveIndex* ArchiveIndex = NULL;
+
+// file with the saved index: the header, checkpoints, members and the names of the members
+// (the archive name is the first one); these structures map directly to on-disk data
+#pragma pack(push, 1)
+struct SArchiveIndexHeader
+{
+    DWORD Signature;        // ARCINDEX_SIGNATURE
+    DWORD Version;          // ARCINDEX_VERSION
+    DWORD Checksum;         // CRC-32 of the data following the header
+    DWORD Reserved;         // zero, aligns the checkpoints
+    unsigned __int64 Size;  // archive size
+    FILETIME LastWrite;     // time of the last change of the archive
+    DWORD Complete;         // CArchiveIndex::Complete
+    DWORD CheckpointsCount; // number of SCheckpoint structures
+    DWORD MembersCount;     // number of SArchiveIndexMember structures
+    DWORD NamesSize;        // size of the zero terminated names
+};
+
+struct SArchiveIndexMember
+{
+    unsigned __int64 DataPos; // SIndexMember::DataPos
+    unsigned __int64 Offset;  // SIndexMember::Offset
+    DWORD NameOffset;         // offset of the name in the names
+};
+#pragma pack(pop)
+
+CArchiveIndex::CArchiveIndex() : Checkpoints(16, 64), Members(1024, 4096)
+{
+    FileName = NULL;
+    Complete = FALSE;
+    Size.Set(0, 0);
+    LastWrite.dwLowDateTime = 0;
+    LastWrite.dwHighDateTime = 0;
+}
+
+CArchiveIndex::~CArchiveIndex()
+{
+    CALL_STACK_MESSAGE1("CArchiveIndex::~CArchiveIndex()");
+    int i;
+    for (i = 0; i < Members.Count; i++)
+        free(Members[i].Name);
+    if (FileName != NULL)
+        free(FileName);
+}
+
+BOOL CArchiveIndex::Init(CDecompressFile* stream)
+{
+    CALL_STACK_MESSAGE1("CArchiveIndex::Init()");
+    FileName = _strdup(stream->GetArchiveName());
+    if (FileName == NULL)
+        return FALSE;
+    Size = stream->GetStreamSize();
+    CQuadWord fileSize;
+    DWORD fileAttr;
+    stream->GetFileInfo(LastWrite, fileSize, fileAttr);
+    return TRUE;
+}
+
+BOOL CArchiveIndex::IsFor(CDecompressFile* stream)
+{
+    CALL_STACK_MESSAGE1("CArchiveIndex::IsFor()");
+    if (!IsFor(stream->GetArchiveName()) || Size != stream->GetStreamSize())
+        return FALSE;
+    FILETIME lastWrite;
+    CQuadWord fileSize;
+    DWORD fileAttr;
+    stream->GetFileInfo(lastWrite, fileSize, fileAttr);
+    return CompareFileTime(&lastWrite, &LastWrite) == 0;
+}
+
+BOOL CArchiveIndex::AddCheckpoint(SCheckpoint* checkpoint)
+{
+    Checkpoints.Add(checkpoint);
+    if (!Checkpoints.IsGood())
+    {
+        Checkpoints.ResetState();
+        delete checkpoint;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL CArchiveIndex::AddMember(const char* name, const CQuadWord& dataPos, const CQuadWord& offset)
+{
+    SIndexMember member;
+    member.Name = _strdup(name);
+    if (member.Name == NULL)
+        return FALSE;
+    member.DataPos = dataPos;
+    member.Offset = offset;
+    Members.Add(member);
+    if (!Members.IsGood())
+    {
+        Members.ResetState();
+        free(member.Name);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static int __cdecl CompareMembers(const void* m1, const void* m2)
+{
+    const SIndexMember* member1 = (const SIndexMember*)m1;
+    const SIndexMember* member2 = (const SIndexMember*)m2;
+    int ret = strcmp(member1->Name, member2->Name);
+    if (ret == 0) // the same names: the first one in the archive goes first
+        ret = member1->DataPos < member2->DataPos ? -1 : (member1->DataPos == member2->DataPos ? 0 : 1);
+    return ret;
+}
+
+void CArchiveIndex::Finish(BOOL complete)
+{
+    CALL_STACK_MESSAGE2("CArchiveIndex::Finish(%d)", complete);
+    Complete = complete;
+    if (Members.Count > 1)
+        qsort(Members.GetData(), Members.Count, sizeof(SIndexMember), CompareMembers);
+}
+
+const SIndexMember*
+CArchiveIndex::FindMember(const char* name)
+{
+    CALL_STACK_MESSAGE2("CArchiveIndex::FindMember(%s)", name);
+    // binary search for the first member with this name
+    int left = 0;
+    int right = Members.Count;
+    while (left < right)
+    {
+        int mid = (left + right) / 2;
+        if (strcmp(Members[mid].Name, name) < 0)
+            left = mid + 1;
+        else
+            right = mid;
+    }
+    if (left < Members.Count && strcmp(Members[left].Name, name) == 0)
+        return &Members[left];
+    return NULL;
+}
+
+const SCheckpoint*
+CArchiveIndex::FindCheckpoint(const CQuadWord& dataPos)
+{
+    CALL_STACK_MESSAGE1("CArchiveIndex::FindCheckpoint()");
+    // binary search for the last checkpoint at or before 'dataPos'
+    int left = 0;
+    int right = Checkpoints.Count;
+    while (left < right)
+    {
+        int mid = (left + right) / 2;
+        if (Checkpoints[mid]->OutPos <= dataPos)
+            left = mid + 1;
+        else
+            right = mid;
+    }
+    return left > 0 ? Checkpoints[left - 1] : NULL;
+}
+
+BOOL CArchiveIndex::GetIndexFileName(const char* archiveName, char* name, BOOL create)
+{
+    CALL_STACK_MESSAGE3("CArchiveIndex::GetIndexFileName(%s, %d)", archiveName, create);
+
+    if (SHGetFolderPath(NULL, CSIDL_LOCAL_APPDATA, NULL, 0 /* SHGFP_TYPE_CURRENT */, name) != S_OK ||
+        !SalamanderGeneral->SalPathAppend(name, ARCINDEX_DIR, MAX_PATH))
+    {
+        return FALSE;
+    }
+    if (create)
+    {
+        // Salamander creates the directory when it stores the first listing
+        char* slash = strrchr(name, '\\');
+        *slash = 0;
+        CreateDirectory(name, NULL); // if it fails (e.g. it already exists), we don't care...
+        *slash = '\\';
+        CreateDirectory(name, NULL);
+    }
+    // the key is CRC of the archive name in lower case (names are case-insensitive),
+    // the file itself contains the full name, so a collision is only a missed index
+    char lowerName[MAX_PATH];
+    lstrcpyn(lowerName, archiveName, MAX_PATH);
+    SalamanderGeneral->ToLowerCase(lowerName);
+    char fileName[20];
+    sprintf(fileName, "tar%08X.tix", SalamanderGeneral->UpdateCrc32(lowerName, (DWORD)strlen(lowerName), 0));
+    return SalamanderGeneral->SalPathAppend(name, fileName, MAX_PATH);
+}
+
+void CArchiveIndex::Save()
+{
+    CALL_STACK_MESSAGE1("CArchiveIndex::Save()");
+
+    char name[MAX_PATH];
+    if (FileName == NULL || !GetIndexFileName(FileName, name, TRUE))
+        return;
+
+    DWORD namesSize = (DWORD)strlen(FileName) + 1;
+    int i;
+    for (i = 0; i < Members.Count; i++)
+        namesSize += (DWORD)strlen(Members[i].Name) + 1;
+    unsigned __int64 totalSize = sizeof(SArchiveIndexHeader) +
+                                 (unsigned __int64)Checkpoints.Count * sizeof(SCheckpoint) +
+                                 (unsigned __int64)Members.Count * sizeof(SArchiveIndexMember) + namesSize;
+    if (totalSize > ARCINDEX_MAX_FILE_SIZE)
+        return;
+    BYTE* data = (BYTE*)malloc((size_t)totalSize);
+    if (data == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        return;
+    }
+    SArchiveIndexHeader* header = (SArchiveIndexHeader*)data;
+    SCheckpoint* checkpoints = (SCheckpoint*)(data + sizeof(SArchiveIndexHeader));
+    SArchiveIndexMember* members = (SArchiveIndexMember*)(checkpoints + Checkpoints.Count);
+    char* names = (char*)(members + Members.Count);
+
+    header->Signature = ARCINDEX_SIGNATURE;
+    header->Version = ARCINDEX_VERSION;
+    header->Size = Size.Value;
+    header->LastWrite = LastWrite;
+    header->Complete = Complete;
+    header->CheckpointsCount = Checkpoints.Count;
+    header->MembersCount = Members.Count;
+    header->NamesSize = namesSize;
+    for (i = 0; i < Checkpoints.Count; i++)
+        checkpoints[i] = *Checkpoints[i];
+    DWORD namesPos = (DWORD)strlen(FileName) + 1;
+    memcpy(names, FileName, namesPos);
+    for (i = 0; i < Members.Count; i++)
+    {
+        members[i].DataPos = Members[i].DataPos.Value;
+        members[i].Offset = Members[i].Offset.Value;
+        members[i].NameOffset = namesPos;
+        DWORD len = (DWORD)strlen(Members[i].Name) + 1;
+        memcpy(names + namesPos, Members[i].Name, len);
+        namesPos += len;
+    }
+    header->Reserved = 0;
+    header->Checksum = SalamanderGeneral->UpdateCrc32(data + sizeof(SArchiveIndexHeader),
+                                                      (DWORD)totalSize - sizeof(SArchiveIndexHeader), 0);
+
+    // write into a temporary file and replace the saved index at once, so another instance
+    // of Salamander never reads a half-written file
+    char tmpName[MAX_PATH + 20];
+    sprintf(tmpName, "%s.%X.tmp", name, GetCurrentProcessId());
+    BOOL ok = FALSE;
+    HANDLE file = CreateFile(tmpName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        DWORD written;
+        ok = WriteFile(file, data, (DWORD)totalSize, &written, NULL) && written == (DWORD)totalSize;
+        CloseHandle(file);
+        if (ok)
+            ok = MoveFileEx(tmpName, name, MOVEFILE_REPLACE_EXISTING);
+        if (!ok)
+            DeleteFile(tmpName);
+    }
+    if (!ok)
+        TRACE_I("CArchiveIndex::Save(): unable to write " << name << ", error " << GetLastError());
+    free(data);
+}
+
+BOOL CArchiveIndex::ReadData(const BYTE* data, DWORD size)
+{
+    CALL_STACK_MESSAGE1("CArchiveIndex::ReadData()");
+
+    const SArchiveIndexHeader* header = (const SArchiveIndexHeader*)data;
+    if (size < sizeof(SArchiveIndexHeader) || header->Signature != ARCINDEX_SIGNATURE ||
+        header->Version != ARCINDEX_VERSION)
+    {
+        return FALSE;
+    }
+    unsigned __int64 expectedSize = sizeof(SArchiveIndexHeader) +
+                                    (unsigned __int64)header->CheckpointsCount * sizeof(SCheckpoint) +
+                                    (unsigned __int64)header->MembersCount * sizeof(SArchiveIndexMember) +
+                                    header->NamesSize;
+    if (expectedSize != size ||
+        SalamanderGeneral->UpdateCrc32(data + sizeof(SArchiveIndexHeader), size - sizeof(SArchiveIndexHeader), 0) !=
+            header->Checksum)
+    {
+        return FALSE;
+    }
+    // the archive name is the first of the names, the last name must be terminated
+    const SCheckpoint* checkpoints = (const SCheckpoint*)(data + sizeof(SArchiveIndexHeader));
+    const SArchiveIndexMember* members = (const SArchiveIndexMember*)(checkpoints + header->CheckpointsCount);
+    const char* names = (const char*)(members + header->MembersCount);
+    if (header->NamesSize == 0 || names[header->NamesSize - 1] != 0 ||
+        !IsFor(names) || header->Size != Size.Value || CompareFileTime(&header->LastWrite, &LastWrite) != 0)
+    {
+        return FALSE; // the archive has changed (or damaged data), the file is overwritten by Save()
+    }
+
+    DWORD i;
+    for (i = 0; i < header->CheckpointsCount; i++)
+    {
+        if (checkpoints[i].WindowPos >= BUFSIZE ||
+            (i > 0 && checkpoints[i].OutPos <= checkpoints[i - 1].OutPos))
+        {
+            return FALSE;
+        }
+        SCheckpoint* checkpoint = new SCheckpoint;
+        if (checkpoint == NULL)
+            return FALSE;
+        *checkpoint = checkpoints[i];
+        if (!AddCheckpoint(checkpoint))
+            return FALSE;
+    }
+    for (i = 0; i < header->MembersCount; i++)
+    {
+        if (members[i].NameOffset >= header->NamesSize ||
+            !AddMember(names + members[i].NameOffset, CQuadWord().SetUI64(members[i].DataPos),
+                       CQuadWord().SetUI64(members[i].Offset)))
+        {
+            return FALSE;
+        }
+    }
+    // the members were saved sorted (see Finish)
+    Complete = header->Complete;
+    return TRUE;
+}
+
+CArchiveIndex*
+CArchiveIndex::Load(CDecompressFile* stream)
+{
+    CALL_STACK_MESSAGE1("CArchiveIndex::Load()");
+
+    char name[MAX_PATH];
+    if (!GetIndexFileName(stream->GetArchiveName(), name, FALSE))
+        return NULL;
+    HANDLE file = CreateFile(name, GENERIC_READ | FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL; // there is no saved index
+
+    CArchiveIndex* index = NULL;
+    DWORD size = GetFileSize(file, NULL);
+    BYTE* data = size != INVALID_FILE_SIZE && size <= ARCINDEX_MAX_FILE_SIZE ? (BYTE*)malloc(size) : NULL;
+    DWORD read;
+    if (data != NULL && ReadFile(file, data, size, &read, NULL) && read == size)
+    {
+        index = new CArchiveIndex;
+        if (index != NULL && index->Init(stream) && index->ReadData(data, size))
+        {
+            // mark the file as recently used, Salamander removes the least recently used
+            // files from the listing cache
+            FILETIME ft;
+            GetSystemTimeAsFileTime(&ft);
+            SetFileTime(file, NULL, NULL, &ft);
+        }
+        else if (index != NULL)
+        {
+            delete index;
+            index = NULL;
+        }
+    }
+    if (data != NULL)
+        free(data);
+    CloseHandle(file);
+    if (index == NULL)
+        TRACE_I("CArchiveIndex::Load(): " << name << " is damaged or for another version of the archive");
+    return index;
+}
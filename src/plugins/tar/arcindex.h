@@ -0,0 +1,87 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// distance (in uncompressed data) between two checkpoints of the decompressor
+#define CHECKPOINT_DISTANCE (32 * 1024 * 1024)
+
+// saved indexes are stored in the directory of Salamander's archive listing cache, so they
+// are removed together with the cached listings (see CArchiveIndex::Save)
+#define ARCINDEX_DIR SALAMANDER_LISTINGCACHE_DIR
+#define ARCINDEX_SIGNATURE 0x31584954                // "TIX1"
+#define ARCINDEX_VERSION 1                           // increase when SCheckpoint or the file format changes
+// bigger indexes are not saved (nor loaded); the index counts into the 64 MB limit of the
+// listing cache, one index must not push all cached listings out of it
+#define ARCINDEX_MAX_FILE_SIZE (8 * 1024 * 1024)
+
+// member of the archive: position of its header in the uncompressed data
+struct SIndexMember
+{
+    char* Name;          // name of the file in the archive (as in SCommonHeader::Name)
+    CQuadWord DataPos;   // position of the header in the uncompressed data
+    CQuadWord Offset;    // CArchive::Offset before reading the header
+};
+
+// random access index of a compressed archive: decompressor checkpoints plus positions
+// of the archive members, built while listing the archive; UnpackOneFile then continues
+// decompression from the nearest checkpoint instead of from the start of the archive;
+// the index is also saved to disk, keyed by the name, size and last write time of
+// the archive, so it is not built again when the archive is opened next time
+class CArchiveIndex
+{
+public:
+    CArchiveIndex();
+    ~CArchiveIndex();
+
+    // remembers identity of the archive the index is built for
+    BOOL Init(CDecompressFile* stream);
+    // is the index built for the archive opened in 'stream' (and was not it changed since)?
+    BOOL IsFor(CDecompressFile* stream);
+    BOOL IsFor(const char* fileName) { return FileName != NULL && SalamanderGeneral->StrICmp(FileName, fileName) == 0; }
+
+    // adds checkpoint, checkpoints must be added in order of their OutPos
+    BOOL AddCheckpoint(SCheckpoint* checkpoint);
+    BOOL AddMember(const char* name, const CQuadWord& dataPos, const CQuadWord& offset);
+    // sorts members by name, must be called before FindMember; 'complete' is TRUE
+    // if the index covers the whole archive
+    void Finish(BOOL complete);
+    BOOL IsComplete() { return Complete; }
+    BOOL HasMembers() { return Members.Count > 0; }
+    int GetMemberCount() { return Members.Count; }
+
+    // returns the first member called 'name', NULL if not found
+    const SIndexMember* FindMember(const char* name);
+    // returns the last checkpoint before 'dataPos', NULL if there is none
+    const SCheckpoint* FindCheckpoint(const CQuadWord& dataPos);
+    // does the index save decompression of the archive (has checkpoints after its start)?
+    BOOL HasCheckpoints() { return Checkpoints.Count > 1; }
+
+    // saves the finished index to disk; errors are only traced, the index is just
+    // an optimization
+    void Save();
+    // loads the index of the archive opened in 'stream' saved by Save(); returns NULL
+    // if there is none or the archive has changed since
+    static CArchiveIndex* Load(CDecompressFile* stream);
+
+protected:
+    // builds the name of the file with the saved index of 'archiveName' into 'name'
+    // (buffer of MAX_PATH characters), 'create' = create its directory if needed;
+    // returns FALSE if it cannot be done
+    static BOOL GetIndexFileName(const char* archiveName, char* name, BOOL create);
+    // fills the empty index from the saved 'data' of 'size' bytes; returns FALSE
+    // if the data is damaged
+    BOOL ReadData(const BYTE* data, DWORD size);
+
+protected:
+    char* FileName;      // archive name
+    CQuadWord Size;      // archive size
+    FILETIME LastWrite;  // time of the last change of the archive
+    BOOL Complete;       // TRUE = all members of the archive are in Members
+
+    TIndirectArray<SCheckpoint> Checkpoints;
+    TDirectArray<SIndexMember> Members;
+};
+
+// index of the last listed archive (NULL if there is none)
+extern CArchiveIndex* ArchiveIndex;
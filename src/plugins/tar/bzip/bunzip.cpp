@@ -2,6 +2,8 @@
 
 #include "../dlldefs.h"
 #include "../fileio.h"
+#include "jobpool.h"
+#include "../arcindex.h"
 #include "bzlib.h"
 #include "bzip.h"
 
@@ -10,7 +12,9 @@
 #include "..\lang\lang.rh"
 
 CBZip::CBZip(const char *filename, HANDLE file, unsigned char *buffer, unsigned long start, unsigned long read, CQuadWord inputSize):
-  CZippedFile(filename, file, buffer, start, read, inputSize), BZStream(NULL), EndReached(FALSE)
+  CZippedFile(filename, file, buffer, start, read, inputSize), BZStream(NULL), EndReached(FALSE),
+  OutTotal(0, 0), Index(NULL), NextCheckpoint(0, 0), Pool(NULL), FirstJob(0), JobsCount(0), Raw(NULL), RawUsed(0), RawAllocated(0), RawStart(0), ScanPos(0),
+  ScanBits(0), PieceStart(0), PieceKind(PIECE_NONE), InputEnd(FALSE), CombinedCrc(0)
 {
   CALL_STACK_MESSAGE2("CBZip::CBZip(%s, , , )", filename);
   
@@ -66,12 +70,23 @@ CBZip::CBZip(const char *filename, HANDLE file, unsigned char *buffer, unsigned
     }
     return;
   }
+
+  // with more processors, decompress the blocks in parallel (see pbunzip.cpp)
+  if (CJobPool::GetThreadsCount() > 1)
+    StartPool(CJobPool::GetThreadsCount());
   // done
 }
 
 CBZip::~CBZip()
 {
   CALL_STACK_MESSAGE1("CBZip::~CBZip()");
+  if (Pool != NULL)
+  {
+    DropJobs();
+    delete Pool;
+  }
+  if (Raw != NULL)
+    free(Raw);
   if (BZStream)
   {
     int ret = BZ2_bzDecompressEnd(BZStream);
@@ -87,8 +102,10 @@ CBZip::DecompressBlock(unsigned short needed)
 {
   if (EndReached)
     return TRUE;
+  if (Pool != NULL)
+    return DecompressBlocks();
   int ret = BZ_OK;
-  while (ret != BZ_STREAM_END && ExtrEnd < Window + BUFSIZE)
+  while (ExtrEnd < Window + BUFSIZE)
   {
     unsigned char *src = DataStart;
     // at least one byte must already be buffered
@@ -109,33 +126,127 @@ CBZip::DecompressBlock(unsigned short needed)
     ret = BZ2_bzDecompress(BZStream);
     if (ret != BZ_OK && ret != BZ_STREAM_END)
     {
-      Ok = FALSE;
-      switch (ret)
-      {
-        case BZ_DATA_ERROR:
-        case BZ_DATA_ERROR_MAGIC:
-          ErrorCode = IDS_ERR_CORRUPT;
-          break;
-        case BZ_MEM_ERROR:
-          ErrorCode = IDS_ERR_MEMORY;
-          break;
-        case BZ_PARAM_ERROR:
-        default:
-          ErrorCode = IDS_ERR_INTERNAL;
-          break;
-      }
+      SetError(ret);
       return FALSE;
     }
     // commit the consumed input bytes
     FReadBlock((unsigned int)(BZStream->next_in - (char *)DataStart));
     unsigned short extracted = (unsigned short)((unsigned char *)BZStream->next_out - ExtrEnd);
     ExtrEnd = (unsigned char *)BZStream->next_out;
+    OutTotal += CQuadWord(extracted, 0);
+    if (ret == BZ_STREAM_END)
+    {
+      // concatenated streams (e.g. from pbzip2): continue with the next one
+      const unsigned char *next = FReadBlock(4);
+      if (next == NULL || next[0] != 'B' || next[1] != 'Z' || next[2] != 'h' ||
+          next[3] < '1' || next[3] > '9')
+      {
+        if (Ok)
+          ErrorCode = 0; // not enough data for another stream is not an error
+        EndReached = TRUE;
+        break;
+      }
+      CDecompressFile::Rewind(4);
+      BZ2_bzDecompressEnd(BZStream);
+      memset(BZStream, 0, sizeof(bz_stream));
+      ret = BZ2_bzDecompressInit(BZStream, 0, 0);
+      if (ret != BZ_OK)
+      {
+        SetError(ret);
+        return FALSE;
+      }
+    }
   }
-  if (ret == BZ_STREAM_END)
-    EndReached = TRUE;
   return TRUE;
 }
 
+// switches to the decompression of the blocks by 'threads' helper threads
+BOOL CBZip::StartPool(int threads)
+{
+  Pool = new CBZip2Pool;
+  if (Pool != NULL && Pool->Start(threads) == 0)
+  {
+    delete Pool;
+    Pool = NULL;
+  }
+  return Pool != NULL;
+}
+
+BOOL CBZip::SetIndex(CArchiveIndex *index)
+{
+  // only the helper threads know where the blocks start; with one processor, one helper
+  // thread is used, it can be started only before anything is decompressed by bzlib here
+  if (index != NULL && Pool == NULL && (OutTotal != CQuadWord(0, 0) || !StartPool(1)))
+    return FALSE;
+  Index = index;
+  NextCheckpoint = OutTotal;
+  return TRUE;
+}
+
+CQuadWord
+CBZip::GetDataPos()
+{
+  return OutTotal - CQuadWord((DWORD)(ExtrEnd - ExtrStart), 0);
+}
+
+BOOL CBZip::SeekCheckpoint(const SCheckpoint *checkpoint)
+{
+  CALL_STACK_MESSAGE1("CBZip::SeekCheckpoint()");
+
+  if (!Ok || (Pool == NULL && !StartPool(1)))
+    return FALSE;
+  LONG high = (LONG)checkpoint->InPos.HiDWord;
+  if (SetFilePointer(File, checkpoint->InPos.LoDWord, &high, FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+      GetLastError() != NO_ERROR)
+  {
+    LastError = GetLastError();
+    ErrorCode = IDS_GZERR_SEEK;
+    Ok = FALSE;
+    return FALSE;
+  }
+  // drop the buffered input and the queued pieces, the next read starts at the byte
+  // where the block starts; its marker is found again and starts the first piece
+  DropJobs();
+  DataStart = Buffer;
+  DataEnd = Buffer;
+  StreamPos = checkpoint->InPos;
+  RawUsed = 0;
+  RawStart = checkpoint->InPos.Value * 8;
+  ScanPos = RawStart;
+  // both markers start with a zero bit, so no marker is found before the checkpoint
+  ScanBits = (unsigned __int64)-1;
+  PieceStart = RawStart;
+  PieceKind = PIECE_NONE;
+  InputEnd = FALSE;
+  EndReached = FALSE;
+
+  // the CRC of the stream continues, so it is checked at its end as usual
+  CombinedCrc = checkpoint->Crc;
+  OutTotal = checkpoint->OutPos;
+  ExtrStart = Window;
+  ExtrEnd = Window;
+  return TRUE;
+}
+
+void CBZip::SetError(int ret)
+{
+  Ok = FALSE;
+  switch (ret)
+  {
+    case BZ_DATA_ERROR:
+    case BZ_DATA_ERROR_MAGIC:
+      ErrorCode = IDS_ERR_CORRUPT;
+      break;
+    case BZ_MEM_ERROR:
+      ErrorCode = IDS_ERR_MEMORY;
+      break;
+    case BZ_PARAM_ERROR:
+    default:
+      ErrorCode = IDS_ERR_INTERNAL;
+      break;
+  }
+}
+
 extern "C" {
 void bz_internal_error(int errcode);
 }
@@ -1,6 +1,62 @@
 ﻿#ifndef __BZIP_H__
 #define __BZIP_H__
 
+// the longest piece of the compressed data between two markers accepted when the
+// blocks are decompressed in parallel; a compressed bzip2 block takes about 1 MB at most
+#define BZIP2_MAX_PIECE_SIZE (2 * 1024 * 1024)
+
+// the highest number of pieces decompressed ahead
+#define BZIP2_MT_MAX_JOBS (2 * MAX_POOL_THREADS)
+
+// kinds of the pieces of the compressed data (see CBZip::PieceKind)
+#define PIECE_NONE 0  // no piece started yet (stream header)
+#define PIECE_BLOCK 1 // starts with the block marker
+#define PIECE_END 2   // starts with the end of stream marker
+
+// ****************************************************************************
+//
+// CBZip2BlockJob
+//
+// Piece of the compressed data starting with a block marker (or end of stream
+// marker) and ending with the next marker. A block is decompressed by a helper
+// thread as a standalone bzip2 stream made of this block only.
+//
+
+struct CBZip2BlockJob: public CPoolJob
+{
+  // input
+  BOOL EndOfStream;         // the piece starts with the end of stream marker, nothing to decompress
+  unsigned char *Piece;     // the piece, its first bit is the highest bit of Piece[0]
+  unsigned long PieceBits;
+  unsigned __int64 StartBit; // bit position of the piece in the compressed data
+
+  // output (valid once the job is done)
+  int Result;               // BZ_STREAM_END on success
+  unsigned char *Out;       // decompressed data
+  unsigned long OutSize;
+  unsigned long OutPos;     // data already returned by CBZip::DecompressBlock()
+
+  CBZip2BlockJob();
+  ~CBZip2BlockJob();
+};
+
+// ****************************************************************************
+//
+// CBZip2Pool
+//
+// Helper threads decompressing CBZip2BlockJob jobs.
+//
+
+class CBZip2Pool: public CJobPool
+{
+  public:
+    ~CBZip2Pool() { Stop(); }
+
+  protected:
+    virtual BOOL Run(void **state, CPoolJob *job);
+    virtual void FreeState(void *state) {}
+};
+
 class CBZip: public CZippedFile
 {
   public:
@@ -11,11 +67,48 @@ class CBZip: public CZippedFile
 
     static BOOL DetectArchive(const unsigned char *inBuffer, unsigned int inBufSize);
 
+    // random access: checkpoints are made at the starts of the blocks, so the blocks
+    // must be decompressed by the helper threads (see pbunzip.cpp)
+    virtual BOOL SetIndex(CArchiveIndex *index);
+    virtual CQuadWord GetDataPos();
+    virtual BOOL SeekCheckpoint(const SCheckpoint *checkpoint);
+
   protected:
     BOOL EndReached;          // set, when all data was extracted
 
+    // random access
+    CQuadWord OutTotal;       // bytes extracted from all bzip2 streams (position of ExtrEnd)
+    CArchiveIndex *Index;     // checkpoints are added here, NULL = do not create them
+    CQuadWord NextCheckpoint; // OutTotal at which the next checkpoint is created
+
     bz_stream *BZStream;
     virtual BOOL DecompressBlock(unsigned short needed);
+
+    // parallel decompression (see pbunzip.cpp), used when Pool is not NULL
+    CBZip2Pool *Pool;
+    CBZip2BlockJob *Jobs[BZIP2_MT_MAX_JOBS]; // queued pieces (circular)
+    int FirstJob;
+    int JobsCount;
+    unsigned char *Raw;       // compressed data from the start of the current piece
+    unsigned long RawUsed;
+    unsigned long RawAllocated;
+    unsigned __int64 RawStart;   // bit position of Raw in the compressed data
+    unsigned __int64 ScanPos;    // bits of the compressed data searched for the markers
+    unsigned __int64 ScanBits;   // the last 64 searched bits
+    unsigned __int64 PieceStart; // bit position of the current piece
+    int PieceKind;            // PIECE_xxx, the kind of the current piece
+    BOOL InputEnd;            // all compressed data was searched
+    unsigned long CombinedCrc; // CRC of the blocks of the current stream
+
+    BOOL StartPool(int threads);
+    void DropJobs();
+    void AddCheckpoint(CBZip2BlockJob *job);
+    BOOL QueueBlocks();
+    unsigned long ScanInput(const unsigned char *data, unsigned long size);
+    BOOL CutPiece(unsigned __int64 pos, int kind);
+    BOOL DecompressBlocks();
+    void PopJob();
+    void SetError(int ret);
 };
 
 #endif // __BZIP_H__
@@ -0,0 +1,441 @@
+﻿#include "precomp.h"
+
+#include "../dlldefs.h"
+#include "../fileio.h"
+#include "jobpool.h"
+#include "../arcindex.h"
+#include "bzlib.h"
+#include "bzip.h"
+
+#include "..\tar.rh"
+#include "..\tar.rh2"
+#include "..\lang\lang.rh"
+
+// bzip2 blocks are not byte aligned, they are found by their 48-bit markers
+#define BLOCK_MARKER ((unsigned __int64)0x314159265359)
+#define END_MARKER ((unsigned __int64)0x177245385090)
+#define MARKER_MASK ((unsigned __int64)0xFFFFFFFFFFFF)
+
+// bits are numbered from the highest bit of the first byte, as bzip2 writes them
+
+static unsigned long GetBits(const unsigned char *src, unsigned __int64 bit, int count)
+{
+  unsigned long ret = 0;
+  for (; count > 0; count--, bit++)
+    ret = (ret << 1) | ((src[bit >> 3] >> (7 - (bit & 7))) & 1);
+  return ret;
+}
+
+static void PutBits(unsigned char *dst, unsigned __int64 bit, unsigned __int64 value, int count)
+{
+  for (count--; count >= 0; count--, bit++)
+  {
+    unsigned char mask = (unsigned char)(0x80 >> (bit & 7));
+    if ((value >> count) & 1)
+      dst[bit >> 3] |= mask;
+    else
+      dst[bit >> 3] &= ~mask;
+  }
+}
+
+static void CopyBits(unsigned char *dst, unsigned __int64 dstBit, const unsigned char *src,
+                     unsigned __int64 srcBit, unsigned __int64 count)
+{
+  // bit by bit until the source is byte aligned
+  for (; count > 0 && (srcBit & 7) != 0; count--, srcBit++, dstBit++)
+    PutBits(dst, dstBit, GetBits(src, srcBit, 1), 1);
+  // then by bytes
+  const unsigned char *s = src + (srcBit >> 3);
+  unsigned char *d = dst + (dstBit >> 3);
+  unsigned int shift = (unsigned int)(dstBit & 7);
+  unsigned __int64 bytes = count >> 3;
+  if (shift == 0)
+    memcpy(d, s, (size_t)bytes);
+  else
+  {
+    unsigned __int64 i;
+    for (i = 0; i < bytes; i++)
+    {
+      d[i] = (unsigned char)((d[i] & (0xFF00 >> shift)) | (s[i] >> shift));
+      d[i + 1] = (unsigned char)(s[i] << (8 - shift));
+    }
+  }
+  srcBit += bytes << 3;
+  dstBit += bytes << 3;
+  count &= 7;
+  // and the rest bit by bit
+  for (; count > 0; count--, srcBit++, dstBit++)
+    PutBits(dst, dstBit, GetBits(src, srcBit, 1), 1);
+}
+
+//********************************************************
+//
+//  CBZip2BlockJob
+//
+
+CBZip2BlockJob::CBZip2BlockJob()
+{
+  EndOfStream = FALSE;
+  Piece = NULL;
+  PieceBits = 0;
+  StartBit = 0;
+  Result = BZ_OK;
+  Out = NULL;
+  OutSize = 0;
+  OutPos = 0;
+}
+
+CBZip2BlockJob::~CBZip2BlockJob()
+{
+  if (Piece != NULL)
+    free(Piece);
+  if (Out != NULL)
+    free(Out);
+}
+
+//********************************************************
+//
+//  CBZip2Pool
+//
+
+// decompresses the block in 'job', returns BZ_STREAM_END on success
+static int DecodeBZip2Block(CBZip2BlockJob *job)
+{
+  // the block marker and the block CRC at least
+  if (job->PieceBits < 80)
+    return BZ_DATA_ERROR;
+
+  if (job->Out != NULL)
+    free(job->Out);
+  job->Out = NULL;
+  job->OutSize = 0;
+
+  // make a stream of this block only: stream header, the block, end of stream marker
+  // and the CRC of the stream, which is the CRC of its only block
+  unsigned long streamBits = 32 + job->PieceBits + 48 + 32;
+  unsigned long streamSize = (streamBits + 7) / 8;
+  unsigned char *stream = (unsigned char *)malloc(streamSize);
+  if (stream == NULL)
+    return BZ_MEM_ERROR;
+  memcpy(stream, "BZh9", 4);
+  stream[streamSize - 1] = 0;
+  CopyBits(stream, 32, job->Piece, 0, job->PieceBits);
+  PutBits(stream, 32 + job->PieceBits, END_MARKER, 48);
+  PutBits(stream, 32 + job->PieceBits + 48, GetBits(job->Piece, 48, 32), 32);
+
+  bz_stream bzStream;
+  memset(&bzStream, 0, sizeof(bzStream));
+  int ret = BZ2_bzDecompressInit(&bzStream, 0, 0);
+  if (ret != BZ_OK)
+  {
+    free(stream);
+    return ret;
+  }
+  bzStream.next_in = (char *)stream;
+  bzStream.avail_in = streamSize;
+  // a block holds 900 kB at most, but the initial run-length encoding can make it longer
+  unsigned long allocated = 1024 * 1024;
+  while (TRUE)
+  {
+    unsigned char *out = (unsigned char *)realloc(job->Out, allocated);
+    if (out == NULL)
+    {
+      ret = BZ_MEM_ERROR;
+      break;
+    }
+    job->Out = out;
+    bzStream.next_out = (char *)job->Out + job->OutSize;
+    bzStream.avail_out = allocated - job->OutSize;
+    ret = BZ2_bzDecompress(&bzStream);
+    job->OutSize = allocated - bzStream.avail_out;
+    if (ret != BZ_OK)
+      break;
+    if (bzStream.avail_out != 0)
+    {
+      // the stream we made is complete, the data must be corrupted
+      ret = BZ_DATA_ERROR;
+      break;
+    }
+    allocated *= 2;
+  }
+  BZ2_bzDecompressEnd(&bzStream);
+  free(stream);
+  return ret;
+}
+
+BOOL CBZip2Pool::Run(void **state, CPoolJob *poolJob)
+{
+  CBZip2BlockJob *job = (CBZip2BlockJob *)poolJob;
+  job->Result = DecodeBZip2Block(job);
+  return TRUE;
+}
+
+//********************************************************
+//
+//  CBZip - parallel decompression
+//
+//  The compressed data is searched for the block and end of stream markers and
+//  cut into pieces starting with them. Helper threads decompress the blocks, the
+//  main thread returns their data in order and checks the CRCs of the streams.
+//  The block marker may appear inside the compressed data by chance, such a
+//  piece fails to decompress and is joined with the next one.
+//
+
+// cuts the current piece at bit 'pos' and starts a new piece of 'kind' there
+BOOL CBZip::CutPiece(unsigned __int64 pos, int kind)
+{
+  if (PieceKind != PIECE_NONE)
+  {
+    CBZip2BlockJob *job = new CBZip2BlockJob;
+    if (job != NULL)
+    {
+      job->EndOfStream = PieceKind == PIECE_END;
+      job->PieceBits = (unsigned long)(pos - PieceStart);
+      job->StartBit = PieceStart;
+      job->Piece = (unsigned char *)malloc(job->PieceBits / 8 + 2);
+    }
+    if (job == NULL || job->Piece == NULL)
+    {
+      if (job != NULL)
+        delete job;
+      Ok = FALSE;
+      ErrorCode = IDS_ERR_MEMORY;
+      return FALSE;
+    }
+    CopyBits(job->Piece, 0, Raw, PieceStart - RawStart, job->PieceBits);
+    // there is nothing to decompress in the end of stream pieces
+    if (!job->EndOfStream)
+      Pool->Submit(job);
+    Jobs[(FirstJob + JobsCount) % BZIP2_MT_MAX_JOBS] = job;
+    JobsCount++;
+  }
+  // keep the compressed data from the byte where the new piece starts
+  unsigned long drop = (unsigned long)((pos >> 3) - (RawStart >> 3));
+  memmove(Raw, Raw + drop, RawUsed - drop);
+  RawUsed -= drop;
+  RawStart = (pos >> 3) << 3;
+  PieceStart = pos;
+  PieceKind = kind;
+  return TRUE;
+}
+
+// searches 'data' for the markers, stops when enough pieces are queued;
+// returns the number of bytes used or -1 on error
+unsigned long CBZip::ScanInput(const unsigned char *data, unsigned long size)
+{
+  if (RawAllocated - RawUsed < size)
+  {
+    unsigned long allocated = max(RawUsed + size, 2 * RawAllocated);
+    unsigned char *raw = (unsigned char *)realloc(Raw, allocated);
+    if (raw == NULL)
+    {
+      Ok = FALSE;
+      ErrorCode = IDS_ERR_MEMORY;
+      return (unsigned long)-1;
+    }
+    Raw = raw;
+    RawAllocated = allocated;
+  }
+  unsigned long i;
+  for (i = 0; i < size && JobsCount < 2 * Pool->GetThreads(); i++)
+  {
+    Raw[RawUsed++] = data[i];
+    ScanBits = (ScanBits << 8) | data[i];
+    ScanPos += 8;
+    // the markers ending in this byte
+    int shift;
+    for (shift = 7; shift >= 0; shift--)
+    {
+      if (ScanPos - shift < 48)
+        continue;
+      unsigned __int64 marker = (ScanBits >> shift) & MARKER_MASK;
+      if (marker == BLOCK_MARKER || marker == END_MARKER)
+      {
+        if (!CutPiece(ScanPos - shift - 48, marker == BLOCK_MARKER ? PIECE_BLOCK : PIECE_END))
+          return (unsigned long)-1;
+      }
+    }
+    if (PieceKind == PIECE_NONE)
+    {
+      // only the stream header so far, keep the bytes where a marker can start
+      if (RawUsed > 16)
+      {
+        memmove(Raw, Raw + RawUsed - 8, 8);
+        RawStart += (RawUsed - 8) * 8;
+        RawUsed = 8;
+      }
+    }
+    else if (ScanPos - PieceStart > (unsigned __int64)BZIP2_MAX_PIECE_SIZE * 8)
+    {
+      if (PieceKind == PIECE_BLOCK)
+      {
+        Ok = FALSE;
+        ErrorCode = IDS_ERR_CORRUPT;
+        return (unsigned long)-1;
+      }
+      // no stream follows the last one, ignore the rest of the file
+      if (!CutPiece(ScanPos, PIECE_NONE))
+        return (unsigned long)-1;
+      InputEnd = TRUE;
+      return size;
+    }
+  }
+  return i;
+}
+
+// reads the compressed data and queues its pieces for the helper threads
+BOOL CBZip::QueueBlocks()
+{
+  while (!InputEnd && JobsCount < 2 * Pool->GetThreads())
+  {
+    // at least one byte must already be buffered
+    if (DataEnd == DataStart && FReadBlock(0) == NULL)
+      return FALSE;
+    if (DataEnd == DataStart)
+    {
+      InputEnd = TRUE;
+      if (PieceKind != PIECE_NONE && !CutPiece(ScanPos, PIECE_NONE))
+        return FALSE;
+      break;
+    }
+    unsigned long used = ScanInput(DataStart, (unsigned long)(DataEnd - DataStart));
+    if (used == (unsigned long)-1)
+      return FALSE;
+    // commit the consumed input bytes
+    FReadBlock(used);
+  }
+  return TRUE;
+}
+
+// waits for the helper threads and releases all queued pieces
+void CBZip::DropJobs()
+{
+  // the helper threads must not work on the pieces we release
+  while (JobsCount > 0)
+  {
+    if (!Jobs[FirstJob]->EndOfStream)
+      Pool->Wait(Jobs[FirstJob]);
+    PopJob();
+  }
+}
+
+// saves the state at the start of the block in 'job' to Index
+void CBZip::AddCheckpoint(CBZip2BlockJob *job)
+{
+  CALL_STACK_MESSAGE1("CBZip::AddCheckpoint()");
+
+  SCheckpoint *checkpoint = new SCheckpoint;
+  if (checkpoint == NULL)
+  {
+    TRACE_E("Low memory, no more checkpoints are created.");
+    Index = NULL;
+    return;
+  }
+  memset(checkpoint, 0, sizeof(SCheckpoint));
+  checkpoint->OutPos = OutTotal;
+  checkpoint->InPos.SetUI64(job->StartBit >> 3);
+  checkpoint->Crc = CombinedCrc;
+  if (!Index->AddCheckpoint(checkpoint))
+  {
+    TRACE_E("Low memory, no more checkpoints are created.");
+    Index = NULL;
+    return;
+  }
+  NextCheckpoint = OutTotal + CQuadWord(CHECKPOINT_DISTANCE, 0);
+}
+
+void CBZip::PopJob()
+{
+  delete Jobs[FirstJob];
+  FirstJob = (FirstJob + 1) % BZIP2_MT_MAX_JOBS;
+  JobsCount--;
+}
+
+// fills the output buffer from the blocks decompressed by the helper threads
+BOOL CBZip::DecompressBlocks()
+{
+  while (ExtrEnd < Window + BUFSIZE)
+  {
+    // keep the helper threads busy
+    if (!QueueBlocks())
+      return FALSE;
+    if (JobsCount == 0)
+    {
+      EndReached = TRUE;
+      return TRUE;
+    }
+    CBZip2BlockJob *job = Jobs[FirstJob];
+    if (job->EndOfStream)
+    {
+      if (job->PieceBits < 80 || GetBits(job->Piece, 48, 32) != CombinedCrc)
+      {
+        Ok = FALSE;
+        ErrorCode = job->PieceBits < 80 ? IDS_ERR_EOF : IDS_GZERR_CRC;
+        return FALSE;
+      }
+      CombinedCrc = 0;
+      PopJob();
+      continue;
+    }
+    Pool->Wait(job);
+    BOOL joinedEnd = FALSE;
+    while (job->Result != BZ_STREAM_END)
+    {
+      // the block marker found inside the compressed data by chance split the block,
+      // join the pieces and decompress them again
+      if (JobsCount < 2 && !QueueBlocks())
+        return FALSE;
+      CBZip2BlockJob *next = JobsCount < 2 ? NULL : Jobs[(FirstJob + 1) % BZIP2_MT_MAX_JOBS];
+      if (next == NULL && InputEnd && !joinedEnd)
+      {
+        // the file ends inside the block
+        Ok = FALSE;
+        ErrorCode = IDS_ERR_EOF;
+        return FALSE;
+      }
+      if (next == NULL || job->PieceBits + next->PieceBits > BZIP2_MAX_PIECE_SIZE * 8)
+      {
+        SetError(job->Result);
+        return FALSE;
+      }
+      if (next->EndOfStream)
+        joinedEnd = TRUE;
+      if (!next->EndOfStream)
+        Pool->Wait(next);
+      unsigned char *piece = (unsigned char *)malloc((job->PieceBits + next->PieceBits) / 8 + 2);
+      if (piece == NULL)
+      {
+        SetError(BZ_MEM_ERROR);
+        return FALSE;
+      }
+      CopyBits(piece, 0, job->Piece, 0, job->PieceBits);
+      CopyBits(piece, job->PieceBits, next->Piece, 0, next->PieceBits);
+      free(next->Piece);
+      next->Piece = piece;
+      next->PieceBits += job->PieceBits;
+      next->StartBit = job->StartBit;
+      next->EndOfStream = FALSE;
+      // 'next' is finished or was never submitted, it can be queued again
+      Pool->Submit(next);
+      Pool->Wait(next);
+      PopJob();
+      job = next;
+    }
+    if (job->OutPos == 0)
+    {
+      // the block starts here, the decompression can be resumed from it later
+      if (Index != NULL && OutTotal >= NextCheckpoint)
+        AddCheckpoint(job);
+      // the stream CRC is made of the CRCs of its blocks
+      CombinedCrc = ((CombinedCrc << 1) | (CombinedCrc >> 31)) ^ GetBits(job->Piece, 48, 32);
+    }
+    unsigned long size = min(job->OutSize - job->OutPos, (unsigned long)(Window + BUFSIZE - ExtrEnd));
+    memcpy(ExtrEnd, job->Out + job->OutPos, size);
+    ExtrEnd += size;
+    OutTotal += CQuadWord(size, 0);
+    job->OutPos += size;
+    if (job->OutPos == job->OutSize)
+      PopJob();
+  }
+  return TRUE;
+}
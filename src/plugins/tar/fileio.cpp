@@ -7,8 +7,11 @@
 #include "fileio.h"
 
 #include "gzip/gzip.h"
+#include "jobpool.h"
 #include "bzip/bzlib.h"
 #include "bzip/bzip.h"
+#include "../7zip/7za/c/Xz.h"
+#include "xz/xz.h"
 #include "compress/compress.h"
 #include "rpm/rpm.h"
 #include "lzh/lzh.h"
@@ -97,14 +100,20 @@ CDecompressFile::CreateInstance(LPCTSTR fileName, DWORD inputOffset, CQuadWord i
                 archive = new CBZip(fileName, file, buffer, inputOffset, read, inputSize);
                 if (archive != NULL && !archive->IsOk() && archive->GetErrorCode() == 0)
                 {
-                    // not compress, try lzh
+                    // not bzip, try xz
                     delete archive;
-                    archive = new CLZH(fileName, file, buffer, read);
+                    archive = new CXz(fileName, file, buffer, inputOffset, read, inputSize);
                     if (archive != NULL && !archive->IsOk() && archive->GetErrorCode() == 0)
                     {
-                        // not compressed, fall back to the base class
+                        // not xz, try lzh
                         delete archive;
-                        archive = new CDecompressFile(fileName, file, buffer, inputOffset, read, inputSize);
+                        archive = new CLZH(fileName, file, buffer, read);
+                        if (archive != NULL && !archive->IsOk() && archive->GetErrorCode() == 0)
+                        {
+                            // not compressed, read the file directly
+                            delete archive;
+                            archive = new CReadAheadFile(fileName, file, buffer, inputOffset, read, inputSize);
+                        }
                     }
                 }
             }
@@ -334,6 +343,33 @@ CDecompressFile::GetBlock(unsigned short size, unsigned short* read /* = NULL*/)
     return src;
 }
 
+const unsigned char*
+CDecompressFile::GetSpan(unsigned long size, unsigned long* read)
+{
+    *read = 0;
+    if (DataEnd == DataStart)
+    {
+        // refill the whole buffer
+        DataStart = Buffer;
+        DataEnd = Buffer;
+        if (FReadBlock(0) == NULL)
+            return NULL;
+        if (DataEnd == DataStart)
+        {
+            ErrorCode = IDS_ERR_EOF;
+            LastError = 0;
+            return NULL;
+        }
+    }
+    if (size > (unsigned long)(DataEnd - DataStart))
+        size = (unsigned long)(DataEnd - DataStart);
+    const unsigned char* ret = DataStart;
+    DataStart += size;
+    StreamPos += CQuadWord(size, 0);
+    *read = size;
+    return ret;
+}
+
 void CDecompressFile::GetFileInfo(FILETIME& lastWrite, CQuadWord& fileSize, DWORD& fileAttr)
 {
     TRACE_E("GetFileInfo called on an uncompressed stream.");
@@ -440,6 +476,33 @@ CZippedFile::GetBlock(unsigned short size, unsigned short* read /* = NULL*/)
     return ret;
 }
 
+const unsigned char*
+CZippedFile::GetSpan(unsigned long size, unsigned long* read)
+{
+    *read = 0;
+    if (!Ok)
+        return NULL;
+    // decompress the next data only when the buffer is empty, so nothing is moved
+    if (ExtrStart == ExtrEnd)
+    {
+        if (ExtrStart == Window + BUFSIZE)
+        {
+            ExtrStart = Window;
+            ExtrEnd = Window;
+        }
+        DecompressBlock(1);
+        // nothing is left at the end of the data
+        if (!Ok || ExtrStart == ExtrEnd)
+            return NULL;
+    }
+    if (size > (unsigned long)(ExtrEnd - ExtrStart))
+        size = (unsigned long)(ExtrEnd - ExtrStart);
+    unsigned char* ret = ExtrStart;
+    ExtrStart += size;
+    *read = size;
+    return ret;
+}
+
 void CZippedFile::GetFileInfo(FILETIME& lastWrite, CQuadWord& fileSize, DWORD& fileAttr)
 {
     CALL_STACK_MESSAGE1("CZippedFile::GetFileInfo(,,)");
@@ -460,3 +523,223 @@ void CZippedFile::GetFileInfo(FILETIME& lastWrite, CQuadWord& fileSize, DWORD& f
         lastWrite.dwHighDateTime = 0;
     }
 }
+
+//********************************************************
+//
+//  CReadAheadFile
+//
+
+struct CReadAheadJob : public CPoolJob
+{
+    HANDLE File;
+    unsigned char* Data; // BUFSIZE bytes for the rest of the previous block, then the block
+    DWORD Size;          // bytes to read
+    DWORD Read;          // bytes read
+    BOOL Result;         // FALSE = read error, see Error
+    DWORD Error;
+    BOOL Pending; // TRUE = submitted to the pool and not waited for yet
+
+    CReadAheadJob()
+    {
+        File = INVALID_HANDLE_VALUE;
+        Data = (unsigned char*)malloc(BUFSIZE + READAHEADSIZE);
+        Size = 0;
+        Read = 0;
+        Result = TRUE;
+        Error = 0;
+        Pending = FALSE;
+    }
+    ~CReadAheadJob()
+    {
+        if (Data != NULL)
+            free(Data);
+    }
+
+    void Run()
+    {
+        Read = 0;
+        Result = ReadFile(File, Data + BUFSIZE, Size, &Read, NULL);
+        Error = Result ? 0 : GetLastError();
+    }
+};
+
+class CReadAheadPool : public CJobPool
+{
+public:
+    virtual ~CReadAheadPool() { Stop(); }
+
+protected:
+    virtual BOOL Run(void** state, CPoolJob* job)
+    {
+        ((CReadAheadJob*)job)->Run();
+        return TRUE;
+    }
+    virtual void FreeState(void* state) {}
+};
+
+CReadAheadFile::CReadAheadFile(const char* filename, HANDLE file, unsigned char* buffer, unsigned long start, unsigned long read, CQuadWord inputSize) : CDecompressFile(filename, file, buffer, start, read, inputSize), Pool(NULL), Current(0)
+{
+    CALL_STACK_MESSAGE3("CReadAheadFile::CReadAheadFile(%s, , %u)", filename, read);
+
+    Jobs[0] = NULL;
+    Jobs[1] = NULL;
+    // if the parent constructor failed, bail out immediately
+    if (!Ok)
+        return;
+
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+        Jobs[i] = new CReadAheadJob;
+        if (Jobs[i] == NULL || Jobs[i]->Data == NULL)
+        {
+            FreeBufAndFile = FALSE;
+            Ok = FALSE;
+            ErrorCode = IDS_ERR_MEMORY;
+            return;
+        }
+        Jobs[i]->File = File;
+    }
+    // the data already read becomes the rest of the block before the first one
+    memcpy(Jobs[0]->Data + BUFSIZE - read, buffer, read);
+    DataStart = Jobs[0]->Data + BUFSIZE - read;
+    DataEnd = Jobs[0]->Data + BUFSIZE;
+    ReadPos = StreamPos + CQuadWord(read, 0);
+
+    // a single thread is enough, it waits for the disk most of the time
+    Pool = new CReadAheadPool;
+    if (Pool != NULL && Pool->Start(1) == 0)
+    {
+        delete Pool;
+        Pool = NULL;
+    }
+    ReadAhead(1);
+}
+
+CReadAheadFile::~CReadAheadFile()
+{
+    CALL_STACK_MESSAGE1("CReadAheadFile::~CReadAheadFile()");
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+        if (Jobs[i] != NULL)
+        {
+            // the helper thread must not read into the released block
+            if (Jobs[i]->Pending)
+                Pool->Wait(Jobs[i]);
+            delete Jobs[i];
+        }
+    }
+    if (Pool != NULL)
+        delete Pool;
+}
+
+void CReadAheadFile::ReadAhead(int i)
+{
+    CReadAheadJob* job = Jobs[i];
+    job->Size = 0;
+    if (ReadPos < InputSize)
+        job->Size = (DWORD)min((unsigned __int64)READAHEADSIZE, (InputSize - ReadPos).Value);
+    ReadPos += CQuadWord(job->Size, 0);
+    if (Pool != NULL && job->Size > 0)
+    {
+        job->Pending = TRUE;
+        Pool->Submit(job);
+    }
+    else
+        job->Run();
+}
+
+BOOL CReadAheadFile::NextBlock()
+{
+    CReadAheadJob* job = Jobs[1 - Current];
+    if (job->Pending)
+    {
+        Pool->Wait(job);
+        job->Pending = FALSE;
+    }
+    if (!job->Result)
+    {
+        Ok = FALSE;
+        ErrorCode = IDS_ERR_FREAD;
+        LastError = job->Error;
+        return FALSE;
+    }
+    if (job->Read == 0)
+    {
+        ErrorCode = IDS_ERR_EOF;
+        LastError = 0;
+        return FALSE;
+    }
+    // the rest is shorter than BUFSIZE, GetBlock() never asks for more
+    unsigned long rest = (unsigned long)(DataEnd - DataStart);
+    memcpy(job->Data + BUFSIZE - rest, DataStart, rest);
+    DataStart = job->Data + BUFSIZE - rest;
+    DataEnd = job->Data + BUFSIZE + job->Read;
+    Current = 1 - Current;
+    ReadAhead(1 - Current);
+    return TRUE;
+}
+
+// returns the last read data, only from the current block (see NextBlock)
+void CReadAheadFile::Rewind(unsigned short size)
+{
+    if (DataStart - size >= Jobs[Current]->Data)
+    {
+        DataStart -= size;
+        StreamPos.Value -= size;
+    }
+    else
+    {
+        TRACE_E("Rewind - requested rewind by too large a portion.");
+        Ok = FALSE;
+        ErrorCode = IDS_ERR_INTERNAL;
+    }
+}
+
+const unsigned char*
+CReadAheadFile::GetBlock(unsigned short size, unsigned short* read /* = NULL*/)
+{
+    if (!Ok)
+    {
+        TRACE_E("GetBlock called on a broken stream.");
+        return NULL;
+    }
+    if (size > BUFSIZE)
+    {
+        TRACE_E("Requested block is too large.");
+        Ok = FALSE;
+        ErrorCode = IDS_ERR_INTERNAL;
+        return NULL;
+    }
+    while ((unsigned long)(DataEnd - DataStart) < size)
+    {
+        if (!NextBlock())
+        {
+            if (read != NULL)
+                *read = (unsigned short)(DataEnd - DataStart);
+            return NULL;
+        }
+    }
+    const unsigned char* ret = DataStart;
+    DataStart += size;
+    StreamPos += CQuadWord(size, 0);
+    if (read != NULL)
+        *read = (unsigned short)min(DataEnd - DataStart, 0xFFFF);
+    return ret;
+}
+
+const unsigned char*
+CReadAheadFile::GetSpan(unsigned long size, unsigned long* read)
+{
+    *read = 0;
+    if (!Ok || (DataEnd == DataStart && !NextBlock()))
+        return NULL;
+    if (size > (unsigned long)(DataEnd - DataStart))
+        size = (unsigned long)(DataEnd - DataStart);
+    const unsigned char* ret = DataStart;
+    DataStart += size;
+    StreamPos += CQuadWord(size, 0);
+    *read = size;
+    return ret;
+}
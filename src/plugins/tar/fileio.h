@@ -5,6 +5,28 @@
 
 // size of file read buffer
 #define BUFSIZE 0x8000 // buffer will be 32 KB
+// size of the blocks read ahead from uncompressed archives (see CReadAheadFile)
+#define READAHEADSIZE 0x100000 // 1 MB
+
+class CArchiveIndex;
+class CReadAheadPool;
+struct CReadAheadJob;
+
+// decompressor state saved at a point where decompression can be resumed later
+// (see CArchiveIndex and CDecompressFile::SeekCheckpoint); bzip2 uses only OutPos,
+// InPos (the byte where a block starts) and Crc (combined CRC of the previous blocks
+// of the stream), its blocks do not depend on the previous data
+struct SCheckpoint
+{
+    CQuadWord OutPos;              // position in the uncompressed data
+    CQuadWord InPos;               // position of the next unread byte in the archive file
+    unsigned long BitBuffer;       // bits read ahead from the input
+    unsigned long BitCount;        // number of bits in BitBuffer
+    unsigned long Crc;             // CRC of the current member up to OutPos
+    CQuadWord MemberSize;          // bytes extracted from the current member up to OutPos
+    unsigned int WindowPos;        // write position in Window
+    unsigned char Window[BUFSIZE]; // last BUFSIZE bytes of the uncompressed data
+};
 
 class CDecompressFile
 {
@@ -38,8 +60,20 @@ public:
     virtual void Rewind(unsigned short size);
 
     virtual const unsigned char* GetBlock(unsigned short size, unsigned short* read = NULL);
+    // returns up to 'size' bytes directly from the buffer, without copying or compacting it
+    // (so usually fewer bytes), 'read' receives their number; the data is valid until the
+    // next call; returns NULL at the end of the data or on error (see IsOk())
+    virtual const unsigned char* GetSpan(unsigned long size, unsigned long* read);
     virtual void GetFileInfo(FILETIME& lastWrite, CQuadWord& fileSize, DWORD& fileAttr);
 
+    // random access to the uncompressed data (see CArchiveIndex), gzip and bzip2 support it:
+    // starts adding checkpoints to 'index' during decompression
+    virtual BOOL SetIndex(CArchiveIndex* index) { return FALSE; }
+    // returns position of the data returned by the next GetBlock() in the uncompressed data
+    virtual CQuadWord GetDataPos() { return CQuadWord(0, 0); }
+    // continues decompression from the state saved in 'checkpoint'
+    virtual BOOL SeekCheckpoint(const SCheckpoint* checkpoint) { return FALSE; }
+
 protected:
     // reads a block from the file
     const unsigned char* FReadBlock(unsigned int number);
@@ -73,6 +107,7 @@ public:
 
     virtual void GetFileInfo(FILETIME& lastWrite, CQuadWord& fileSize, DWORD& fileAttr);
     virtual const unsigned char* GetBlock(unsigned short size, unsigned short* read);
+    virtual const unsigned char* GetSpan(unsigned long size, unsigned long* read);
     virtual void Rewind(unsigned short size);
 
 protected:
@@ -83,3 +118,29 @@ protected:
     virtual BOOL DecompressBlock(unsigned short needed) = 0;
     virtual BOOL CompactBuffer();
 };
+
+// uncompressed archive: a helper thread reads the next READAHEADSIZE block of the file
+// while the current one is being processed, GetSpan() returns the data straight from
+// the blocks
+class CReadAheadFile : public CDecompressFile
+{
+public:
+    CReadAheadFile(const char* filename, HANDLE file, unsigned char* buffer, unsigned long start, unsigned long read, CQuadWord inputSize);
+    virtual ~CReadAheadFile();
+
+    virtual void Rewind(unsigned short size);
+    virtual const unsigned char* GetBlock(unsigned short size, unsigned short* read = NULL);
+    virtual const unsigned char* GetSpan(unsigned long size, unsigned long* read);
+
+protected:
+    // starts reading the block following the blocks already read into Jobs[i]
+    void ReadAhead(int i);
+    // makes the block read ahead the current one, the unused data of the current block
+    // is moved in front of it; returns FALSE at the end of the file or on error
+    BOOL NextBlock();
+
+    CReadAheadPool* Pool;   // helper thread reading the file, NULL = we read it ourselves
+    CReadAheadJob* Jobs[2]; // the current block and the block read ahead
+    int Current;            // index of the current block in Jobs
+    CQuadWord ReadPos;      // position in the file where the next block starts
+};
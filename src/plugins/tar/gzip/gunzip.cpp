@@ -5,6 +5,7 @@
 
 #include "../dlldefs.h"
 #include "../fileio.h"
+#include "../arcindex.h"
 #include "gzip.h"
 
 #include "..\tar.rh"
@@ -863,6 +864,10 @@ BOOL CGZip::InflateBlock()
         unsigned long b; // bit buffer
         unsigned k;      // number of bits in bit buffer
 
+        // block boundary: decompression can be resumed from here later
+        if (Index != NULL && OutTotal >= NextCheckpoint)
+            AddCheckpoint();
+
         // make local bit buffer
         b = BitBuffer;
         k = BitCount;
@@ -926,6 +931,7 @@ BOOL CGZip::InflateBlock()
     // update crc and extracted size
     unsigned short extracted = (unsigned short)(ExtrEnd - begin);
     TotalCnt += CQuadWord(extracted, 0);
+    OutTotal += CQuadWord(extracted, 0);
     crc = UpdateCRC(crc, begin, extracted);
 
     if (ret != -1)
@@ -972,7 +978,8 @@ BOOL CGZip::InflateBlock()
 CGZip::CGZip(const char* filename, HANDLE file, unsigned char* buffer, unsigned long start, unsigned long read, CQuadWord inputSize) : CZippedFile(filename, file, buffer, start, read, inputSize), CopyInProgress(FALSE), LastBlock(FALSE), CopyCount(0),
                                                                                                                                        CopyDistance(0), BlockType(0), LiteralTable(NULL), LiteralBits(0), DistanceTable(NULL),
                                                                                                                                        DistanceBits(0), FixedLiteralTable(NULL), FixedLiteralBits(0), FixedDistanceTable(NULL),
-                                                                                                                                       FixedDistanceBits(0), StoredLen(0), BitBuffer(0), BitCount(0), InProgress(FALSE)
+                                                                                                                                       FixedDistanceBits(0), StoredLen(0), BitBuffer(0), BitCount(0), InProgress(FALSE),
+                                                                                                                                       OutTotal(0, 0), Index(NULL), NextCheckpoint(0, 0)
 {
     CALL_STACK_MESSAGE2("CGZip::CGZip(%s, , , )", filename);
 
@@ -1215,6 +1222,94 @@ void CGZip::GetFileInfo(FILETIME& lastWrite, CQuadWord& fileSize, DWORD& fileAtt
     }
 }
 
+BOOL CGZip::SetIndex(CArchiveIndex* index)
+{
+    Index = index;
+    NextCheckpoint = OutTotal;
+    return TRUE;
+}
+
+CQuadWord
+CGZip::GetDataPos()
+{
+    return OutTotal - CQuadWord((DWORD)(ExtrEnd - ExtrStart), 0);
+}
+
+// saves the decompressor state at the block boundary to Index
+void CGZip::AddCheckpoint()
+{
+    CALL_STACK_MESSAGE1("CGZip::AddCheckpoint()");
+
+    SCheckpoint* checkpoint = new SCheckpoint;
+    if (checkpoint == NULL)
+    {
+        TRACE_E("Low memory, no more checkpoints are created.");
+        Index = NULL;
+        return;
+    }
+    checkpoint->OutPos = OutTotal;
+    checkpoint->InPos = StreamPos;
+    checkpoint->BitBuffer = BitBuffer;
+    checkpoint->BitCount = BitCount;
+    checkpoint->Crc = crc;
+    checkpoint->MemberSize = TotalCnt;
+    // the window is circular, deflate may refer to any of its bytes
+    checkpoint->WindowPos = (unsigned int)(ExtrEnd - Window);
+    memcpy(checkpoint->Window, Window, BUFSIZE);
+    if (!Index->AddCheckpoint(checkpoint))
+    {
+        TRACE_E("Low memory, no more checkpoints are created.");
+        Index = NULL;
+        return;
+    }
+    NextCheckpoint = OutTotal + CQuadWord(CHECKPOINT_DISTANCE, 0);
+}
+
+BOOL CGZip::SeekCheckpoint(const SCheckpoint* checkpoint)
+{
+    CALL_STACK_MESSAGE1("CGZip::SeekCheckpoint()");
+
+    if (!Ok)
+        return FALSE;
+    LONG high = (LONG)checkpoint->InPos.HiDWord;
+    if (SetFilePointer(File, checkpoint->InPos.LoDWord, &high, FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+        GetLastError() != NO_ERROR)
+    {
+        LastError = GetLastError();
+        ErrorCode = IDS_GZERR_SEEK;
+        Ok = FALSE;
+        return FALSE;
+    }
+    // drop the buffered input, the next read starts at the checkpoint
+    DataStart = Buffer;
+    DataEnd = Buffer;
+    StreamPos = checkpoint->InPos;
+    BitBuffer = checkpoint->BitBuffer;
+    BitCount = checkpoint->BitCount;
+
+    // the checkpoint is at the block boundary, forget the current block
+    HufTableFree(LiteralTable);
+    LiteralTable = NULL;
+    HufTableFree(DistanceTable);
+    DistanceTable = NULL;
+    HufTableFree(FixedLiteralTable);
+    FixedLiteralTable = NULL;
+    HufTableFree(FixedDistanceTable);
+    FixedDistanceTable = NULL;
+    InProgress = FALSE;
+    CopyInProgress = FALSE;
+    LastBlock = FALSE;
+
+    // CRC and size of the member continue, so they are checked at its end as usual
+    crc = checkpoint->Crc;
+    TotalCnt = checkpoint->MemberSize;
+    OutTotal = checkpoint->OutPos;
+    memcpy(Window, checkpoint->Window, BUFSIZE);
+    ExtrStart = Window + checkpoint->WindowPos;
+    ExtrEnd = ExtrStart;
+    return TRUE;
+}
+
 BOOL CGZip::CompactBuffer()
 {
     CALL_STACK_MESSAGE1("CGZip::CompactBuffer()");
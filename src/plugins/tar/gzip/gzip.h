@@ -65,9 +65,18 @@ public:
 
     virtual void GetFileInfo(FILETIME& lastWrite, CQuadWord& fileSize, DWORD& fileAttr);
 
+    virtual BOOL SetIndex(CArchiveIndex* index);
+    virtual CQuadWord GetDataPos();
+    virtual BOOL SeekCheckpoint(const SCheckpoint* checkpoint);
+
 protected:
     CQuadWord TotalCnt; // total number of bytes extracted from archive
 
+    // random access
+    CQuadWord OutTotal;       // bytes extracted from all gzip members (position of ExtrEnd)
+    CArchiveIndex* Index;     // checkpoints are added here, NULL = do not create them
+    CQuadWord NextCheckpoint; // OutTotal at which the next checkpoint is created
+
     BOOL InProgress;     // current block is not finished yet
     BOOL CopyInProgress; // current operation is copy
     BOOL LastBlock;      // is the current block the last one ?
@@ -89,6 +98,7 @@ protected:
     unsigned long crc;
 
     // internal, private functions
+    void AddCheckpoint();
     BOOL InflateBlock();
     BOOL InflateStoredInit();
     int InflateStored();
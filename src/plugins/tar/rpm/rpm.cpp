@@ -6,6 +6,7 @@
 #include "../dlldefs.h"
 #include "../fileio.h"
 #include "../gzip/gzip.h"
+#include "jobpool.h"
 #include "../bzip/bzlib.h"
 #include "../bzip/bzip.h"
 #include "rpm.h"
@@ -102,6 +103,18 @@ const unsigned char* CRPM::GetBlock(unsigned short size, unsigned short* read)
     return CDecompressFile::GetBlock(size, read);
 }
 
+const unsigned char* CRPM::GetSpan(unsigned long size, unsigned long* read)
+{
+    if (Stream)
+    {
+        const unsigned char* ret = Stream->GetSpan(size, read);
+        if (!Stream->IsOk())
+            Ok = FALSE;
+        return ret;
+    }
+    return CDecompressFile::GetSpan(size, read);
+}
+
 void CRPM::Rewind(unsigned short size)
 {
     if (Stream)
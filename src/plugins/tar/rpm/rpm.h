@@ -300,6 +300,7 @@ public:
     BOOL RPMReadHeader(FILE* fContents);
 
     virtual const unsigned char* GetBlock(unsigned short size, unsigned short* read = NULL);
+    virtual const unsigned char* GetSpan(unsigned long size, unsigned long* read);
     virtual void Rewind(unsigned short size);
     virtual void GetFileInfo(FILETIME& lastWrite, CQuadWord& fileSize, DWORD& fileAttr);
     // Should other functions be forwarded to Stream?????
@@ -285,7 +285,16 @@ private:
     BOOL Ok;
     CQuadWord Offset;
     DWORD Silent;
-
+    CArchiveIndex* Index; // random access index being built, NULL if not built
+    BOOL Indexable;       // FALSE for archives stored inside another file (.deb), see CArchiveIndex
+
+    BOOL DoListArchive(const char* prefix, CSalamanderDirectoryAbstract* dir);
+    BOOL DoUnpackOneFile(const char* nameInArchive, const char* targetPath,
+                         const char* newFileName, BOOL seek);
+    void StartIndex();
+    void FinishIndex(BOOL complete);
+    BOOL SeekToMember(const char* nameInArchive);
+    void ReopenStream();
     BOOL ListStream(CSalamanderDirectoryAbstract* dir);
     BOOL UnpackStream(const char* targetPath, BOOL doProgress,
                       const char* nameInArchive, CNames* names, const char* newName);
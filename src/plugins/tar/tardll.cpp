@@ -5,6 +5,7 @@
 
 #include "fileio.h"
 #include "tardll.h"
+#include "arcindex.h"
 #include "tar.h"
 #include "gzip/gzip.h"
 #include "rpm/rpm.h"
@@ -40,9 +41,10 @@
 //                3 - work-in-progress version before Servant Salamander 2.5 beta 1, removed the *.CPIO viewer
 //                4 - work-in-progress version before Servant Salamander 2.5 beta 1, added .z archives
 //                5 - work-in-progress version before Servant Salamander 2.52 beta 2, added .DEB archives
+//                6 - added .XZ and .TXZ archives
 
 int ConfigVersion = 0;
-#define CURRENT_CONFIG_VERSION 5
+#define CURRENT_CONFIG_VERSION 6
 const char* CONFIG_VERSION = "Version";
 
 // plugin interface object, its methods are called from Salamander
@@ -158,10 +160,16 @@ CPluginInterfaceAbstract* WINAPI SalamanderPluginEntry(CSalamanderPluginEntryAbs
                                    VERSINFO_VERSION_NO_PLATFORM,
                                    VERSINFO_COPYRIGHT,
                                    LoadStr(IDS_PLUGIN_DESCRIPTION),
-                                   "TAR" /* neprekladat! */, "tar;tgz;taz;tbz;gz;bz;bz2;z;rpm;cpio;deb");
+                                   "TAR" /* neprekladat! */, "tar;tgz;taz;tbz;txz;gz;bz;bz2;xz;z;rpm;cpio;deb");
 
     salamander->SetPluginHomePageURL("www.altap.cz");
 
+    // the listing depends only on the archive contents and has no plugin data, so Salamander
+    // may keep it in its persistent listing cache (saves decompressing the whole .tar.gz);
+    // older versions do not have the method
+    if (salamander->GetVersion() >= SALAMANDER_VERSION_ARCCAP)
+        salamander->SetArchiverCapabilities(ARCCAP_CACHEABLELISTING);
+
     return &PluginInterface;
 }
 
@@ -176,6 +184,17 @@ void CPluginInterface::About(HWND parent)
     SalamanderGeneral->SalMessageBox(parent, buf, LoadStr(IDS_ABOUT), MB_OK | MB_ICONINFORMATION);
 }
 
+BOOL CPluginInterface::Release(HWND parent, BOOL force)
+{
+    CALL_STACK_MESSAGE2("CPluginInterface::Release(, %d)", force);
+    if (ArchiveIndex != NULL)
+    {
+        delete ArchiveIndex;
+        ArchiveIndex = NULL;
+    }
+    return TRUE;
+}
+
 void CPluginInterface::LoadConfiguration(HWND parent, HKEY regKey, CSalamanderRegistryAbstract* registry)
 {
     CALL_STACK_MESSAGE1("CPluginInterface::LoadConfiguration(, ,)");
@@ -206,16 +225,16 @@ void CPluginInterface::Connect(HWND parent, CSalamanderConnectAbstract* salamand
 
     // base part:
     salamander->AddCustomUnpacker("TAR (Plugin)",
-                                  "*.tar;*.tgz;*.tbz;*.taz;"
-                                  "*.tar.gz;*.tar.bz;*.tar.bz2;*.tar.z;"
-                                  "*_tar.gz;*_tar.bz;*_tar.bz2;*_tar.z;"
-                                  "*_tar_gz;*_tar_bz;*_tar_bz2;*_tar_z;"
-                                  "*.tar_gz;*.tar_bz;*.tar_bz2;*.tar_z;"
-                                  "*.gz;*.bz;*.bz2;*.z;"
+                                  "*.tar;*.tgz;*.tbz;*.taz;*.txz;"
+                                  "*.tar.gz;*.tar.bz;*.tar.bz2;*.tar.xz;*.tar.z;"
+                                  "*_tar.gz;*_tar.bz;*_tar.bz2;*_tar.xz;*_tar.z;"
+                                  "*_tar_gz;*_tar_bz;*_tar_bz2;*_tar_xz;*_tar_z;"
+                                  "*.tar_gz;*.tar_bz;*.tar_bz2;*.tar_xz;*.tar_z;"
+                                  "*.gz;*.bz;*.bz2;*.xz;*.z;"
                                   "*.rpm;*.cpio;*.deb",
-                                  ConfigVersion < 5);                                       // ignored during upgrades except when upgrading to version 4 - required update because of "*.z" and others
-    salamander->AddPanelArchiver("tgz;tbz;taz;tar;gz;bz;bz2;z;rpm;cpio;deb", FALSE, FALSE); // ignored when upgrading the plugin
-    salamander->AddViewer("*.rpm", FALSE);                                                  // ignored when upgrading the plugin except when upgrading from a version without the viewer (the version shipped with SS 2.0)
+                                  ConfigVersion < 6);                                              // ignored during upgrades except when upgrading to version 6 - required update because of "*.xz" and others
+    salamander->AddPanelArchiver("tgz;tbz;taz;txz;tar;gz;bz;bz2;xz;z;rpm;cpio;deb", FALSE, FALSE); // ignored when upgrading the plugin
+    salamander->AddViewer("*.rpm", FALSE);                                                         // ignored when upgrading the plugin except when upgrading from a version without the viewer (the version shipped with SS 2.0)
 
     // section for upgrades:
     if (ConfigVersion < 1) // 1 - work-in-progress version before Servant Salamander 2.5 beta 1, added tbz, bz, bz2, and rpm
@@ -246,6 +265,10 @@ void CPluginInterface::Connect(HWND parent, CSalamanderConnectAbstract* salamand
     {
         salamander->AddPanelArchiver("deb", FALSE, TRUE);
     }
+    if (ConfigVersion < 6) // 6 - added .xz archives
+    {
+        salamander->AddPanelArchiver("txz;xz", FALSE, TRUE);
+    }
 }
 
 CPluginInterfaceForArchiverAbstract*
@@ -351,6 +374,19 @@ BOOL CPluginInterfaceForArchiver::UnpackWholeArchive(CSalamanderForOperationsAbs
     return FALSE;
 }
 
+BOOL CPluginInterfaceForArchiver::CanCloseArchive(CSalamanderForOperationsAbstract* salamander,
+                                                  const char* fileName, BOOL force, int panel)
+{
+    CALL_STACK_MESSAGE4("CPluginInterfaceForArchiver::CanCloseArchive(, %s, %d, %d)", fileName, force, panel);
+    // the archive is no longer shown in the panel, release its index (see CArchiveIndex)
+    if (ArchiveIndex != NULL && ArchiveIndex->IsFor(fileName))
+    {
+        delete ArchiveIndex;
+        ArchiveIndex = NULL;
+    }
+    return TRUE;
+}
+
 /*
 BOOL
 CPluginInterfaceForArchiver::PackToArchive(CSalamanderForOperationsAbstract *salamander,
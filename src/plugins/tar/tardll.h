@@ -37,10 +37,7 @@ public:
                                            const char* mask, const char* targetDir, BOOL delArchiveWhenDone,
                                            CDynamicString* archiveVolumes);
     virtual BOOL WINAPI CanCloseArchive(CSalamanderForOperationsAbstract* salamander, const char* fileName,
-                                        BOOL force, int panel)
-    {
-        return TRUE;
-    }
+                                        BOOL force, int panel);
     virtual BOOL WINAPI GetCacheInfo(char* tempPath, BOOL* ownDelete, BOOL* cacheCopies) { return FALSE; }
     virtual void WINAPI DeleteTmpCopy(const char* fileName, BOOL firstFile) {}
     virtual BOOL WINAPI PrematureDeleteTmpCopy(HWND parent, int copiesCount) { return FALSE; }
@@ -61,7 +58,7 @@ class CPluginInterface : public CPluginInterfaceAbstract
 public:
     virtual void WINAPI About(HWND parent);
 
-    virtual BOOL WINAPI Release(HWND parent, BOOL force) { return TRUE; }
+    virtual BOOL WINAPI Release(HWND parent, BOOL force);
 
     virtual void WINAPI LoadConfiguration(HWND parent, HKEY regKey, CSalamanderRegistryAbstract* registry);
     virtual void WINAPI SaveConfiguration(HWND parent, HKEY regKey, CSalamanderRegistryAbstract* registry);
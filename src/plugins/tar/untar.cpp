@@ -5,6 +5,7 @@
 
 #include "dlldefs.h"
 #include "fileio.h"
+#include "arcindex.h"
 #include "tar.h"
 #include "deb/deb.h"
 
@@ -176,6 +177,8 @@ CArchive::CArchive(const char* fileName, CSalamanderForOperationsAbstract* salam
     Silent = 0;
     Ok = TRUE;
     Stream = NULL;
+    Index = NULL;
+    Indexable = offset == 0;
     SalamanderIf = salamander;
     if (fileName == NULL || salamander == NULL)
     {
@@ -207,10 +210,65 @@ BOOL CArchive::ListArchive(const char* prefix, CSalamanderDirectoryAbstract* dir
     if (!IsOk())
         return FALSE;
 
+    // compressed archive: while listing it, build an index for UnpackOneFile so that
+    // it does not need to decompress the archive from its start
+    StartIndex();
+    BOOL ret = DoListArchive(prefix, dir);
+    FinishIndex(ret);
+    return ret;
+}
+
+// starts building the random access index of a compressed archive (see CArchiveIndex)
+void CArchive::StartIndex()
+{
+    CALL_STACK_MESSAGE1("CArchive::StartIndex()");
+
+    if (!Indexable || !Stream->IsCompressed())
+        return;
+    Index = new CArchiveIndex;
+    if (Index != NULL && (!Index->Init(Stream) || !Stream->SetIndex(Index)))
+    {
+        delete Index;
+        Index = NULL;
+    }
+}
+
+// 'complete' is TRUE if the whole archive was read
+void CArchive::FinishIndex(BOOL complete)
+{
+    CALL_STACK_MESSAGE2("CArchive::FinishIndex(%d)", complete);
+
+    if (Index == NULL)
+        return;
+    Stream->SetIndex(NULL);
+    // keep the index that covers more of the archive
+    if (Index->HasMembers() &&
+        (complete || ArchiveIndex == NULL || !ArchiveIndex->IsFor(Stream) ||
+         (!ArchiveIndex->IsComplete() && ArchiveIndex->GetMemberCount() < Index->GetMemberCount())))
+    {
+        Index->Finish(complete);
+        if (ArchiveIndex != NULL)
+            delete ArchiveIndex;
+        ArchiveIndex = Index;
+        // keep it for the next opening of the archive too, when it saves something
+        if (ArchiveIndex->HasCheckpoints())
+            ArchiveIndex->Save();
+    }
+    else
+        delete Index;
+    Index = NULL;
+}
+
+BOOL CArchive::DoListArchive(const char* prefix, CSalamanderDirectoryAbstract* dir)
+{
+    CALL_STACK_MESSAGE1("CArchive::DoListArchive( )");
+
     // first try to detect the archive and read the first header
     Silent = 0;
     Offset.Set(0, 0);
     SCommonHeader header;
+    CQuadWord headerPos = Stream->GetDataPos();
+    CQuadWord headerOffset = Offset;
     int ret = ReadArchiveHeader(header, TRUE);
 
     // if this is not a supported format, unpack only the outer compression when present
@@ -238,6 +296,10 @@ BOOL CArchive::ListArchive(const char* prefix, CSalamanderDirectoryAbstract* dir
         // ignore entries we cannot interpret
         if (!header.Ignored)
         {
+            // failure is not fatal, UnpackOneFile just searches for the member from the start
+            if (Index != NULL)
+                Index->AddMember(header.Name, headerPos, headerOffset);
+
             char path[2 * MAX_PATH];
 
             if (prefix)
@@ -284,6 +346,8 @@ BOOL CArchive::ListArchive(const char* prefix, CSalamanderDirectoryAbstract* dir
         }
 
         // prepare a new header for the next iteration
+        headerPos = Stream->GetDataPos();
+        headerOffset = Offset;
         if (ReadArchiveHeader(header, FALSE) != TAR_OK)
             return FALSE;
 
@@ -301,14 +365,39 @@ BOOL CArchive::UnpackOneFile(const char* nameInArchive, const CFileData* fileDat
     if (!IsOk())
         return FALSE;
 
+    Offset.Set(0, 0);
+    BOOL seek = SeekToMember(nameInArchive);
+    if (!IsOk())
+        return FALSE; // the archive could not be opened again
+    // the listing may come from Salamander's listing cache, so ListArchive did not have
+    // to build the index; build it (or make it longer) while searching for the file
+    if (!seek && (ArchiveIndex == NULL || !ArchiveIndex->IsFor(Stream) || !ArchiveIndex->IsComplete()))
+        StartIndex();
+    BOOL ret = DoUnpackOneFile(nameInArchive, targetPath, newFileName, seek);
+    FinishIndex(FALSE);
+    return ret;
+}
+
+BOOL CArchive::DoUnpackOneFile(const char* nameInArchive, const char* targetPath,
+                               const char* newFileName, BOOL seek)
+{
+    CALL_STACK_MESSAGE5("CArchive::DoUnpackOneFile(%s, %s, %s, %d)", nameInArchive, targetPath, newFileName, seek);
+
     // first try to detect the archive and read the first header
     Silent = 0;
-    Offset.Set(0, 0);
     SCommonHeader header;
-    int ret = ReadArchiveHeader(header, TRUE);
-    // if this is not a supported format, unpack only the outer compression when present
-    if (ret == TAR_NOTAR && Stream->IsCompressed())
-        return UnpackStream(targetPath, FALSE, nameInArchive, NULL, newFileName);
+    CQuadWord headerPos = Stream->GetDataPos();
+    CQuadWord headerOffset = Offset;
+    int ret;
+    if (seek)
+        ret = ReadArchiveHeader(header, FALSE); // the format is known from the listing
+    else
+    {
+        ret = ReadArchiveHeader(header, TRUE);
+        // if this is not a supported format, unpack only the outer compression when present
+        if (ret == TAR_NOTAR && Stream->IsCompressed())
+            return UnpackStream(targetPath, FALSE, nameInArchive, NULL, newFileName);
+    }
     if (ret != TAR_OK)
         return FALSE;
     if (header.Finished)
@@ -320,6 +409,8 @@ BOOL CArchive::UnpackOneFile(const char* nameInArchive, const CFileData* fileDat
     // we have an archive, so proceed - decode all files from the archive
     for (;;)
     {
+        if (Index != NULL && !header.Ignored)
+            Index->AddMember(header.Name, headerPos, headerOffset);
         found = !strcmp(header.Name, nameInArchive);
         // if we cannot interpret what we found, skip it; otherwise extract the file
         // What we don't support (everything except files & dirs) has zero size and Ignored set.
@@ -342,6 +433,8 @@ BOOL CArchive::UnpackOneFile(const char* nameInArchive, const CFileData* fileDat
         if (found)
             return TRUE;
         // prepare a new header for the next iteration
+        headerPos = Stream->GetDataPos();
+        headerOffset = Offset;
         if (ReadArchiveHeader(header, FALSE) != TAR_OK)
             return FALSE;
         // reached the end of the archive; finish appropriately
@@ -350,6 +443,72 @@ BOOL CArchive::UnpackOneFile(const char* nameInArchive, const CFileData* fileDat
     }
 }
 
+// moves the stream to the header of 'nameInArchive' using the index of the archive;
+// returns FALSE if the stream stays (or was returned) at the start of the archive
+BOOL CArchive::SeekToMember(const char* nameInArchive)
+{
+    CALL_STACK_MESSAGE2("CArchive::SeekToMember(%s)", nameInArchive);
+
+    if (!Indexable || !Stream->IsCompressed())
+        return FALSE;
+    if (ArchiveIndex == NULL || !ArchiveIndex->IsFor(Stream))
+    {
+        // the index may have been saved when the archive was opened before
+        CArchiveIndex* index = CArchiveIndex::Load(Stream);
+        if (index == NULL)
+            return FALSE;
+        if (ArchiveIndex != NULL)
+            delete ArchiveIndex;
+        ArchiveIndex = index;
+    }
+    const SIndexMember* member = ArchiveIndex->FindMember(nameInArchive);
+    if (member == NULL)
+        return FALSE;
+    const SCheckpoint* checkpoint = ArchiveIndex->FindCheckpoint(member->DataPos);
+    if (checkpoint == NULL || checkpoint->OutPos == CQuadWord(0, 0))
+        return FALSE; // nothing to skip, read the archive from the start
+    if (Stream->SeekCheckpoint(checkpoint))
+    {
+        // skip the data between the checkpoint and the header of the member
+        CQuadWord skip = member->DataPos - checkpoint->OutPos;
+        while (skip.Value > 0)
+        {
+            unsigned long size;
+            if (Stream->GetSpan(skip.Value > READAHEADSIZE ? READAHEADSIZE : skip.LoDWord, &size) == NULL)
+                break;
+            skip.Value -= size;
+        }
+        if (skip.Value == 0)
+        {
+            Offset = member->Offset;
+            return TRUE;
+        }
+    }
+    // something went wrong, return to the start of the archive
+    TRACE_E("CArchive::SeekToMember(): unable to use the index of " << Stream->GetArchiveName());
+    ReopenStream();
+    return FALSE;
+}
+
+// opens the archive again, so the stream is at its start; Ok is FALSE on error
+void CArchive::ReopenStream()
+{
+    CALL_STACK_MESSAGE1("CArchive::ReopenStream()");
+
+    char* fileName = _strdup(Stream->GetArchiveName());
+    delete Stream;
+    Stream = NULL;
+    Offset.Set(0, 0);
+    if (fileName != NULL)
+    {
+        // only archives starting at the start of the file are indexed (see Indexable)
+        Stream = CDecompressFile::CreateInstance(fileName, 0, CQuadWord(0, 0));
+        free(fileName);
+    }
+    if (Stream == NULL || !Stream->IsOk())
+        Ok = FALSE;
+}
+
 // extraction of selected files
 BOOL CArchive::UnpackArchive(const char* targetPath, const char* archiveRoot,
                              SalEnumSelection next, void* param)
@@ -702,8 +861,9 @@ int CArchive::WriteOutData(const SCommonHeader& header, const char* targetPath,
     size.Set(0, 0);
     while (size < header.FileInfo.Size)
     {
-        unsigned short toRead = (unsigned short)(header.FileInfo.Size - size > CQuadWord(BUFSIZE, 0) ? BUFSIZE : (header.FileInfo.Size - size).Value);
-        const unsigned char* buffer = Stream->GetBlock(toRead);
+        // write the data straight from the buffers of the stream, in as large blocks as it has
+        unsigned long toRead;
+        const unsigned char* buffer = Stream->GetSpan(header.FileInfo.Size - size > CQuadWord(READAHEADSIZE, 0) ? READAHEADSIZE : (header.FileInfo.Size - size).LoDWord, &toRead);
 
         if (buffer == NULL)
         {
@@ -1760,12 +1920,9 @@ BOOL CArchive::UnpackStream(const char* targetPath, BOOL doProgress,
     // the size field in the header may not be reliable; keep unpacking while data remains
     for (;;)
     {
-        // read an entire block
-        unsigned short read;
-        const unsigned char* buffer = Stream->GetBlock(BUFSIZE, &read);
-        // if a full block is not available, read whatever remains
-        if (buffer == NULL && read > 0)
-            buffer = Stream->GetBlock(read);
+        // take whatever the stream has decompressed
+        unsigned long read;
+        const unsigned char* buffer = Stream->GetSpan(READAHEADSIZE, &read);
         if (!Stream->IsOk())
         {
             SalamanderGeneral->ShowMessageBox(LoadErr(Stream->GetErrorCode(), Stream->GetLastErr()),
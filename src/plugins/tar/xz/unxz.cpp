@@ -0,0 +1,527 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+
+#include "../dlldefs.h"
+#include "../fileio.h"
+#include "jobpool.h"
+#include "../../7zip/7za/c/7zCrc.h"
+#include "../../7zip/7za/c/Xz.h"
+#include "../../7zip/7za/c/XzCrc64.h"
+#include "xz.h"
+
+#include "..\tar.rh"
+#include "..\tar.rh2"
+#include "..\lang\lang.rh"
+
+// the xz decoder from the 7-Zip plugin sources allocates its dictionary and buffers here
+static void* XzAllocMem(void* p, size_t size) { return malloc(size); }
+static void XzFreeMem(void* p, void* address) { free(address); }
+static ISzAlloc XzAlloc = {XzAllocMem, XzFreeMem};
+
+// prepares 'p' for decompression of 'block', defined in XzDec.c but not declared in Xz.h
+extern "C" SRes XzDec_Init(CMixCoder* p, const CXzBlock* block);
+
+// ISeekInStream reading the archive file from 'Start', used to read the index of the
+// archive from its end
+struct CXzFileStream
+{
+    ISeekInStream Stream;
+    HANDLE File;
+    CQuadWord Start;
+    CQuadWord Size;
+};
+
+static SRes XzFileRead(void* p, void* buf, size_t* size)
+{
+    CXzFileStream* s = (CXzFileStream*)p;
+    DWORD read;
+    if (!ReadFile(s->File, buf, (DWORD)min(*size, 0x40000000), &read, NULL))
+    {
+        *size = 0;
+        return SZ_ERROR_READ;
+    }
+    *size = read;
+    return SZ_OK;
+}
+
+static SRes XzFileSeek(void* p, Int64* pos, ESzSeek origin)
+{
+    CXzFileStream* s = (CXzFileStream*)p;
+    CQuadWord newPos;
+    switch (origin)
+    {
+    case SZ_SEEK_SET:
+        newPos.Value = s->Start.Value + *pos;
+        break;
+    case SZ_SEEK_END:
+        newPos.Value = s->Start.Value + s->Size.Value + *pos;
+        break;
+    default:
+    {
+        LONG hi = 0;
+        DWORD lo = SetFilePointer(s->File, 0, &hi, FILE_CURRENT);
+        if (lo == INVALID_SET_FILE_POINTER && GetLastError() != NO_ERROR)
+            return SZ_ERROR_READ;
+        newPos.Set(lo, hi);
+        newPos.Value += *pos;
+        break;
+    }
+    }
+    LONG hi = (LONG)newPos.HiDWord;
+    if (SetFilePointer(s->File, (LONG)newPos.LoDWord, &hi, FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+        GetLastError() != NO_ERROR)
+    {
+        return SZ_ERROR_READ;
+    }
+    *pos = (Int64)(newPos.Value - s->Start.Value);
+    return SZ_OK;
+}
+
+//********************************************************
+//
+//  CXzBlockJob
+//
+
+CXzBlockJob::CXzBlockJob()
+{
+    In = NULL;
+    InSize = 0;
+    Unpadded = 0;
+    Flags = 0;
+    EndPos.Set(0, 0);
+    Result = SZ_OK;
+    Out = NULL;
+    OutSize = 0;
+    OutPos = 0;
+}
+
+CXzBlockJob::~CXzBlockJob()
+{
+    if (In != NULL)
+        free(In);
+    if (Out != NULL)
+        free(Out);
+}
+
+//********************************************************
+//
+//  CXzPool
+//
+
+// decompresses the block in 'job' using 'coder'
+static SRes DecodeXzBlock(CMixCoder* coder, CXzBlockJob* job)
+{
+    unsigned long headerSize = ((unsigned long)job->In[0] << 2) + 4;
+    unsigned long checkSize = XzFlags_GetCheckSize(job->Flags);
+    if (job->In[0] == 0 || headerSize + checkSize > job->Unpadded)
+        return SZ_ERROR_ARCHIVE;
+    unsigned long packSize = job->Unpadded - headerSize - checkSize;
+
+    CXzBlock block;
+    SRes res = XzBlock_Parse(&block, job->In);
+    if (res != SZ_OK)
+        return res;
+    // the sizes in the block header are optional, but must match the index
+    if ((XzBlock_HasPackSize(&block) && block.packSize != packSize) ||
+        (XzBlock_HasUnpackSize(&block) && block.unpackSize != job->OutSize))
+    {
+        return SZ_ERROR_ARCHIVE;
+    }
+    res = XzDec_Init(coder, &block);
+    if (res != SZ_OK)
+        return res;
+
+    job->Out = (unsigned char*)malloc(max(job->OutSize, 1));
+    if (job->Out == NULL)
+        return SZ_ERROR_MEM;
+    SizeT inPos = 0;
+    SizeT outPos = 0;
+    ECoderStatus status;
+    while (TRUE)
+    {
+        SizeT inLen = packSize - inPos;
+        SizeT outLen = job->OutSize - outPos;
+        res = MixCoder_Code(coder, job->Out + outPos, &outLen, job->In + headerSize + inPos, &inLen,
+                            True, CODER_FINISH_END, &status);
+        inPos += inLen;
+        outPos += outLen;
+        if (res != SZ_OK)
+            return res;
+        if (status == CODER_STATUS_FINISHED_WITH_MARK || (inLen == 0 && outLen == 0))
+            break;
+    }
+    if (status != CODER_STATUS_FINISHED_WITH_MARK || inPos != packSize || outPos != job->OutSize)
+        return SZ_ERROR_DATA;
+
+    // the padding must be zeros, the check follows it
+    const unsigned char* check = job->In + job->InSize - checkSize;
+    const unsigned char* pad;
+    for (pad = job->In + headerSize + packSize; pad < check; pad++)
+    {
+        if (*pad != 0)
+            return SZ_ERROR_DATA;
+    }
+    CXzCheck xzCheck;
+    Byte digest[SHA256_DIGEST_SIZE]; // the longest check
+    XzCheck_Init(&xzCheck, XzFlags_GetCheckType(job->Flags));
+    XzCheck_Update(&xzCheck, job->Out, job->OutSize);
+    if (XzCheck_Final(&xzCheck, digest) && memcmp(digest, check, checkSize) != 0)
+        return SZ_ERROR_CRC;
+    return SZ_OK;
+}
+
+BOOL CXzPool::Run(void** state, CPoolJob* poolJob)
+{
+    CXzBlockJob* job = (CXzBlockJob*)poolJob;
+    CMixCoder* coder = (CMixCoder*)*state;
+    if (coder == NULL)
+    {
+        coder = (CMixCoder*)malloc(sizeof(CMixCoder));
+        if (coder == NULL)
+        {
+            job->Result = SZ_ERROR_MEM;
+            return TRUE;
+        }
+        MixCoder_Construct(coder, &XzAlloc);
+        *state = coder;
+    }
+    job->Result = DecodeXzBlock(coder, job);
+    // the compressed data is not needed any more
+    free(job->In);
+    job->In = NULL;
+    return job->Result == SZ_OK;
+}
+
+void CXzPool::FreeState(void* state)
+{
+    MixCoder_Free((CMixCoder*)state);
+    free(state);
+}
+
+//********************************************************
+//
+//  CXz
+//
+
+CXz::CXz(const char* filename, HANDLE file, unsigned char* buffer, unsigned long start, unsigned long read, CQuadWord inputSize) : CZippedFile(filename, file, buffer, start, read, inputSize), EndReached(FALSE), Unpacker(NULL), Pool(NULL), Start(start, 0), NextStream(-1), NextBlock(0), NextBlockPos(0, 0), FirstJob(0), JobsCount(0), Pending(0)
+{
+    CALL_STACK_MESSAGE2("CXz::CXz(%s, , , )", filename);
+
+    Xzs_Construct(&Streams);
+
+    // if the parent constructor failed, bail out immediately
+    if (!Ok)
+        return;
+
+    // if the "magic number" is not at the start, it is not an xz stream
+    if (DataEnd - DataStart < XZ_SIG_SIZE || memcmp(DataStart, XZ_SIG, XZ_SIG_SIZE) != 0)
+    {
+        Ok = FALSE;
+        FreeBufAndFile = FALSE;
+        return;
+    }
+    // we have xz, the header is verified by the decoder
+
+    static BOOL tablesReady = FALSE;
+    if (!tablesReady)
+    {
+        CrcGenerateTable();
+        Crc64GenerateTable();
+        tablesReady = TRUE;
+    }
+
+    // the blocks can be decompressed in parallel only when we know where they are,
+    // this needs the archive to end with the xz stream (not true for .deb members)
+    if (CQuadWord(0, 0) == inputSize && CJobPool::GetThreadsCount() > 1 && StartThreads())
+        return;
+
+    Unpacker = (CXzUnpacker*)malloc(sizeof(CXzUnpacker));
+    if (Unpacker == NULL)
+    {
+        Ok = FALSE;
+        ErrorCode = IDS_ERR_MEMORY;
+        FreeBufAndFile = FALSE;
+        return;
+    }
+    XzUnpacker_Construct(Unpacker, &XzAlloc);
+    XzUnpacker_Init(Unpacker);
+}
+
+CXz::~CXz()
+{
+    CALL_STACK_MESSAGE1("CXz::~CXz()");
+    if (Pool != NULL)
+    {
+        // the helper threads must not work on the blocks we release
+        while (JobsCount > 0)
+        {
+            Pool->Wait(Jobs[FirstJob]);
+            delete Jobs[FirstJob];
+            FirstJob = (FirstJob + 1) % XZ_MT_MAX_JOBS;
+            JobsCount--;
+        }
+        delete Pool;
+    }
+    Xzs_Free(&Streams, &XzAlloc);
+    if (Unpacker != NULL)
+    {
+        XzUnpacker_Free(Unpacker);
+        free(Unpacker);
+    }
+}
+
+// reads the index of the archive and starts the helper threads if there are more blocks
+// to decompress; returns FALSE if the stream has to be decompressed sequentially
+BOOL CXz::StartThreads()
+{
+    CALL_STACK_MESSAGE1("CXz::StartThreads()");
+
+    // the index is at the end of the archive, return to the current position afterwards
+    LONG curHi = 0;
+    DWORD curLo = SetFilePointer(File, 0, &curHi, FILE_CURRENT);
+    if (curLo == INVALID_SET_FILE_POINTER && GetLastError() != NO_ERROR)
+        return FALSE;
+
+    CXzFileStream fileStream;
+    fileStream.Stream.Read = XzFileRead;
+    fileStream.Stream.Seek = XzFileSeek;
+    fileStream.File = File;
+    fileStream.Start = Start;
+    fileStream.Size = InputSize - Start;
+    CLookToRead* lookToRead = (CLookToRead*)malloc(sizeof(CLookToRead));
+    SRes res = SZ_ERROR_MEM;
+    Int64 startOffset = -1;
+    if (lookToRead != NULL)
+    {
+        LookToRead_CreateVTable(lookToRead, False);
+        lookToRead->realStream = &fileStream.Stream;
+        LookToRead_Init(lookToRead);
+        res = Xzs_ReadBackward(&Streams, &lookToRead->s, &startOffset, NULL, &XzAlloc);
+        free(lookToRead);
+    }
+
+    // only archives made of the xz streams with multiple, not too big blocks
+    BOOL parallel = res == SZ_OK && startOffset == 0 && Xzs_GetNumBlocks(&Streams) > 1;
+    size_t i;
+    for (i = 0; parallel && i < Streams.num; i++)
+    {
+        const CXzStream* stream = &Streams.streams[i];
+        if (!XzFlags_IsSupported(stream->flags))
+            parallel = FALSE;
+        size_t j;
+        for (j = 0; parallel && j < stream->numBlocks; j++)
+        {
+            if (stream->blocks[j].unpackSize > XZ_MT_MAX_BLOCK_SIZE ||
+                stream->blocks[j].totalSize > XZ_MT_MAX_BLOCK_SIZE + XZ_MT_MAX_BLOCK_SIZE / 8)
+            {
+                parallel = FALSE;
+            }
+        }
+    }
+    if (parallel)
+    {
+        Pool = new CXzPool;
+        if (Pool != NULL && Pool->Start(CJobPool::GetThreadsCount()) == 0)
+        {
+            delete Pool;
+            Pool = NULL;
+        }
+    }
+    if (Pool == NULL)
+    {
+        if (res != SZ_OK)
+            TRACE_I("CXz::StartThreads(): unable to read the index of the archive, decompressing in one thread");
+        Xzs_Free(&Streams, &XzAlloc);
+        if (SetFilePointer(File, (LONG)curLo, &curHi, FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+            GetLastError() != NO_ERROR)
+        {
+            Ok = FALSE;
+            ErrorCode = IDS_GZERR_SEEK;
+            LastError = GetLastError();
+            FreeBufAndFile = FALSE;
+            return TRUE; // the error has to be reported
+        }
+        return FALSE;
+    }
+    NextStream = (int)Streams.num - 1;
+    NextBlock = 0;
+    NextBlockPos.SetUI64(Streams.streams[NextStream].startOffset + XZ_STREAM_HEADER_SIZE);
+    return TRUE;
+}
+
+// reads the next blocks from the archive and queues them for the helper threads
+BOOL CXz::QueueBlocks()
+{
+    while (JobsCount < 2 * Pool->GetThreads() && NextStream >= 0)
+    {
+        const CXzStream* stream = &Streams.streams[NextStream];
+        if (NextBlock == stream->numBlocks)
+        {
+            // go to the next stream, the index, footer and padding between them are skipped
+            NextStream--;
+            NextBlock = 0;
+            if (NextStream >= 0)
+                NextBlockPos.SetUI64(Streams.streams[NextStream].startOffset + XZ_STREAM_HEADER_SIZE);
+            continue;
+        }
+        const CXzBlockSizes* sizes = &stream->blocks[NextBlock];
+        if (JobsCount > 0 && Pending + sizes->unpackSize > XZ_MT_MAX_PENDING)
+            break;
+
+        CXzBlockJob* job = new CXzBlockJob;
+        if (job == NULL)
+        {
+            Ok = FALSE;
+            ErrorCode = IDS_ERR_MEMORY;
+            return FALSE;
+        }
+        job->Unpadded = (unsigned long)sizes->totalSize;
+        job->InSize = (unsigned long)((sizes->totalSize + 3) & ~(UInt64)3);
+        job->OutSize = (unsigned long)sizes->unpackSize;
+        job->Flags = stream->flags;
+        job->In = (unsigned char*)malloc(max(job->InSize, 1));
+        if (job->In == NULL)
+        {
+            delete job;
+            Ok = FALSE;
+            ErrorCode = IDS_ERR_MEMORY;
+            return FALSE;
+        }
+        CQuadWord pos = Start + NextBlockPos;
+        LONG hi = (LONG)pos.HiDWord;
+        DWORD read;
+        if ((SetFilePointer(File, (LONG)pos.LoDWord, &hi, FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+             GetLastError() != NO_ERROR) ||
+            !ReadFile(File, job->In, job->InSize, &read, NULL))
+        {
+            delete job;
+            Ok = FALSE;
+            ErrorCode = IDS_ERR_FREAD;
+            LastError = GetLastError();
+            return FALSE;
+        }
+        if (read != job->InSize)
+        {
+            delete job;
+            Ok = FALSE;
+            ErrorCode = IDS_ERR_EOF;
+            return FALSE;
+        }
+        NextBlockPos += CQuadWord(job->InSize, 0);
+        NextBlock++;
+        job->EndPos = Start + NextBlockPos;
+
+        Pool->Submit(job);
+        Jobs[(FirstJob + JobsCount) % XZ_MT_MAX_JOBS] = job;
+        JobsCount++;
+        Pending += job->OutSize;
+    }
+    return TRUE;
+}
+
+// fills the output buffer from the blocks decompressed by the helper threads
+BOOL CXz::DecompressBlocks()
+{
+    while (ExtrEnd < Window + BUFSIZE)
+    {
+        // keep the helper threads busy
+        if (!QueueBlocks())
+            return FALSE;
+        if (JobsCount == 0)
+        {
+            EndReached = TRUE;
+            return TRUE;
+        }
+        CXzBlockJob* job = Jobs[FirstJob];
+        Pool->Wait(job);
+        if (job->Result != SZ_OK)
+        {
+            SetError(job->Result);
+            return FALSE;
+        }
+        unsigned long size = min(job->OutSize - job->OutPos, (unsigned long)(Window + BUFSIZE - ExtrEnd));
+        memcpy(ExtrEnd, job->Out + job->OutPos, size);
+        ExtrEnd += size;
+        job->OutPos += size;
+        if (job->OutPos == job->OutSize)
+        {
+            StreamPos = job->EndPos; // for the progress
+            Pending -= job->OutSize;
+            delete job;
+            FirstJob = (FirstJob + 1) % XZ_MT_MAX_JOBS;
+            JobsCount--;
+        }
+    }
+    return TRUE;
+}
+
+BOOL CXz::DecompressBlock(unsigned short needed)
+{
+    if (EndReached)
+        return TRUE;
+    if (Pool != NULL)
+        return DecompressBlocks();
+    while (ExtrEnd < Window + BUFSIZE)
+    {
+        // at least one byte must already be buffered
+        if (DataEnd == DataStart && FReadBlock(0) == NULL)
+            return FALSE;
+        if (DataEnd == DataStart)
+        {
+            if (XzUnpacker_IsStreamWasFinished(Unpacker))
+            {
+                EndReached = TRUE;
+                return TRUE;
+            }
+            Ok = FALSE;
+            ErrorCode = IDS_ERR_EOF;
+            return FALSE;
+        }
+        SizeT inLen = DataEnd - DataStart;
+        SizeT outLen = Window + BUFSIZE - ExtrEnd;
+        ECoderStatus status;
+        SRes res = XzUnpacker_Code(Unpacker, ExtrEnd, &outLen, DataStart, &inLen, CODER_FINISH_ANY, &status);
+        // commit the consumed input bytes
+        FReadBlock((unsigned int)inLen);
+        ExtrEnd += outLen;
+        if (res != SZ_OK)
+        {
+            // data after the last stream (e.g. padding of the archive stored in a .deb)
+            if (res == SZ_ERROR_NO_ARCHIVE && XzUnpacker_IsStreamWasFinished(Unpacker))
+            {
+                EndReached = TRUE;
+                return TRUE;
+            }
+            SetError(res);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+void CXz::SetError(SRes res)
+{
+    Ok = FALSE;
+    switch (res)
+    {
+    case SZ_ERROR_MEM:
+        ErrorCode = IDS_ERR_MEMORY;
+        break;
+    case SZ_ERROR_CRC:
+        ErrorCode = IDS_GZERR_CRC;
+        break;
+    case SZ_ERROR_UNSUPPORTED:
+        ErrorCode = IDS_GZERR_BADMETHOD;
+        break;
+    case SZ_ERROR_DATA:
+    case SZ_ERROR_ARCHIVE:
+    case SZ_ERROR_NO_ARCHIVE:
+        ErrorCode = IDS_ERR_CORRUPT;
+        break;
+    default:
+        ErrorCode = IDS_ERR_INTERNAL;
+        break;
+    }
+}
@@ -0,0 +1,96 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// blocks bigger than this (uncompressed) are not decompressed in parallel, the whole
+// stream is then decompressed sequentially
+#define XZ_MT_MAX_BLOCK_SIZE (64 * 1024 * 1024)
+
+// the highest number of uncompressed bytes held by the blocks decompressed ahead
+#define XZ_MT_MAX_PENDING (256 * 1024 * 1024)
+
+// the highest number of blocks decompressed ahead
+#define XZ_MT_MAX_JOBS (2 * MAX_POOL_THREADS)
+
+// ****************************************************************************
+//
+// CXzBlockJob
+//
+// One xz block read from the archive and decompressed by a helper thread.
+//
+
+struct CXzBlockJob : public CPoolJob
+{
+    // input
+    unsigned char* In;       // the whole block: header, compressed data, padding and check
+    unsigned long InSize;    // size of the block including the padding
+    unsigned long Unpadded;  // size of the block without the padding (from the index)
+    CXzStreamFlags Flags;    // flags of the stream the block belongs to
+    CQuadWord EndPos;        // position of the end of the block in the archive file
+
+    // output (valid once the job is done)
+    SRes Result;
+    unsigned char* Out;      // decompressed data
+    unsigned long OutSize;
+    unsigned long OutPos;    // data already returned by CXz::DecompressBlock()
+
+    CXzBlockJob();
+    ~CXzBlockJob();
+};
+
+// ****************************************************************************
+//
+// CXzPool
+//
+// Helper threads decompressing CXzBlockJob jobs, every thread keeps its own
+// decoder (CMixCoder) for all the blocks it decompresses.
+//
+
+class CXzPool : public CJobPool
+{
+public:
+    ~CXzPool() { Stop(); }
+
+protected:
+    virtual BOOL Run(void** state, CPoolJob* job);
+    virtual void FreeState(void* state);
+};
+
+// ****************************************************************************
+//
+// CXz
+//
+// xz stream (.tar.xz, .txz, .xz). Decompressed sequentially by XzUnpacker from
+// the 7-Zip sources, or block by block in helper threads when the index at the
+// end of the archive shows more blocks (written by "xz -T" for example).
+//
+
+class CXz : public CZippedFile
+{
+public:
+    CXz(const char* filename, HANDLE file, unsigned char* buffer, unsigned long start, unsigned long read, CQuadWord inputSize);
+    virtual ~CXz();
+
+protected:
+    BOOL EndReached;         // set, when all data was extracted
+    CXzUnpacker* Unpacker;   // sequential decompression, NULL when Pool is used
+
+    CXzPool* Pool;           // parallel decompression, NULL when Unpacker is used
+    CXzs Streams;            // index of the archive, streams are in reverse order
+    CQuadWord Start;         // position of the first stream in the archive file
+    int NextStream;          // position of the next block to queue in Streams
+    size_t NextBlock;
+    CQuadWord NextBlockPos;  // position of the next block relative to Start
+    CXzBlockJob* Jobs[XZ_MT_MAX_JOBS]; // queued blocks (circular)
+    int FirstJob;
+    int JobsCount;
+    unsigned long Pending;   // uncompressed size of the queued blocks
+
+    virtual BOOL DecompressBlock(unsigned short needed);
+
+    BOOL StartThreads();
+    BOOL QueueBlocks();
+    BOOL DecompressBlocks();
+    void SetError(SRes res);
+};
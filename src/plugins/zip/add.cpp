@@ -24,6 +24,8 @@
 #include "common.h"
 #include "add_del.h"
 #include "deflate.h"
+#include "jobpool.h"
+#include "pdeflate.h"
 #include "crypt.h"
 #include "iosfxset.h"
 #include "sfxmake/sfxmake.h"
@@ -91,7 +93,11 @@ int CZipPack::PackNormal(SalEnumSelection2 next, void* param)
         ErrorID = IDS_MODIFICATION_NOT_SUPPORTED;
     if (!ErrorID)
     {
-        if (Config.BackupZip)
+        // instead of backing up an existing archive into a temporary file we try to
+        // append the new files behind it, see PrepareAppend()
+        Append = Config.BackupZip && !ZeroZip && ExtraBytes == 0;
+        AppendOffs = ZipFile->Size;
+        if (Config.BackupZip && !Append)
             ErrorID = CreateTempFile();
         else
             TempFile = ZipFile;
@@ -114,11 +120,13 @@ int CZipPack::PackNormal(SalEnumSelection2 next, void* param)
                         ErrorID = IDS_NODISPLAY;
                         UserBreak = TRUE;
                     }
+                    if (!ErrorID && !NothingToDo && Append)
+                        ErrorID = PrepareAppend();
                     if (!ErrorID && !NothingToDo)
                     {
-                        if (DelFiles.Count)
+                        if (DelFiles.Count && !Append)
                         {
-                            QuickSortHeaders(0, DelFiles.Count - 1, DelFiles);
+                            SortHeaders(0, DelFiles.Count - 1, DelFiles);
                             ProgressTotalSize = CQuadWord().SetUI64(ZipFile->Size) -
                                                 CQuadWord().SetUI64(DelFiles[0]->LocHeaderOffs) -
                                                 MatchedTotalSize -
@@ -129,12 +137,12 @@ int CZipPack::PackNormal(SalEnumSelection2 next, void* param)
                             if (Config.BackupZip)
                                 ProgressTotalSize += CQuadWord().SetUI64(DelFiles[0]->LocHeaderOffs);
                         }
-                        else if (Config.BackupZip)
+                        else if (Config.BackupZip && !Append)
                             ProgressTotalSize = CQuadWord().SetUI64(CentrDirOffs); //size of backuped file
                         else
                             ProgressTotalSize = CQuadWord(0, 0);
                         ProgressTotalSize += AddTotalSize + CQuadWord(addCount, 0);
-                        if (DelFiles.Count)
+                        if (DelFiles.Count && !Append) // when appending they were only left out of the central directory
                         {
                             int i;
                             ErrorID = DeleteFiles(&i);
@@ -142,7 +150,7 @@ int CZipPack::PackNormal(SalEnumSelection2 next, void* param)
                                 Recover();
                         }
                         else //backup zip
-                            if (Config.BackupZip)
+                            if (Config.BackupZip && !Append)
                                 ErrorID = BackupZip();
                         if (!ErrorID && !UserBreak)
                         {
@@ -157,7 +165,19 @@ int CZipPack::PackNormal(SalEnumSelection2 next, void* param)
                 if (NewCentrDir)
                     free(NewCentrDir);
             }
-            if (Config.BackupZip)
+            if (Append)
+            {
+                if (ErrorID || UserBreak)
+                    UndoAppend();
+                else
+                {
+                    if (!NothingToDo && Config.TimeToNewestFile &&
+                        NewestFileTime.dwLowDateTime != 0 && NewestFileTime.dwHighDateTime != 0)
+                        SetFileTime(ZipFile->File, NULL, NULL, &NewestFileTime);
+                    FinishAppend();
+                }
+            }
+            else if (Config.BackupZip && TempFile != ZipFile) // PrepareAppend() may have failed to create it
             {
                 if (ErrorID || UserBreak || NothingToDo)
                 {
@@ -533,6 +553,16 @@ int CZipPack::WriteEOCentrDirRecord()
     unsigned comLen = Comment ? EONewCentrDir.CommentLen : 0;
     unsigned len = 0;
 
+    if (Append)
+    {
+        // the new central directory has to be on the disk before the record pointing
+        // to it, otherwise a crash could leave a record pointing to garbage
+        if (Flush(TempFile, TempFile->OutputBuffer, TempFile->BufferPosition, NULL))
+            return IDS_NODISPLAY;
+        TempFile->BufferPosition = 0;
+        FlushFileBuffers(TempFile->File);
+    }
+
     if (NewCentrDirSize < 0xFFFFFFFF)
         EONewCentrDir.CentrDirSize = (__UINT32)NewCentrDirSize;
     else
@@ -1299,6 +1329,108 @@ int CZipPack::BackupZip()
     return ret;
 }
 
+// Appending keeps the original archive untouched: the new files, the new central
+// directory and the end of central directory record are written behind its end,
+// the replaced files are only left out of the new central directory. The space
+// left by them and by the old central directory is reclaimed when the archive is
+// rebuilt, which happens once there is too much of it or when deleting files.
+// Before anything is appended, the original size is saved to a journal file; if
+// the append is not finished (crash, power loss), RecoverAppend() truncates the
+// archive back when it is opened next time.
+int CZipPack::PrepareAppend()
+{
+    CALL_STACK_MESSAGE1("CZipPack::PrepareAppend()");
+    CFileHeader* centralHeader;
+    CFileInfo file;
+    QWORD used = 0;
+    int i;
+
+    for (centralHeader = (CFileHeader*)NewCentrDir;
+         (char*)centralHeader < NewCentrDir + NewCentrDirSize;
+         centralHeader = (CFileHeader*)((char*)centralHeader +
+                                        sizeof(CFileHeader) +
+                                        centralHeader->NameLen +
+                                        centralHeader->ExtraLen +
+                                        centralHeader->CommentLen))
+    {
+        ProcessHeader(centralHeader, &file);
+        used += sizeof(CLocalFileHeader) + centralHeader->NameLen + centralHeader->ExtraLen + file.CompSize;
+    }
+    for (i = 0; i < DelFiles.Count; i++)
+        used -= min(used, sizeof(CLocalFileHeader) + DelFiles[i]->NameLen + DelFiles[i]->CompSize);
+    if (AppendOffs - min(used, AppendOffs) > AppendOffs / 4 || !WriteAppendJournal())
+    {
+        // too much unused space or no journal, rebuild the archive through a temporary file
+        Append = false;
+        int errorID = CreateTempFile();
+        if (errorID)
+            TempFile = ZipFile;
+        return errorID;
+    }
+
+    for (i = 0; i < DelFiles.Count; i++)
+        UpdateCentrDir(DelFiles[i], NULL, 0);
+    NewCentrDirOffs = AppendOffs;
+    return 0;
+}
+
+// saves the size of the archive before appending, see RecoverAppend()
+BOOL CZipPack::WriteAppendJournal()
+{
+    CALL_STACK_MESSAGE1("CZipPack::WriteAppendJournal()");
+    char journalName[MAX_PATH + 1];
+    CAppendJournal record;
+    DWORD written;
+
+    if (!GetAppendJournalName(journalName))
+        return FALSE;
+    record.Signature = SIG_APPENDJOURNAL;
+    record.Size = AppendOffs;
+    if (!GetFileTime(ZipFile->File, NULL, NULL, &record.LastWrite))
+        return FALSE;
+    HANDLE journal = CreateFile(journalName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                FILE_ATTRIBUTE_HIDDEN | FILE_FLAG_WRITE_THROUGH, NULL);
+    if (journal == INVALID_HANDLE_VALUE)
+    {
+        TRACE_E("CZipPack::WriteAppendJournal(): unable to create " << journalName << ", error " << GetLastError());
+        return FALSE;
+    }
+    // the journal must be on the disk before the archive is changed
+    BOOL ret = WriteFile(journal, &record, sizeof(record), &written, NULL) && written == sizeof(record) &&
+               FlushFileBuffers(journal);
+    CloseHandle(journal);
+    if (!ret)
+        DeleteFile(journalName);
+    return ret;
+}
+
+// the append is complete: makes sure it is on the disk and removes the journal
+void CZipPack::FinishAppend()
+{
+    CALL_STACK_MESSAGE1("CZipPack::FinishAppend()");
+    char journalName[MAX_PATH + 1];
+    if (FlushFileBuffers(ZipFile->File) && GetAppendJournalName(journalName))
+        DeleteFile(journalName);
+}
+
+// cuts off everything appended to the archive, so it is the same as before
+void CZipPack::UndoAppend()
+{
+    CALL_STACK_MESSAGE1("CZipPack::UndoAppend()");
+    LONG distHi = HIDWORD(AppendOffs);
+    ZipFile->BufferPosition = 0;
+    if (SetFilePointer(ZipFile->File, LODWORD((DWORD)(AppendOffs & 0x00000000FFFFFFFF)), &distHi, FILE_BEGIN) == 0xFFFFFFFF &&
+            GetLastError() != NO_ERROR ||
+        !SetEndOfFile(ZipFile->File))
+    {
+        // the journal stays, RecoverAppend() tries again when the archive is opened
+        TRACE_E("CZipPack::UndoAppend(): unable to truncate the archive, error " << GetLastError());
+    }
+    else
+        FinishAppend();
+    ZipFile->RealFilePointer = AppendOffs;
+}
+
 int ReadInput(char* buffer, unsigned size, int* error, void* user)
 {
     CALL_STACK_MESSAGE2("ReadInput( , %u, , )", size);
@@ -1382,6 +1514,226 @@ int WriteOutput(char* buffer, unsigned size, void* user)
     return 0;
 }
 
+void CZipPack::StartDeflateThreads()
+{
+    CALL_STACK_MESSAGE1("CZipPack::StartDeflateThreads()");
+    DeflatePool = NULL;
+    PreDeflated = NULL;
+    int threads = CJobPool::GetThreadsCount();
+    if (Config.Level == 0 || threads < 2 || AddFiles.Count == 0)
+        return; // nothing to compress or nothing to gain
+    DeflatePool = new CDeflatePool;
+    PreDeflated = (CDeflateJob**)calloc(AddFiles.Count, sizeof(CDeflateJob*));
+    if (DeflatePool == NULL || PreDeflated == NULL || DeflatePool->Start(threads) == 0)
+    {
+        TRACE_E("CZipPack::StartDeflateThreads(): compressing in one thread");
+        if (DeflatePool != NULL)
+            delete DeflatePool;
+        if (PreDeflated != NULL)
+            free(PreDeflated);
+        DeflatePool = NULL;
+        PreDeflated = NULL;
+        return;
+    }
+    PreDeflateFirst = 0;
+    PreDeflateNext = 0;
+    PreDeflateJobs = 0;
+    PreDeflatePending = 0;
+}
+
+void CZipPack::StopDeflateThreads()
+{
+    CALL_STACK_MESSAGE1("CZipPack::StopDeflateThreads()");
+    if (DeflatePool != NULL)
+    {
+        for (; PreDeflateFirst < PreDeflateNext; PreDeflateFirst++)
+            ReleasePreDeflated(PreDeflateFirst);
+        delete DeflatePool;
+        DeflatePool = NULL;
+        free(PreDeflated);
+        PreDeflated = NULL;
+    }
+}
+
+// hands the small files following 'current' over to the helper threads, so they
+// are compressed by the time PackFiles() gets to them
+void CZipPack::PreDeflate(int current)
+{
+    CALL_STACK_MESSAGE2("CZipPack::PreDeflate(%d)", current);
+    // drop the jobs of the files PackFiles() has skipped
+    for (; PreDeflateFirst < current; PreDeflateFirst++)
+        ReleasePreDeflated(PreDeflateFirst);
+    if (PreDeflateNext < current)
+        PreDeflateNext = current;
+    int maxJobs = 4 * DeflatePool->GetThreads();
+    while (PreDeflateNext < AddFiles.Count && PreDeflateJobs < maxJobs)
+    {
+        CAddInfo* info = AddFiles[PreDeflateNext];
+        if ((info->Action == AF_ADD || info->Action == AF_OVERWRITE) && !info->IsDir &&
+            info->Size.Value > 0 && info->Size.Value < PREDEFLATE_MAX_SIZE)
+        {
+            if (PreDeflatePending + info->Size.Value > PREDEFLATE_MAX_PENDING)
+                break; // wait until PackFiles() takes some of the compressed files
+            CDeflateJob* job = new CDeflateJob;
+            if (job == NULL)
+                break;
+            job->FileName = info->Name;
+            job->Size = info->Size.Value;
+            job->Level = Config.Level;
+            // PackFiles() passes this flag to CDeflate for the file, a file which does not
+            // compress is stored only if there is no data descriptor
+            if (Options.Action & PA_MULTIVOL || Removable ||
+                (Options.Encrypt && Config.EncryptMethod == EM_ZIP20))
+            {
+                job->Flag = GPF_DATADESCR;
+            }
+            DeflatePool->Submit(job);
+            PreDeflated[PreDeflateNext] = job;
+            PreDeflateJobs++;
+            PreDeflatePending += job->Size;
+        }
+        PreDeflateNext++;
+    }
+}
+
+// returns the job of file 'index' compressed ahead or NULL if the file has to be
+// compressed now ('file' is its current state, 'flag' the flag for CDeflate)
+CDeflateJob* CZipPack::GetPreDeflated(int index, CFileInfo* file, __UINT16 flag)
+{
+    CALL_STACK_MESSAGE2("CZipPack::GetPreDeflated(%d, , )", index);
+    CDeflateJob* job = PreDeflated[index];
+    if (job == NULL)
+        return NULL;
+    DeflatePool->Wait(job);
+    if (job->Failed || job->Size != file->Size ||
+        CompareFileTime(&job->LastWrite, &file->LastWrite) != 0 ||
+        (job->Flag & GPF_DATADESCR) != (flag & GPF_DATADESCR))
+    {
+        // the file could not be read or it has changed since
+        ReleasePreDeflated(index);
+        return NULL;
+    }
+    return job;
+}
+
+void CZipPack::ReleasePreDeflated(int index)
+{
+    CDeflateJob* job = PreDeflated[index];
+    if (job != NULL)
+    {
+        DeflatePool->Wait(job);
+        PreDeflated[index] = NULL;
+        PreDeflateJobs--;
+        PreDeflatePending -= job->Size;
+        delete job;
+    }
+}
+
+// waits for a piece of the file compressed by DeflateChunks() and writes it
+static int WriteDeflatedChunk(CZipPack* pack, CDeflateJob* job, ullg* compLen,
+                              __UINT16* interAttr, __UINT16* flag)
+{
+    pack->DeflatePool->Wait(job);
+    if (job->Failed)
+        return IDS_LOWMEM;
+    if (job->DictLen == 0) // the first piece
+        *interAttr = job->InterAttr;
+    *flag |= job->Flag & (FAST | SLOW);
+    *compLen += job->OutLen;
+    return WriteOutput(job->Out, job->OutLen, pack);
+}
+
+// compresses SourFile in DEFLATE_CHUNK_SIZE pieces by the helper threads: the file
+// is read here, every piece is compressed with the previous WSIZE bytes as its
+// dictionary and the pieces are written in order as one deflate stream
+int CZipPack::DeflateChunks(ullg* compLen, __UINT16* interAttr, __UINT16* flag)
+{
+    CALL_STACK_MESSAGE1("CZipPack::DeflateChunks(, , )");
+    CDeflateJob* jobs[2 * MAX_POOL_THREADS]; // pieces being compressed, in file order
+    int maxJobs = 2 * DeflatePool->GetThreads();
+    int first = 0;
+    int count = 0;
+    CDeflateJob* prev = NULL;
+    BOOL eof = FALSE;
+    int errorID = 0;
+
+    *compLen = 0;
+    while (!eof && !errorID)
+    {
+        if (count == maxJobs)
+        {
+            // make room by writing the oldest piece (never 'prev', maxJobs >= 2)
+            errorID = WriteDeflatedChunk(this, jobs[first], compLen, interAttr, flag);
+            delete jobs[first];
+            first = (first + 1) % maxJobs;
+            count--;
+            if (errorID)
+                break;
+        }
+        CDeflateJob* job = new CDeflateJob;
+        if (job != NULL)
+            job->Data = (char*)malloc(WSIZE + DEFLATE_CHUNK_SIZE);
+        if (job == NULL || job->Data == NULL)
+        {
+            if (job != NULL)
+                delete job;
+            errorID = IDS_LOWMEM;
+            break;
+        }
+        job->Level = Config.Level;
+        if (prev != NULL)
+        {
+            unsigned prevLen = prev->DictLen + prev->DataLen;
+            job->DictLen = min(prevLen, WSIZE);
+            memcpy(job->Data, prev->Data + prevLen - job->DictLen, job->DictLen);
+        }
+        while (job->DataLen < DEFLATE_CHUNK_SIZE)
+        {
+            int error = 0;
+            int read = ReadInput(job->Data + job->DictLen + job->DataLen,
+                                 DEFLATE_CHUNK_SIZE - job->DataLen, &error, this);
+            if (error)
+            {
+                errorID = error;
+                break;
+            }
+            if (read == 0 || read == EOF)
+            {
+                eof = TRUE;
+                break;
+            }
+            job->DataLen += read;
+        }
+        if (errorID || job->DataLen == 0)
+        {
+            delete job;
+            break;
+        }
+        DeflatePool->Submit(job);
+        jobs[(first + count) % maxJobs] = job;
+        count++;
+        prev = job;
+    }
+    // write the remaining pieces, after an error just wait for them
+    while (count > 0)
+    {
+        if (!errorID)
+            errorID = WriteDeflatedChunk(this, jobs[first], compLen, interAttr, flag);
+        else
+            DeflatePool->Wait(jobs[first]);
+        delete jobs[first];
+        first = (first + 1) % maxJobs;
+        count--;
+    }
+    if (!errorID)
+    {
+        char lastBlock[] = DEFLATE_LAST_BLOCK;
+        errorID = WriteOutput(lastBlock, DEFLATE_LAST_BLOCK_SIZE, this);
+        *compLen += DEFLATE_LAST_BLOCK_SIZE;
+    }
+    return errorID;
+}
+
 int CZipPack::PackFiles()
 {
     CALL_STACK_MESSAGE1("CZipPack::PackFiles()");
@@ -1432,8 +1784,11 @@ int CZipPack::PackFiles()
         writePos = ArchiveDataOffs;
     else
         writePos = /*EONewCentrDir.*/ NewCentrDirOffs;
+    StartDeflateThreads();
     for (i = 0; i < AddFiles.Count && !errorID && !UserBreak; i++)
     {
+        if (DeflatePool != NULL)
+            PreDeflate(i);
         next = AddFiles[i];
         if (next->Action != AF_ADD && next->Action != AF_OVERWRITE)
             continue;
@@ -1710,8 +2065,26 @@ int CZipPack::PackFiles()
             {
                 ullg size = 0;
                 int method = next->Method;
-                errorID = defObj->Deflate(&next->InterAttr, &method, Config.Level, &next->Flag,
-                                          &size, WriteOutput, ReadInput, this);
+                CDeflateJob* job = DeflatePool != NULL ? GetPreDeflated(i, &file, next->Flag) : NULL;
+                if (job != NULL)
+                {
+                    // the file was already compressed by a helper thread
+                    if (Salamander->ProgressAddSize((int)job->Size, TRUE))
+                        errorID = WriteOutput(job->Out, job->OutLen, this);
+                    else
+                        errorID = IDS_USERBREAK;
+                    size = job->OutLen;
+                    method = job->Method;
+                    next->InterAttr = job->InterAttr;
+                    next->Flag |= job->Flag & (FAST | SLOW);
+                    Crc = job->Crc;
+                    ReleasePreDeflated(i);
+                }
+                else if (DeflatePool != NULL && file.Size >= PREDEFLATE_MAX_SIZE)
+                    errorID = DeflateChunks(&size, &next->InterAttr, &next->Flag);
+                else
+                    errorID = defObj->Deflate(&next->InterAttr, &method, Config.Level, &next->Flag,
+                                              &size, WriteOutput, ReadInput, this);
                 file.CompSize = size;
                 switch (errorID)
                 {
@@ -1790,6 +2163,7 @@ int CZipPack::PackFiles()
         file.Name = NULL;
         UserBreak = !Salamander->ProgressAddSize(1, TRUE);
     }
+    StopDeflateThreads();
     if (!errorID && !UserBreak)
         /*EONewCentrDir.*/ NewCentrDirOffs = writePos;
     free(buffer);
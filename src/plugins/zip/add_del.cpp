@@ -162,7 +162,11 @@ int CZipPack::DeleteFromArchive(SalEnumSelection next, void* param)
         ErrorID = IDS_MODIFICATION_NOT_SUPPORTED;
     if (!ErrorID)
     {
-        if (Config.BackupZip)
+        // the deleted files are only left out of a new central directory written behind
+        // the archive, unless PrepareAppend() decides to rebuild it
+        Append = Config.BackupZip && ExtraBytes == 0;
+        AppendOffs = ZipFile->Size;
+        if (Config.BackupZip && !Append)
             ErrorID = CreateTempFile();
         else
             TempFile = ZipFile;
@@ -186,7 +190,7 @@ int CZipPack::DeleteFromArchive(SalEnumSelection next, void* param)
                         ErrorID = CZipCommon::MatchFiles(DelFiles, delNames, dirs, NewCentrDir);
                         if (!ErrorID && DelFiles.Count)
                         {
-                            QuickSortHeaders(0, DelFiles.Count - 1, DelFiles);
+                            SortHeaders(0, DelFiles.Count - 1, DelFiles);
                             ProgressTotalSize = CQuadWord().SetUI64(ZipFile->Size) -
                                                 CQuadWord().SetUI64(DelFiles[0]->LocHeaderOffs) -
                                                 MatchedTotalSize -
@@ -194,15 +198,20 @@ int CZipPack::DeleteFromArchive(SalEnumSelection next, void* param)
                                                 CQuadWord().SetUI64(CentrDirSize) -
                                                 CQuadWord(sizeof(CEOCentrDirRecord), 0) -
                                                 CQuadWord(EOCentrDir.CommentLen, 0);
-                            if (Config.BackupZip)
-                                ProgressTotalSize += CQuadWord().SetUI64(DelFiles[0]->LocHeaderOffs);
                             //Salamander->ProgressSetTotalSize(0, AssumedDelProgress);
                             bool exist;
                             if (RootLen && !Config.NoEmptyDirs)
                                 ErrorID = CountFilesInRoot(&filesInRoot, &exist);
+                            if (!ErrorID && Append)
+                                ErrorID = PrepareAppend();
+                            if (!ErrorID && Config.BackupZip && !Append)
+                                ProgressTotalSize += CQuadWord().SetUI64(DelFiles[0]->LocHeaderOffs);
                             if (!ErrorID)
                             {
-                                ErrorID = DeleteFiles(&filesDeleted);
+                                if (Append)
+                                    filesDeleted = DelFiles.Count; // PrepareAppend() left them out of the central directory
+                                else
+                                    ErrorID = DeleteFiles(&filesDeleted);
                                 if (ErrorID && !Config.BackupZip)
                                     Recover();
                                 if (!ErrorID && (!UserBreak || UserBreak && !Config.BackupZip))
@@ -268,7 +277,20 @@ int CZipPack::DeleteFromArchive(SalEnumSelection next, void* param)
                     }
                 }
             }
-            if (Config.BackupZip)
+            if (Append)
+            {
+                if (ErrorID || UserBreak)
+                    UndoAppend();
+                else
+                {
+                    // WriteCentrDir() found the newest of the remaining files, as when rebuilding the archive
+                    if (Config.TimeToNewestFile &&
+                        NewestFileTime.dwLowDateTime != 0 && NewestFileTime.dwHighDateTime != 0)
+                        SetFileTime(ZipFile->File, NULL, NULL, &NewestFileTime);
+                    FinishAppend();
+                }
+            }
+            else if (Config.BackupZip && TempFile != ZipFile) // PrepareAppend() may have failed to create it
             {
                 if (ErrorID || UserBreak)
                 {
@@ -44,6 +44,9 @@ struct CAddInfo
 
 typedef TIndirectArray2<char> TIndirectArray2_char_;
 
+class CDeflatePool;
+struct CDeflateJob;
+
 enum CSfxSettingsComments
 {
     SFX_COMMENT_HEAD,
@@ -102,6 +105,8 @@ public:
     CExtendedOptions Options;
     bool RecoverOK;
     FILETIME NewestFileTime;
+    bool Append;      // new files are appended behind the original archive instead of rebuilding it
+    QWORD AppendOffs; // size of the original archive, the appended data start here
 
     //multi-volume archives
     bool OverwriteAll;
@@ -113,6 +118,14 @@ public:
     QWORD ArchiveDataOffs;
     BOOL SeccondPass;
 
+    //multi-threaded compression (see pdeflate.h)
+    CDeflatePool* DeflatePool; // NULL = files are compressed only in the calling thread
+    CDeflateJob** PreDeflated; // files compressed ahead, indexed as AddFiles
+    int PreDeflateFirst;       // the first file which may have a job in PreDeflated
+    int PreDeflateNext;        // the next file to be considered for compressing ahead
+    int PreDeflateJobs;        // number of jobs in PreDeflated
+    QWORD PreDeflatePending;   // total size of files in PreDeflated
+
     //delete from archive
 
     CZipPack(const char* zipName, const char* zipRoot,
@@ -126,6 +139,9 @@ public:
         NewestFileTime.dwLowDateTime = 0;
         NewestFileTime.dwHighDateTime = 0;
         SeccondPass = FALSE;
+        DeflatePool = NULL;
+        PreDeflated = NULL;
+        Append = false;
     }
 
     ~CZipPack()
@@ -158,7 +174,17 @@ public:
     int LoadCentralDirectory();
     int MatchFiles(int& count); // count is the expected number of files after the operation
     int BackupZip();
+    int PrepareAppend();
+    BOOL WriteAppendJournal();
+    void FinishAppend();
+    void UndoAppend();
     int PackFiles();
+    void StartDeflateThreads();
+    void StopDeflateThreads();
+    void PreDeflate(int current);
+    CDeflateJob* GetPreDeflated(int index, CFileInfo* file, __UINT16 flag);
+    void ReleasePreDeflated(int index);
+    int DeflateChunks(ullg* compLen, __UINT16* interAttr, __UINT16* flag);
     int FinishPack(int reason = FPR_NORMAL);
     int GetDirInfo(const char* name, DWORD* attr, FILETIME* lastWrite);
     int IsDirectoryEmpty(const char* name);
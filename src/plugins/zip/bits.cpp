@@ -34,20 +34,23 @@ const uch _bl_order[BL_CODES] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3,
  * the desired pack level (0..9). The values given below have been tuned to
  * exclude worst case performance for pathological files. Better values may be
  * found for specific files.
+ * Levels 1 to 5 and 8 were retuned for the multiplicative hash: higher nice
+ * and lazy values at levels 1 to 5 gain 0.1-1% of ratio at the same speed,
+ * the shorter chain at level 8 is about 25% faster for 0.07% of ratio.
  */
 const config _configuration_table[10] =
     {
         /*      good lazy nice chain */
         /* 0 */ {0, 0, 0, 0}, /* store only */
-        /* 1 */ {4, 4, 8, 4}, /* maximum speed, no lazy matches */
-        /* 2 */ {4, 5, 16, 8},
-        /* 3 */ {4, 6, 32, 32},
+        /* 1 */ {4, 4, 16, 4}, /* maximum speed, no lazy matches */
+        /* 2 */ {4, 5, 32, 8},
+        /* 3 */ {4, 8, 32, 32},
 
-        /* 4 */ {4, 4, 16, 16}, /* lazy matches */
-        /* 5 */ {8, 16, 32, 32},
+        /* 4 */ {4, 6, 32, 16}, /* lazy matches */
+        /* 5 */ {8, 16, 64, 32},
         /* 6 */ {8, 16, 128, 128},
         /* 7 */ {8, 32, 128, 256},
-        /* 8 */ {32, 128, 258, 1024},
+        /* 8 */ {32, 128, 258, 512},
         /* 9 */ {32, 258, 258, 4096} /* maximum compression */
 };
 
@@ -117,10 +120,39 @@ int CDeflate::Deflate(ush* internAttr, int* compMethod, int compLevel,
         ReadData = readFunc;
         Flag = *flag;
         level = compLevel;
+        chunk = 0;
         //encrypted = *flag & GPF_ENCRYPTED ? true  : false;
         bi_init();
         ct_init(internAttr, compMethod);
-        lm_init(level, flag);
+        lm_init(level, flag, NULL, 0);
+        *compLen = deflate();
+        return 0;
+    }
+    catch (int errorID)
+    {
+        return errorID;
+    }
+}
+
+int CDeflate::DeflateChunk(ush* internAttr, int compLevel, ush* flag, const char* dict,
+                           unsigned dictLen, ullg* compLen, FWriteData writeFunc,
+                           FReadData readFunc, void* userData)
+{
+#ifdef ZIP_DLL
+    CALL_STACK_MESSAGE3("CDeflate::DeflateChunk( , %d, , , %u, , , , )", compLevel, dictLen);
+#endif //ZIP_DLL
+    int method = DEFLATE;
+    try
+    {
+        UserData = userData;
+        WriteData = writeFunc;
+        ReadData = readFunc;
+        Flag = *flag;
+        level = compLevel;
+        chunk = 1;
+        bi_init();
+        ct_init(internAttr, &method);
+        lm_init(level, flag, dict, dictLen);
         *compLen = deflate();
         return 0;
     }
@@ -146,21 +178,17 @@ void CDeflate::bi_init() /* output zip file, NULL for in-memory compression */
 void CDeflate::send_bits(int value,  /* value to send */
                          int length) /* number of bits */
 {
-    /* If not enough room in bi_buf, use (valid) bits from bi_buf and
-     * (16 - bi_valid) bits from value, leaving (width - (16-bi_valid))
-     * unused bits in value.
+    /* Append the value to bi_buf and write its lowest Buf_size bits once
+     * there are enough of them; bi_valid < Buf_size on entry, so bi_buf
+     * can't overflow.
      */
-    if (bi_valid > (int)Buf_size - length)
-    {
-        bi_buf |= (value << bi_valid);
-        PUTSHORT(bi_buf);
-        bi_buf = (ush)value >> (Buf_size - bi_valid);
-        bi_valid += length - Buf_size;
-    }
-    else
+    bi_buf |= (ullg)(unsigned)value << bi_valid;
+    bi_valid += length;
+    if (bi_valid >= (int)Buf_size)
     {
-        bi_buf |= value << bi_valid;
-        bi_valid += length;
+        PUTLONG(bi_buf);
+        bi_buf >>= Buf_size;
+        bi_valid -= Buf_size;
     }
 }
 
@@ -211,13 +239,15 @@ void CDeflate::flush_outbuf(unsigned w,     /* value to flush */
  */
 void CDeflate::bi_windup()
 {
-    if (bi_valid > 8)
+    while (bi_valid > 8)
     {
-        PUTSHORT(bi_buf);
+        PUTSHORT((ush)bi_buf);
+        bi_buf >>= 16;
+        bi_valid -= 16;
     }
-    else if (bi_valid > 0)
+    if (bi_valid > 0)
     {
-        PUTBYTE(bi_buf);
+        PUTBYTE((uch)bi_buf);
     }
     flush_outbuf(0, 0);
     bi_buf = 0;
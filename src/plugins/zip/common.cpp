@@ -261,16 +261,23 @@ CZipCommon::CZipCommon(const char* zipName, const char* zipRoot,
     Comment = NULL;
     Unix = FALSE;
     ArchiveVolumes = archiveVolumes;
+    CentrDirMapping = NULL;
+    CentrDirView = NULL;
+    CentrDirData = NULL;
+    CentrDirMapSize = 0;
 
     DWORD ret = GetCurrentDirectory(MAX_PATH + 1, OriginalCurrentDir);
     if (!ret || ret > MAX_PATH + 1)
         *OriginalCurrentDir = 0;
+
+    RecoverAppend();
 }
 
 CZipCommon::~CZipCommon()
 {
     CALL_STACK_MESSAGE1("CZipCommon::~CZipCommon()");
 
+    UnmapCentralDirectory();
     if (ZipFile)
         CloseCFile(ZipFile);
     if (*OriginalCurrentDir)
@@ -319,6 +326,91 @@ int CZipCommon::CheckZip()
     return ErrorID;
 }
 
+BOOL CZipCommon::GetAppendJournalName(char* journalName)
+{
+    if (lstrlen(ZipName) + lstrlen(APPEND_JOURNAL_EXT) > MAX_PATH)
+        return FALSE;
+    lstrcpy(journalName, ZipName);
+    lstrcat(journalName, APPEND_JOURNAL_EXT);
+    return TRUE;
+}
+
+// returns TRUE if the archive ends with an end of central directory record written
+// by the append, i.e. the append was finished and only the journal was not deleted
+static BOOL IsAppendFinished(HANDLE file, QWORD size, QWORD originalSize)
+{
+    unsigned tail = (unsigned)min(size - originalSize, 64 * 1024 + sizeof(CEOCentrDirRecord));
+    char* buffer = (char*)malloc(tail);
+    if (buffer == NULL)
+        return TRUE; // rather keep the archive as it is
+    QWORD pos = size - tail;
+    LONG posHi = HIDWORD(pos);
+    DWORD read;
+    BOOL ret = FALSE;
+    if ((SetFilePointer(file, LODWORD(pos), &posHi, FILE_BEGIN) != 0xFFFFFFFF || GetLastError() == NO_ERROR) &&
+        ReadFile(file, buffer, tail, &read, NULL) && read == tail)
+    {
+        int i;
+        for (i = (int)tail - (int)sizeof(CEOCentrDirRecord); i >= 0 && !ret; i--)
+        {
+            CEOCentrDirRecord* record = (CEOCentrDirRecord*)(buffer + i);
+            ret = record->Signature == SIG_EOCENTRDIR &&
+                  i + sizeof(CEOCentrDirRecord) + record->CommentLen == tail &&
+                  (record->CentrDirOffs == 0xFFFFFFFF || record->CentrDirOffs >= originalSize);
+        }
+    }
+    free(buffer);
+    return ret;
+}
+
+void CZipCommon::RecoverAppend()
+{
+    CALL_STACK_MESSAGE1("CZipCommon::RecoverAppend()");
+    char journalName[MAX_PATH + 1];
+    if (!GetAppendJournalName(journalName))
+        return;
+    HANDLE journal = CreateFile(journalName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, NULL);
+    if (journal == INVALID_HANDLE_VALUE)
+        return; // no append was interrupted
+    CAppendJournal record;
+    DWORD read;
+    BOOL valid = ReadFile(journal, &record, sizeof(record), &read, NULL) && read == sizeof(record) &&
+                 record.Signature == SIG_APPENDJOURNAL;
+    CloseHandle(journal);
+    if (valid)
+    {
+        // while the append runs the archive is open without FILE_SHARE_WRITE, so we cannot
+        // truncate an append that is still in progress
+        HANDLE file = CreateFile(ZipName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            TRACE_I("CZipCommon::RecoverAppend(): unable to open " << ZipName << ", error " << GetLastError());
+            return; // try again next time
+        }
+        CQuadWord size;
+        DWORD err;
+        if (SalamanderGeneral->SalGetFileSize(file, size, err) && size.Value > record.Size &&
+            !IsAppendFinished(file, size.Value, record.Size))
+        {
+            LONG distHi = HIDWORD(record.Size);
+            if (SetFilePointer(file, LODWORD(record.Size), &distHi, FILE_BEGIN) == 0xFFFFFFFF &&
+                    GetLastError() != NO_ERROR ||
+                !SetEndOfFile(file))
+            {
+                TRACE_E("CZipCommon::RecoverAppend(): unable to truncate " << ZipName << ", error " << GetLastError());
+                CloseHandle(file);
+                return;
+            }
+            SetFileTime(file, NULL, NULL, &record.LastWrite);
+            TRACE_I("CZipCommon::RecoverAppend(): interrupted append to " << ZipName << " was undone");
+        }
+        CloseHandle(file);
+    }
+    DeleteFile(journalName);
+}
+
 int CZipCommon::Read(CFile* file, void* buffer, unsigned bytesToRead,
                      unsigned* bytesRead, bool* skipAll)
 {
@@ -1251,6 +1343,95 @@ int CZipCommon::ReadCentralHeader(CFileHeader* fileHeader, LPQWORD offset,
     return 0;
 }
 
+void CZipCommon::MapCentralDirectory()
+{
+    CALL_STACK_MESSAGE1("CZipCommon::MapCentralDirectory()");
+    if (CentrDirData || MultiVol || ZeroZip || !CentrDirSize)
+        return;
+
+    // the view must start on allocation granularity boundary; it reaches to the end
+    // of file so that damaged CentrDirSize behaves the same as with ReadCentralHeader
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    QWORD start = CentrDirOffs + ExtraBytes;
+    if (start >= ZipFile->Size)
+        return;
+    QWORD viewOffs = start - start % si.dwAllocationGranularity;
+    QWORD viewSize = ZipFile->Size - viewOffs;
+    if (viewSize > (SIZE_T)-1)
+        return; // does not fit to address space (32-bit version)
+
+    // copy-on-write pages: ProcessHeader() may modify the header
+    CentrDirMapping = CreateFileMapping(ZipFile->File, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (CentrDirMapping)
+    {
+        CentrDirView = (char*)MapViewOfFile(CentrDirMapping, FILE_MAP_COPY, DWORD(viewOffs >> 32),
+                                            DWORD(viewOffs), (SIZE_T)viewSize);
+        if (CentrDirView)
+        {
+            CentrDirData = CentrDirView + (start - viewOffs);
+            CentrDirMapSize = ZipFile->Size - start;
+            return;
+        }
+        CloseHandle(CentrDirMapping);
+        CentrDirMapping = NULL;
+    }
+    TRACE_I("Unable to map central directory, error " << GetLastError());
+}
+
+void CZipCommon::UnmapCentralDirectory()
+{
+    CALL_STACK_MESSAGE1("CZipCommon::UnmapCentralDirectory()");
+    if (CentrDirView)
+        UnmapViewOfFile(CentrDirView);
+    if (CentrDirMapping)
+        CloseHandle(CentrDirMapping);
+    CentrDirMapping = NULL;
+    CentrDirView = NULL;
+    CentrDirData = NULL;
+    CentrDirMapSize = 0;
+}
+
+int CZipCommon::GetCentralHeader(CFileHeader* buffer, CFileHeader** fileHeader,
+                                 LPQWORD offset, unsigned int* size)
+{
+    CALL_STACK_MESSAGE_NONE
+    if (!CentrDirData)
+    {
+        *fileHeader = buffer;
+        return ReadCentralHeader(buffer, offset, size);
+    }
+    // same checks as in ReadCentralHeader, but without copying the data
+    QWORD pos = *offset - (CentrDirOffs + ExtraBytes);
+    if (pos + sizeof(CFileHeader) > CentrDirMapSize)
+    {
+        Fatal = true;
+        return IDS_EOF;
+    }
+    CFileHeader* header = (CFileHeader*)(CentrDirData + pos);
+    if (header->Signature != SIG_CENTRFH)
+    {
+        Fatal = true;
+        return IDS_MISSCHSIG;
+    }
+    unsigned s = sizeof(CFileHeader) + header->NameLen + header->ExtraLen + header->CommentLen;
+    if (s > MAX_HEADER_SIZE)
+    {
+        Fatal = true;
+        return IDS_ERRFORMAT;
+    }
+    if (pos + s > CentrDirMapSize)
+    {
+        Fatal = true;
+        return IDS_EOF;
+    }
+    *fileHeader = header;
+    *offset += s;
+    if (size)
+        *size = s;
+    return 0;
+}
+
 // macro that makes reading extra headers more readable
 #define NEXT(t) *(t*)((char*)fileHeader + (iterator += sizeof(t), iterator - sizeof(t)))
 
@@ -1603,6 +1784,20 @@ void CZipCommon::SplitPath(char** path, char** name, const char* pathToSplit)
 
 #define ITEM_LH_OFFSET(i) (((CFileInfo*)(*headersArray)[i])->LocHeaderOffs)
 
+void CZipCommon::SortHeaders(int left, int right, TIndirectArray2<CFileInfo>& headers)
+{
+    CALL_STACK_MESSAGE_NONE
+    int i;
+    for (i = left; i < right; i++)
+    {
+        if (headers[i]->LocHeaderOffs > headers[i + 1]->LocHeaderOffs)
+        {
+            QuickSortHeaders(left, right, headers);
+            return;
+        }
+    }
+}
+
 void CZipCommon::QuickSortHeaders(int left, int right, TIndirectArray2<CFileInfo>& headers)
 {
     CALL_STACK_MESSAGE_NONE
@@ -1815,6 +2010,7 @@ int CZipCommon::MatchFiles(TIndirectArray2<CFileInfo>& files, TIndirectArray2<CE
 {
     CALL_STACK_MESSAGE1("CZipCommon::MatchFiles(, , )");
     CFileHeader* centralHeader = NULL;
+    CFileHeader* headerBuffer = NULL; // for reading the headers from the file
     char* tempName = NULL;
     int tempNameLen;
     CFileInfo* fileInfo = NULL;
@@ -1825,12 +2021,12 @@ int CZipCommon::MatchFiles(TIndirectArray2<CFileInfo>& files, TIndirectArray2<CE
     DWORD pathFlag = Unix ? 0 : NORM_IGNORECASE;
 
     if (!centrDir)
-        centralHeader = (CFileHeader*)malloc(MAX_HEADER_SIZE);
+        headerBuffer = (CFileHeader*)malloc(MAX_HEADER_SIZE);
     tempName = (char*)malloc(MAX_HEADER_SIZE);
-    if ((!centralHeader && !centrDir) || !tempName)
+    if ((!headerBuffer && !centrDir) || !tempName)
     {
-        if (centralHeader && !centrDir)
-            free(centralHeader);
+        if (headerBuffer)
+            free(headerBuffer);
         if (tempName)
             free(tempName);
         return IDS_LOWMEM;
@@ -1844,6 +2040,8 @@ int CZipCommon::MatchFiles(TIndirectArray2<CFileInfo>& files, TIndirectArray2<CE
         errorID = ChangeDisk();
     }
     QuickSortNames(0, namesArray.Count - 1, namesArray, Unix != 0);
+    if (!centrDir)
+        MapCentralDirectory();
 
     int cnt;
     for (cnt = 0; readSize < CentrDirSize && !errorID; cnt++)
@@ -1867,7 +2065,7 @@ int CZipCommon::MatchFiles(TIndirectArray2<CFileInfo>& files, TIndirectArray2<CE
                     centralHeader->CommentLen;
         }
         else
-            errorID = ReadCentralHeader(centralHeader, &readOffset, &s);
+            errorID = GetCentralHeader(headerBuffer, &centralHeader, &readOffset, &s);
         if (errorID)
             break;
         readSize += s;
@@ -1938,7 +2136,10 @@ int CZipCommon::MatchFiles(TIndirectArray2<CFileInfo>& files, TIndirectArray2<CE
     }
 
     if (!centrDir)
-        free(centralHeader);
+    {
+        UnmapCentralDirectory();
+        free(headerBuffer);
+    }
     free(tempName);
     return errorID;
 }
@@ -25,17 +25,24 @@ extern CSalamanderGUIAbstract* SalamanderGUI;
 
 #define INIT_CRC 0L
 
-// used in CFileData.PluginData
+// used in CFileData.PluginData; fixed-size record, the records of a listing are stored
+// in blocks owned by its CPluginDataInterface (see CZIPFileDataArray)
 class CZIPFileData
 {
 public:
-    CZIPFileData(QWORD qwPackedSize, int nItem, BOOL bUnix) : PackedSize(qwPackedSize), ItemNumber(nItem), Unix(bUnix) {}
+    CZIPFileData(QWORD qwPackedSize, int nItem, QWORD qwHeaderOffs, BOOL bUnix) : PackedSize(qwPackedSize), HeaderOffs(qwHeaderOffs), ItemNumber(nItem), Unix(bUnix) {}
 
     QWORD PackedSize;
-    int ItemNumber; // # of item in Cetral Directory, not offset
+    QWORD HeaderOffs; // offset of item's header from the start of Central Directory
+    int ItemNumber;   // # of item in Cetral Directory, not offset
     BOOL Unix;
 };
 
+// number of CZIPFileData records allocated at once
+#define ZIPFILEDATA_BLOCK 4096
+
+typedef TDirectArray2<CZIPFileData> CZIPFileDataArray;
+
 struct CExtInfo
 {
     LPTSTR Name;
@@ -198,6 +205,13 @@ public:
 
     TIndirectArray2<char>* ArchiveVolumes;
 
+    // central directory mapped to memory (see MapCentralDirectory()), NULL if it is read
+    // from the file through ReadCentralHeader()
+    HANDLE CentrDirMapping;
+    char* CentrDirView;    // start of the view (aligned to allocation granularity)
+    char* CentrDirData;    // start of the central directory inside the view
+    QWORD CentrDirMapSize; // number of bytes available from CentrDirData
+
     CZipCommon(const char* zipName, const char* zipRoot,
                CSalamanderForOperationsAbstract* salamander,
                TIndirectArray2<char>* archiveVolumes);
@@ -206,6 +220,13 @@ public:
 
     int CheckZip();
 
+    // returns the name of the journal of an append to the archive (see CAppendJournal),
+    // FALSE if it is too long
+    BOOL GetAppendJournalName(char* journalName);
+    // if an append to the archive was interrupted (crash, power loss), cuts the appended
+    // data off so that the original end of central directory record is at the end again
+    void RecoverAppend();
+
     //file IO
     int Read(CFile* file, void* buffer, unsigned bytesToRead,
              unsigned* bytesRead, bool* skipAll);
@@ -227,6 +248,13 @@ public:
     int FindZip64EOCentrDirLocator();
     int CheckForExtraBytes();
     int ReadCentralHeader(CFileHeader* fileHeader, LPQWORD offset, unsigned int* size);
+    // maps central directory of a read-only opened single volume archive to memory,
+    // on failure the headers are read from the file as before
+    void MapCentralDirectory();
+    void UnmapCentralDirectory();
+    // like ReadCentralHeader, but returns pointer into the mapped central directory
+    // if it is available, otherwise reads the header into 'buffer' and returns it
+    int GetCentralHeader(CFileHeader* buffer, CFileHeader** fileHeader, LPQWORD offset, unsigned int* size);
     void ProcessHeader(CFileHeader* fileHeader, CFileInfo* fileInfo);
     bool IsDirByHeader(CFileHeader* fileHeader);
     int ProcessName(CFileHeader* fileHeader, char* outputName);
@@ -235,6 +263,9 @@ public:
                             CFileInfo* fileInfo, CAESExtraField* aesExtraField);
     void SplitPath(char** path, char** name, const char* pathToSplit);
     void QuickSortHeaders(int left, int right, TIndirectArray2<CFileInfo>& headers);
+    // sorts 'headers' by the offsets of local headers, skips the sorting if they are in
+    // this order already (files matched in the order of central directory usually are)
+    void SortHeaders(int left, int right, TIndirectArray2<CFileInfo>& headers);
     int EnumFiles(TIndirectArray2<CExtInfo>& namesArray, int& dirs, SalEnumSelection next, void* param);
     int MatchFiles(TIndirectArray2<CFileInfo>& files, TIndirectArray2<CExtInfo>& namesArray, int dirs, char* centrDir);
     /*HWND GetParent()
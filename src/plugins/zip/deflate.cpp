@@ -5,6 +5,7 @@
 #include <crtdbg.h>
 #include <ostream>
 #include <commctrl.h>
+#include <intrin.h>
 
 #ifdef ZIP_DLL
 #include "spl_base.h"
@@ -24,10 +25,13 @@
  *    MIN_LOOKAHEAD bytes (to avoid referencing memory beyond the end
  *    of window[] when looking for matches towards the end).
  */
-void CDeflate::lm_init(int pack_level, /* 0: store, 1: best speed, 9: best compression */
-                       ush* flagbits)  /* general purpose bit flag */
+void CDeflate::lm_init(int pack_level,   /* 0: store, 1: best speed, 9: best compression */
+                       ush* flagbits,    /* general purpose bit flag */
+                       const char* dict, /* input preceding the new data or NULL */
+                       unsigned dictLen) /* length of dict, at most WSIZE */
 {
     unsigned j;
+    IPos hash_head;
     int errorID = 0;
 
     if (pack_level < 1 || pack_level > 9)
@@ -83,15 +87,22 @@ void CDeflate::lm_init(int pack_level, /* 0: store, 1: best speed, 9: best compr
     }
     /* ??? reduce max_chain_length for binary files */
 
-    strstart = 0;
-    block_start = 0L;
+    /* The dictionary is placed at the start of the window, so matches
+     * can reach back into it, and the new data follow it.
+     */
+    if (dict == NULL || dictLen > WSIZE)
+        dictLen = 0;
+    if (dictLen > 0)
+        memcpy((char*)window, dict, dictLen);
+    strstart = dictLen;
+    block_start = (long)dictLen;
 
     j = WSIZE;
 #ifndef MAXSEG_64K
     if (sizeof(int) > 2)
         j <<= 1; /* Can read 64K in one step */
 #endif
-    lookahead = ReadData((char*)window, j, &errorID, UserData);
+    lookahead = ReadData((char*)window + dictLen, j - dictLen, &errorID, UserData);
     if (errorID)
         Error(errorID);
 
@@ -107,12 +118,9 @@ void CDeflate::lm_init(int pack_level, /* 0: store, 1: best speed, 9: best compr
     if (lookahead < MIN_LOOKAHEAD)
         fill_window();
 
-    ins_h = 0;
-    for (j = 0; j < MIN_MATCH - 1; j++)
-        UPDATE_HASH(ins_h, window[j]);
-    /* If lookahead < MIN_MATCH, ins_h is garbage, but this is
-     * not important since only literal bytes will be emitted.
-     */
+    /* Insert all strings of the dictionary in the hash table. */
+    for (j = 0; j < dictLen; j++)
+        INSERT_STRING(j, hash_head);
 }
 
 /* ===========================================================================
@@ -144,6 +152,27 @@ void CDeflate::lm_free()
  *   string (strstart) and its distance is <= MAX_DIST, and prev_length >= 1
  */
 
+/* ===========================================================================
+ * Return the number of equal bytes at the beginning of two 8 byte words,
+ * diff is their xor and must not be zero (x86 and x64 are little endian).
+ */
+static __forceinline int first_diff_byte(ullg diff)
+{
+    unsigned long bit;
+#ifdef _WIN64
+    _BitScanForward64(&bit, diff);
+    return (int)(bit >> 3);
+#else
+    if ((ulg)diff != 0)
+    {
+        _BitScanForward(&bit, (ulg)diff);
+        return (int)(bit >> 3);
+    }
+    _BitScanForward(&bit, (ulg)(diff >> 32));
+    return 4 + (int)(bit >> 3);
+#endif
+}
+
 /* For 80x86 and 680x0 and ARM, an optimized version is in match.asm or
  * match.S. The code is functionally equivalent, so you can use the C version
  * if desired.
@@ -241,24 +270,24 @@ error:
 
         /* The check at best_len-1 can be removed because it will be made
          * again later. (This heuristic is not always a win.)
-         * It is not necessary to compare scan[2] and match[2] since they
-         * are always equal when the other bytes match, given that
-         * the hash keys are equal and that HASH_BITS >= 8.
+         * Compare 8 bytes at a time from strstart+2 up to strstart+257,
+         * MAX_MATCH-2 is a multiple of 8, so the last word ends exactly at
+         * strend and nothing beyond window+strstart+MIN_LOOKAHEAD is read.
          */
         scan += 2, match++;
 
-        /* We check for insufficient lookahead only every 8th comparison;
-         * the 256th check will be made at strstart+258.
-         */
         do
         {
-        } while (*++scan == *++match && *++scan == *++match &&
-                 *++scan == *++match && *++scan == *++match &&
-                 *++scan == *++match && *++scan == *++match &&
-                 *++scan == *++match && *++scan == *++match &&
-                 scan < strend);
+            ullg diff = *(ullg far*)scan ^ *(ullg far*)match;
+            if (diff != 0)
+            {
+                scan += first_diff_byte(diff);
+                break;
+            }
+            scan += 8, match += 8;
+        } while (scan < strend);
 
-        Assert(scan <= window + (unsigned)(window_size - 1), "wild scan");
+        Assert(scan <= strend, "wild scan");
 
         len = MAX_MATCH - (int)(strend - scan);
         scan = strend - MAX_MATCH;
@@ -447,11 +476,6 @@ ullg CDeflate::deflate_fast()
             {
                 strstart += match_length;
                 match_length = 0;
-                ins_h = window[strstart];
-                UPDATE_HASH(ins_h, window[strstart + 1]);
-#if MIN_MATCH != 3
-                Call UPDATE_HASH() MIN_MATCH - 3 more times
-#endif
             }
         }
         else
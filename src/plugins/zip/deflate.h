@@ -6,6 +6,10 @@
 typedef int (*FWriteData)(char*, unsigned, void*);
 typedef int (*FReadData)(char*, unsigned, int*, void*);
 
+// an empty final block with static trees, it terminates the outputs of CDeflate::DeflateChunk()
+#define DEFLATE_LAST_BLOCK "\x03\x00"
+#define DEFLATE_LAST_BLOCK_SIZE 2
+
 // deflate error codes
 // 0 success
 // 1 bad pack level
@@ -62,9 +66,9 @@ typedef int (*FReadData)(char*, unsigned, int*, void*);
 
 //********* BITS ************
 
-#define Buf_size (8 * 2 * sizeof(char))
-/* Number of bits used within bi_buf. (bi_buf might be implemented on
- * more than 16 bits on some systems.)
+#define Buf_size (8 * 4 * sizeof(char))
+/* Number of bits written from bi_buf at once. bi_buf has 64 bits, so
+ * a code of up to 16 bits always fits in it next to Buf_size-1 pending bits.
  */
 
 /* Output a 16 bit value to the bit stream, lower (oldest) byte first */
@@ -81,6 +85,23 @@ typedef int (*FReadData)(char*, unsigned, int*, void*);
         } \
     }
 
+/* Output the lower 32 bits of l to the bit stream, lower (oldest) byte first;
+ * x86 and x64 are little endian, so a single store does it.
+ */
+#define PUTLONG(l) \
+    { \
+        if (out_offset + 4 <= out_size) \
+        { \
+            *(ulg*)(out_buf + out_offset) = (ulg)(l); \
+            out_offset += 4; \
+        } \
+        else \
+        { \
+            PUTSHORT((ush)(l)); \
+            PUTSHORT((ush)((l) >> 16)); \
+        } \
+    }
+
 #define PUTBYTE(b) \
     { \
         if (out_offset < out_size) \
@@ -299,13 +320,6 @@ typedef unsigned IPos;
  * save space in the various tables. IPos is used only for parameter passing.
  */
 
-#define H_SHIFT ((HASH_BITS + MIN_MATCH - 1) / MIN_MATCH)
-/* Number of bits by which ins_h and del_h must be shifted at each
- * input step. It must be such that after MIN_MATCH steps, the oldest
- * byte no longer takes part in the hash key, that is:
- *   H_SHIFT * MIN_MATCH >= HASH_BITS
- */
-
 #define max_insert_length max_lazy_match
 /* Insert new strings in the hash table only if the match length
  * is not greater than this length. This saves time but degrades compression.
@@ -328,25 +342,28 @@ typedef struct config
 /* result of memcmp for equal strings */
 
 /* ===========================================================================
- * Update a hash value with the given input byte
- * IN  assertion: all calls to to UPDATE_HASH are made with consecutive
- *    input characters, so that a running hash key can be computed from the
- *    previous key instead of complete recalculation each time.
+ * Compute the hash key of the MIN_MATCH bytes at window index s. The bytes
+ * are multiplied by a large odd constant and the top HASH_BITS bits of the
+ * product are taken, which spreads the keys much better than the old rolling
+ * shift and xor hash did (shorter chains, mainly on binary data). The key
+ * does not depend on the previous one, so strings need not be inserted at
+ * consecutive positions. An equal key no longer implies an equal third byte,
+ * longest_match() compares it anyway.
+ * IN  assertion: window[s .. s+3] are readable, the fourth byte is masked out.
  */
-#define UPDATE_HASH(h, c) (h = (((h) << H_SHIFT) ^ (c)) & HASH_MASK)
+#define HASH_KEY(s) \
+    (((*(ulg far*)&window[s] & 0xffffff) * 0x9e3779b1) >> (32 - HASH_BITS))
 
 /* ===========================================================================
  * Insert string s in the dictionary and set match_head to the previous head
- * of the hash chain (the most recent string with same hash key). Return
- * the previous length of the hash chain.
- * IN  assertion: all calls to to INSERT_STRING are made with consecutive
- *    input characters and the first MIN_MATCH bytes of s are valid
- *    (except for the last MIN_MATCH-1 bytes of the input file).
+ * of the hash chain (the most recent string with same hash key).
+ * IN  assertion: the first MIN_MATCH bytes of s are valid (except for the
+ *    last MIN_MATCH-1 bytes of the input file, where the key is garbage).
  */
 #define INSERT_STRING(s, match_head) \
-    (UPDATE_HASH(ins_h, window[(s) + (MIN_MATCH - 1)]), \
+    (ins_h = HASH_KEY(s), \
      prev[(s) & WMASK] = match_head = head[ins_h], \
-     head[ins_h] = (s))
+     head[ins_h] = (Pos)(s))
 
 /* ===========================================================================
  * Flush the current block, with given end-of-file flag.
@@ -432,7 +449,7 @@ class CDeflate
      * Local data used by the "bit string" routines.
      */
 
-    unsigned short bi_buf;
+    ullg bi_buf;
     /* Output buffer. bits are inserted starting at the bottom (least significant
      * bits).
      */
@@ -442,7 +459,7 @@ class CDeflate
      * are always zero.
      */
 
-    char file_outbuf[1024];
+    char file_outbuf[16384];
     /* Output buffer for compression to file */
 
     char *in_buf, *out_buf;
@@ -931,8 +948,10 @@ class CDeflate
      *    window_size is sufficient to contain the whole input file plus
      *    MIN_LOOKAHEAD bytes (to avoid referencing memory beyond the end
      *    of window[] when looking for matches towards the end).
+     * 'dict' (dictLen bytes, at most WSIZE) is the input preceding the new
+     *    data, it is only used to find matches (see DeflateChunk()).
      */
-    void lm_init(int pack_level, ush* flagbits);
+    void lm_init(int pack_level, ush* flagbits, const char* dict, unsigned dictLen);
 
     /* ===========================================================================
      * Free the window and hash table
@@ -983,6 +1002,7 @@ class CDeflate
     FReadData ReadData;
     //bool        encrypted;
     ush Flag;
+    int chunk; /* the input is a piece of a longer input (see DeflateChunk()) */
 
 public:
     CDeflate();
@@ -996,4 +1016,13 @@ public:
     int Deflate(ush* internAttr, int* compMethod, int compLevel,
                 ush* flag, ullg* compLen, FWriteData writeFunc,
                 FReadData readFunc, void* userData);
+
+    // compresses one piece of a longer input so that the pieces can be compressed
+    // independently (e.g. in several threads) and their outputs concatenated: 'dict'
+    // (dictLen bytes, at most WSIZE) is the input preceding this piece, the output
+    // contains no final block and ends on a byte boundary with an empty stored block;
+    // the concatenated outputs must be terminated by DEFLATE_LAST_BLOCK
+    int DeflateChunk(ush* internAttr, int compLevel, ush* flag, const char* dict,
+                     unsigned dictLen, ullg* compLen, FWriteData writeFunc,
+                     FReadData readFunc, void* userData);
 };
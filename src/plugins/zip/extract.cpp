@@ -23,10 +23,13 @@
 #include "lang\lang.rh"
 #include "extract.h"
 #include "inflate.h"
+#include "jobpool.h"
+#include "pinflate.h"
 #include "explode.h"
 #include "unshrink.h"
 #include "unreduce.h"
 #include "unbzip2.h"
+#include "unlzma.h"
 #include "crypt.h"
 #include "add_del.h"
 #include "dialogs.h"
@@ -49,6 +52,9 @@ CZipUnpack::CZipUnpack(const char* zipName, const char* zipRoot, CSalamanderForO
     Test = false;
     AllocateWholeFile = true;
     TestAllocateWholeFile = true;
+    InflatePool = NULL;
+    PreInflated = NULL;
+    PreInflatedFile = NULL;
 }
 
 int CZipUnpack::UnpackArchive(const char* targetDir, SalEnumSelection next, void* param)
@@ -101,13 +107,13 @@ int CZipUnpack::UnpackArchive(const char* targetDir, SalEnumSelection next, void
                             right = i;
                             i++;
                         }
-                        QuickSortHeaders(left, right, extrFiles);
+                        SortHeaders(left, right, extrFiles);
                         left = ++right;
                     }
                 }
                 else
                 {
-                    QuickSortHeaders(0, extrFiles.Count - 1, extrFiles);
+                    SortHeaders(0, extrFiles.Count - 1, extrFiles);
                 }
                 if (*OriginalCurrentDir)
                     SetCurrentDirectory(targetDir);
@@ -142,7 +148,7 @@ int CZipUnpack::UnpackOneFile(const char* nameInZip, const CFileData* fileData,
     ErrorID = CheckZip();
     if (!ErrorID && !ZeroZip)
     {
-        ErrorID = FindFile(nameInZip, &fileInfo, zipFileData->ItemNumber);
+        ErrorID = FindFile(nameInZip, &fileInfo, zipFileData->ItemNumber, zipFileData->HeaderOffs);
         if (!ErrorID)
         {
             lstrcpy(targetDir, targetPath);
@@ -254,13 +260,13 @@ int CZipUnpack::UnpackWholeArchive(const char* mask, const char* targetDir)
                             right = i;
                             i++;
                         }
-                        QuickSortHeaders(left, right, extrFiles);
+                        SortHeaders(left, right, extrFiles);
                         left = ++right;
                     }
                 }
                 else
                 {
-                    QuickSortHeaders(0, extrFiles.Count - 1, extrFiles);
+                    SortHeaders(0, extrFiles.Count - 1, extrFiles);
                 }
                 if (*OriginalCurrentDir && !Test)
                     SetCurrentDirectory(targetDir);
@@ -272,7 +278,7 @@ int CZipUnpack::UnpackWholeArchive(const char* mask, const char* targetDir)
     return ErrorID;
 }
 
-int CZipUnpack::FindFile(LPCTSTR name, CFileInfo* fileInfo, int nItem)
+int CZipUnpack::FindFile(LPCTSTR name, CFileInfo* fileInfo, int nItem, QWORD headerOffs)
 {
     CALL_STACK_MESSAGE2("CZipUnpack::FindFile(%s, )", name);
     CFileHeader* centralHeader;
@@ -295,13 +301,20 @@ int CZipUnpack::FindFile(LPCTSTR name, CFileInfo* fileInfo, int nItem)
     }
     readOffset = CentrDirOffs + ExtraBytes;
     readSize = 0;
+    int i = 0;
     if (DiskNum != CentrDirStartDisk && MultiVol)
     {
         DiskNum = CentrDirStartDisk;
         errorID = ChangeDisk();
     }
-    int i;
-    for (i = 0; readSize < CentrDirSize && !errorID; i++)
+    if (!MultiVol && headerOffs < CentrDirSize)
+    {
+        // jump directly to the header of the item, no need to read all previous headers
+        readOffset += headerOffs;
+        readSize = headerOffs;
+        i = nItem;
+    }
+    for (; i <= nItem && readSize < CentrDirSize && !errorID; i++)
     {
         unsigned int s;
 
@@ -432,14 +445,16 @@ int CZipUnpack::MatchFilesToMask(TIndirectArray2<char>& maskArray)
         DiskNum = CentrDirStartDisk;
         errorID = ChangeDisk();
     }
+    MapCentralDirectory();
     for (; readSize < CentrDirSize && !errorID;)
     {
         unsigned int s;
-        errorID = ReadCentralHeader(centralHeader, &readOffset, &s);
+        CFileHeader* header;
+        errorID = GetCentralHeader(centralHeader, &header, &readOffset, &s);
         if (errorID)
             break;
         readSize += s;
-        tempNameLen = ProcessName(centralHeader, tempName);
+        tempNameLen = ProcessName(header, tempName);
         sour = tempName + tempNameLen;
         hasExtension = false;
         while (sour >= tempName && *sour != '\\')
@@ -456,7 +471,7 @@ int CZipUnpack::MatchFilesToMask(TIndirectArray2<char>& maskArray)
                     errorID = IDS_LOWMEM;
                     break;
                 }
-                ProcessHeader(centralHeader, fileInfo);
+                ProcessHeader(header, fileInfo);
                 fileInfo->NameLen = tempNameLen;
                 fileInfo->Name = (char*)malloc(tempNameLen + 1);
                 if (!fileInfo->Name)
@@ -477,6 +492,7 @@ int CZipUnpack::MatchFilesToMask(TIndirectArray2<char>& maskArray)
             }
         }
     }
+    UnmapCentralDirectory();
     free(centralHeader);
     free(tempName);
     return errorID;
@@ -680,6 +696,137 @@ int CZipUnpack::InflateFile(CFileInfo* fileInfo, BOOL deflate64, int* errorID)
     return exitCode;
 }
 
+// writes the file decompressed ahead by a helper thread (PreInflatedFile), returns
+// the same results as InflateFile()
+int CZipUnpack::WritePreInflated(CFileInfo* fileInfo, int* errorID)
+{
+    CALL_STACK_MESSAGE1("CZipUnpack::WritePreInflated(, )");
+    CInflateJob* job = PreInflatedFile;
+    int exitCode = DEC_NOERROR;
+
+    Crc = job->Crc;
+    if (!Test)
+        OutputError = Write(OutputFile, job->Out, (unsigned)job->OutLen, &SkipAllIOErrors);
+    else
+    {
+        ExtractedBytes += job->OutLen;
+        OutputError = 0;
+    }
+    if (!OutputError)
+    {
+        // the same as ExtractFlush(), user break is handled by the caller
+        if (!Salamander->ProgressAddSize((int)job->OutLen, TRUE))
+            UserBreak = true;
+    }
+    else
+    {
+        switch (OutputError)
+        {
+        case ERR_SKIP:
+            exitCode = DEC_SKIP;
+            break;
+        case ERR_CANCEL:
+            exitCode = DEC_CANCEL;
+            *errorID = IDS_NODISPLAY;
+        }
+    }
+    return exitCode;
+}
+
+void CZipUnpack::StartInflateThreads()
+{
+    CALL_STACK_MESSAGE1("CZipUnpack::StartInflateThreads()");
+    InflatePool = NULL;
+    PreInflated = NULL;
+    PreInflatedFile = NULL;
+    int threads = CJobPool::GetThreadsCount();
+    if (MultiVol || threads < 2 || ExtrFiles->Count < 2)
+        return; // the volumes are read only by ExtractFiles() or nothing to gain
+    InflatePool = new CInflatePool(ZipName);
+    PreInflated = (CInflateJob**)calloc(ExtrFiles->Count, sizeof(CInflateJob*));
+    if (InflatePool == NULL || PreInflated == NULL || InflatePool->Start(threads) == 0)
+    {
+        TRACE_E("CZipUnpack::StartInflateThreads(): decompressing in one thread");
+        if (InflatePool != NULL)
+            delete InflatePool;
+        if (PreInflated != NULL)
+            free(PreInflated);
+        InflatePool = NULL;
+        PreInflated = NULL;
+        return;
+    }
+    PreInflateFirst = 0;
+    PreInflateNext = 0;
+    PreInflateJobs = 0;
+    PreInflatePending = 0;
+}
+
+void CZipUnpack::StopInflateThreads()
+{
+    CALL_STACK_MESSAGE1("CZipUnpack::StopInflateThreads()");
+    if (InflatePool != NULL)
+    {
+        for (; PreInflateFirst < PreInflateNext; PreInflateFirst++)
+            ReleasePreInflated(PreInflateFirst);
+        delete InflatePool;
+        InflatePool = NULL;
+        free(PreInflated);
+        PreInflated = NULL;
+    }
+}
+
+// hands the small deflated files following 'current' over to the helper threads,
+// so they are decompressed by the time ExtractFiles() gets to them; encrypted files
+// are left to ExtractFiles() which asks for the password
+void CZipUnpack::PreInflate(int current)
+{
+    CALL_STACK_MESSAGE2("CZipUnpack::PreInflate(%d)", current);
+    // drop the jobs of the files ExtractFiles() has skipped
+    for (; PreInflateFirst < current; PreInflateFirst++)
+        ReleasePreInflated(PreInflateFirst);
+    if (PreInflateNext < current)
+        PreInflateNext = current;
+    int maxJobs = 4 * InflatePool->GetThreads();
+    while (PreInflateNext < ExtrFiles->Count && PreInflateJobs < maxJobs)
+    {
+        CFileInfo* fileInfo = (*ExtrFiles)[PreInflateNext];
+        if (!fileInfo->IsDir && !(fileInfo->Flag & GPF_ENCRYPTED) &&
+            (fileInfo->Method == CM_DEFLATED || fileInfo->Method == CM_DEFLATE64) &&
+            fileInfo->Size > 0 && fileInfo->Size <= PREINFLATE_MAX_SIZE &&
+            fileInfo->CompSize > 0 && fileInfo->CompSize <= PREINFLATE_MAX_SIZE)
+        {
+            if (PreInflatePending + fileInfo->Size > PREINFLATE_MAX_PENDING)
+                break; // wait until ExtractFiles() takes some of the decompressed files
+            CInflateJob* job = new CInflateJob;
+            if (job == NULL)
+                break;
+            job->LocHeaderOffs = fileInfo->LocHeaderOffs;
+            job->CompSize = fileInfo->CompSize;
+            job->Size = fileInfo->Size;
+            job->Deflate64 = fileInfo->Method == CM_DEFLATE64;
+            job->KeepData = !Test;
+            InflatePool->Submit(job);
+            PreInflated[PreInflateNext] = job;
+            PreInflateJobs++;
+            PreInflatePending += job->Size;
+        }
+        PreInflateNext++;
+    }
+}
+
+void CZipUnpack::ReleasePreInflated(int index)
+{
+    CInflateJob* job = PreInflated[index];
+    if (job != NULL)
+    {
+        InflatePool->Wait(job);
+        PreInflated[index] = NULL;
+        PreInflateJobs--;
+        PreInflatePending -= job->Size;
+        delete job;
+    }
+}
+
 void CZipUnpack::InflateFreeFixedHufman()
 {
     CALL_STACK_MESSAGE1("CZipUnpack::InflateFreeFixedHufman()");
@@ -1155,6 +1302,94 @@ int CZipUnpack::UnBZIP2File(CFileInfo* fileInfo, int* errorID)
     return exitCode;
 }
 
+int CZipUnpack::UnLZMAFile(CFileInfo* fileInfo, int* errorID)
+{
+    CALL_STACK_MESSAGE1("CZipUnpack::UnLZMAFile(, )");
+    CDecompressionObject decompress;
+    COutputManager output;
+    CInputManager input;
+    int ret, exitCode = DEC_NOERROR;
+
+    memset(&decompress, 0, sizeof(decompress));
+    ZipFile->FilePointer = fileInfo->DataOffset;
+    BytesLeft = fileInfo->CompSize;
+    if (Encrypted)
+        BytesLeft -= AESContextValid ? SAL_AES_SALT_LENGTH(AESContext.mode) + SAL_AES_PWD_VER_LENGTH + AES_MAXHMAC : ENCRYPT_HEADER_SIZE;
+    decompress.CompBytesLeft = BytesLeft;
+    Crc = INIT_CRC;
+    input.NextByte = (__UINT8*)InputBuffer;
+    input.BytesLeft = 0;
+    input.Error = 0;
+    input.Refill = Refill;
+    output.SlideWin = (__UINT8*)SlideWindow;
+    output.WinSize = WinSize;
+    output.Flush = ExtractFlush;
+    decompress.Input = &input;
+    decompress.Output = &output;
+    decompress.UserData = this;
+    decompress.ucsize = fileInfo->Size;
+    switch (ret = UnLZMA(&decompress))
+    {
+    case 1:
+    {
+        if (decompress.Input->Error == IDS_EOF ||
+            decompress.Input->Error == IDS_MACERROR)
+        {
+            switch (ProcessError(
+                decompress.Input->Error == IDS_MACERROR ? IDS_MACERROR : IDS_ERRCOMPDATA,
+                0, FileNameDisp,
+                PE_NORETRY | DialogFlags, &SkipAllDataErr))
+            {
+            case ERR_SKIP:
+                exitCode = DEC_SKIP;
+                break;
+            case ERR_CANCEL:
+                exitCode = DEC_CANCEL;
+                *errorID = IDS_NODISPLAY;
+            }
+        }
+        else
+        {
+            exitCode = DEC_CANCEL;
+            *errorID = decompress.Input->Error;
+        }
+        break;
+    }
+
+    case 2:
+    {
+        switch (OutputError)
+        {
+        case ERR_SKIP:
+            exitCode = DEC_SKIP;
+            break;
+        case ERR_CANCEL:
+            exitCode = DEC_CANCEL;
+            *errorID = IDS_NODISPLAY;
+            break;
+        }
+        break;
+    }
+    case 3: // Out of memory
+    case 4: // Error uncompressing LZMA stream
+        switch (ProcessError(
+            ret == 3 ? IDS_LOWMEM : IDS_ERRCOMPDATA,
+            0, FileNameDisp,
+            PE_NORETRY | DialogFlags, &SkipAllDataErr))
+        {
+        case ERR_SKIP:
+            exitCode = DEC_SKIP;
+            break;
+        case ERR_CANCEL:
+            exitCode = DEC_CANCEL;
+            *errorID = IDS_NODISPLAY;
+            break;
+        }
+        break;
+    }
+    return exitCode;
+}
+
 int CZipUnpack::ExtractSingleFile(char* targetDir, int targetDirLen,
                                   CFileInfo* fileInfo, BOOL* success, const char* newFileName)
 {
@@ -1518,10 +1753,16 @@ int CZipUnpack::ExtractSingleFile(char* targetDir, int targetDirLen,
                             switch (fileInfo->Method)
                             {
                             case CM_DEFLATE64:
-                                result = InflateFile(fileInfo, TRUE, &errorID);
+                                if (PreInflatedFile != NULL)
+                                    result = WritePreInflated(fileInfo, &errorID);
+                                else
+                                    result = InflateFile(fileInfo, TRUE, &errorID);
                                 break;
                             case CM_DEFLATED:
-                                result = InflateFile(fileInfo, FALSE, &errorID);
+                                if (PreInflatedFile != NULL)
+                                    result = WritePreInflated(fileInfo, &errorID);
+                                else
+                                    result = InflateFile(fileInfo, FALSE, &errorID);
                                 break;
                             case CM_STORED:
                                 result = UnStoreFile(fileInfo, &errorID);
@@ -1541,6 +1782,9 @@ int CZipUnpack::ExtractSingleFile(char* targetDir, int targetDirLen,
                             case CM_BZIP2:
                                 result = UnBZIP2File(fileInfo, &errorID);
                                 break;
+                            case CM_LZMA:
+                                result = UnLZMAFile(fileInfo, &errorID);
+                                break;
                             default:
                             {
                                 switch (ProcessError(IDS_BADMETHOD, 0, FileNameDisp,
@@ -1714,8 +1958,12 @@ int CZipUnpack::ExtractFiles(const char* targetDir)
         Silent = 0;
         ProgressTotalSize += CQuadWord(ExtrFiles->Count, 0);
         Salamander->ProgressDialogAddText(LoadStr(Test ? IDS_TESTFILES : IDS_EXTRACTFILES), FALSE);
+        if (!errorID)
+            StartInflateThreads();
         for (i = 0; i < ExtrFiles->Count && !errorID && !UserBreak; i++)
         {
+            if (InflatePool != NULL)
+                PreInflate(i);
             fileInfo = (*ExtrFiles)[i];
             if (tempDirLen + 1 + fileInfo->NameLen - RootLen - (RootLen ? 1 : 0) >=
                 (DWORD)(Test ? ZIP_MAX_PATH : MAX_PATH - (fileInfo->IsDir ? 12 : 0)))
@@ -1737,7 +1985,14 @@ int CZipUnpack::ExtractFiles(const char* targetDir)
             {
                 Salamander->ProgressSetTotalSize(CQuadWord().SetUI64(fileInfo->Size), ProgressTotalSize);
                 BOOL ok;
+                if (InflatePool != NULL && PreInflated[i] != NULL)
+                {
+                    InflatePool->Wait(PreInflated[i]);
+                    if (!PreInflated[i]->Failed) // otherwise decompress it again to report the error
+                        PreInflatedFile = PreInflated[i];
+                }
                 errorID = ExtractSingleFile(tempDir, tempDirLen, fileInfo, &ok);
+                PreInflatedFile = NULL;
                 if (!ok)
                     AllFilesOK = FALSE; // for archive testing
                 UserBreak = !Salamander->ProgressAddSize(1, TRUE);
@@ -1745,6 +2000,7 @@ int CZipUnpack::ExtractFiles(const char* targetDir)
             else
                 UserBreak = true;
         }
+        StopInflateThreads();
         InflateFreeFixedHufman();
     }
     /*
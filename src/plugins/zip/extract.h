@@ -14,6 +14,9 @@ int ExtractFiles(const char *targetDir, CExtractInfo *info);
 int ExtractSingleFile(char * targetDir, int targetDirLen,
                       CFileInfo * fileInfo, CExtractInfo * info);
 */
+class CInflatePool;
+struct CInflateJob;
+
 class CZipUnpack : public CZipCommon
 {
 public:
@@ -64,6 +67,15 @@ public:
     unsigned OutBufSize;
     bool Unshrinking;
 
+    //multi-threaded decompression (see pinflate.h)
+    CInflatePool* InflatePool;    // NULL = files are decompressed only in the calling thread
+    CInflateJob** PreInflated;    // files decompressed ahead, indexed as ExtrFiles
+    CInflateJob* PreInflatedFile; // the file being extracted if it was decompressed ahead
+    int PreInflateFirst;          // the first file which may have a job in PreInflated
+    int PreInflateNext;           // the next file to be considered for decompressing ahead
+    int PreInflateJobs;           // number of jobs in PreInflated
+    QWORD PreInflatePending;      // total size of files in PreInflated
+
     CZipUnpack(const char* zipName, const char* zipRoot, CSalamanderForOperationsAbstract* salamander,
                TIndirectArray2<char>* archiveVolumes);
 
@@ -81,16 +93,22 @@ public:
 
     //int EnumFiles(CDynamicArray * namesArray, SalEnumSelection next, void * param);
     //int MatchFiles(CDynamicArray *namesArray);
-    int FindFile(LPCTSTR name, CFileInfo* fileInfo, int nItem);
+    int FindFile(LPCTSTR name, CFileInfo* fileInfo, int nItem, QWORD headerOffs);
     int PrepareMaskArray(TIndirectArray2<char>& maskArray, const char* masks);
     int MatchFilesToMask(TIndirectArray2<char>& maskArray);
     int InflateFile(CFileInfo* fileInfo, BOOL deflate64, int* errorID);
+    int WritePreInflated(CFileInfo* fileInfo, int* errorID);
+    void StartInflateThreads();
+    void StopInflateThreads();
+    void PreInflate(int current);
+    void ReleasePreInflated(int index);
     void InflateFreeFixedHufman();
     int UnStoreFile(CFileInfo* fileInfo, int* errorID);
     int ExplodeFile(CFileInfo* fileInfo, int* errorID);
     int UnShrinkFile(CFileInfo* fileInfo, int* errorID);
     int UnReduceFile(CFileInfo* fileInfo, int* errorID);
     int UnBZIP2File(CFileInfo* fileInfo, int* errorID);
+    int UnLZMAFile(CFileInfo* fileInfo, int* errorID);
     int ExtractFiles(const char* targetDir);
     int ExtractSingleFile(char* targetDir, int targetDirLen,
                           CFileInfo* fileInfo, BOOL* success, const char* newFileName = NULL);
@@ -25,7 +25,7 @@
 #include "common.h"
 #include "list.h"
 
-int CZipList::ListArchive(CSalamanderDirectoryAbstract* dir, BOOL& haveFiles)
+int CZipList::ListArchive(CSalamanderDirectoryAbstract* dir, CZIPFileDataArray* fileData, BOOL& haveFiles)
 {
     CALL_STACK_MESSAGE1("CZipList::ListArchive( )");
     int ret;
@@ -41,11 +41,11 @@ int CZipList::ListArchive(CSalamanderDirectoryAbstract* dir, BOOL& haveFiles)
             return ErrorID = IDS_NODISPLAY;
     ErrorID = CheckZip();
     if (!ErrorID)
-        return ErrorID = List(dir, haveFiles);
+        return ErrorID = List(dir, fileData, haveFiles);
     return ErrorID;
 }
 
-int CZipList::List(CSalamanderDirectoryAbstract* dir, BOOL& haveFiles)
+int CZipList::List(CSalamanderDirectoryAbstract* dir, CZIPFileDataArray* fileData, BOOL& haveFiles)
 {
     CALL_STACK_MESSAGE1("CZipList::List()");
     CFileHeader* centralHeader;
@@ -71,6 +71,8 @@ int CZipList::List(CSalamanderDirectoryAbstract* dir, BOOL& haveFiles)
         //      free(pathBuf);
         return IDS_LOWMEM;
     }
+    // huge archives: walk the central directory in place instead of copying every header
+    MapCentralDirectory();
 
 START_LIST:
     // TRACE_I("zip listing started");
@@ -94,22 +96,25 @@ START_LIST:
         for (readSize = 0; readSize < CentrDirSize; cnt++)
         {
             unsigned int s;
-            int err = ReadCentralHeader(centralHeader, &readOffset, &s);
+            CFileHeader* header;
+            int err = GetCentralHeader(centralHeader, &header, &readOffset, &s);
             if (err)
             {
                 errorID = err;
                 break;
             }
+            QWORD headerOffs = readSize;
             readSize += s;
-            if (centralHeader->Version >> 8 == HS_UNIX && !Unix)
+            if (header->Version >> 8 == HS_UNIX && !Unix)
             {
                 Unix = TRUE;
                 dir->Clear(NULL);
+                fileData->Destroy();
                 dir->SetFlags(SALDIRFLAG_CASESENSITIVE);
                 goto START_LIST;
             }
-            int fileInfoNameLen = ProcessName(centralHeader, fileInfo.Name);
-            ProcessHeader(centralHeader, &fileInfo);
+            int fileInfoNameLen = ProcessName(header, fileInfo.Name);
+            ProcessHeader(header, &fileInfo);
             //      path = pathBuf;
             //      SplitPath(&path, &name, fileInfo.Name);
             // j.r. optimization instead of SplitPath
@@ -147,13 +152,13 @@ START_LIST:
             file.LastWrite = fileInfo.LastWrite;
             file.DosName = NULL;
             file.Hidden = file.Attr & FILE_ATTRIBUTE_HIDDEN ? 1 : 0;
-            file.PluginData = (DWORD_PTR) new CZIPFileData(fileInfo.CompSize, cnt, Unix);
-            if (!file.PluginData)
+            if (!fileData->Add(CZIPFileData(fileInfo.CompSize, cnt, headerOffs, Unix)))
             {
                 SalamanderGeneral->Free(file.Name);
                 errorID = IDS_LOWMEM;
                 break;
             }
+            file.PluginData = (DWORD_PTR)&(*fileData)[fileData->Count - 1];
 
             if (!sortByExtDirsAsFiles && fileInfo.IsDir)
             {
@@ -177,7 +182,6 @@ START_LIST:
                 file.IsLink = 0;
                 if (!dir->AddDir(path, file, NULL))
                 {
-                    delete (CZIPFileData*)file.PluginData;
                     TRACE_E("Error adding directory " << path << "\\" << file.Name << " in the list");
                     SalamanderGeneral->Free(file.Name);
                     if (_tcslen(path) >= _MAX_PATH)
@@ -197,7 +201,6 @@ START_LIST:
                 file.IsLink = SalamanderGeneral->IsFileLink(file.Ext);
                 if (!dir->AddFile(path, file, NULL))
                 {
-                    delete (CZIPFileData*)file.PluginData;
                     TRACE_E("Error adding file " << path << "\\" << file.Name << " to the list");
                     SalamanderGeneral->Free(file.Name);
                     if (_tcslen(path) >= _MAX_PATH)
@@ -224,6 +227,7 @@ START_LIST:
         haveFiles = cnt > 0;
     }
     free(centralHeader);
+    UnmapCentralDirectory();
     //free(fileInfo.Name); handled in the destructor
     //  free(pathBuf);
 
@@ -10,6 +10,7 @@ public:
     {
         Extract = true;
     }
-    int ListArchive(CSalamanderDirectoryAbstract* dir, BOOL& haveFiles);
-    int List(CSalamanderDirectoryAbstract* dir, BOOL& haveFiles);
+    // 'fileData' receives the CZIPFileData records of the listed items
+    int ListArchive(CSalamanderDirectoryAbstract* dir, CZIPFileDataArray* fileData, BOOL& haveFiles);
+    int List(CSalamanderDirectoryAbstract* dir, CZIPFileDataArray* fileData, BOOL& haveFiles);
 };
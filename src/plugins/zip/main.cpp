@@ -779,8 +779,7 @@ BOOL CPluginInterfaceForMenuExt::HelpForMenuItem(HWND parent, int id)
 
 void CPluginDataInterface::ReleasePluginData(CFileData& file, BOOL isDir)
 {
-    // file.PluginData is NULL for folders not having extra items in the archive - see GetFileDataForUpDir & GetFileDataForNewDir
-    delete (CZIPFileData*)file.PluginData; // However, delete NULL is perfectly OK
+    // not called (see CallReleaseForFiles), file.PluginData points to FileData
 }
 
 // Callback called by Salamander to obtain custom column text - see spl_com.h / FColumnGetText
@@ -889,8 +888,15 @@ BOOL CPluginInterfaceForArchiver::ListArchive(CSalamanderForOperationsAbstract*
 
     CZipList list(fileName, salamander);
 
-    BOOL haveFiles;
-    if (list.ErrorID || list.ListArchive(dir, haveFiles))
+    // the listed items point to the records in 'data', so it is created first
+    CPluginDataInterface* data = new CPluginDataInterface();
+    if (data == NULL)
+    {
+        SalamanderGeneral->ShowMessageBox(LoadStr(IDS_LOWMEM), LoadStr(IDS_PLUGINNAME), MSGBOX_ERROR);
+        return FALSE;
+    }
+    BOOL haveFiles = FALSE;
+    if (list.ErrorID || list.ListArchive(dir, &data->FileData, haveFiles))
     {
         if (list.ErrorID != IDS_NODISPLAY)
         {
@@ -898,9 +904,13 @@ BOOL CPluginInterfaceForArchiver::ListArchive(CSalamanderForOperationsAbstract*
                                               LoadStr(IDS_PLUGINNAME), MSGBOX_ERROR);
         }
         if (!haveFiles)
+        {
+            dir->Clear(NULL);
+            delete data;
             return FALSE;
+        }
     }
-    pluginData = new CPluginDataInterface();
+    pluginData = data;
     return TRUE;
 }
 
@@ -0,0 +1,161 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+
+#include "selfextr/comdefs.h"
+#include "config.h"
+#include "typecons.h"
+#include "chicon.h"
+#include "common.h"
+#include "deflate.h"
+#include "jobpool.h"
+#include "pdeflate.h"
+
+#ifndef SSZIP
+#include "zip.rh"
+#include "zip.rh2"
+#include "lang\lang.rh"
+#include "dialogs.h"
+#else //SSZIP
+#include "sszip/dialogs.h"
+#endif //SSZIP
+
+// ****************************************************************************
+//
+// CDeflateJob
+//
+
+CDeflateJob::CDeflateJob()
+{
+    FileName = NULL;
+    Size = 0;
+    Data = NULL;
+    DictLen = 0;
+    DataLen = 0;
+    Level = 0;
+    Flag = 0;
+    Failed = FALSE;
+    Out = NULL;
+    OutLen = 0;
+    OutAlloc = 0;
+    Method = CM_DEFLATED;
+    InterAttr = (__UINT16)UNKNOWN;
+    Crc = INIT_CRC;
+    LastWrite.dwLowDateTime = 0;
+    LastWrite.dwHighDateTime = 0;
+    DataRead = 0;
+}
+
+CDeflateJob::~CDeflateJob()
+{
+    if (Data != NULL)
+        free(Data);
+    if (Out != NULL)
+        free(Out);
+}
+
+// CDeflate input and output of a job, see FReadData and FWriteData
+
+static int ReadJobData(char* buffer, unsigned size, int* error, void* user)
+{
+    CDeflateJob* job = (CDeflateJob*)user;
+    unsigned left = job->DataLen - job->DataRead;
+    if (left == 0)
+        return EOF;
+    if (size > left)
+        size = left;
+    memcpy(buffer, job->Data + job->DictLen + job->DataRead, size);
+    job->DataRead += size;
+    return size;
+}
+
+static int WriteJobOutput(char* buffer, unsigned size, void* user)
+{
+    CDeflateJob* job = (CDeflateJob*)user;
+    if (job->OutLen + size > job->OutAlloc)
+    {
+        unsigned alloc = max(job->OutAlloc * 2, job->OutLen + size);
+        alloc = max(alloc, 64 * 1024);
+        char* out = (char*)realloc(job->Out, alloc);
+        if (out == NULL)
+            return IDS_LOWMEM;
+        job->Out = out;
+        job->OutAlloc = alloc;
+    }
+    memcpy(job->Out + job->OutLen, buffer, size);
+    job->OutLen += size;
+    return 0;
+}
+
+// ****************************************************************************
+//
+// CDeflatePool
+//
+
+BOOL CDeflatePool::ReadWholeFile(CDeflateJob* job)
+{
+    HANDLE file = CreateFile(job->FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                             FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return FALSE;
+    BOOL ok = FALSE;
+    DWORD sizeHigh;
+    DWORD size = GetFileSize(file, &sizeHigh);
+    if (size != INVALID_FILE_SIZE && sizeHigh == 0 && size == job->Size &&
+        GetFileTime(file, NULL, NULL, &job->LastWrite))
+    {
+        job->Data = (char*)malloc(size);
+        DWORD read;
+        if (job->Data != NULL && ReadFile(file, job->Data, size, &read, NULL) && read == size)
+        {
+            job->DictLen = 0;
+            job->DataLen = size;
+            job->Crc = SalamanderGeneral->UpdateCrc32(job->Data, size, INIT_CRC);
+            ok = TRUE;
+        }
+    }
+    CloseHandle(file);
+    return ok;
+}
+
+BOOL CDeflatePool::Run(void** state, CPoolJob* poolJob)
+{
+    CDeflateJob* job = (CDeflateJob*)poolJob;
+    if (job->FileName != NULL && !ReadWholeFile(job))
+    {
+        job->Failed = TRUE; // PackFiles() reads the file again and reports the error
+        return TRUE;
+    }
+    if (*state == NULL)
+        *state = new CDeflate();
+    CDeflate* deflate = (CDeflate*)*state;
+    if (deflate == NULL)
+    {
+        job->Failed = TRUE;
+        return TRUE;
+    }
+    ullg compLen;
+    int ret;
+    job->DataRead = 0;
+    if (job->FileName != NULL)
+    {
+        ret = deflate->Deflate(&job->InterAttr, &job->Method, job->Level, &job->Flag, &compLen,
+                               WriteJobOutput, ReadJobData, job);
+        free(job->Data); // not needed any more, only pieces of files serve as dictionaries
+        job->Data = NULL;
+    }
+    else
+    {
+        ret = deflate->DeflateChunk(&job->InterAttr, job->Level, &job->Flag, job->Data, job->DictLen,
+                                    &compLen, WriteJobOutput, ReadJobData, job);
+    }
+    if (ret != 0)
+        job->Failed = TRUE;
+    return ret == 0; // CDeflate interrupted by an exception is not reused
+}
+
+void CDeflatePool::FreeState(void* state)
+{
+    delete (CDeflate*)state;
+}
@@ -0,0 +1,66 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// files smaller than this are read and compressed whole by the helper threads ahead
+// of CZipPack::PackFiles(), bigger files are read by PackFiles() and compressed in
+// DEFLATE_CHUNK_SIZE pieces (see CDeflate::DeflateChunk())
+#define PREDEFLATE_MAX_SIZE (1024 * 1024)
+#define DEFLATE_CHUNK_SIZE (128 * 1024)
+
+// the highest number of input bytes held by the files compressed ahead
+#define PREDEFLATE_MAX_PENDING (32 * 1024 * 1024)
+
+// ****************************************************************************
+//
+// CDeflateJob
+//
+// One file or one piece of a file compressed by a helper thread into memory.
+//
+
+struct CDeflateJob : public CPoolJob
+{
+    // input
+    const char* FileName; // != NULL = the job reads the whole file itself into 'Data'
+    QWORD Size;           // expected size of 'FileName', a file of other size is not compressed
+    char* Data;           // 'DictLen' bytes of dictionary followed by 'DataLen' bytes to compress
+    unsigned DictLen;
+    unsigned DataLen;
+    int Level;
+    __UINT16 Flag; // general purpose bit flag, CDeflate adds FAST/SLOW into it
+
+    // output (valid once the job is done)
+    BOOL Failed; // TRUE = the file could not be read or there was not enough memory
+    char* Out;
+    unsigned OutLen;
+    unsigned OutAlloc;
+    int Method; // CM_DEFLATED or CM_STORED if the file did not compress
+    __UINT16 InterAttr;
+    unsigned Crc;       // only for whole files
+    FILETIME LastWrite; // only for whole files
+
+    unsigned DataRead; // part of 'Data' already handed to CDeflate
+
+    CDeflateJob();
+    ~CDeflateJob();
+};
+
+// ****************************************************************************
+//
+// CDeflatePool
+//
+// Helper threads compressing CDeflateJob jobs, every thread has its own CDeflate.
+//
+
+class CDeflatePool : public CJobPool
+{
+public:
+    ~CDeflatePool() { Stop(); }
+
+protected:
+    virtual BOOL Run(void** state, CPoolJob* job);
+    virtual void FreeState(void* state);
+
+    BOOL ReadWholeFile(CDeflateJob* job);
+};
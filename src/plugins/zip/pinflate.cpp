@@ -0,0 +1,191 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+
+#include "selfextr/comdefs.h"
+#include "config.h"
+#include "typecons.h"
+#include "chicon.h"
+#include "common.h"
+#include "inflate.h"
+#include "jobpool.h"
+#include "pinflate.h"
+
+#ifndef SSZIP
+#include "zip.rh"
+#include "zip.rh2"
+#include "lang\lang.rh"
+#include "dialogs.h"
+#else //SSZIP
+#include "sszip/dialogs.h"
+#endif //SSZIP
+
+// ****************************************************************************
+//
+// CInflateJob
+//
+
+CInflateJob::CInflateJob()
+{
+    LocHeaderOffs = 0;
+    CompSize = 0;
+    Size = 0;
+    Deflate64 = FALSE;
+    KeepData = TRUE;
+    Failed = FALSE;
+    Out = NULL;
+    OutLen = 0;
+    Crc = INIT_CRC;
+    In = NULL;
+}
+
+CInflateJob::~CInflateJob()
+{
+    if (In != NULL)
+        free(In);
+    if (Out != NULL)
+        free(Out);
+}
+
+// ****************************************************************************
+//
+// CInflatePool
+//
+
+// state of one helper thread
+struct CInflateState
+{
+    HANDLE ZipFile;
+    HANDLE Heap;
+    char* SlideWindow;
+    huft* fixed_tl64;
+    huft* fixed_td64;
+    int fixed_bl64,
+        fixed_bd64;
+    huft* fixed_tl32;
+    huft* fixed_td32;
+    int fixed_bl32,
+        fixed_bd32;
+    uch Padding[4]; // read after the end of the compressed data (always an error)
+};
+
+#define CINFLATEJOB(decompress) ((CInflateJob*)decompress->UserData)
+
+// the whole compressed file is in the input buffer, so asking for more is an error
+static void RefillJob(CDecompressionObject* decompress)
+{
+    CInflateState* state = (CInflateState*)decompress->Input->UserData;
+    decompress->Input->Error = IDS_EOF;
+    decompress->Input->NextByte = state->Padding;
+    decompress->Input->BytesLeft = sizeof(state->Padding);
+}
+
+static int FlushJob(unsigned bytes, CDecompressionObject* decompress)
+{
+    CInflateJob* job = CINFLATEJOB(decompress);
+    if (job->OutLen + bytes > job->Size)
+        return 1; // the file is longer than it should be
+    job->Crc = SalamanderGeneral->UpdateCrc32(decompress->Output->SlideWin, bytes, job->Crc);
+    if (job->KeepData)
+        memcpy(job->Out + job->OutLen, decompress->Output->SlideWin, bytes);
+    job->OutLen += bytes;
+    return 0;
+}
+
+static BOOL ReadAt(HANDLE file, QWORD offset, void* buffer, DWORD size)
+{
+    LARGE_INTEGER pos;
+    pos.QuadPart = offset;
+    DWORD read;
+    return SetFilePointerEx(file, pos, NULL, FILE_BEGIN) &&
+           ReadFile(file, buffer, size, &read, NULL) && read == size;
+}
+
+BOOL CInflatePool::Run(void** statePtr, CPoolJob* poolJob)
+{
+    CInflateJob* job = (CInflateJob*)poolJob;
+    CInflateState* state = (CInflateState*)*statePtr;
+    job->Failed = TRUE;
+    if (state == NULL)
+    {
+        state = new CInflateState;
+        if (state == NULL)
+            return TRUE;
+        memset(state, 0, sizeof(CInflateState));
+        *statePtr = state;
+        state->ZipFile = CreateFile(ZipName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                    FILE_FLAG_RANDOM_ACCESS, NULL);
+        state->Heap = HeapCreate(HEAP_NO_SERIALIZE, INITIAL_HEAP_SIZE, MAXIMUM_HEAP_SIZE);
+        state->SlideWindow = (char*)malloc(SLIDE_WINDOW_SIZE);
+    }
+    if (state->ZipFile == INVALID_HANDLE_VALUE || state->Heap == NULL || state->SlideWindow == NULL)
+        return TRUE; // ExtractFiles() decompresses the file itself
+
+    // find the data behind the local header
+    CLocalFileHeader header;
+    if (!ReadAt(state->ZipFile, job->LocHeaderOffs, &header, sizeof(header)) ||
+        header.Signature != SIG_LOCALFH)
+    {
+        return TRUE;
+    }
+    job->In = (char*)malloc((size_t)job->CompSize);
+    if (job->KeepData)
+        job->Out = (char*)malloc((size_t)job->Size);
+    if (job->In == NULL || job->KeepData && job->Out == NULL ||
+        !ReadAt(state->ZipFile, job->LocHeaderOffs + sizeof(header) + header.NameLen + header.ExtraLen,
+                job->In, (DWORD)job->CompSize))
+    {
+        return TRUE;
+    }
+
+    CDecompressionObject decompress;
+    COutputManager output;
+    CInputManager input;
+    input.NextByte = (uch*)job->In;
+    input.BytesLeft = (unsigned)job->CompSize;
+    input.UserData = state;
+    input.Error = 0;
+    input.Refill = RefillJob;
+    output.SlideWin = (uch*)state->SlideWindow;
+    output.WinSize = SLIDE_WINDOW_SIZE;
+    output.Flush = FlushJob;
+    decompress.Input = &input;
+    decompress.Output = &output;
+    decompress.UserData = job;
+    decompress.HeapInfo = (void*)state->Heap;
+    decompress.fixed_tl64 = state->fixed_tl64;
+    decompress.fixed_td64 = state->fixed_td64;
+    decompress.fixed_bl64 = state->fixed_bl64;
+    decompress.fixed_bd64 = state->fixed_bd64;
+    decompress.fixed_tl32 = state->fixed_tl32;
+    decompress.fixed_td32 = state->fixed_td32;
+    decompress.fixed_bl32 = state->fixed_bl32;
+    decompress.fixed_bd32 = state->fixed_bd32;
+    int ret = Inflate(&decompress, job->Deflate64);
+    state->fixed_tl64 = decompress.fixed_tl64;
+    state->fixed_td64 = decompress.fixed_td64;
+    state->fixed_bl64 = decompress.fixed_bl64;
+    state->fixed_bd64 = decompress.fixed_bd64;
+    state->fixed_tl32 = decompress.fixed_tl32;
+    state->fixed_td32 = decompress.fixed_td32;
+    state->fixed_bl32 = decompress.fixed_bl32;
+    state->fixed_bd32 = decompress.fixed_bd32;
+
+    free(job->In); // not needed any more
+    job->In = NULL;
+    job->Failed = ret != 0 || input.Error != 0 || job->OutLen != job->Size;
+    return TRUE;
+}
+
+void CInflatePool::FreeState(void* statePtr)
+{
+    CInflateState* state = (CInflateState*)statePtr;
+    if (state->ZipFile != NULL && state->ZipFile != INVALID_HANDLE_VALUE)
+        CloseHandle(state->ZipFile);
+    if (state->Heap != NULL)
+        HeapDestroy(state->Heap); // frees also the fixed Huffman tables
+    if (state->SlideWindow != NULL)
+        free(state->SlideWindow);
+    delete state;
+}
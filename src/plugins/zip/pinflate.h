@@ -0,0 +1,60 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// files smaller than this are decompressed by the helper threads ahead of
+// CZipUnpack::ExtractFiles(), bigger files are decompressed by ExtractFiles()
+#define PREINFLATE_MAX_SIZE (1024 * 1024)
+
+// the highest number of uncompressed bytes held by the files decompressed ahead
+#define PREINFLATE_MAX_PENDING (32 * 1024 * 1024)
+
+// ****************************************************************************
+//
+// CInflateJob
+//
+// One file from the archive decompressed by a helper thread into memory.
+//
+
+struct CInflateJob : public CPoolJob
+{
+    // input
+    QWORD LocHeaderOffs; // offset of the local header of the file in the archive
+    QWORD CompSize;
+    QWORD Size;
+    BOOL Deflate64;
+    BOOL KeepData; // FALSE = only compute Crc (testing the archive)
+
+    // output (valid once the job is done)
+    BOOL Failed; // TRUE = the file must be decompressed again by ExtractFiles() to report the error
+    char* Out;   // decompressed data if KeepData is TRUE
+    QWORD OutLen;
+    unsigned Crc;
+
+    char* In; // compressed data
+
+    CInflateJob();
+    ~CInflateJob();
+};
+
+// ****************************************************************************
+//
+// CInflatePool
+//
+// Helper threads decompressing CInflateJob jobs, every thread reads the archive
+// through its own handle and has its own heap for the Huffman tables.
+//
+
+class CInflatePool : public CJobPool
+{
+public:
+    CInflatePool(const char* zipName) { ZipName = zipName; }
+    ~CInflatePool() { Stop(); }
+
+protected:
+    virtual BOOL Run(void** state, CPoolJob* job);
+    virtual void FreeState(void* state);
+
+    const char* ZipName;
+};
@@ -614,6 +614,7 @@ ullg CDeflate::flush_block(char* buf,      /* input block, or NULL if too old */
 {
     ulg opt_lenb, static_lenb; /* opt_len and static_len in bytes */
     int max_blindex;           /* index of last bit length code of non zero freq */
+    int last = eof && !chunk;  /* true if this is the final block of the stream */
 
     flag_buf[last_flags] = flags; /* Save the flags for the last 8 items */
 
@@ -651,7 +652,7 @@ ullg CDeflate::flush_block(char* buf,      /* input block, or NULL if too old */
         cmpr_bytelen == 0L && cmpr_len_bits == 0L)
     { /* force stored file */
 #else
-    if (stored_len <= opt_lenb && eof &&
+    if (stored_len <= opt_lenb && eof && !chunk &&
         cmpr_bytelen == 0L && cmpr_len_bits == 0L &&
         seekable() && !(Flag & 0x08))
     { //0x08 == GPF_DATADESCR
@@ -681,7 +682,7 @@ ullg CDeflate::flush_block(char* buf,      /* input block, or NULL if too old */
          * successful. If LIT_BUFSIZE <= WSIZE, it is never too late to
          * transform a block into a stored block.
          */
-        send_bits((STORED_BLOCK << 1) + eof, 3); /* send block type */
+        send_bits((STORED_BLOCK << 1) + last, 3); /* send block type */
         cmpr_bytelen += ((cmpr_len_bits + 3 + 7) >> 3) + stored_len + 4;
         cmpr_len_bits = 0L;
 
@@ -696,7 +697,7 @@ ullg CDeflate::flush_block(char* buf,      /* input block, or NULL if too old */
     else if (static_lenb == opt_lenb)
     {
 #endif
-        send_bits((STATIC_TREES << 1) + eof, 3);
+        send_bits((STATIC_TREES << 1) + last, 3);
         compress_block((ct_data near*)static_ltree, (ct_data near*)static_dtree);
         cmpr_len_bits += 3 + static_len;
         cmpr_bytelen += cmpr_len_bits >> 3;
@@ -704,7 +705,7 @@ ullg CDeflate::flush_block(char* buf,      /* input block, or NULL if too old */
     }
     else
     {
-        send_bits((DYN_TREES << 1) + eof, 3);
+        send_bits((DYN_TREES << 1) + last, 3);
         send_all_trees(l_desc.max_code + 1, d_desc.max_code + 1, max_blindex + 1);
         compress_block((ct_data near*)dyn_ltree, (ct_data near*)dyn_dtree);
         cmpr_len_bits += 3 + opt_len;
@@ -715,7 +716,21 @@ ullg CDeflate::flush_block(char* buf,      /* input block, or NULL if too old */
            "bad compressed size");
     init_block();
 
-    if (eof)
+    if (eof && chunk)
+    {
+        /* End the piece with an empty stored block, so the next piece starts
+         * on a byte boundary.
+         */
+        send_bits(STORED_BLOCK << 1, 3);
+        bi_windup();
+        PUTSHORT(0);
+        PUTSHORT(0xffff);
+        flush_outbuf(0, 0);
+        cmpr_len_bits += 3 + 7;
+        cmpr_bytelen += (cmpr_len_bits >> 3) + 4;
+        cmpr_len_bits = 0L;
+    }
+    else if (eof)
     {
 #if defined(PGP) && !defined(MMAP)
         /* Wipe out sensitive data for pgp */
@@ -794,19 +809,43 @@ int CDeflate::ct_tally(int dist, /* distance of matched string */
 }
 
 /* ===========================================================================
- * Send the block data compressed using the given Huffman trees
+ * Append length bits of value to the local bit buffer buf holding valid bits
+ * and write 32 bits out once there are enough of them. valid < Buf_size on
+ * entry and length <= 32, so buf can't overflow.
+ */
+#define SEND_BITS_LOCAL(value, length) \
+    { \
+        buf |= (ullg)(value) << valid; \
+        valid += (length); \
+        if (valid >= (int)Buf_size) \
+        { \
+            PUTLONG(buf); \
+            buf >>= Buf_size; \
+            valid -= Buf_size; \
+        } \
+    }
+
+/* ===========================================================================
+ * Send the block data compressed using the given Huffman trees. The bit
+ * buffer is kept in locals, so the compiler does not have to reload it after
+ * each byte stored to out_buf, and a code is sent together with its extra
+ * bits (at most 15 + 13 bits).
  */
 void CDeflate::compress_block(ct_data near* ltree, /* literal tree */
                               ct_data near* dtree) /* distance tree */
 {
-    unsigned dist;   /* distance of matched string */
-    int lc;          /* match length or unmatched char (if dist == 0) */
-    unsigned lx = 0; /* running index in l_buf */
-    unsigned dx = 0; /* running index in d_buf */
-    unsigned fx = 0; /* running index in flag_buf */
-    uch flag = 0;    /* current flags */
-    unsigned code;   /* the code to send */
-    int extra;       /* number of extra bits to send */
+    unsigned dist;        /* distance of matched string */
+    int lc;               /* match length or unmatched char (if dist == 0) */
+    unsigned lx = 0;      /* running index in l_buf */
+    unsigned dx = 0;      /* running index in d_buf */
+    unsigned fx = 0;      /* running index in flag_buf */
+    uch flag = 0;         /* current flags */
+    unsigned code;        /* the code to send */
+    int extra;            /* number of extra bits to send */
+    ulg bits;             /* a code with its extra bits */
+    int len;              /* their number */
+    ullg buf = bi_buf;    /* local copy of bi_buf */
+    int valid = bi_valid; /* local copy of bi_valid */
 
     if (last_lit != 0)
         do
@@ -816,35 +855,36 @@ void CDeflate::compress_block(ct_data near* ltree, /* literal tree */
             lc = l_buf[lx++];
             if ((flag & 1) == 0)
             {
-                send_code(lc, ltree); /* send a literal byte */
+                SEND_BITS_LOCAL(ltree[lc].Code, ltree[lc].Len); /* send a literal byte */
             }
             else
             {
                 /* Here, lc is the match length - MIN_MATCH */
                 code = length_code[lc];
-                send_code(code + LITERALS + 1, ltree); /* send the length code */
+                bits = ltree[code + LITERALS + 1].Code; /* the length code */
+                len = ltree[code + LITERALS + 1].Len;
                 extra = extra_lbits[code];
                 if (extra != 0)
                 {
-                    lc -= base_length[code];
-                    send_bits(lc, extra); /* send the extra length bits */
+                    /* base_length[] is not set for the last code, which has no extra bits */
+                    bits |= (ulg)(lc - base_length[code]) << len; /* the extra length bits */
+                    len += extra;
                 }
+                SEND_BITS_LOCAL(bits, len);
                 dist = d_buf[dx++];
                 /* Here, dist is the match distance - 1 */
                 code = d_code(dist);
                 Assert(code < D_CODES, "bad d_code");
 
-                send_code(code, dtree); /* send the distance code */
-                extra = extra_dbits[code];
-                if (extra != 0)
-                {
-                    dist -= base_dist[code];
-                    send_bits(dist, extra); /* send the extra distance bits */
-                }
+                /* send the distance code and the extra distance bits */
+                SEND_BITS_LOCAL(dtree[code].Code | ((ulg)(dist - base_dist[code]) << dtree[code].Len),
+                                dtree[code].Len + extra_dbits[code]);
             } /* literal or match pair ? */
             flag >>= 1;
         } while (lx < last_lit);
 
+    bi_buf = buf;
+    bi_valid = valid;
     send_code(END_BLOCK, ltree);
 }
 
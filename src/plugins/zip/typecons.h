@@ -197,6 +197,15 @@ typedef struct
     __UINT32 StartDisk;     // Disk Start Number
 } CZip64ExtraField;
 
+// contents of the journal file written before appending to an archive
+// (see CZipPack::PrepareAppend() and CZipCommon::RecoverAppend())
+typedef struct
+{
+    __UINT32 Signature;  // SIG_APPENDJOURNAL
+    __UINT64 Size;       // size of the archive before appending
+    FILETIME LastWrite;  // its last write time
+} CAppendJournal;
+
 #pragma pack(pop)
 
 #define IF_STORED_AES 1 // File is stored and AES-encrypted
@@ -353,6 +362,9 @@ extern const SYSTEMTIME MinZipTime;
 #define SIG_EOCENTRDIR 0x06054b50      //end of central dir signature
 #define SIG_ZIP64EOCENTRDIR 0x06064b50 //zip64 end of central dir
 #define SIG_ZIP64LOCATOR 0x07064b50    //zip64 end of central dir locator
+#define SIG_APPENDJOURNAL 0x4a415053   //"SPAJ", journal of an append, see CAppendJournal
+
+#define APPEND_JOURNAL_EXT ".zipappend" //appended to the archive name to get its journal name
 
 #define ZIP64_HEADER_ID 0x0001 //zip64 extra header id
 
@@ -373,6 +385,7 @@ extern const SYSTEMTIME MinZipTime;
 #define CM_DEFLATED 8
 #define CM_DEFLATE64 9
 #define CM_BZIP2 12
+#define CM_LZMA 14
 #define CM_AES 99
 
 #define HS_FAT 00
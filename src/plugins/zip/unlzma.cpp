@@ -0,0 +1,110 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+#include <crtdbg.h>
+#include <commctrl.h>
+
+#include "config.h"
+#include "zip.rh2"
+#include "common.h"
+#include "inflate.h" // CDecompressionObject
+#include "..\7zip\7za\c\LzmaDec.h"
+
+// the LZMA decoder from the 7-Zip plugin sources, we only need its memory for probabilities and dictionary
+static void* LzmaAllocMem(void* p, size_t size) { return malloc(size); }
+static void LzmaFreeMem(void* p, void* address) { free(address); }
+static ISzAlloc LzmaAlloc = {LzmaAllocMem, LzmaFreeMem};
+
+// reads 'size' bytes from the input, returns FALSE on error (see decompress->Input->Error)
+static BOOL ReadInput(CDecompressionObject* decompress, Byte* buf, unsigned size)
+{
+    while (size > 0)
+    {
+        if (!decompress->Input->BytesLeft)
+        {
+            decompress->Input->Refill(decompress);
+            if (decompress->Input->Error)
+                return FALSE;
+        }
+        *buf++ = *decompress->Input->NextByte++;
+        decompress->Input->BytesLeft--;
+        size--;
+    }
+    return TRUE;
+}
+
+// expands method 14 (LZMA), decompress->ucsize must be set to the size of the file,
+// returns 0 on success, 1 input error, 2 output error, 3 out of memory, 4 corrupted data
+int UnLZMA(CDecompressionObject* decompress)
+{
+    CLzmaDec lzma;
+    ELzmaStatus status;
+    SRes res;
+    Byte header[4 + LZMA_PROPS_SIZE];
+    int ret = 0;
+
+    // ZIP adds its own header to the LZMA stream: version of the LZMA SDK (2 bytes),
+    // size of the properties (2 bytes) and the properties
+    if (!ReadInput(decompress, header, sizeof(header)))
+        return 1;
+    if (header[2] + (header[3] << 8) != LZMA_PROPS_SIZE)
+        return 4;
+
+    LzmaDec_Construct(&lzma);
+    res = LzmaDec_Allocate(&lzma, header + 4, LZMA_PROPS_SIZE, &LzmaAlloc);
+    if (res != SZ_OK)
+        return res == SZ_ERROR_MEM ? 3 : 4;
+    LzmaDec_Init(&lzma);
+
+    // the stream may or may not end with the end marker (general purpose flag bit 1),
+    // the size of the file is always known, so we just stop after the last byte
+    unsigned __int64 left = decompress->ucsize;
+    Byte* out = (Byte*)decompress->Output->SlideWin;
+    SizeT outLeft = decompress->Output->WinSize;
+    while (left > 0)
+    {
+        if (!decompress->Input->BytesLeft)
+        {
+            decompress->Input->Refill(decompress);
+            if (decompress->Input->Error)
+            {
+                ret = 1;
+                break;
+            }
+        }
+        SizeT inLen = decompress->Input->BytesLeft;
+        SizeT outLen = left < outLeft ? (SizeT)left : outLeft;
+        res = LzmaDec_DecodeToBuf(&lzma, out, &outLen, decompress->Input->NextByte, &inLen,
+                                  LZMA_FINISH_ANY, &status);
+        decompress->Input->NextByte += inLen;
+        decompress->Input->BytesLeft -= (unsigned)inLen;
+        out += outLen;
+        outLeft -= outLen;
+        left -= outLen;
+        if (res != SZ_OK || inLen == 0 && outLen == 0 ||
+            status == LZMA_STATUS_FINISHED_WITH_MARK && left > 0)
+        {
+            ret = 4;
+            break;
+        }
+        if (!outLeft)
+        {
+            if (decompress->Output->Flush(decompress->Output->WinSize, decompress))
+            {
+                ret = 2;
+                break;
+            }
+            out = (Byte*)decompress->Output->SlideWin;
+            outLeft = decompress->Output->WinSize;
+        }
+    }
+
+    if (!ret && outLeft < decompress->Output->WinSize &&
+        decompress->Output->Flush(decompress->Output->WinSize - (unsigned)outLeft, decompress))
+    {
+        ret = 2;
+    }
+    LzmaDec_Free(&lzma, &LzmaAlloc);
+    return ret;
+}
@@ -0,0 +1,6 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+int UnLZMA(CDecompressionObject* decompress);
@@ -11,11 +11,15 @@
 class CPluginDataInterface : public CPluginDataInterfaceAbstract
 {
 public:
-    CPluginDataInterface() {}
+    // CZIPFileData of all listed files and directories, released together with the listing
+    CZIPFileDataArray FileData;
+
+    CPluginDataInterface() : FileData(ZIPFILEDATA_BLOCK) {}
     virtual ~CPluginDataInterface() {}
 
-    virtual BOOL WINAPI CallReleaseForFiles() { return TRUE; }
-    virtual BOOL WINAPI CallReleaseForDirs() { return TRUE; }
+    // the records are not released one by one, they are in FileData
+    virtual BOOL WINAPI CallReleaseForFiles() { return FALSE; }
+    virtual BOOL WINAPI CallReleaseForDirs() { return FALSE; }
     virtual void WINAPI ReleasePluginData(CFileData& file, BOOL isDir);
     virtual void WINAPI GetFileDataForUpDir(const char* archivePath, CFileData& upDir) {}
     virtual BOOL WINAPI GetFileDataForNewDir(const char* dirName, CFileData& dir) { return TRUE; }
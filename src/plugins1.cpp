@@ -1895,6 +1895,12 @@ BOOL CSalamanderPluginEntry::AddFSName(const char* fsName, int* newFSNameIndex)
     return FALSE;
 }
 
+void CSalamanderPluginEntry::SetArchiverCapabilities(DWORD capabilities)
+{
+    CALL_STACK_MESSAGE2("CSalamanderPluginEntry::SetArchiverCapabilities(0x%X)", capabilities);
+    Plugin->ArcListingCacheable = (capabilities & ARCCAP_CACHEABLELISTING) != 0;
+}
+
 //
 // ****************************************************************************
 // CPluginMenuItem
@@ -2069,6 +2075,7 @@ CPluginData::CPluginData(const char* name, const char* dllName, BOOL supportPane
     UnpackDlgUnpackMask = NULL;
     PluginIsNethood = FALSE;
     PluginUsesPasswordManager = FALSE;
+    ArcListingCacheable = FALSE;
     IconOverlaysCount = 0;
     IconOverlays = NULL;
 }
@@ -2249,6 +2256,7 @@ BOOL CPluginData::InitDLL(HWND parent, BOOL quiet, BOOL waitCursor, BOOL showUns
                     BOOL oldPluginUsesPasswordManager = PluginUsesPasswordManager;
                     PluginIsNethood = FALSE;
                     PluginUsesPasswordManager = FALSE;
+                    ArcListingCacheable = FALSE; // plugin ho musi nastavit pri kazdem loadu (viz SetArchiverCapabilities)
 
                     EnterPlugin(); // pro entry-point plug-inu
                     Plugins.EnterDataCS();
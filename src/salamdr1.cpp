@@ -3,6 +3,11 @@
 
 #include "precomp.h"
 #include <time.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#endif // defined(_M_IX86) || defined(_M_X64)
 //#ifdef MSVC_RUNTIME_CHECKS
 #include <rtcapi.h>
 //#endif // MSVC_RUNTIME_CHECKS
@@ -683,8 +688,11 @@ COLORREF CustomColors[NUMBER_OF_CUSTOMCOLORS] =
 // CRC32
 //
 
-static DWORD Crc32Tab[256];
-static BOOL Crc32TabInitialized = FALSE;
+static DWORD Crc32Tab[16][256]; // tabulky pro "slicing-by-16", Crc32Tab[0] je klasicka bajtova tabulka
+static volatile BOOL Crc32TabInitialized = FALSE; // volatile: nastavuje se az po naplneni tabulek (UpdateCrc32 se vola z libovolneho threadu)
+#if defined(_M_IX86) || defined(_M_X64)
+static BOOL Crc32UseCLMul = FALSE; // TRUE = CPU umi PCLMULQDQ (+SSE2), pouzijeme UpdateCrc32CLMul()
+#endif
 
 void MakeCrc32Table(DWORD* crcTab)
 {
@@ -714,6 +722,125 @@ void MakeCrc32Table(DWORD* crcTab)
     }
 }
 
+// pripravi tabulky pro UpdateCrc32() a zjisti, jestli CPU umi PCLMULQDQ
+static void InitCrc32()
+{
+    MakeCrc32Table(Crc32Tab[0]);
+    // Crc32Tab[k][n] je CRC bajtu 'n' nasledovaneho 'k' nulovymi bajty
+    int k;
+    for (k = 1; k < 16; k++)
+    {
+        int n;
+        for (n = 0; n < 256; n++)
+            Crc32Tab[k][n] = (Crc32Tab[k - 1][n] >> 8) ^ Crc32Tab[0][Crc32Tab[k - 1][n] & 0xff];
+    }
+#if defined(_M_IX86) || defined(_M_X64)
+    int cpuInfo[4];
+    __cpuid(cpuInfo, 1);
+    Crc32UseCLMul = (cpuInfo[2] & (1 << 1)) != 0 /* PCLMULQDQ */ && (cpuInfo[3] & (1 << 26)) != 0 /* SSE2 */;
+#endif
+    Crc32TabInitialized = TRUE;
+}
+
+#if defined(_M_IX86) || defined(_M_X64)
+
+// CRC-32 pomoci instrukce PCLMULQDQ ("folding" po 4 x 16 bajtech + Barrettova redukce,
+// viz Intel: "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction");
+// 'crc' i navratova hodnota jsou v invertovanem tvaru (bez uvodniho a zaverecneho XORu),
+// 'count' musi byt nasobek 16 a aspon 64
+static DWORD UpdateCrc32CLMul(const BYTE* p, DWORD count, DWORD crc)
+{
+    // konstanty pro bitove zrcadleny polynom CRC-32 (x^N mod P(x) pro ruzna N) a polynom pro Barrettovu redukci
+    static const unsigned __int64 k1k2[2] = {0x0154442bd4, 0x01c6e41596};
+    static const unsigned __int64 k3k4[2] = {0x01751997d0, 0x00ccaa009e};
+    static const unsigned __int64 k5k0[2] = {0x0163cd6124, 0x0000000000};
+    static const unsigned __int64 poly[2] = {0x01db710641, 0x01f7011641};
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(p + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    x0 = _mm_loadu_si128((const __m128i*)k1k2);
+    p += 64;
+    count -= 64;
+
+    // paralelni "folding" bloku po 64 bajtech
+    while (count >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(p + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(p + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(p + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(p + 0x30)));
+
+        p += 64;
+        count -= 64;
+    }
+
+    // slozeni ctyr 128-bitovych hodnot do jedne
+    x0 = _mm_loadu_si128((const __m128i*)k3k4);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // zbyvajici bloky po 16 bajtech
+    while (count >= 16)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)p)), x5);
+        p += 16;
+        count -= 16;
+    }
+
+    // redukce ze 128 na 64 bitu
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrettova redukce na 32 bitu
+    x0 = _mm_loadu_si128((const __m128i*)poly);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (DWORD)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+#endif // defined(_M_IX86) || defined(_M_X64)
+
 DWORD UpdateCrc32(const void* buffer, DWORD count, DWORD crcVal)
 {
     CALL_STACK_MESSAGE_NONE
@@ -722,68 +849,47 @@ DWORD UpdateCrc32(const void* buffer, DWORD count, DWORD crcVal)
         return 0;
 
     if (!Crc32TabInitialized)
+        InitCrc32();
+
+    const BYTE* p = (const BYTE*)buffer;
+    DWORD c = crcVal ^ 0xFFFFFFFF;
+
+#if defined(_M_IX86) || defined(_M_X64)
+    if (Crc32UseCLMul && count >= 64)
     {
-        MakeCrc32Table(Crc32Tab);
-        Crc32TabInitialized = TRUE;
+        DWORD blocks = count & ~15;
+        c = UpdateCrc32CLMul(p, blocks, c);
+        p += blocks;
+        count -= blocks;
     }
+#endif
 
-    BYTE* p = (BYTE*)buffer;
-    DWORD c = crcVal ^ 0xFFFFFFFF;
+    // "slicing-by-16": zpracovavame 16 bajtu najednou pomoci 16 tabulek (predpoklada little-endian,
+    // cteni DWORDu z nezarovnanych adres je na x86/x64 i ARM64 v poradku)
+    while (count >= 16)
+    {
+        DWORD d0 = *(const DWORD*)p ^ c;
+        DWORD d1 = *(const DWORD*)(p + 4);
+        DWORD d2 = *(const DWORD*)(p + 8);
+        DWORD d3 = *(const DWORD*)(p + 12);
+        c = Crc32Tab[15][d0 & 0xff] ^ Crc32Tab[14][(d0 >> 8) & 0xff] ^
+            Crc32Tab[13][(d0 >> 16) & 0xff] ^ Crc32Tab[12][d0 >> 24] ^
+            Crc32Tab[11][d1 & 0xff] ^ Crc32Tab[10][(d1 >> 8) & 0xff] ^
+            Crc32Tab[9][(d1 >> 16) & 0xff] ^ Crc32Tab[8][d1 >> 24] ^
+            Crc32Tab[7][d2 & 0xff] ^ Crc32Tab[6][(d2 >> 8) & 0xff] ^
+            Crc32Tab[5][(d2 >> 16) & 0xff] ^ Crc32Tab[4][d2 >> 24] ^
+            Crc32Tab[3][d3 & 0xff] ^ Crc32Tab[2][(d3 >> 8) & 0xff] ^
+            Crc32Tab[1][(d3 >> 16) & 0xff] ^ Crc32Tab[0][d3 >> 24];
+        p += 16;
+        count -= 16;
+    }
 
     if (count)
         do
         {
-            c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
+            c = Crc32Tab[0][((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
         } while (--count);
 
-    // Honza: meril jsem nasledujici optimalizace a nemaji zadny vyznam;
-    // jedina sance by bylo prepsani do ASM a cteni pameti po DWORDech,
-    // ze kterych by pak bylo mozne vyzobavat jednotlive bajty;
-    // pri soucasnem nastaveni release verze neni prekladac schopen tuto
-    // optimalizaci provest za nas.
-    /*
-  int remain = count % 8;
-  count -= remain;
-  while (remain)
-  {
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    remain--;
-  }
-  while (count)
-  {
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    count -= 8;
-  }
-*/
-    /*
-  int remain = count % 4;
-  count -= remain;
-  while (remain > 0)
-  {
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    remain--;
-  }
-
-
-  DWORD *pdw = (DWORD*)p;
-  DWORD dw;
-  while (count > 0)
-  {
-    dw = *pdw++;
-    c = Crc32Tab[((int)c ^ ((BYTE)(dw))) & 0xFF] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ ((BYTE)(dw >> 8))) & 0xFF] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ ((BYTE)(dw >> 16))) & 0xFF] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ ((BYTE)(dw >> 24))) & 0xFF] ^ (c >> 8);
-    count -= 4;
-  }
-*/
     return c ^ 0xFFFFFFFF; /* (instead of ~c for 64-bit machines) */
 }
 
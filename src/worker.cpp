@@ -5,6 +5,7 @@
 
 #include "cfgdlg.h"
 #include "worker.h"
+#include "bwsched.h"
 
 #include <Aclapi.h>
 #include <Ntsecapi.h>
@@ -517,6 +518,8 @@ COperations::COperations(int base, int delta, char* waitInQueueSubject, char* wa
     LastBufferLimit = 1;
     LastSetupTime = GetTickCount();
     BytesTrFromLastSetup = CQuadWord(0, 0);
+    BandwidthMember = 0;
+    BandwidthRate = 0;
     UseProgressBufferLimit = FALSE;
     ProgressBufferLimit = ASYNC_SLOW_COPY_BUF_SIZE;
     LastProgBufLimTestTime = GetTickCount() - 1000;
@@ -538,7 +541,14 @@ void COperations::CalcLimitBufferSize(int* limitBufferSize, int bufferSize)
 {
     if (limitBufferSize != NULL)
     {
-        *limitBufferSize = UseSpeedLimit && SpeedLimit < (DWORD)bufferSize ? (UseProgressBufferLimit && ProgressBufferLimit < SpeedLimit ? ProgressBufferLimit : SpeedLimit) : (UseProgressBufferLimit && ProgressBufferLimit < (DWORD)bufferSize ? ProgressBufferLimit : bufferSize);
+        DWORD limit = bufferSize;
+        if (UseSpeedLimit && SpeedLimit < limit)
+            limit = SpeedLimit;
+        if (BandwidthRate != 0 && BandwidthRate < limit) // vic nez za vterinu podilu na sdilenem limitu nema smysl prenaset najednou
+            limit = BandwidthRate;
+        if (UseProgressBufferLimit && ProgressBufferLimit < limit)
+            limit = ProgressBufferLimit;
+        *limitBufferSize = limit;
     }
 }
 
@@ -602,9 +612,9 @@ void COperations::AddBytesToSpeedMetersAndTFSandPS(DWORD bytesCount, BOOL onlyTo
         {
             if (limitBufferSize != NULL && bytesCount > 0)
             {
+                DWORD sleepNow = 0;
                 if (UseSpeedLimit)
                 {
-                    DWORD sleepNow = 0;
                     if (SleepAfterWrite == -1) // tohle je prvni paket, nastavime parametry speed-limitu
                     {
                         CalcLimitBufferSize(limitBufferSize, bufferSize);
@@ -673,16 +683,27 @@ void COperations::AddBytesToSpeedMetersAndTFSandPS(DWORD bytesCount, BOOL onlyTo
                     }
                     if (bytesCount > SpeedLimit)               // doslo ke zpomaleni behem operace (napr. probehl read&write 32KB bufferu a speed-limit je 1 B/s, tedy teoreticky bysme meli ted 32768 sekund cekat, coz je prirozene nerealne)
                         bytesCountForSpeedMeters = SpeedLimit; // do meraku rychlosti "prizname" jen byty do speed-limitu (napr. jen 1 B)
-                    if (sleepNow > 0)                          // brzdime kvuli speed-limitu
-                    {
-                        HANDLES(LeaveCriticalSection(&StatusCS));
-                        Sleep(sleepNow);
-                        HANDLES(EnterCriticalSection(&StatusCS));
-                        ti = GetTickCount();
-                    }
                 }
                 else
                     CalcLimitBufferSize(limitBufferSize, bufferSize); // bez limitu - plna rychlost (az na ProgressBufferLimit)
+
+                if (BandwidthMember != 0) // sdileny limit vsech operaci (per-device a globalni)
+                {
+                    DWORD sharedSleep = BandwidthScheduler.Consume(BandwidthMember, bytesCount, ti, &BandwidthRate);
+                    if (sharedSleep > 1000) // cekat dele nez vterinu nema smysl, dluh v BandwidthScheduler zustava, dobrzdime u dalsich paketu
+                        sharedSleep = 1000;
+                    if (sharedSleep > sleepNow)
+                        sleepNow = sharedSleep;
+                    if (BandwidthRate != 0 && *limitBufferSize > (int)BandwidthRate) // podil na limitu se mohl zmenit (pribyla operace, zmena limitu)
+                        *limitBufferSize = BandwidthRate;
+                }
+                if (sleepNow > 0) // brzdime kvuli speed-limitu
+                {
+                    HANDLES(LeaveCriticalSection(&StatusCS));
+                    Sleep(sleepNow);
+                    HANDLES(EnterCriticalSection(&StatusCS));
+                    ti = GetTickCount();
+                }
             }
             TransferSpeedMeter.BytesReceived(bytesCountForSpeedMeters, ti, maxPacketSize);
             TransferredFileSize.Value += bytesCount;
@@ -831,6 +852,49 @@ void COperations::GetSpeedLimit(BOOL* useSpeedLimit, DWORD* speedLimit)
     HANDLES(LeaveCriticalSection(&StatusCS));
 }
 
+void COperations::RegisterInBandwidthScheduler()
+{
+    CALL_STACK_MESSAGE1("COperations::RegisterInBandwidthScheduler()");
+    if (!ShowStatus || BandwidthMember != 0)
+        return; // jen Copy/Move operace (bez ShowStatus se AddBytesToSpeedMetersAndTFSandPS nevola)
+
+    const char* sourceName = NULL;
+    const char* targetName = NULL;
+    int i;
+    for (i = 0; i < Count; i++) // zdroj a cil vezmeme z prvniho kopirovaneho/presouvaneho souboru
+    {
+        COperation* op = &At(i);
+        if (op->Opcode == ocCopyFile || op->Opcode == ocMoveFile)
+        {
+            sourceName = op->SourceName;
+            targetName = op->TargetName;
+            break;
+        }
+    }
+    if (sourceName == NULL)
+        return; // nic se nekopiruje (napr. jen rename adresaru), neni co brzdit
+
+    // operace spoustene "az nic jineho nepobezi" bereme jako kopirovani na pozadi (mensi podil)
+    int member = BandwidthScheduler.AddMember(sourceName, targetName,
+                                              StartOnIdle ? BWSCHED_WEIGHT_IDLE : BWSCHED_WEIGHT_NORMAL);
+    HANDLES(EnterCriticalSection(&StatusCS));
+    BandwidthMember = member;
+    BandwidthRate = 0;
+    HANDLES(LeaveCriticalSection(&StatusCS));
+}
+
+void COperations::UnregisterFromBandwidthScheduler()
+{
+    CALL_STACK_MESSAGE1("COperations::UnregisterFromBandwidthScheduler()");
+    HANDLES(EnterCriticalSection(&StatusCS));
+    int member = BandwidthMember;
+    BandwidthMember = 0;
+    BandwidthRate = 0;
+    HANDLES(LeaveCriticalSection(&StatusCS));
+    if (member != 0)
+        BandwidthScheduler.RemoveMember(member);
+}
+
 //
 // ****************************************************************************
 // CAsyncCopyParams
@@ -7863,6 +7927,7 @@ unsigned ThreadWorkerBody(void* parameter)
                          //---
     SetProgress(hProgressDlg, 0, 0, dlgData);
     script->InitSpeedMeters(FALSE);
+    script->RegisterInBandwidthScheduler();
 
     char lastLantasticCheckRoot[MAX_PATH]; // posledni root cesty kontrolovany na Lantastic ("" = nic nebylo kontrolovano)
     lastLantasticCheckRoot[0] = 0;
@@ -8188,6 +8253,7 @@ unsigned ThreadWorkerBody(void* parameter)
         free(tgtBuffer);
     if (bufferIsAllocated)
         free(buffer);
+    script->UnregisterFromBandwidthScheduler();
     *dlgData.CancelWorker = Error;                  // pokud jde o Cancel, dame to najevo ...
     SendMessage(hProgressDlg, WM_COMMAND, IDOK, 0); // koncime ...
     WaitForSingleObject(wContinue, INFINITE);       // potrebujeme zastavit hl.thread
@@ -296,6 +296,10 @@ private:
     DWORD LastSetupTime;            // GetTickCount() z okamziku posledniho vypoctu parametru speed-limitu + pripadneho dobrzdeni
     CQuadWord BytesTrFromLastSetup; // kolik bytu bylo preneseno od okamziku LastSetupTime
 
+    // data pro sdileny limit vsech operaci (viz BandwidthScheduler), pouzivaji se jen v sekci StatusCS
+    int BandwidthMember; // ID operace v BandwidthScheduler, 0 = operace neni registrovana
+    DWORD BandwidthRate; // aktualni podil operace na sdilenem limitu (v bytech za vterinu), 0 = bez limitu
+
     // jen pro asynchroni kopirovani: data pro omezovac velikosti bufferu (aby se hybal progress, nesmi byt buffer moc velky), pouzivaji se jen v sekci StatusCS
     BOOL UseProgressBufferLimit;  // TRUE = ma se pouzivat omezovac velikosti bufferu (asynchroni kopirovani)
     DWORD ProgressBufferLimit;    // limit velikosti bufferu pro kopirovani, zajistuje rozumnou frekvenci udaju pro progres
@@ -344,6 +348,11 @@ public:
 
     void SetSpeedLimit(BOOL useSpeedLimit, DWORD speedLimit);
     void GetSpeedLimit(BOOL* useSpeedLimit, DWORD* speedLimit);
+
+    // registrace Copy/Move operace do BandwidthScheduler (sdileny limit rychlosti vsech operaci),
+    // zdroj a cil se zjisti z prvni kopirovaci/presouvaci operace ve skriptu
+    void RegisterInBandwidthScheduler();
+    void UnregisterFromBandwidthScheduler();
 };
 
 class COperationsQueue // fronta diskovych Copy/Move operaci
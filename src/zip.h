@@ -148,6 +148,8 @@ struct CSalamanderDirectoryAddCache
 
 class CSalamanderDirectory : public CSalamanderDirectoryAbstract
 {
+    friend class CArchiveListingCache; // stores and rebuilds whole trees (see lstcache.h)
+
 protected:
     CFilesArray Dirs;                              // names of subdirectories (contents stored in SalamDirs at the same index)
     TDirectArray<CSalamanderDirectory*> SalamDirs; // pointers to CSalamanderDirectory (pointers are NULL until first access, then the objects are allocated)